@@ -0,0 +1,542 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_archive.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#ifdef HAVE_LZMA
+#  include <lzma.h>
+#endif
+
+
+/* --- Constant values --- */
+#define ARCHIVE_MAGIC_SIZE 6
+#define ARCHIVE_XZ_MAGIC "\xfd" "7zXZ\0" /* xz Stream Header */
+#define ARCHIVE_ZSTD_MAGIC "\x28\xb5\x2f\xfd" /* zstd frame */
+#define ARCHIVE_ZSTD_SKIPPABLE "\x5e\x2a\x4d\x18" /* Seek table frame */
+#define ARCHIVE_INDEX_CHUNK 65536 /* Read unit of index search */
+
+
+/* --- Data structures --- */
+
+/* One independently decodable block */
+typedef struct {
+	off_t offset; /* Uncompressed offset */
+	size_t size; /* Uncompressed size */
+	off_t packed_offset; /* File offset of block header */
+	size_t packed_size; /* Block header, data and padding */
+	size_t unpadded_size; /* Without block padding */
+	int check; /* lzma_check of stream */
+} ArchiveFrame;
+
+/* Decompressed frame in cache */
+typedef struct {
+	int frame; /* Index of Archive.frames, -1 if unused */
+	char *data;
+	size_t capacity;
+	uint64_t used; /* Archive.clock of last use */
+} ArchiveSlot;
+
+/* Seekable compressed vmcore */
+typedef struct Archive {
+	ArchiveFrame *frames; /* Sorted by offset */
+	int frame_count;
+	size_t frame_max; /* Largest uncompressed frame */
+	ArchiveSlot slots[ARCHIVE_CACHE_FRAMES];
+	int slot_count;
+	uint64_t clock;
+	char *packed; /* Compressed frame being decoded */
+	size_t packed_capacity;
+} Archive;
+
+
+/* --- Prototypes --- */
+#ifdef HAVE_LZMA
+static int archive_read_index(File *file, Archive *archive);
+static ArchiveSlot *archive_frame(File *file, int frame);
+static int archive_decode(File *file, ArchiveFrame *frame, char *out);
+static void *archive_lzma_alloc(void *opaque, size_t nmemb, size_t size);
+static void archive_lzma_free(void *opaque, void *ptr);
+static int archive_pread(File *file, void *buffer, off_t offset,
+                         size_t size);
+#endif
+
+
+/* --- Variables --- */
+#ifdef HAVE_LZMA
+/* liblzma allocates from arena too */
+static const lzma_allocator archive_allocator = {
+	archive_lzma_alloc, archive_lzma_free, NULL
+};
+#endif
+
+
+/* ============================================================
+       archive_open() - Open compressed vmcore by frame index
+         Nothing is done for plain file, archive is NULL.
+         Size of File becomes uncompressed size, blocks are
+         decoded on read only where they are needed.
+   ============================================================ */
+int archive_open(File *file)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] archive_open:";
+	char magic[ARCHIVE_MAGIC_SIZE];
+	memset(magic, 0x00, sizeof(magic));
+#ifdef HAVE_LZMA
+	Archive *archive = NULL;
+	int loop = 0;
+#endif
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(file->fdesc != 0);
+	
+	if ((file->size < sizeof(magic)) ||
+	    (pread(file->fdesc, magic, sizeof(magic), 0) != sizeof(magic))) {
+		return RETVAL_SUCCESS;
+	}
+	if ((! memcmp(magic, ARCHIVE_ZSTD_MAGIC, 4)) ||
+	    (! memcmp(magic, ARCHIVE_ZSTD_SKIPPABLE, 4))) {
+		fprintf(stderr, "%s zstd archive is not supported, "
+		        "use xz with blocks (xz -T0): %s\n", estr, file->filename);
+		return RETVAL_FAILURE;
+	}
+	if (memcmp(magic, ARCHIVE_XZ_MAGIC, ARCHIVE_MAGIC_SIZE)) {
+		return RETVAL_SUCCESS;
+	}
+	
+#ifdef HAVE_LZMA
+	archive = mem_calloc(1, sizeof(Archive));
+	if (archive == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (archive_read_index(file, archive)) {
+		goto ERROR_FREE;
+	}
+	
+	/* Small cache, no more than quarter of memory left */
+	archive->slot_count = ARCHIVE_CACHE_FRAMES;
+	while ((archive->slot_count > 1) &&
+	       (archive->frame_max * archive->slot_count >
+	        mem_available() / 4)) {
+		archive->slot_count--;
+	}
+	for (loop = 0; loop < archive->slot_count; loop++) {
+		archive->slots[loop].frame = -1;
+	}
+	fprintf(stdout, "%s:    * Archive:    xz, %d blocks, 0x%lx bytes, "
+	        "cache %d\n", APP_NAME, archive->frame_count,
+	        (unsigned long) file->size, archive->slot_count);
+	file->archive = archive;
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(archive->frames);
+	mem_free(archive);
+	return RETVAL_FAILURE;
+#else
+	fprintf(stderr, "%s Built without liblzma: %s\n", estr, file->filename);
+	return RETVAL_FAILURE;
+#endif
+}
+
+
+/* ============================================================
+       archive_close() - Free frame index and cache
+   ============================================================ */
+void archive_close(File *file)
+{
+	/* --- Variables --- */
+	Archive *archive = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	
+	archive = file->archive;
+	if (archive == NULL) {
+		return;
+	}
+	for (loop = 0; loop < archive->slot_count; loop++) {
+		mem_free(archive->slots[loop].data);
+	}
+	mem_free(archive->packed);
+	mem_free(archive->frames);
+	mem_free(archive);
+	file->archive = NULL;
+	return;
+}
+
+
+/* ============================================================
+       archive_read() - Read uncompressed range
+         Frames covering range are taken from cache or decoded.
+   ============================================================ */
+int archive_read(File *file, void *buffer, off_t offset, size_t size)
+{
+#ifdef HAVE_LZMA
+	/* --- Variables --- */
+	char estr[] = "[ERROR] archive_read:";
+	Archive *archive = NULL;
+	ArchiveFrame *frame = NULL;
+	ArchiveSlot *slot = NULL;
+	size_t done = 0;
+	size_t skip = 0;
+	size_t length = 0;
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(file->archive != NULL);
+	assert(buffer != NULL);
+	
+	archive = file->archive;
+	
+	/* Last frame starting at or before offset */
+	low = 0;
+	high = archive->frame_count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (archive->frames[middle].offset <= offset) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	
+	for (middle = low - 1; done < size; middle++) {
+		if ((middle < 0) || (middle >= archive->frame_count)) {
+			fprintf(stderr, "%s No block at 0x%lx\n",
+			        estr, (unsigned long) (offset + done));
+			return RETVAL_FAILURE;
+		}
+		frame = &archive->frames[middle];
+		slot = archive_frame(file, middle);
+		if (slot == NULL) {
+			return RETVAL_FAILURE;
+		}
+		skip = offset + done - frame->offset;
+		length = frame->size - skip;
+		if (length > size - done) {
+			length = size - done;
+		}
+		memcpy((char*) buffer + done, slot->data + skip, length);
+		done += length;
+	}
+	
+	return RETVAL_SUCCESS;
+#else
+	return RETVAL_FAILURE;
+#endif
+}
+
+
+#ifdef HAVE_LZMA
+/* ============================================================
+       archive_read_index() - Build frame list from xz Index
+         lzma_file_info_decoder() reads Stream Footers and
+         Indexes from the end, asking where to read next.
+   ============================================================ */
+static int archive_read_index(File *file, Archive *archive)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] archive_read_index:";
+	lzma_stream decoder = LZMA_STREAM_INIT;
+	lzma_index *index = NULL;
+	lzma_index_iter iter;
+	memset(&iter, 0x00, sizeof(lzma_index_iter));
+	lzma_ret result = LZMA_OK;
+	uint8_t *chunk = NULL;
+	uint64_t position = 0;
+	size_t length = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(archive != NULL);
+	
+	chunk = mem_alloc(ARCHIVE_INDEX_CHUNK);
+	if (chunk == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	decoder.allocator = &archive_allocator;
+	if (lzma_file_info_decoder(&decoder, &index, mem_available() / 2,
+	                           file->size) != LZMA_OK) {
+		fprintf(stderr, "%s Can not start index decoder.\n", estr);
+		mem_free(chunk);
+		return RETVAL_FAILURE;
+	}
+	while (result == LZMA_OK) {
+		if (decoder.avail_in == 0) {
+			length = (file->size - position < ARCHIVE_INDEX_CHUNK) ?
+			         file->size - position : ARCHIVE_INDEX_CHUNK;
+			if ((length == 0) ||
+			    archive_pread(file, chunk, position, length)) {
+				result = LZMA_DATA_ERROR;
+				break;
+			}
+			decoder.next_in = chunk;
+			decoder.avail_in = length;
+			position += length;
+		}
+		result = lzma_code(&decoder, LZMA_RUN);
+		if (result == LZMA_SEEK_NEEDED) {
+			position = decoder.seek_pos;
+			decoder.avail_in = 0;
+			result = LZMA_OK;
+		}
+	}
+	lzma_end(&decoder);
+	mem_free(chunk);
+	if (result != LZMA_STREAM_END) {
+		fprintf(stderr, "%s Broken xz index: %d\n", estr, (int) result);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Non-empty blocks, in uncompressed order */
+	archive->frame_count = lzma_index_block_count(index);
+	archive->frames = mem_calloc(archive->frame_count + 1,
+	                             sizeof(ArchiveFrame));
+	if (archive->frames == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		lzma_index_end(index, &archive_allocator);
+		return RETVAL_FAILURE;
+	}
+	lzma_index_iter_init(&iter, index);
+	for (loop = 0; (loop < archive->frame_count) &&
+	     (! lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK));
+	     loop++) {
+		archive->frames[loop].offset = iter.block.uncompressed_file_offset;
+		archive->frames[loop].size = iter.block.uncompressed_size;
+		archive->frames[loop].packed_offset =
+		    iter.block.compressed_file_offset;
+		archive->frames[loop].packed_size = iter.block.total_size;
+		archive->frames[loop].unpadded_size = iter.block.unpadded_size;
+		archive->frames[loop].check = (iter.stream.flags != NULL) ?
+		                              iter.stream.flags->check :
+		                              LZMA_CHECK_NONE;
+		if (archive->frame_max < iter.block.uncompressed_size) {
+			archive->frame_max = iter.block.uncompressed_size;
+		}
+	}
+	archive->frame_count = loop;
+	file->size = lzma_index_uncompressed_size(index);
+	lzma_index_end(index, &archive_allocator);
+	
+	/* Single block of whole vmcore can not be read in part */
+	if (archive->frame_max > ARCHIVE_FRAME_MAX) {
+		fprintf(stderr, "%s Block of 0x%lx bytes, not seekable. "
+		        "Compress with xz -T0 or --block-size.\n",
+		        estr, (unsigned long) archive->frame_max);
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       archive_frame() - Get decompressed frame from cache
+         Least recently used slot is decoded again on miss.
+   ============================================================ */
+static ArchiveSlot *archive_frame(File *file, int frame)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] archive_frame:";
+	Archive *archive = NULL;
+	ArchiveSlot *slot = NULL;
+	char *data = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	
+	archive = file->archive;
+	archive->clock++;
+	for (loop = 0; loop < archive->slot_count; loop++) {
+		if (archive->slots[loop].frame == frame) {
+			archive->slots[loop].used = archive->clock;
+			file->stat.hits++;
+			return &archive->slots[loop];
+		}
+		if ((slot == NULL) || (archive->slots[loop].used < slot->used)) {
+			slot = &archive->slots[loop];
+		}
+	}
+	
+	file->stat.misses++;
+	slot->frame = -1;
+	if (slot->capacity < archive->frames[frame].size) {
+		data = mem_realloc(slot->data, archive->frames[frame].size);
+		if (data == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return NULL;
+		}
+		slot->data = data;
+		slot->capacity = archive->frames[frame].size;
+	}
+	if (archive_decode(file, &archive->frames[frame], slot->data)) {
+		return NULL;
+	}
+	slot->frame = frame;
+	slot->used = archive->clock;
+	
+	return slot;
+}
+
+
+/* ============================================================
+       archive_decode() - Decompress one xz Block
+         Block Header gives filters, Index gives sizes.
+   ============================================================ */
+static int archive_decode(File *file, ArchiveFrame *frame, char *out)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] archive_decode:";
+	Archive *archive = NULL;
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+	memset(filters, 0x00, sizeof(filters));
+	lzma_block block;
+	memset(&block, 0x00, sizeof(lzma_block));
+	lzma_ret result = LZMA_OK;
+	uint8_t *data = NULL;
+	size_t in_pos = 0;
+	size_t out_pos = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(frame != NULL);
+	assert(out != NULL);
+	
+	archive = file->archive;
+	if (archive->packed_capacity < frame->packed_size) {
+		data = mem_realloc(archive->packed, frame->packed_size);
+		if (data == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		archive->packed = (char*) data;
+		archive->packed_capacity = frame->packed_size;
+	}
+	data = (uint8_t*) archive->packed;
+	if (archive_pread(file, data, frame->packed_offset, frame->packed_size)) {
+		return RETVAL_FAILURE;
+	}
+	
+	block.version = 1;
+	block.check = frame->check;
+	block.filters = filters;
+	block.header_size = lzma_block_header_size_decode(data[0]);
+	if ((block.header_size > frame->packed_size) ||
+	    (lzma_block_header_decode(&block, &archive_allocator,
+	                              data) != LZMA_OK) ||
+	    (lzma_block_compressed_size(&block,
+	                                frame->unpadded_size) != LZMA_OK)) {
+		fprintf(stderr, "%s Broken block header at 0x%lx\n",
+		        estr, (unsigned long) frame->packed_offset);
+		result = LZMA_DATA_ERROR;
+	}
+	else {
+		/* Dictionary larger than block is never used */
+		for (loop = 0; filters[loop].id != LZMA_VLI_UNKNOWN; loop++) {
+			if ((filters[loop].id == LZMA_FILTER_LZMA2) &&
+			    (((lzma_options_lzma*) filters[loop].options)->dict_size >
+			     frame->size)) {
+				((lzma_options_lzma*) filters[loop].options)->dict_size =
+				    (frame->size > LZMA_DICT_SIZE_MIN) ?
+				    frame->size : LZMA_DICT_SIZE_MIN;
+			}
+		}
+		in_pos = block.header_size;
+		result = lzma_block_buffer_decode(&block, &archive_allocator,
+		                                  data, &in_pos, frame->packed_size,
+		                                  (uint8_t*) out, &out_pos,
+		                                  frame->size);
+		if ((result != LZMA_OK) || (out_pos != frame->size)) {
+			fprintf(stderr, "%s Can not decode block at 0x%lx: %d\n",
+			        estr, (unsigned long) frame->packed_offset,
+			        (int) result);
+			result = LZMA_DATA_ERROR;
+		}
+	}
+	for (loop = 0; filters[loop].id != LZMA_VLI_UNKNOWN; loop++) {
+		archive_lzma_free(NULL, filters[loop].options);
+	}
+	
+	return (result == LZMA_OK) ? RETVAL_SUCCESS : RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       archive_lzma_alloc() - lzma_allocator alloc by mem_alloc()
+   ============================================================ */
+static void *archive_lzma_alloc(void *opaque, size_t nmemb, size_t size)
+{
+	if ((size != 0) && (nmemb > SIZE_MAX / size)) {
+		return NULL;
+	}
+	return mem_alloc(nmemb * size);
+}
+
+
+/* ============================================================
+       archive_lzma_free() - lzma_allocator free by mem_free()
+   ============================================================ */
+static void archive_lzma_free(void *opaque, void *ptr)
+{
+	mem_free(ptr);
+	return;
+}
+
+
+/* ============================================================
+       archive_pread() - Read compressed bytes from file
+   ============================================================ */
+static int archive_pread(File *file, void *buffer, off_t offset,
+                         size_t size)
+{
+	/* --- Variables --- */
+	errno = 0;
+	char estr[] = "[ERROR] archive_pread:";
+	ssize_t readbytes = 0;
+	size_t done = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(buffer != NULL);
+	
+	while (done < size) {
+		readbytes = pread(file->fdesc, (char*) buffer + done,
+		                  size - done, offset + done);
+		file->stat.syscalls++;
+		if ((readbytes == -1) && (errno == EINTR)) {
+			continue;
+		}
+		if (readbytes <= 0) {
+			fprintf(stderr, "%s Can not read: %s(0x%lx:0x%lx)\n",
+			        estr, file->filename, (unsigned long) offset,
+			        (unsigned long) size);
+			return RETVAL_FAILURE;
+		}
+		done += readbytes;
+	}
+	file->stat.bytes += done;
+	
+	return RETVAL_SUCCESS;
+}
+#endif
+
+
+/* ====================================================================== */
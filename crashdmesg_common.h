@@ -10,12 +10,16 @@
 #ifndef _LARGEFILE64_SOURCE
 #  define _LARGEFILE64_SOURCE
 #endif
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
 
 
 /* --- Include system header files --- */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -26,6 +30,8 @@
 #include <errno.h>
 #include <elf.h>
 #include <time.h>
+#include <fnmatch.h>
+#include <pthread.h>
 
 
 /* --- Constant values --- */
@@ -37,6 +43,57 @@
 #define APP_VERSION "0.9.3"
 
 #define DEFAULT_VMCORE "/proc/vmcore"
+#define MAX_SPLIT_FILES 64 /* Max files of split dump */
+#define MAX_WATCH_DIRS 16 /* Max directories to watch */
+#define WATCH_DEFAULT_WORKERS 2 /* vmcores processed at once */
+#define WATCH_SETTLE_TIME 5 /* [sec] vmcore size must be stable */
+#define WATCH_VMCORE_NAME "vmcore" /* Written by kdump when complete */
+#define WATCH_OUTPUT_NAME "vmcore-dmesg.txt"
+#define WATCH_STATE_FILENAME ".crashdmesg.state"
+#define CACHE_BLOCK_SIZE 4096 /* Block size of read cache */
+#define CACHE_DEFAULT_LIMIT 262144 /* 256KB, Memory limit of read cache */
+#define CACHE_MAX_COALESCE 64 /* Max blocks in one coalesced read */
+#define SEARCH_SIMD_BYTES 8 /* Max start bytes for SSE2 prefilter */
+#define SCAN_CHUNK_SIZE 4194304 /* 4MB, Unit of memory scan */
+#define SCAN_CHUNK_OVERLAP 65536 /* Max struct printk_log length */
+#define SCAN_MAX_THREADS 64 /* Max threads of memory scan */
+#define SCAN_MIN_RUN 8 /* Min consecutive records of a candidate */
+#define SCAN_MIN_CHUNK 262144 /* Chunk size under tight memory limit */
+#define PRINTK_MIN_WINDOW 131072 /* Holds largest struct printk_log */
+#define PRINTK_WRAP ((size_t) -1) /* Wrap point of ring, unknown offset */
+#define PRINTK_RECORD_ALIGN 4 /* Min alignment of struct printk_log */
+#define MAX_OUTPUTS 8 /* Max -O outputs */
+#define FANOUT_QUEUE_DEPTH 16 /* Batches queued per output */
+#define FANOUT_BATCH_RECORDS 512 /* Max records of one batch */
+#define FANOUT_BATCH_SIZE 65536 /* Max text bytes of one batch */
+#define ARCHIVE_CACHE_FRAMES 4 /* Decompressed frames kept at once */
+#define ARCHIVE_FRAME_MAX 67108864 /* 64MB, Max uncompressed frame */
+#define STREAM_FILENAME "-" /* vmcore is read from stdin */
+#define STREAM_CHUNK_SIZE 1048576 /* 1MB, Unit of stream read */
+#define STREAM_SYMBOL_SIZE 8 /* Bytes kept at each VMCOREINFO SYMBOL */
+#define SINK_BLOCK_SIZE 4096 /* O_DIRECT write unit */
+#define SINK_BUFFER_SIZE 65536 /* Output buffer of sink */
+#define SINK_SYNC_DEFAULT 64 /* [KB] fdatasync interval of sink */
+#define MODULE_NAME_LEN 56 /* 64 - sizeof(unsigned long)
+                               See:include/linux/module.h */
+#define MODULE_MAX_COUNT 65536 /* Stop walking broken list */
+#define MODULE_READ_MAX 65536 /* Max size of struct module to read */
+#define TASK_COMM_LEN 16 /* See:include/linux/sched.h */
+#define TASK_MAX_COUNT 4194304 /* PID_MAX_LIMIT, stop walking broken list */
+#define TASK_MAX_CPUS 8192 /* Max NR_CPUS */
+#define PERCPU_READ_SPAN 65536 /* safe and NMI buffers of a CPU read at once
+                                  if they are this close */
+#define PERCPU_LABEL_SIZE 24 /* "[CPUnnnn nmi] " */
+#define KSYM_NAME_LEN 512 /* Max symbol name, See:include/linux/kallsyms.h */
+#define KALLSYMS_MAX_SYMS 4194304 /* Sanity limit of kallsyms_num_syms */
+#define KALLSYMS_ENTRY_MAX 0x3fff /* Max tokens of one kallsyms_names entry */
+#define KALLSYMS_WINDOW 65536 /* Read unit of kallsyms_names */
+#define KALLSYMS_SCAN_CHUNK 1048576 /* 1MB, Unit of kallsyms table scan */
+#define KALLSYMS_KERNEL_MAP 0xffffffff80000000UL /* __START_KERNEL_map,
+                                                   tables are in image */
+#define KALLSYMS_STACK_SIZE 16384 /* THREAD_SIZE, stack is scanned to its end */
+#define KALLSYMS_MAX_FRAMES 64 /* Max backtrace lines of one CPU */
+#define DEADLINE_GRACE 1 /* [sec] Hard exit if still blocked after deadline */
 #define MAX_LOGBUF_LIMIT 1048576 /* 1MB */
 #define VMCOREINFO_MAX_SIZE 4096 /* Max size of vmcoreinfo.
                                     See:include/linux/kexec.h */
@@ -45,24 +102,282 @@
                                See:include/linux/utsname.h */
 #define CRASHTIME_LENGTH 20 /* Text size of decimal 2^64-1 */
 #define NOTETYPE_VMCOREINFO 0x00000000 /* Elf64_Nhdr.n_type */
+#define NOTE_INDEX_STEP 64 /* Grow step of NOTE index */
+#define LAYOUT_NONE 0xffffffff /* Layout offset is unknown */
+
+/* struct elf_prstatus (x86_64), See:include/linux/elfcore.h */
+#define PRSTATUS_PID_OFFSET 32 /* pr_pid */
+#define PRSTATUS_REG_OFFSET 112 /* pr_reg */
+#define PRSTATUS_REG_COUNT 27 /* struct user_regs_struct */
+#define PRSTATUS_REG_R15 0
+#define PRSTATUS_REG_R14 1
+#define PRSTATUS_REG_R13 2
+#define PRSTATUS_REG_R12 3
+#define PRSTATUS_REG_RBP 4
+#define PRSTATUS_REG_RBX 5
+#define PRSTATUS_REG_R11 6
+#define PRSTATUS_REG_R10 7
+#define PRSTATUS_REG_R9 8
+#define PRSTATUS_REG_R8 9
+#define PRSTATUS_REG_RAX 10
+#define PRSTATUS_REG_RCX 11
+#define PRSTATUS_REG_RDX 12
+#define PRSTATUS_REG_RSI 13
+#define PRSTATUS_REG_RDI 14
+#define PRSTATUS_REG_ORIG_RAX 15
+#define PRSTATUS_REG_RIP 16
+#define PRSTATUS_REG_CS 17
+#define PRSTATUS_REG_EFLAGS 18
+#define PRSTATUS_REG_RSP 19
+#define PRSTATUS_REG_SS 20
+#define PRSTATUS_REG_FS_BASE 21
+#define PRSTATUS_REG_GS_BASE 22
+
+/* Ring buffer format */
+#define LOGFORMAT_LEGACY 0 /* Plain text log_buf (- 3.4) */
+#define LOGFORMAT_RECORD 1 /* struct printk_log records (3.5 - 5.9) */
 
 
 /* --- Data structures --- */
 
+/* Block of read cache */
+typedef struct CacheBlock {
+	off_t index; /* Block number in file, -1 if unused */
+	size_t length; /* Valid bytes, short at end of file */
+	char *data;
+	struct CacheBlock *hash_next;
+	struct CacheBlock *lru_prev; /* Newer */
+	struct CacheBlock *lru_next; /* Older */
+} CacheBlock;
+
+/* Read cache, LRU of CACHE_BLOCK_SIZE blocks */
+typedef struct {
+	char *buffer; /* Block data, aligned to CACHE_BLOCK_SIZE */
+	CacheBlock *blocks;
+	CacheBlock **hash;
+	size_t count; /* Number of blocks */
+	size_t hash_mask;
+	CacheBlock *lru_head; /* Most recently used */
+	CacheBlock *lru_tail; /* Least recently used */
+} FileCache;
+
+/* Read statistics */
+typedef struct {
+	uint64_t syscalls; /* pread/preadv calls */
+	uint64_t bytes; /* Bytes read from file */
+	uint64_t hits; /* Blocks found in cache */
+	uint64_t misses; /* Blocks read into cache */
+} FileStat;
+
 /* File descriptor and Filesize */
 typedef struct {
 	char   *filename;
 	int    fdesc;
 	size_t size;
+	size_t cache_limit; /* Memory limit of read cache, 0 disables */
+	FileCache *cache;
+	FileStat stat;
+	struct Stream *stream; /* Non-seekable input, NULL if file */
+	char *stream_copy; /* Copy of whole stream, NULL if none */
+	struct Archive *archive; /* Compressed vmcore, NULL if plain */
 } File;
 
-/* Keep file descriptor and vmcore information */
+/* LOAD segment, VMCore.loads is sorted by vaddr */
+typedef struct {
+	uint64_t vaddr;
+	uint64_t paddr;
+	uint64_t size; /* p_filesz */
+	off_t offset; /* p_offset */
+	File *file; /* File which contains this segment */
+} LoadSegment;
+
+/* Durable output file */
+typedef struct {
+	char *path;
+	int fdesc;
+	int direct; /* Opened with O_DIRECT */
+	FILE *stream; /* fopencookie() stream writing to this sink */
+	char *buffer; /* Aligned to SINK_BLOCK_SIZE */
+	size_t fill; /* Bytes in buffer */
+	size_t threshold; /* Write blocks when fill reaches this */
+	off_t offset; /* File offset of buffer[0] */
+	size_t sync_interval; /* fdatasync() every [byte], 0 only at close */
+	size_t unsynced; /* Bytes written after last sync */
+	uint64_t written; /* Total bytes */
+	uint64_t syncs; /* fdatasync() calls */
+	struct timespec elapsed; /* Time spent in write and sync */
+	int error;
+} Sink;
+
+/* Records shared by outputs, see crashdmesg_fanout.c */
+typedef struct Fanout {
+	struct FanoutSink *sinks;
+	int sink_count;
+	struct FanoutBatch *batch; /* Being filled, NULL if none */
+	pthread_mutex_t lock; /* Reference counts of batches */
+} Fanout;
+
+/* Range of stream kept in memory */
+typedef struct {
+	off_t offset;
+	size_t size;
+	off_t valid; /* Data before this had passed when planned */
+	char *data;
+} StreamRange;
+
+/* Non-seekable input, read once front to back */
+typedef struct Stream {
+	StreamRange *ranges;
+	int range_count;
+	off_t position; /* Bytes consumed */
+	char *chunk; /* Data just before position */
+	size_t chunk_size;
+	size_t retained; /* Bytes of all ranges */
+	Sink copy; /* Whole stream passes through, if stream_copy */
+	struct VMCore *vmcore; /* Set by stream_plan() */
+	off_t pointer_offset; /* log_buf to plan ring, -1 if none */
+	off_t length_offset; /* log_buf_len */
+} Stream;
+
+/* Multi pattern search, Aho-Corasick automaton */
+typedef struct {
+	char **patterns;
+	int pattern_count;
+	int32_t *next; /* Transition table, [state * 256 + byte] */
+	int32_t *output; /* Pattern index matched at state, -1 if none */
+	int state_count;
+	char start[256]; /* Bytes which leave root state */
+	unsigned char start_bytes[SEARCH_SIMD_BYTES];
+	int start_count;
+	uint64_t records; /* Records searched */
+	uint64_t matches; /* Records matched */
+} Search;
+
+/* Commandline options */
+typedef struct {
+	char *filename;
+	char **files; /* vmcore files, processed one by one */
+	int file_count;
+	char *split_files[MAX_SPLIT_FILES]; /* Files of split dump */
+	int split_count;
+	int registers; /* Print NT_PRSTATUS registers */
+	size_t cache_limit; /* Read cache size [byte] */
+	char *watch_dirs[MAX_WATCH_DIRS]; /* Watch mode directories */
+	int watch_count;
+	int watch_workers; /* Max child processes */
+	char *watch_state; /* State file of processed vmcores */
+	char *pattern_file; /* Search mode patterns */
+	Search *search; /* Compiled patterns, NULL if not search mode */
+	int recover; /* Scan memory instead of VMCOREINFO */
+	size_t memory_limit; /* Hard ceiling of allocation [byte], 0 if none */
+	char *output_file; /* Durable output of records, NULL for stdout */
+	size_t sync_interval; /* Output sync interval [byte] */
+	int modules; /* Print loaded kernel modules */
+	int tasks; /* Print task list */
+	int backtrace; /* Print symbolized stack of each CPU */
+	unsigned int time_budget; /* [sec] Newest records first, 0 if none */
+	char *store_dir; /* Append records to indexed store, NULL if none */
+	char *query_dir; /* Query store instead of dump */
+	char **query_terms; /* "key=value" terms of query */
+	int query_count;
+	char *stream_copy; /* Copy of stdin vmcore, NULL if none */
+	char *outputs[MAX_OUTPUTS]; /* -O output specs */
+	int output_count;
+	int percpu; /* Read per-CPU printk_safe/NMI buffers */
+	int pstore; /* Read ramoops zones instead of ring buffer */
+	uint64_t pstore_start; /* Physical range of ramoops zones */
+	uint64_t pstore_size; /* 0 scans all memory */
+} Option;
+
+/* Dump one vmcore, used by watch mode */
+typedef int (*DumpFunction)(Option *option, char *filename);
+
+/* One ELF note, points into VMCore.note_buffer */
 typedef struct {
+	uint32_t type; /* Elf64_Nhdr.n_type */
+	uint32_t namesz;
+	uint32_t descsz;
+	char *name;
+	char *desc;
+} Note;
+
+/* Structure offsets used by record decoders.
+   Every member is uint32_t, LAYOUT_NONE if unknown. */
+typedef struct {
+	uint32_t printk_log_size;      /* sizeof(struct printk_log) */
+	uint32_t printk_log_ts_nsec;   /* u64 ts_nsec */
+	uint32_t printk_log_len;       /* u16 len */
+	uint32_t printk_log_text_len;  /* u16 text_len */
+	uint32_t printk_log_dict_len;  /* u16 dict_len */
+	uint32_t printk_log_facility;  /* u8 facility */
+	uint32_t printk_log_flags;     /* u8 flags:5, level:3 */
+	uint32_t module_size;          /* sizeof(struct module) */
+	uint32_t module_list;          /* struct list_head list */
+	uint32_t module_name;          /* char name[MODULE_NAME_LEN] */
+	uint32_t module_core;          /* void *module_core (core_layout.base) */
+	uint32_t module_core_size;     /* unsigned int core_size */
+	uint32_t module_taints;        /* unsigned long taints */
+	uint32_t task_tasks;           /* struct list_head tasks */
+	uint32_t task_pid;             /* pid_t pid */
+	uint32_t task_comm;            /* char comm[TASK_COMM_LEN] */
+	uint32_t task_state;           /* unsigned int __state (long state) */
+	uint32_t task_exit_state;      /* int exit_state */
+	uint32_t task_thread_group;    /* struct list_head thread_group */
+	uint32_t rq_curr;              /* struct task_struct *curr */
+	uint32_t printk_safe_size;     /* sizeof(struct printk_safe_seq_buf) */
+	uint32_t printk_safe_len;      /* atomic_t len */
+	uint32_t printk_safe_lost;     /* atomic_t message_lost */
+	uint32_t printk_safe_buffer;   /* unsigned char buffer[] */
+} Layout;
+
+/* Compiled-in layout profile, selected by OSRELEASE */
+typedef struct {
+	char *pattern; /* fnmatch(3) pattern of OSRELEASE */
+	char *name;
+	Layout layout;
+} LayoutProfile;
+
+/* Flat access plan, built once by layout_setup() */
+typedef struct {
+	const LayoutProfile *profile; /* Selected profile */
+	int overrides; /* Number of values taken from VMCOREINFO */
+	Layout layout;
+} LayoutPlan;
+
+/* One kernel symbol from kallsyms */
+typedef struct {
+	uint64_t address;
+	uint32_t name; /* Offset in Kallsyms.names */
+	char type; /* nm(1) letter */
+} KallsymsEntry;
+
+/* Symbol table decompressed from vmcore, sorted by address */
+typedef struct {
+	int loaded; /* 1 if loaded, -1 if not available, 0 if not tried */
+	KallsymsEntry *symbols;
+	int count;
+	char *names; /* Pool of names, NUL terminated */
+	size_t names_size;
+	size_t names_capacity;
+	uint64_t text_start; /* _stext, 0 if unknown */
+	uint64_t text_end; /* _etext */
+} Kallsyms;
+
+/* Keep file descriptor and vmcore information */
+typedef struct VMCore {
 	File file;
 	Elf64_Ehdr elf_header;
 	char vmcoreinfo[VMCOREINFO_MAX_SIZE];
 	size_t vmcoreinfo_size; /* vmcoreinfo real size */
-	char *osrelease[OSRELEASE_LENGTH];
+	char *note_buffer; /* All NOTE segments */
+	Note *notes; /* Index of note_buffer */
+	int note_count;
+	File *parts[MAX_SPLIT_FILES]; /* Files of dump, parts[0] is &file */
+	int part_count;
+	LoadSegment *loads; /* LOAD segments of all parts */
+	int load_count;
+	int paddr_hit; /* Index of LOAD last found by physical address */
+	char osrelease[OSRELEASE_LENGTH];
 	size_t osrelease_size; /* osrelease real size */
 	time_t crashtime; /* CRASHTIME value [sec] */
 	uint64_t log_buf; /* log_buf [virtual address] */
@@ -70,27 +385,143 @@ typedef struct {
 	                     Value may be larger than log_buf_len. */
 	int32_t log_buf_len; /* log_buf_len [size] */
 	uint32_t logged_chars; /* logged_chars [size] */
+	uint32_t log_first_idx; /* log_first_idx [offset] */
+	uint32_t log_next_idx; /* log_next_idx [offset] */
+	uint64_t log_first_seq; /* log_first_seq [sequence] */
+	uint64_t log_next_seq; /* log_next_seq [sequence] */
+	int log_format; /* LOGFORMAT_* */
+	LayoutPlan plan; /* Structure layout */
+	uint64_t pgt; /* Kernel page table root [physical address] */
+	int pgt_levels; /* 4 or 5, 0 if not searched, -1 if not available */
+	Kallsyms kallsyms; /* Loaded on demand by kallsyms_load() */
 } VMCore;
 
+/* Part of ring buffer in file */
+typedef struct {
+	File *file;
+	off_t offset;
+	size_t size;
+} RingExtent;
+
+/* Ring buffer contents read from vmcore */
+typedef struct {
+	char *buffer; /* Window of ring, oldest first if LOGFORMAT_LEGACY */
+	size_t capacity; /* Size of buffer */
+	size_t window; /* Ring offset of buffer[0] */
+	size_t window_size; /* Valid bytes in buffer */
+	RingExtent *extents; /* Ring contents in file, in ring order */
+	int extent_count;
+	size_t size;
+	size_t cursor; /* Iteration: offset in buffer */
+	uint64_t seq; /* Iteration: next sequence number */
+} Ring;
+
+/* One log record */
+typedef struct {
+	uint64_t seq;
+	uint64_t ts_nsec;
+	int level; /* -1 if unknown */
+	int facility; /* -1 if unknown */
+	int prefixed; /* text includes own "<N>[ ts ]" prefix */
+	char *text;
+	size_t text_len;
+} Record;
+
+/* Lines left in per-CPU printk_safe/NMI buffers, newer than ring */
+typedef struct {
+	Record *records; /* CPU order, safe buffer before NMI buffer */
+	int count;
+	char *text; /* Pool of labelled texts */
+	size_t text_size;
+	uint64_t seq; /* Sequence number of records[0] */
+	int next; /* Iteration: next index of records */
+	uint32_t lost; /* Sum of message_lost */
+} SafeLog;
+
 
 /* --- Common Prototypes --- */
+int mem_setup(size_t limit);
+void *mem_alloc(size_t size);
+void *mem_calloc(size_t count, size_t size);
+void *mem_realloc(void *ptr, size_t size);
+char *mem_strdup(const char *string);
+void *mem_alloc_aligned(size_t align, size_t size);
+void mem_free(void *ptr);
+size_t mem_available(void);
+void mem_print_usage(FILE *stream);
+int sink_open(Sink *sink, char *path, size_t sync_interval);
+int sink_close(Sink *sink);
 int file_open(File *file);
 int file_close(File *file);
 int file_read(File *file, void *buffer, off_t offset, size_t size);
 int elf_validate_elfheader(VMCore *vmcore);
 int elf_read_vmcoreinfo(VMCore *vmcore);
+int elf_read_notes(VMCore *vmcore);
+void elf_free_notes(VMCore *vmcore);
+int elf_print_prstatus(VMCore *vmcore, FILE *stream);
 int elf_search_vmcoreinfo_symbol(VMCore *vmcore, char *key, uint64_t *ret);
 int elf_search_vmcoreinfo_key(VMCore *vmcore, char *key, char* *ptr);
-int elf_read_load_uint64(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, uint64_t *ret);
-int elf_read_load_uint32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, uint32_t *ret);
-int elf_read_load_int32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                        uint64_t vaddr, int32_t *ret);
-int elf_search_load_data(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, size_t size, off_t *ret);
+int elf_search_vmcoreinfo_number(VMCore *vmcore, char *key, uint64_t *ret);
+int elf_read_load_uint64(VMCore *vmcore, uint64_t vaddr, uint64_t *ret);
+int elf_read_load_uint32(VMCore *vmcore, uint64_t vaddr, uint32_t *ret);
+int elf_read_load_int32(VMCore *vmcore, uint64_t vaddr, int32_t *ret);
+int elf_read_load_data(VMCore *vmcore, uint64_t vaddr,
+                       void *buffer, size_t size);
+LoadSegment *elf_find_load(VMCore *vmcore, uint64_t vaddr);
+int elf_search_load_data(VMCore *vmcore, uint64_t vaddr, size_t size,
+                         File* *file, off_t *ret);
+int elf_load_segments(VMCore *vmcore);
+void elf_close_segments(VMCore *vmcore);
 int elf_read_osrelease(VMCore *vmcore, char *buffer, size_t buffer_size);
 int elf_read_crashtime(VMCore *vmcore, time_t *crashtime);
+int layout_setup(VMCore *vmcore);
+int layout_setup_default(VMCore *vmcore);
+int watch_run(Option *option, DumpFunction dump);
+int scan_is_raw(VMCore *vmcore);
+int scan_load_raw(VMCore *vmcore);
+int scan_read_ring(VMCore *vmcore, Ring *ring);
+int module_print_list(VMCore *vmcore, FILE *stream);
+int task_print_list(VMCore *vmcore, FILE *stream);
+int task_read_cpus(VMCore *vmcore, char *name, int *cpus, int max);
+int percpu_read_safe(VMCore *vmcore, SafeLog *log, uint64_t next_seq);
+void percpu_free_safe(SafeLog *log);
+int percpu_next_record(SafeLog *log, Record *record);
+int percpu_read_console_seq(VMCore *vmcore, uint64_t *seq);
+int pstore_read_ring(VMCore *vmcore, uint64_t start, uint64_t size,
+                     Ring *ring);
+int kallsyms_load(VMCore *vmcore);
+void kallsyms_free(VMCore *vmcore);
+int kallsyms_search_symbol(VMCore *vmcore, char *name, uint64_t *ret);
+char *kallsyms_lookup(VMCore *vmcore, uint64_t address,
+                      uint64_t *offset, uint64_t *size);
+int kallsyms_print_backtrace(VMCore *vmcore, FILE *stream);
+int fanout_open(Fanout *fanout, char **specs, int count,
+                size_t sync_interval);
+int fanout_close(Fanout *fanout);
+int fanout_write(Fanout *fanout, Record *record);
+int archive_open(File *file);
+void archive_close(File *file);
+int archive_read(File *file, void *buffer, off_t offset, size_t size);
+int stream_open(File *file);
+int stream_close(File *file);
+int stream_read(File *file, void *buffer, off_t offset, size_t size);
+int stream_plan(VMCore *vmcore);
+int store_append(VMCore *vmcore, Ring *ring, char *dir);
+int store_query(char *dir, char **terms, int count, FILE *stream);
+int search_compile(Search *search, char *filename);
+void search_free(Search *search);
+int search_record(Search *search, Record *record);
+int printk_read_ring(VMCore *vmcore, Ring *ring);
+void printk_free_ring(Ring *ring);
+int printk_setup_ring(Ring *ring, RingExtent *extents, int extent_count);
+int printk_next_record(VMCore *vmcore, Ring *ring, Record *record);
+int printk_seek_record(VMCore *vmcore, Ring *ring, size_t cursor,
+                       uint64_t seq, Record *record);
+int printk_read_seq(VMCore *vmcore, Ring *ring);
+int printk_head(VMCore *vmcore, Ring *ring, size_t *cursor, uint64_t *seq);
+int printk_sync_record(VMCore *vmcore, Ring *ring, size_t from, size_t end,
+                       size_t *ret);
+void printk_print_record(FILE *stream, Record *record);
 
 
 #endif /* ! CRASHDMESG_COMMON_H */
@@ -9,11 +9,40 @@
 #include "crashdmesg_common.h"
 
 
+/* --- Constant values --- */
+
+/* x86_64 page table, See:arch/x86/include/asm/pgtable_types.h */
+#define PGT_PAGE_SHIFT 12
+#define PGT_PAGE_SIZE (1UL << PGT_PAGE_SHIFT)
+#define PGT_INDEX_BITS 9 /* 512 entries per table */
+#define PGT_ENTRY_PRESENT 0x001 /* _PAGE_PRESENT */
+#define PGT_ENTRY_LARGE 0x080 /* _PAGE_PSE, 1GB or 2MB page */
+#define PGT_ENTRY_ADDR 0x000ffffffffff000UL /* Physical address bits */
+
+
+/* --- Data structures --- */
+
+/* Thread argument of elf_load_part() */
+typedef struct {
+	VMCore *vmcore;
+	File *file;
+	pthread_t thread;
+	int started;
+	LoadSegment *loads; /* PT_LOAD of this file */
+	int load_count;
+	int result;
+} ElfPartLoader;
+
+
 /* --- Prototypes --- */
-static int elf_search_vmcoreinfo(VMCore *vmcore,
-                                 off_t *offset, size_t *size);
-static int elf_search_note_segment(VMCore *vmcore,
-                                   off_t *offset, size_t *size);
+static int elf_check_elfheader(Elf64_Ehdr *header);
+static int elf_index_notes(VMCore *vmcore, char *buffer, size_t size);
+static void *elf_load_part(void *arg);
+static int elf_compare_load(const void *a, const void *b);
+static char *elf_find_vmcoreinfo_key(VMCore *vmcore, char *key);
+static int elf_find_paddr(VMCore *vmcore, uint64_t paddr, size_t size,
+                          File* *file, off_t *ret);
+static int elf_vtop(VMCore *vmcore, uint64_t vaddr, uint64_t *paddr);
 
 
 /* ============================================================
@@ -23,10 +52,6 @@ int elf_validate_elfheader(VMCore *vmcore)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_validate_elfheader:";
-	uint8_t valid_ident[EI_NIDENT] = { 
-	    ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
-	    ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_NONE,
-	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 	Elf64_Ehdr *header = NULL;
 	
 	/* --- Assert check --- */
@@ -42,6 +67,25 @@ int elf_validate_elfheader(VMCore *vmcore)
 		return RETVAL_FAILURE;
 	}
 	
+	return elf_check_elfheader(header);
+}
+
+
+/* ============================================================
+       elf_check_elfheader() - Validate ELF header
+   ============================================================ */
+static int elf_check_elfheader(Elf64_Ehdr *header)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_check_elfheader:";
+	uint8_t valid_ident[EI_NIDENT] = { 
+	    ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+	    ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_NONE,
+	    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	
+	/* --- Assert check --- */
+	assert(header != NULL);
+	
 	/* Validate IDENT (first 16byte) */
 	if (memcmp((void*) header->e_ident, (void*) valid_ident, EI_NIDENT)) {
 		fprintf(stderr, "%s Invalid IDENT data.\n", estr);
@@ -68,139 +112,274 @@ int elf_read_vmcoreinfo(VMCore *vmcore)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_read_vmcoreinfo:";
-	off_t vmcoreinfo_offset = 0;
-	size_t vmcoreinfo_size = 0;
+	Note *note = NULL;
+	int loop = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
 	assert(vmcore->elf_header.e_ident[0] == ELFMAG0);
+	assert(vmcore->vmcoreinfo[0] == 0x00);
+	
+	/* Read all NOTE segments */
+	if ((vmcore->notes == NULL) && elf_read_notes(vmcore)) {
+		fprintf(stderr, "%s Can not read NOTE segment.\n", estr);
+		return RETVAL_FAILURE;
+	}
 	
 	/* Search VMCOREINFO */
-	if (elf_search_vmcoreinfo(vmcore, &vmcoreinfo_offset, &vmcoreinfo_size)) {
-		fprintf(stderr, "%s Can not find VMCOREINFO data.\n", estr);
+	for (loop = 0; loop < vmcore->note_count; loop++) {
+		note = &vmcore->notes[loop];
+		if ((note->type == NOTETYPE_VMCOREINFO) &&
+		    (note->namesz >= 10) && (! memcmp(note->name, "VMCOREINFO", 10))) {
+			break;
+		}
+	}
+	if (loop == vmcore->note_count) {
+		fprintf(stderr, "%s VMCOREINFO not found.\n", estr);
 		return RETVAL_FAILURE;
 	}
 	
-	/* Read VMCOREINFO */
-	if (vmcoreinfo_size > sizeof(vmcore->vmcoreinfo)) {
-		fprintf(stderr, "%s VMCOREINFO is too big.\n", estr);
+	/* Copy VMCOREINFO */
+	if (note->descsz == 0) {
+		fprintf(stderr, "%s VMCOREINFO found, but invalid.\n", estr);
 		return RETVAL_FAILURE;
 	}
-	if (file_read(&vmcore->file, (void*) vmcore->vmcoreinfo,
-	              vmcoreinfo_offset, vmcoreinfo_size)) {
-		fprintf(stderr, "%s Failed to read VMCOREINFO.\n", estr);
+	if (note->descsz > sizeof(vmcore->vmcoreinfo)) {
+		fprintf(stderr, "%s VMCOREINFO is too big.\n", estr);
 		return RETVAL_FAILURE;
 	}
-	vmcore->vmcoreinfo_size = vmcoreinfo_size;
+	memcpy(vmcore->vmcoreinfo, note->desc, note->descsz);
+	vmcore->vmcoreinfo_size = note->descsz;
 	
 	return RETVAL_SUCCESS;
 }
 
 
 /* ============================================================
-       elf_search_vmcoreinfo() - Search VMCOREINFO text
+       elf_read_notes() - Read and Index all NOTE segments
+         One read per PT_NOTE, notes are kept in vmcore.
    ============================================================ */
-static int elf_search_vmcoreinfo(VMCore *vmcore,
-                                 off_t *offset, size_t *size)
+int elf_read_notes(VMCore *vmcore)
 {
 	/* --- Variables --- */
-	char estr[] = "[ERROR] elf_search_vmcoreinfo:";
-	off_t note_offset = 0;
-	size_t note_size = 0;
-	Elf64_Nhdr note_header;
-	memset(&note_header, 0x00, sizeof(Elf64_Nhdr));
-	off_t cursor = 0;
+	char estr[] = "[ERROR] elf_read_notes:";
+	Elf64_Phdr *phdrs = NULL;
+	size_t phdrs_size = 0;
+	size_t total_size = 0;
+	size_t cursor = 0;
+	int loop = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(vmcore->vmcoreinfo[0] == 0x00);
+	assert(vmcore->notes == NULL);
 	
-	if (elf_search_note_segment(vmcore, &note_offset, &note_size)) {
-		fprintf(stderr, "%s Can not find NOTE segment.\n", estr);
+	/* Read program header table at once */
+	phdrs_size = sizeof(Elf64_Phdr) * vmcore->elf_header.e_phnum;
+	phdrs = mem_alloc(phdrs_size);
+	if (phdrs == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
 		return RETVAL_FAILURE;
 	}
+	if (file_read(&vmcore->file, (void*) phdrs,
+	              vmcore->elf_header.e_phoff, phdrs_size)) {
+		fprintf(stderr, "%s Failed to read program header.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	/* Size of all NOTE segments */
+	for (loop = 0; loop < vmcore->elf_header.e_phnum; loop++) {
+		if (phdrs[loop].p_type != PT_NOTE) {
+			continue;
+		}
+		if ((phdrs[loop].p_filesz == 0) ||
+		    (phdrs[loop].p_offset >= vmcore->file.size) ||
+		    (phdrs[loop].p_filesz > vmcore->file.size - phdrs[loop].p_offset)) {
+			fprintf(stderr, "%s NOTE segment found, but invalid.\n", estr);
+			goto ERROR_FREE;
+		}
+		total_size += phdrs[loop].p_filesz;
+	}
+	if (total_size == 0) {
+		fprintf(stderr, "%s NOTE segment not found.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	/* Read each NOTE segment */
+	vmcore->note_buffer = mem_alloc(total_size);
+	if (vmcore->note_buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_FREE;
+	}
+	for (loop = 0; loop < vmcore->elf_header.e_phnum; loop++) {
+		if (phdrs[loop].p_type != PT_NOTE) {
+			continue;
+		}
+		if (file_read(&vmcore->file, vmcore->note_buffer + cursor,
+		              phdrs[loop].p_offset, phdrs[loop].p_filesz)) {
+			fprintf(stderr, "%s Failed to read NOTE segment.\n", estr);
+			goto ERROR_FREE;
+		}
+		if (elf_index_notes(vmcore, vmcore->note_buffer + cursor,
+		                    phdrs[loop].p_filesz)) {
+			fprintf(stderr, "%s Failed to parse NOTE segment.\n", estr);
+			goto ERROR_FREE;
+		}
+		cursor += phdrs[loop].p_filesz;
+	}
+	
+	mem_free(phdrs);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(phdrs);
+	elf_free_notes(vmcore);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       elf_index_notes() - Append notes in buffer to index
+   ============================================================ */
+static int elf_index_notes(VMCore *vmcore, char *buffer, size_t size)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_index_notes:";
+	Elf64_Nhdr note_header;
+	memset(&note_header, 0x00, sizeof(Elf64_Nhdr));
+	Note *notes = NULL;
+	Note *note = NULL;
+	size_t cursor = 0;
+	size_t namesz = 0;
+	size_t descsz = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(buffer != NULL);
 	
 	/* Parse NOTE segment */
-	for (cursor = note_offset; cursor < note_offset + note_size; ) {
-		if (file_read(&vmcore->file, (void*) &note_header,
-		              cursor, sizeof(Elf64_Nhdr))) {
-			fprintf(stderr, "%s Failed to read NOTE header.\n", estr);
+	while (cursor + sizeof(Elf64_Nhdr) <= size) {
+		memcpy(&note_header, buffer + cursor, sizeof(Elf64_Nhdr));
+		namesz = ((note_header.n_namesz + 3) / 4) * 4;
+		descsz = ((note_header.n_descsz + 3) / 4) * 4;
+		if ((note_header.n_namesz == 0) && (note_header.n_descsz == 0)) {
+			/* Zero padding at end of segment */
+			break;
+		}
+		if ((namesz > size - cursor - sizeof(Elf64_Nhdr)) ||
+		    (descsz > size - cursor - sizeof(Elf64_Nhdr) - namesz)) {
+			fprintf(stderr, "%s Note at 0x%x overflows segment.\n",
+			        estr, (unsigned) cursor);
 			return RETVAL_FAILURE;
 		}
-		if (note_header.n_type == NOTETYPE_VMCOREINFO) {
-			/* VMCOREINFO found */
-			*offset = cursor + sizeof(Elf64_Nhdr);
-			*offset += ((note_header.n_namesz + 3) / 4) * 4;
-			*size = note_header.n_descsz;
-			if ((*size <= 0) ||
-			    (*offset < note_offset) ||
-			    (*offset >= note_offset + note_size) ||
-			    (*offset + *size > note_offset + note_size)) {
-				fprintf(stderr, "%s VMCOREINFO found, but invalid.\n", estr);
-				*offset = 0;
-				*size = 0;
+		
+		/* Grow index */
+		if ((vmcore->note_count % NOTE_INDEX_STEP) == 0) {
+			notes = mem_realloc(vmcore->notes, sizeof(Note) *
+			                (vmcore->note_count + NOTE_INDEX_STEP));
+			if (notes == NULL) {
+				fprintf(stderr, "%s Can not allocate memory.\n", estr);
 				return RETVAL_FAILURE;
 			}
-			return RETVAL_SUCCESS;
+			vmcore->notes = notes;
 		}
+		note = &vmcore->notes[vmcore->note_count++];
+		note->type = note_header.n_type;
+		note->namesz = note_header.n_namesz;
+		note->descsz = note_header.n_descsz;
+		note->name = buffer + cursor + sizeof(Elf64_Nhdr);
+		note->desc = note->name + namesz;
 		
-		/* Skip segment */
-		cursor += sizeof(Elf64_Nhdr);
-		cursor += ((note_header.n_namesz + 3) / 4) * 4;
-		cursor += ((note_header.n_descsz + 3) / 4) * 4;
+		/* Next note */
+		cursor += sizeof(Elf64_Nhdr) + namesz + descsz;
 	}
-
-	/* VMCOREINFO not found */
-	fprintf(stderr, "%s VMCOREINFO not found.\n", estr);
+	
 	return RETVAL_SUCCESS;
 }
 
 
 /* ============================================================
-       elf_search_note_segment() - Search NOTE segment
+       elf_free_notes() - Free NOTE index
    ============================================================ */
-static int elf_search_note_segment(VMCore *vmcore,
-                                   off_t *offset, size_t *size)
+void elf_free_notes(VMCore *vmcore)
+{
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	mem_free(vmcore->notes);
+	mem_free(vmcore->note_buffer);
+	vmcore->notes = NULL;
+	vmcore->note_buffer = NULL;
+	vmcore->note_count = 0;
+	return;
+}
+
+
+/* ============================================================
+       elf_print_prstatus() - Print registers of each CPU
+         NT_PRSTATUS notes are saved in CPU order.
+   ============================================================ */
+int elf_print_prstatus(VMCore *vmcore, FILE *stream)
 {
 	/* --- Variables --- */
-	char estr[] = "[ERROR] elf_search_note_segment:";
-	Elf64_Phdr pgm_header;
-	memset(&pgm_header, 0x00, sizeof(Elf64_Phdr));
-	off_t ph_offset = 0;
+	char estr[] = "[ERROR] elf_print_prstatus:";
+	Note *note = NULL;
+	uint64_t reg[PRSTATUS_REG_COUNT];
+	memset(reg, 0x00, sizeof(reg));
+	int32_t pid = 0;
+	int cpu = 0;
 	int loop = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(offset != NULL);
-	assert(size != NULL);
+	assert(stream != NULL);
 	
-	ph_offset = vmcore->elf_header.e_phoff;
-	for (loop = 0; loop < vmcore->elf_header.e_phnum; loop++) {
-		if (file_read(&vmcore->file, (void*) &pgm_header,
-		              ph_offset, sizeof(Elf64_Phdr))) {
-			fprintf(stderr, "%s Failed to read program header.\n", estr);
-			return RETVAL_FAILURE;
+	for (loop = 0; loop < vmcore->note_count; loop++) {
+		note = &vmcore->notes[loop];
+		if (note->type != NT_PRSTATUS) {
+			continue;
 		}
-		if (pgm_header.p_type == PT_NOTE) {
-			/* NOTE segment found */
-			*offset = pgm_header.p_offset;
-			*size = pgm_header.p_filesz;
-			if ((*offset < 0) || (*size <= 0) ||
-			    (*offset >= vmcore->file.size) ||
-			    (*offset + *size >= vmcore->file.size)) {
-				fprintf(stderr, "%s NOTE segment found, but invalid.\n", estr);
-				*offset = 0;
-				*size = 0;
-				return RETVAL_FAILURE;
-			}
-			return RETVAL_SUCCESS;
+		if (note->descsz < PRSTATUS_REG_OFFSET + sizeof(reg)) {
+			fprintf(stderr, "%s NT_PRSTATUS is too small: %u\n",
+			        estr, note->descsz);
+			return RETVAL_FAILURE;
 		}
-		ph_offset += vmcore->elf_header.e_phentsize;
+		memcpy(&pid, note->desc + PRSTATUS_PID_OFFSET, sizeof(pid));
+		memcpy(reg, note->desc + PRSTATUS_REG_OFFSET, sizeof(reg));
+		
+		/* Same format as __show_regs(), See:arch/x86/kernel/process_64.c */
+		fprintf(stream, "CPU: %d PID: %d\n", cpu, pid);
+		fprintf(stream, "RIP: %04lx:%016lx\n",
+		        reg[PRSTATUS_REG_CS] & 0xffff, reg[PRSTATUS_REG_RIP]);
+		fprintf(stream, "RSP: %04lx:%016lx EFLAGS: %08lx\n",
+		        reg[PRSTATUS_REG_SS] & 0xffff, reg[PRSTATUS_REG_RSP],
+		        reg[PRSTATUS_REG_EFLAGS]);
+		fprintf(stream, "RAX: %016lx RBX: %016lx RCX: %016lx\n",
+		        reg[PRSTATUS_REG_RAX], reg[PRSTATUS_REG_RBX],
+		        reg[PRSTATUS_REG_RCX]);
+		fprintf(stream, "RDX: %016lx RSI: %016lx RDI: %016lx\n",
+		        reg[PRSTATUS_REG_RDX], reg[PRSTATUS_REG_RSI],
+		        reg[PRSTATUS_REG_RDI]);
+		fprintf(stream, "RBP: %016lx R08: %016lx R09: %016lx\n",
+		        reg[PRSTATUS_REG_RBP], reg[PRSTATUS_REG_R8],
+		        reg[PRSTATUS_REG_R9]);
+		fprintf(stream, "R10: %016lx R11: %016lx R12: %016lx\n",
+		        reg[PRSTATUS_REG_R10], reg[PRSTATUS_REG_R11],
+		        reg[PRSTATUS_REG_R12]);
+		fprintf(stream, "R13: %016lx R14: %016lx R15: %016lx\n",
+		        reg[PRSTATUS_REG_R13], reg[PRSTATUS_REG_R14],
+		        reg[PRSTATUS_REG_R15]);
+		fprintf(stream, "FS:  %016lx GS:  %016lx ORIG_RAX: %016lx\n",
+		        reg[PRSTATUS_REG_FS_BASE], reg[PRSTATUS_REG_GS_BASE],
+		        reg[PRSTATUS_REG_ORIG_RAX]);
+		cpu++;
+	}
+	if (cpu == 0) {
+		fprintf(stderr, "%s NT_PRSTATUS not found.\n", estr);
+		return RETVAL_FAILURE;
 	}
 	
-	/* NOTE segment not found */
-	fprintf(stderr, "%s NOTE segment not found.\n", estr);
-	return RETVAL_FAILURE;
+	return RETVAL_SUCCESS;
 }
 
 
@@ -281,6 +460,29 @@ int elf_search_vmcoreinfo_key(VMCore *vmcore, char *key, char* *ptr)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_search_vmcoreinfo_symbol:";
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(key != NULL);
+	assert(ptr != NULL);
+	
+	*ptr = elf_find_vmcoreinfo_key(vmcore, key);
+	if (*ptr == NULL) {
+		/* key not found */
+		fprintf(stderr, "%s Key(%s) not found in VMCOREINFO.\n", estr, key);
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       elf_find_vmcoreinfo_key() - Search key, NULL if not found
+   ============================================================ */
+static char *elf_find_vmcoreinfo_key(VMCore *vmcore, char *key)
+{
+	/* --- Variables --- */
 	int key_length = 0;
 	char *cursor = NULL;
 	char *limit = NULL;
@@ -288,7 +490,6 @@ int elf_search_vmcoreinfo_key(VMCore *vmcore, char *key, char* *ptr)
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
 	assert(key != NULL);
-	assert(ptr != NULL);
 	
 	key_length = strlen(key);
 	limit = vmcore->vmcoreinfo + vmcore->vmcoreinfo_size;
@@ -296,46 +497,106 @@ int elf_search_vmcoreinfo_key(VMCore *vmcore, char *key, char* *ptr)
 		if (*cursor == key[0]) {
 			if (cursor + key_length < limit) {
 				if (! memcmp(cursor, key, key_length)) {
-					*ptr = cursor;
-					return RETVAL_SUCCESS;
+					return cursor;
 				}
 			}
 			else {
 				/* Nearly end of buffer */
-				goto ERROR_NOTFOUND;
+				return NULL;
 			}
 		}
 	}
 	
-ERROR_NOTFOUND:
-	/* key not found */
-	fprintf(stderr, "%s Key(%s) not found in VMCOREINFO.\n", estr, key);
-	return RETVAL_FAILURE;
+	return NULL;
+}
+
+
+/* ============================================================
+       elf_search_vmcoreinfo_number() - Return "key=value" value
+         key is "SYMBOL(x)", "OFFSET(x.y)", "SIZE(x)", ...
+         Missing key is not reported, caller decides.
+   ============================================================ */
+int elf_search_vmcoreinfo_number(VMCore *vmcore, char *key, uint64_t *ret)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_search_vmcoreinfo_number:";
+	int key_length = 0;
+	char search_key[MAX_SYMBOL_NAME];
+	memset(search_key, 0x00, sizeof(search_key));
+	char valuetext[CRASHTIME_LENGTH + 1];
+	memset(valuetext, 0x00, sizeof(valuetext));
+	char *cursor = NULL;
+	char *limit = NULL;
+	char *endptr = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(key != NULL);
+	assert(ret != NULL);
+	
+	/* Build search key "key=" */
+	key_length = strlen(key);
+	if (key_length + 2 >= sizeof(search_key)) {
+		fprintf(stderr, "%s Search key \"%s\" is too big.\n", estr, key);
+		return RETVAL_FAILURE;
+	}
+	memcpy(search_key, key, key_length);
+	search_key[key_length] = '=';
+	
+	cursor = elf_find_vmcoreinfo_key(vmcore, search_key);
+	if (cursor == NULL) {
+		return RETVAL_FAILURE;
+	}
+	
+	/* Copy value text, terminated by '\n' */
+	cursor += key_length + 1;
+	limit = vmcore->vmcoreinfo + vmcore->vmcoreinfo_size;
+	for (loop = 0; (loop < sizeof(valuetext) - 1) && (cursor < limit);
+	     loop++, cursor++) {
+		if ((*cursor == '\n') || (*cursor == 0x00)) {
+			break;
+		}
+		valuetext[loop] = *cursor;
+	}
+	if (loop == 0) {
+		fprintf(stderr, "%s Empty value: %s\n", estr, key);
+		return RETVAL_FAILURE;
+	}
+	
+	/* SYMBOL() is hex without "0x", others are decimal */
+	errno = 0;
+	if (! strncmp(key, "SYMBOL(", 7)) {
+		*ret = strtoull(valuetext, &endptr, 16);
+	}
+	else {
+		*ret = strtoull(valuetext, &endptr, 10);
+	}
+	if ((errno != 0) || (*endptr != 0x00)) {
+		fprintf(stderr, "%s Failed to convert value: %s=%s\n",
+		        estr, key, valuetext);
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
 }
 
 
 /* ============================================================
        elf_read_load_uint64() - Read uint64_t value from LOAD
    ============================================================ */
-int elf_read_load_uint64(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, uint64_t *ret)
+int elf_read_load_uint64(VMCore *vmcore, uint64_t vaddr, uint64_t *ret)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_read_load_uint64:";
-	off_t ret_offset = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(phdr_cache != NULL);
+	assert(ret != NULL);
 	
 	/* Search and Read */
-	if (elf_search_load_data(vmcore, phdr_cache,
-	                         vaddr, sizeof(uint64_t), &ret_offset)) {
-		fprintf(stderr, "%s Can not find data.\n", estr);
-		return RETVAL_FAILURE;
-	}
-	if (file_read(&vmcore->file, (void*) ret, ret_offset, sizeof(uint64_t))) {
-		fprintf(stderr, "%s Can not read data from file.\n", estr);
+	if (elf_read_load_data(vmcore, vaddr, (void*) ret, sizeof(uint64_t))) {
+		fprintf(stderr, "%s Can not read data.\n", estr);
 		return RETVAL_FAILURE;
 	}
 	
@@ -346,25 +607,18 @@ int elf_read_load_uint64(VMCore *vmcore, Elf64_Phdr *phdr_cache,
 /* ============================================================
        elf_read_load_uint32() - Read uint32_t value from LOAD
    ============================================================ */
-int elf_read_load_uint32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, uint32_t *ret)
+int elf_read_load_uint32(VMCore *vmcore, uint64_t vaddr, uint32_t *ret)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_read_load_uint32:";
-	off_t ret_offset = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(phdr_cache != NULL);
+	assert(ret != NULL);
 	
 	/* Search and Read */
-	if (elf_search_load_data(vmcore, phdr_cache,
-	                         vaddr, sizeof(uint32_t), &ret_offset)) {
-		fprintf(stderr, "%s Can not find data.\n", estr);
-		return RETVAL_FAILURE;
-	}
-	if (file_read(&vmcore->file, (void*) ret, ret_offset, sizeof(uint32_t))) {
-		fprintf(stderr, "%s Can not read data from file.\n", estr);
+	if (elf_read_load_data(vmcore, vaddr, (void*) ret, sizeof(uint32_t))) {
+		fprintf(stderr, "%s Can not read data.\n", estr);
 		return RETVAL_FAILURE;
 	}
 	
@@ -375,26 +629,75 @@ int elf_read_load_uint32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
 /* ============================================================
        elf_read_load_int32() - Read int32_t value from LOAD
    ============================================================ */
-int elf_read_load_int32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                        uint64_t vaddr, int32_t *ret)
+int elf_read_load_int32(VMCore *vmcore, uint64_t vaddr, int32_t *ret)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_read_load_int32:";
-	off_t ret_offset = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(phdr_cache != NULL);
+	assert(ret != NULL);
 	
 	/* Search and Read */
-	if (elf_search_load_data(vmcore, phdr_cache,
-	                         vaddr, sizeof(int32_t), &ret_offset)) {
-		fprintf(stderr, "%s Can not find data.\n", estr);
+	if (elf_read_load_data(vmcore, vaddr, (void*) ret, sizeof(int32_t))) {
+		fprintf(stderr, "%s Can not read data.\n", estr);
 		return RETVAL_FAILURE;
 	}
-	if (file_read(&vmcore->file, (void*) ret, ret_offset, sizeof(int32_t))) {
-		fprintf(stderr, "%s Can not read data from file.\n", estr);
-		return RETVAL_FAILURE;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       elf_read_load_data() - Read data from LOAD
+         Address out of LOAD (vmalloc, modules) is read page by
+         page through kernel page table.
+   ============================================================ */
+int elf_read_load_data(VMCore *vmcore, uint64_t vaddr,
+                       void *buffer, size_t size)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_read_load_data:";
+	LoadSegment *load = NULL;
+	File *file = NULL;
+	off_t offset = 0;
+	uint64_t paddr = 0;
+	size_t done = 0;
+	size_t length = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(buffer != NULL);
+	
+	/* Whole data in one LOAD, one read */
+	load = elf_find_load(vmcore, vaddr);
+	if ((load != NULL) && (vaddr - load->vaddr < load->size) &&
+	    (size <= load->size - (vaddr - load->vaddr))) {
+		if (file_read(load->file, buffer,
+		              load->offset + vaddr - load->vaddr, size)) {
+			fprintf(stderr, "%s Can not read data from file.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Physical pages are not contiguous, translate each */
+	while (done < size) {
+		length = PGT_PAGE_SIZE - ((vaddr + done) & (PGT_PAGE_SIZE - 1));
+		if (length > size - done) {
+			length = size - done;
+		}
+		if (elf_vtop(vmcore, vaddr + done, &paddr) ||
+		    elf_find_paddr(vmcore, paddr, length, &file, &offset)) {
+			fprintf(stderr, "%s Can not find data: 0x%016lx\n",
+			        estr, (unsigned long) (vaddr + done));
+			return RETVAL_FAILURE;
+		}
+		if (file_read(file, (char*) buffer + done, offset, length)) {
+			fprintf(stderr, "%s Can not read data from file.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		done += length;
 	}
 	
 	return RETVAL_SUCCESS;
@@ -403,58 +706,379 @@ int elf_read_load_int32(VMCore *vmcore, Elf64_Phdr *phdr_cache,
 
 /* ============================================================
        elf_search_load_data() - Search data and return file offset
+         Data out of LOAD must not cross page boundary.
    ============================================================ */
-int elf_search_load_data(VMCore *vmcore, Elf64_Phdr *phdr_cache,
-                         uint64_t vaddr, size_t size, off_t *ret)
+int elf_search_load_data(VMCore *vmcore, uint64_t vaddr, size_t size,
+                         File* *file, off_t *ret)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] elf_search_load_data:";
-	off_t ph_offset = 0;
-	int loop = 0;
+	LoadSegment *load = NULL;
+	uint64_t paddr = 0;
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
-	assert(phdr_cache != NULL);
+	assert(file != NULL);
 	assert(ret != NULL);
 	assert(size > 0);
 	
-	/* Search LOAD segment, use cache first */
-	if ((phdr_cache->p_type == PT_LOAD) && (phdr_cache->p_offset > 0) &&
-	    (phdr_cache->p_vaddr > 0) && (phdr_cache->p_filesz > 0)) {
-		/* Program header cache is valid */
-		if ((vaddr >= phdr_cache->p_vaddr) &&
-		    (vaddr + size < phdr_cache->p_vaddr + phdr_cache->p_filesz)) {
-			/* return data offset in file */
-			*ret = phdr_cache->p_offset + vaddr - phdr_cache->p_vaddr;
+	load = elf_find_load(vmcore, vaddr);
+	if ((load != NULL) && (vaddr - load->vaddr < load->size) &&
+	    (size <= load->size - (vaddr - load->vaddr))) {
+		/* return data offset in file */
+		*file = load->file;
+		*ret = load->offset + vaddr - load->vaddr;
+		return RETVAL_SUCCESS;
+	}
+	if ((size <= PGT_PAGE_SIZE - (vaddr & (PGT_PAGE_SIZE - 1))) &&
+	    (! elf_vtop(vmcore, vaddr, &paddr)) &&
+	    (! elf_find_paddr(vmcore, paddr, size, file, ret))) {
+		return RETVAL_SUCCESS;
+	}
+	
+	/* LOAD segment not found */
+	fprintf(stderr, "%s Data not found in LOAD segment.\n", estr);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       elf_find_load() - Return last LOAD starting <= vaddr
+         NULL if none, caller checks the end.
+   ============================================================ */
+LoadSegment *elf_find_load(VMCore *vmcore, uint64_t vaddr)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_find_load:";
+	LoadSegment *load = NULL;
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	
+	/* Load segments are sorted by vaddr */
+	if ((vmcore->loads == NULL) && elf_load_segments(vmcore)) {
+		fprintf(stderr, "%s Failed to read program header.\n", estr);
+		return NULL;
+	}
+	low = 0;
+	high = vmcore->load_count - 1;
+	while (low <= high) {
+		middle = (low + high) / 2;
+		if (vmcore->loads[middle].vaddr <= vaddr) {
+			load = &vmcore->loads[middle];
+			low = middle + 1;
+		}
+		else {
+			high = middle - 1;
+		}
+	}
+	return load;
+}
+
+
+/* ============================================================
+       elf_find_paddr() - Search physical address in LOAD
+   ============================================================ */
+static int elf_find_paddr(VMCore *vmcore, uint64_t paddr, size_t size,
+                          File* *file, off_t *ret)
+{
+	/* --- Variables --- */
+	LoadSegment *load = NULL;
+	int loop = 0;
+	
+	/* Last hit first, page table walk and its data stay close */
+	for (loop = 0; loop <= vmcore->load_count; loop++) {
+		if (loop == 0) {
+			if (vmcore->paddr_hit >= vmcore->load_count) {
+				continue;
+			}
+			load = &vmcore->loads[vmcore->paddr_hit];
+		}
+		else {
+			load = &vmcore->loads[loop - 1];
+		}
+		if ((paddr >= load->paddr) && (paddr - load->paddr < load->size) &&
+		    (size <= load->size - (paddr - load->paddr))) {
+			vmcore->paddr_hit = load - vmcore->loads;
+			*file = load->file;
+			*ret = load->offset + paddr - load->paddr;
 			return RETVAL_SUCCESS;
 		}
 	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       elf_vtop() - Translate vaddr by x86_64 kernel page table
+         Root is SYMBOL(init_top_pgt), 4 or 5 levels.
+   ============================================================ */
+static int elf_vtop(VMCore *vmcore, uint64_t vaddr, uint64_t *paddr)
+{
+	/* --- Variables --- */
+	LoadSegment *load = NULL;
+	File *file = NULL;
+	off_t offset = 0;
+	uint64_t table = 0;
+	uint64_t entry = 0;
+	uint64_t mask = 0;
+	int shift = 0;
 	
-	/* Search each LOAD segment */
-	ph_offset = vmcore->elf_header.e_phoff;
-	for (loop = 0; loop < vmcore->elf_header.e_phnum; loop++) {
-		if (file_read(&vmcore->file, (void*) phdr_cache,
-		    ph_offset, sizeof(Elf64_Phdr))) {
-			fprintf(stderr, "%s Failed to read program header.\n", estr);
+	/* Find page table root once, physical address of it */
+	if (vmcore->pgt_levels == 0) {
+		vmcore->pgt_levels = -1;
+		if (elf_search_vmcoreinfo_number(vmcore, "SYMBOL(init_top_pgt)",
+		                                 &table) &&
+		    elf_search_vmcoreinfo_number(vmcore, "SYMBOL(init_level4_pgt)",
+		                                 &table)) {
 			return RETVAL_FAILURE;
 		}
-		if (phdr_cache->p_type == PT_LOAD) {
-			/* LOAD segment found */
-			if ((vaddr >= phdr_cache->p_vaddr) &&
-			    (vaddr + size < phdr_cache->p_vaddr + phdr_cache->p_filesz)) {
-				*ret = phdr_cache->p_offset + vaddr - phdr_cache->p_vaddr;
-				return RETVAL_SUCCESS;
-			}
+		load = elf_find_load(vmcore, table);
+		if ((load == NULL) || (table - load->vaddr >= load->size)) {
+			return RETVAL_FAILURE;
+		}
+		vmcore->pgt = load->paddr + table - load->vaddr;
+		vmcore->pgt_levels = 4;
+		if ((! elf_search_vmcoreinfo_number(vmcore,
+		                                    "NUMBER(pgtable_l5_enabled)",
+		                                    &entry)) && (entry == 1)) {
+			vmcore->pgt_levels = 5;
 		}
-		ph_offset += vmcore->elf_header.e_phentsize;
+	}
+	if (vmcore->pgt_levels < 0) {
+		return RETVAL_FAILURE;
 	}
 	
-	/* LOAD segment not found */
-	fprintf(stderr, "%s Data not found in LOAD segment.\n", estr);
+	/* Walk down, stop at large page */
+	table = vmcore->pgt;
+	for (shift = PGT_PAGE_SHIFT + PGT_INDEX_BITS * (vmcore->pgt_levels - 1);
+	     shift >= PGT_PAGE_SHIFT; shift -= PGT_INDEX_BITS) {
+		if (elf_find_paddr(vmcore, table + 8 * ((vaddr >> shift) &
+		                   ((1UL << PGT_INDEX_BITS) - 1)),
+		                   sizeof(entry), &file, &offset) ||
+		    file_read(file, &entry, offset, sizeof(entry)) ||
+		    (! (entry & PGT_ENTRY_PRESENT))) {
+			return RETVAL_FAILURE;
+		}
+		mask = (1UL << shift) - 1;
+		if ((shift == PGT_PAGE_SHIFT) ||
+		    ((shift <= PGT_PAGE_SHIFT + 2 * PGT_INDEX_BITS) &&
+		     (entry & PGT_ENTRY_LARGE))) {
+			*paddr = (entry & PGT_ENTRY_ADDR & ~mask) | (vaddr & mask);
+			return RETVAL_SUCCESS;
+		}
+		table = entry & PGT_ENTRY_ADDR;
+	}
 	return RETVAL_FAILURE;
 }
 
 
+/* ============================================================
+       elf_load_segments() - Build LOAD segment index
+         Each file of split dump is loaded by its own thread.
+   ============================================================ */
+int elf_load_segments(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_load_segments:";
+	ElfPartLoader loaders[MAX_SPLIT_FILES];
+	memset(loaders, 0x00, sizeof(loaders));
+	LoadSegment *loads = NULL;
+	int load_count = 0;
+	int result = RETVAL_SUCCESS;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(vmcore->loads == NULL);
+	
+	if (vmcore->part_count == 0) {
+		/* Not split */
+		vmcore->parts[0] = &vmcore->file;
+		vmcore->part_count = 1;
+	}
+	
+	/* Load headers of each file concurrently */
+	for (loop = 0; loop < vmcore->part_count; loop++) {
+		loaders[loop].vmcore = vmcore;
+		loaders[loop].file = vmcore->parts[loop];
+		if (vmcore->part_count == 1) {
+			elf_load_part(&loaders[loop]);
+			continue;
+		}
+		if (pthread_create(&loaders[loop].thread, NULL,
+		                   elf_load_part, &loaders[loop])) {
+			fprintf(stderr, "%s Can not create thread.\n", estr);
+			loaders[loop].result = RETVAL_FAILURE;
+			continue;
+		}
+		loaders[loop].started = 1;
+	}
+	for (loop = 0; loop < vmcore->part_count; loop++) {
+		if (loaders[loop].started) {
+			pthread_join(loaders[loop].thread, NULL);
+		}
+		if (loaders[loop].result) {
+			fprintf(stderr, "%s Can not load: %s\n",
+			        estr, vmcore->parts[loop]->filename);
+			result = RETVAL_FAILURE;
+		}
+		load_count += loaders[loop].load_count;
+	}
+	if (result) {
+		goto ERROR_FREE;
+	}
+	
+	/* Merge and Sort */
+	loads = mem_alloc(sizeof(LoadSegment) * (load_count ? load_count : 1));
+	if (loads == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		result = RETVAL_FAILURE;
+		goto ERROR_FREE;
+	}
+	load_count = 0;
+	for (loop = 0; loop < vmcore->part_count; loop++) {
+		memcpy(&loads[load_count], loaders[loop].loads,
+		       sizeof(LoadSegment) * loaders[loop].load_count);
+		load_count += loaders[loop].load_count;
+	}
+	qsort(loads, load_count, sizeof(LoadSegment), elf_compare_load);
+	for (loop = 1; loop < load_count; loop++) {
+		if (loads[loop - 1].vaddr + loads[loop - 1].size > loads[loop].vaddr) {
+			fprintf(stderr, "%s LOAD segments overlap at 0x%016lx.\n",
+			        estr, loads[loop].vaddr);
+		}
+	}
+	vmcore->loads = loads;
+	vmcore->load_count = load_count;
+	
+	/* Free per-file index */
+ERROR_FREE:
+	for (loop = 0; loop < vmcore->part_count; loop++) {
+		mem_free(loaders[loop].loads);
+	}
+	return result;
+}
+
+
+/* ============================================================
+       elf_load_part() - Read ELF header and LOAD of one file
+         Thread routine of elf_load_segments().
+   ============================================================ */
+static void *elf_load_part(void *arg)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] elf_load_part:";
+	ElfPartLoader *loader = NULL;
+	File *file = NULL;
+	Elf64_Ehdr header;
+	memset(&header, 0x00, sizeof(Elf64_Ehdr));
+	Elf64_Phdr *phdrs = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(arg != NULL);
+	
+	loader = (ElfPartLoader*) arg;
+	loader->result = RETVAL_FAILURE;
+	file = loader->file;
+	
+	/* Primary file is already opened and validated */
+	if ((! file->fdesc) && file_open(file)) {
+		fprintf(stderr, "%s Can not open file: %s\n", estr, file->filename);
+		return NULL;
+	}
+	if (file_read(file, (void*) &header, 0, sizeof(Elf64_Ehdr)) ||
+	    elf_check_elfheader(&header)) {
+		fprintf(stderr, "%s Invalid ELF header: %s\n", estr, file->filename);
+		return NULL;
+	}
+	
+	/* Read program header table at once */
+	phdrs = mem_alloc(sizeof(Elf64_Phdr) * header.e_phnum);
+	loader->loads = mem_alloc(sizeof(LoadSegment) * header.e_phnum);
+	if ((phdrs == NULL) || (loader->loads == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_FREE;
+	}
+	if (file_read(file, (void*) phdrs, header.e_phoff,
+	              sizeof(Elf64_Phdr) * header.e_phnum)) {
+		fprintf(stderr, "%s Failed to read program header.\n", estr);
+		goto ERROR_FREE;
+	}
+	for (loop = 0; loop < header.e_phnum; loop++) {
+		if ((phdrs[loop].p_type != PT_LOAD) || (phdrs[loop].p_filesz == 0)) {
+			continue;
+		}
+		if ((phdrs[loop].p_offset >= file->size) ||
+		    (phdrs[loop].p_filesz > file->size - phdrs[loop].p_offset)) {
+			fprintf(stderr, "%s LOAD segment out of file: %s(0x%lx)\n",
+			        estr, file->filename, phdrs[loop].p_offset);
+			goto ERROR_FREE;
+		}
+		loader->loads[loader->load_count].vaddr = phdrs[loop].p_vaddr;
+		loader->loads[loader->load_count].paddr = phdrs[loop].p_paddr;
+		loader->loads[loader->load_count].size = phdrs[loop].p_filesz;
+		loader->loads[loader->load_count].offset = phdrs[loop].p_offset;
+		loader->loads[loader->load_count].file = file;
+		loader->load_count++;
+	}
+	
+	mem_free(phdrs);
+	loader->result = RETVAL_SUCCESS;
+	return NULL;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(phdrs);
+	return NULL;
+}
+
+
+/* ============================================================
+       elf_compare_load() - qsort() comparator, by vaddr
+   ============================================================ */
+static int elf_compare_load(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const LoadSegment *load_a = (const LoadSegment*) a;
+	const LoadSegment *load_b = (const LoadSegment*) b;
+	
+	if (load_a->vaddr < load_b->vaddr) {
+		return -1;
+	}
+	if (load_a->vaddr > load_b->vaddr) {
+		return 1;
+	}
+	return 0;
+}
+
+
+/* ============================================================
+       elf_close_segments() - Free LOAD index, Close split files
+   ============================================================ */
+void elf_close_segments(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	mem_free(vmcore->loads);
+	vmcore->loads = NULL;
+	vmcore->load_count = 0;
+	
+	/* parts[0] is vmcore->file, closed by caller */
+	for (loop = 1; loop < vmcore->part_count; loop++) {
+		if (vmcore->parts[loop]->fdesc) {
+			file_close(vmcore->parts[loop]);
+		}
+	}
+	return;
+}
+
+
 /* ============================================================
        elf_read_osrelease() - Search OSRELEASE string
    ============================================================ */
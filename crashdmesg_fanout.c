@@ -0,0 +1,667 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_fanout.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+
+
+/* --- Constant values --- */
+#define FANOUT_FILE 0 /* Durable file by Sink */
+#define FANOUT_CONSOLE 1 /* Device or file, plain writes */
+#define FANOUT_SYSLOG 2 /* Datagram to syslog socket */
+#define FANOUT_FORMAT_DMESG 0 /* Same as stdout */
+#define FANOUT_FORMAT_PLAIN 1 /* Text only */
+#define FANOUT_FORMAT_SYSLOG 2 /* "<PRI>crashdmesg: [ts] text" */
+#define FANOUT_PREFIX_MAX 64 /* Longest prefix of any format */
+#define FANOUT_DEFAULT_SYSLOG "/dev/log"
+#define FANOUT_FACILITY_KERN 0 /* LOG_KERN, also for unknown facility */
+#define FANOUT_FACILITY_MAX 23 /* LOG_LOCAL7 */
+#define FANOUT_LEVEL_INFO 6 /* LOG_INFO, for unknown level */
+#define FANOUT_LEVEL_MAX 7 /* LOG_DEBUG */
+
+
+/* --- Data structures --- */
+
+/* Records produced once, shared by all sinks */
+typedef struct FanoutBatch {
+	int refs; /* Sinks still using batch, under Fanout.lock */
+	int count;
+	size_t fill; /* Bytes used in text */
+	Record records[FANOUT_BATCH_RECORDS];
+	char text[FANOUT_BATCH_SIZE];
+} FanoutBatch;
+
+/* One output, own thread draining own queue */
+typedef struct FanoutSink {
+	char *spec; /* "type:target,key=value,..." as given */
+	int type; /* FANOUT_FILE, ... */
+	char *target;
+	int format; /* FANOUT_FORMAT_* */
+	int level; /* Records with level <= this, -1 for all */
+	char *pattern_file;
+	Search search; /* Own pattern matcher, counters are per sink */
+	int block; /* Wait if queue is full, else drop batch */
+	Sink sink; /* FANOUT_FILE */
+	FILE *stream; /* FANOUT_FILE and FANOUT_CONSOLE */
+	int fdesc; /* FANOUT_SYSLOG */
+	FanoutBatch *queue[FANOUT_QUEUE_DEPTH];
+	int head;
+	int count;
+	int closing;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	pthread_t thread;
+	struct Fanout *fanout;
+	uint64_t records; /* Records written */
+	uint64_t bytes;
+	uint64_t dropped; /* Records not queued, queue was full */
+	int error;
+} FanoutSink;
+
+
+/* --- Prototypes --- */
+static int fanout_parse(FanoutSink *sink, char *spec);
+static int fanout_open_sink(FanoutSink *sink, size_t sync_interval);
+static void fanout_close_sink(FanoutSink *sink);
+static int fanout_publish(Fanout *fanout);
+static void fanout_release(Fanout *fanout, FanoutBatch *batch);
+static void *fanout_worker(void *arg);
+static int fanout_emit(FanoutSink *sink, Record *record);
+static size_t fanout_body(Record *record, char* *body);
+
+
+/* ============================================================
+       fanout_open() - Open every output and Start its thread
+         Output is "file:path", "console:device" or
+         "syslog[:socket]", then ",format=dmesg|plain|syslog",
+         ",level=N", ",pattern=file", ",block" or ",drop".
+   ============================================================ */
+int fanout_open(Fanout *fanout, char **specs, int count,
+                size_t sync_interval)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_open:";
+	FanoutSink *sink = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(fanout != NULL);
+	assert(specs != NULL);
+	
+	memset(fanout, 0x00, sizeof(Fanout));
+	pthread_mutex_init(&fanout->lock, NULL);
+	fanout->sinks = mem_calloc(count, sizeof(FanoutSink));
+	if (fanout->sinks == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_CLOSE;
+	}
+	
+	for (loop = 0; loop < count; loop++) {
+		sink = &fanout->sinks[loop];
+		sink->fanout = fanout;
+		sink->fdesc = -1;
+		if (fanout_parse(sink, specs[loop]) ||
+		    fanout_open_sink(sink, sync_interval)) {
+			fprintf(stderr, "%s Can not open output: %s\n",
+			        estr, specs[loop]);
+			mem_free(sink->spec);
+			goto ERROR_CLOSE;
+		}
+		pthread_mutex_init(&sink->lock, NULL);
+		pthread_cond_init(&sink->not_empty, NULL);
+		pthread_cond_init(&sink->not_full, NULL);
+		if (pthread_create(&sink->thread, NULL, fanout_worker, sink)) {
+			fprintf(stderr, "%s Can not create thread.\n", estr);
+			sink->error = 1;
+			fanout_close_sink(sink);
+			pthread_mutex_destroy(&sink->lock);
+			pthread_cond_destroy(&sink->not_empty);
+			pthread_cond_destroy(&sink->not_full);
+			/* Queue is still empty, nothing was published */
+			mem_free(sink->spec);
+			goto ERROR_CLOSE;
+		}
+		fanout->sink_count++;
+	}
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_CLOSE:
+	fanout_close(fanout);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       fanout_close() - Flush, Wait queues and Close outputs
+   ============================================================ */
+int fanout_close(Fanout *fanout)
+{
+	/* --- Variables --- */
+	FanoutSink *sink = NULL;
+	int retval = RETVAL_SUCCESS;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(fanout != NULL);
+	
+	if (fanout->batch != NULL) {
+		fanout_publish(fanout);
+	}
+	for (loop = 0; loop < fanout->sink_count; loop++) {
+		sink = &fanout->sinks[loop];
+		pthread_mutex_lock(&sink->lock);
+		sink->closing = 1;
+		pthread_cond_signal(&sink->not_empty);
+		pthread_mutex_unlock(&sink->lock);
+	}
+	
+	/* Slow outputs finish their queue here */
+	for (loop = 0; loop < fanout->sink_count; loop++) {
+		sink = &fanout->sinks[loop];
+		pthread_join(sink->thread, NULL);
+		fanout_close_sink(sink);
+		fprintf(stdout, "%s:    * Sink:       %s, %lu records, %lu bytes, "
+		        "%lu dropped\n", APP_NAME, sink->spec,
+		        (unsigned long) sink->records, (unsigned long) sink->bytes,
+		        (unsigned long) sink->dropped);
+		if (sink->error) {
+			retval = RETVAL_FAILURE;
+		}
+		pthread_mutex_destroy(&sink->lock);
+		pthread_cond_destroy(&sink->not_empty);
+		pthread_cond_destroy(&sink->not_full);
+		mem_free(sink->spec);
+	}
+	mem_free(fanout->sinks);
+	pthread_mutex_destroy(&fanout->lock);
+	memset(fanout, 0x00, sizeof(Fanout));
+	return retval;
+}
+
+
+/* ============================================================
+       fanout_write() - Copy record into batch, once for all
+   ============================================================ */
+int fanout_write(Fanout *fanout, Record *record)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_write:";
+	FanoutBatch *batch = NULL;
+	Record *copy = NULL;
+	size_t length = 0;
+	
+	/* --- Assert check --- */
+	assert(fanout != NULL);
+	assert(record != NULL);
+	
+	length = record->text_len;
+	if (length > FANOUT_BATCH_SIZE) {
+		length = FANOUT_BATCH_SIZE;
+	}
+	batch = fanout->batch;
+	if ((batch != NULL) && ((batch->count == FANOUT_BATCH_RECORDS) ||
+	                        (batch->fill + length > FANOUT_BATCH_SIZE))) {
+		if (fanout_publish(fanout)) {
+			return RETVAL_FAILURE;
+		}
+		batch = NULL;
+	}
+	if (batch == NULL) {
+		batch = mem_alloc(sizeof(FanoutBatch));
+		if (batch == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		batch->refs = 1;
+		batch->count = 0;
+		batch->fill = 0;
+		fanout->batch = batch;
+	}
+	
+	copy = &batch->records[batch->count++];
+	*copy = *record;
+	copy->text = batch->text + batch->fill;
+	copy->text_len = length;
+	memcpy(copy->text, record->text, length);
+	batch->fill += length;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       fanout_publish() - Queue batch to every output
+         Full queue blocks or drops, per output.
+   ============================================================ */
+static int fanout_publish(Fanout *fanout)
+{
+	/* --- Variables --- */
+	FanoutBatch *batch = NULL;
+	FanoutSink *sink = NULL;
+	int loop = 0;
+	
+	batch = fanout->batch;
+	fanout->batch = NULL;
+	for (loop = 0; loop < fanout->sink_count; loop++) {
+		sink = &fanout->sinks[loop];
+		pthread_mutex_lock(&sink->lock);
+		while (sink->block && (! sink->error) &&
+		       (sink->count == FANOUT_QUEUE_DEPTH)) {
+			pthread_cond_wait(&sink->not_full, &sink->lock);
+		}
+		if (sink->count == FANOUT_QUEUE_DEPTH) {
+			sink->dropped += batch->count;
+			pthread_mutex_unlock(&sink->lock);
+			continue;
+		}
+		pthread_mutex_lock(&fanout->lock);
+		batch->refs++;
+		pthread_mutex_unlock(&fanout->lock);
+		sink->queue[(sink->head + sink->count) % FANOUT_QUEUE_DEPTH] = batch;
+		sink->count++;
+		pthread_cond_signal(&sink->not_empty);
+		pthread_mutex_unlock(&sink->lock);
+	}
+	
+	/* Reference of producer */
+	fanout_release(fanout, batch);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       fanout_release() - Drop reference, Free by last user
+   ============================================================ */
+static void fanout_release(Fanout *fanout, FanoutBatch *batch)
+{
+	/* --- Variables --- */
+	int refs = 0;
+	
+	pthread_mutex_lock(&fanout->lock);
+	refs = --batch->refs;
+	pthread_mutex_unlock(&fanout->lock);
+	if (refs == 0) {
+		mem_free(batch);
+	}
+	return;
+}
+
+
+/* ============================================================
+       fanout_worker() - Thread of one output
+   ============================================================ */
+static void *fanout_worker(void *arg)
+{
+	/* --- Variables --- */
+	FanoutSink *sink = NULL;
+	FanoutBatch *batch = NULL;
+	int loop = 0;
+	
+	sink = (FanoutSink*) arg;
+	while (1) {
+		pthread_mutex_lock(&sink->lock);
+		while ((sink->count == 0) && (! sink->closing)) {
+			pthread_cond_wait(&sink->not_empty, &sink->lock);
+		}
+		if (sink->count == 0) {
+			pthread_mutex_unlock(&sink->lock);
+			break;
+		}
+		batch = sink->queue[sink->head];
+		sink->head = (sink->head + 1) % FANOUT_QUEUE_DEPTH;
+		sink->count--;
+		pthread_cond_signal(&sink->not_full);
+		pthread_mutex_unlock(&sink->lock);
+	
+		/* After error, batches are only released */
+		for (loop = 0; (loop < batch->count) && (! sink->error); loop++) {
+			if (fanout_emit(sink, &batch->records[loop])) {
+				pthread_mutex_lock(&sink->lock);
+				sink->error = 1;
+				pthread_cond_signal(&sink->not_full);
+				pthread_mutex_unlock(&sink->lock);
+			}
+		}
+		fanout_release(sink->fanout, batch);
+	}
+	return NULL;
+}
+
+
+/* ============================================================
+       fanout_emit() - Filter, Format and Write one record
+   ============================================================ */
+static int fanout_emit(FanoutSink *sink, Record *record)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_emit:";
+	char prefix[FANOUT_PREFIX_MAX];
+	memset(prefix, 0x00, sizeof(prefix));
+	struct iovec vector[3];
+	memset(vector, 0x00, sizeof(vector));
+	char *body = NULL;
+	size_t body_len = 0;
+	int prefix_len = 0;
+	int priority = 0;
+	int facility = 0;
+	int level = 0;
+	ssize_t sent = 0;
+	
+	/* Unknown level is not filtered */
+	if ((sink->level >= 0) && (record->level > sink->level)) {
+		return RETVAL_SUCCESS;
+	}
+	if (sink->pattern_file && (search_record(&sink->search, record) < 0)) {
+		return RETVAL_SUCCESS;
+	}
+	
+	body_len = fanout_body(record, &body);
+	switch (sink->format) {
+	case FANOUT_FORMAT_DMESG:
+		body = record->text;
+		body_len = record->text_len;
+		if (! record->prefixed) {
+			prefix_len = snprintf(prefix, sizeof(prefix), "[%5lu.%06lu] ",
+			        (unsigned long) (record->ts_nsec / 1000000000ULL),
+			        (unsigned long) (record->ts_nsec % 1000000000ULL) / 1000);
+		}
+		break;
+	case FANOUT_FORMAT_SYSLOG:
+		/* PRI must stay in 0-191, record may not carry either */
+		facility = record->facility;
+		if ((facility < 0) || (facility > FANOUT_FACILITY_MAX)) {
+			facility = FANOUT_FACILITY_KERN;
+		}
+		level = record->level;
+		if (level < 0) {
+			level = FANOUT_LEVEL_INFO;
+		}
+		else if (level > FANOUT_LEVEL_MAX) {
+			level = FANOUT_LEVEL_MAX;
+		}
+		priority = (facility << 3) | level;
+		prefix_len = snprintf(prefix, sizeof(prefix),
+		        "<%d>%s: [%5lu.%06lu] ", priority, APP_NAME,
+		        (unsigned long) (record->ts_nsec / 1000000000ULL),
+		        (unsigned long) (record->ts_nsec % 1000000000ULL) / 1000);
+		break;
+	default:
+		break;
+	}
+	
+	/* One datagram per record, no newline */
+	if (sink->type == FANOUT_SYSLOG) {
+		vector[0].iov_base = prefix;
+		vector[0].iov_len = prefix_len;
+		vector[1].iov_base = body;
+		vector[1].iov_len = body_len;
+		do {
+			sent = writev(sink->fdesc, vector, 2);
+		} while ((sent == -1) && (errno == EINTR));
+		if (sent == -1) {
+			fprintf(stderr, "%s Can not send: %s: [%d] %s\n",
+			        estr, sink->target, errno, strerror(errno));
+			return RETVAL_FAILURE;
+		}
+	}
+	else {
+		fwrite(prefix, 1, prefix_len, sink->stream);
+		fwrite(body, 1, body_len, sink->stream);
+		if (fputc('\n', sink->stream) == EOF) {
+			fprintf(stderr, "%s Can not write: %s\n", estr, sink->target);
+			return RETVAL_FAILURE;
+		}
+	}
+	sink->records++;
+	sink->bytes += prefix_len + body_len + (sink->type != FANOUT_SYSLOG);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       fanout_body() - Text without own "<N>[ ts ] " prefix
+   ============================================================ */
+static size_t fanout_body(Record *record, char* *body)
+{
+	/* --- Variables --- */
+	char *cursor = NULL;
+	char *limit = NULL;
+	char *close = NULL;
+	
+	cursor = record->text;
+	limit = record->text + record->text_len;
+	if (record->prefixed) {
+		if ((limit - cursor >= 3) && (cursor[0] == '<') && (cursor[2] == '>')) {
+			cursor += 3;
+		}
+		if ((cursor < limit) && (*cursor == '[')) {
+			close = memchr(cursor, ']', limit - cursor);
+			if (close != NULL) {
+				cursor = close + 1;
+				if ((cursor < limit) && (*cursor == ' ')) {
+					cursor++;
+				}
+			}
+		}
+	}
+	*body = cursor;
+	return limit - cursor;
+}
+
+
+/* ============================================================
+       fanout_parse() - Parse output spec
+   ============================================================ */
+static int fanout_parse(FanoutSink *sink, char *spec)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_parse:";
+	char *copy = NULL;
+	char *token = NULL;
+	char *saveptr = NULL;
+	char *value = NULL;
+	char *endptr = NULL;
+	
+	/* Spec is kept for messages, copy is cut into fields */
+	sink->spec = mem_alloc(2 * (strlen(spec) + 1));
+	if (sink->spec == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	strcpy(sink->spec, spec);
+	copy = sink->spec + strlen(spec) + 1;
+	strcpy(copy, spec);
+	
+	/* "type:target" */
+	token = strtok_r(copy, ",", &saveptr);
+	if (token == NULL) {
+		fprintf(stderr, "%s Empty output.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	value = strchr(token, ':');
+	if (value != NULL) {
+		*value++ = 0x00;
+	}
+	sink->level = -1;
+	if (! strcmp(token, "file")) {
+		sink->type = FANOUT_FILE;
+		sink->format = FANOUT_FORMAT_DMESG;
+		sink->block = 1;
+	}
+	else if (! strcmp(token, "console")) {
+		sink->type = FANOUT_CONSOLE;
+		sink->format = FANOUT_FORMAT_DMESG;
+	}
+	else if (! strcmp(token, "syslog")) {
+		sink->type = FANOUT_SYSLOG;
+		sink->format = FANOUT_FORMAT_SYSLOG;
+		if (value == NULL) {
+			value = FANOUT_DEFAULT_SYSLOG;
+		}
+	}
+	else {
+		fprintf(stderr, "%s Unknown output type: %s\n", estr, token);
+		return RETVAL_FAILURE;
+	}
+	if ((value == NULL) || (*value == 0x00)) {
+		fprintf(stderr, "%s No target of %s\n", estr, token);
+		return RETVAL_FAILURE;
+	}
+	sink->target = value;
+	
+	/* ",key=value" */
+	while ((token = strtok_r(NULL, ",", &saveptr)) != NULL) {
+		value = strchr(token, '=');
+		if (value != NULL) {
+			*value++ = 0x00;
+		}
+		if (! strcmp(token, "block") && (value == NULL)) {
+			sink->block = 1;
+		}
+		else if (! strcmp(token, "drop") && (value == NULL)) {
+			sink->block = 0;
+		}
+		else if (value == NULL) {
+			fprintf(stderr, "%s Invalid option: %s\n", estr, token);
+			return RETVAL_FAILURE;
+		}
+		else if (! strcmp(token, "format")) {
+			if (! strcmp(value, "dmesg")) {
+				sink->format = FANOUT_FORMAT_DMESG;
+			}
+			else if (! strcmp(value, "plain")) {
+				sink->format = FANOUT_FORMAT_PLAIN;
+			}
+			else if (! strcmp(value, "syslog")) {
+				sink->format = FANOUT_FORMAT_SYSLOG;
+			}
+			else {
+				fprintf(stderr, "%s Unknown format: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+		}
+		else if (! strcmp(token, "level")) {
+			sink->level = strtol(value, &endptr, 10);
+			if ((*value == 0x00) || (*endptr != 0x00) ||
+			    (sink->level < 0) || (sink->level > 7)) {
+				fprintf(stderr, "%s Invalid level: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+		}
+		else if (! strcmp(token, "pattern")) {
+			sink->pattern_file = value;
+		}
+		else {
+			fprintf(stderr, "%s Unknown option: %s\n", estr, token);
+			return RETVAL_FAILURE;
+		}
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       fanout_open_sink() - Open target of one output
+   ============================================================ */
+static int fanout_open_sink(FanoutSink *sink, size_t sync_interval)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_open_sink:";
+	struct sockaddr_un address;
+	memset(&address, 0x00, sizeof(struct sockaddr_un));
+	
+	if (sink->pattern_file &&
+	    search_compile(&sink->search, sink->pattern_file)) {
+		return RETVAL_FAILURE;
+	}
+	
+	switch (sink->type) {
+	case FANOUT_FILE:
+		/* Durable, as -o */
+		if (sink_open(&sink->sink, sink->target, sync_interval)) {
+			goto ERROR_FREE;
+		}
+		sink->stream = sink->sink.stream;
+		break;
+	case FANOUT_CONSOLE:
+		/* Serial line is slow, but written as is */
+		sink->stream = fopen(sink->target, "a");
+		if (sink->stream == NULL) {
+			fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+			        estr, sink->target, errno, strerror(errno));
+			goto ERROR_FREE;
+		}
+		break;
+	case FANOUT_SYSLOG:
+		if (strlen(sink->target) >= sizeof(address.sun_path)) {
+			fprintf(stderr, "%s Path is too long: %s\n", estr, sink->target);
+			goto ERROR_FREE;
+		}
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, sink->target);
+		sink->fdesc = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if ((sink->fdesc == -1) ||
+		    (connect(sink->fdesc, (struct sockaddr*) &address,
+		             sizeof(address)) == -1)) {
+			fprintf(stderr, "%s Can not connect: %s: [%d] %s\n",
+			        estr, sink->target, errno, strerror(errno));
+			if (sink->fdesc != -1) {
+				close(sink->fdesc);
+			}
+			goto ERROR_FREE;
+		}
+		break;
+	}
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	if (sink->pattern_file) {
+		search_free(&sink->search);
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       fanout_close_sink() - Close target of one output
+   ============================================================ */
+static void fanout_close_sink(FanoutSink *sink)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] fanout_close_sink:";
+	
+	switch (sink->type) {
+	case FANOUT_FILE:
+		if (sink_close(&sink->sink)) {
+			sink->error = 1;
+		}
+		break;
+	case FANOUT_CONSOLE:
+		if (fclose(sink->stream) == EOF) {
+			fprintf(stderr, "%s Can not close: %s: [%d] %s\n",
+			        estr, sink->target, errno, strerror(errno));
+			sink->error = 1;
+		}
+		break;
+	case FANOUT_SYSLOG:
+		close(sink->fdesc);
+		break;
+	}
+	if (sink->pattern_file) {
+		search_free(&sink->search);
+	}
+	return;
+}
+
+
+/* ====================================================================== */
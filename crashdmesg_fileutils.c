@@ -7,6 +7,18 @@
 
 /* --- Include header files --- */
 #include "crashdmesg_common.h"
+#include <sys/uio.h>
+
+
+/* --- Prototypes --- */
+static int file_cache_create(File *file);
+static void file_cache_destroy(File *file);
+static CacheBlock *file_cache_lookup(FileCache *cache, off_t index);
+static CacheBlock *file_cache_evict(FileCache *cache);
+static void file_cache_touch(FileCache *cache, CacheBlock *block);
+static int file_cache_fill(File *file, CacheBlock **blocks, int count);
+static int file_read_direct(File *file, void *buffer,
+                            off_t offset, size_t size);
 
 
 /* ============================================================
@@ -32,6 +44,9 @@ int file_open(File *file)
 		fprintf(stderr, "%s File already opened.\n", estr);
 		return RETVAL_FAILURE;
 	}
+	if (! strcmp(file->filename, STREAM_FILENAME)) {
+		return stream_open(file);
+	}
 	
 	/* Get stat and Open */
 	if (stat(file->filename, &filestat) == -1) {
@@ -47,6 +62,27 @@ int file_open(File *file)
 		return RETVAL_FAILURE;
 	}
 	file->size = (size_t) filestat.st_size;
+	memset(&file->stat, 0x00, sizeof(FileStat));
+	
+	/* Compressed vmcore, frames are cached instead of blocks */
+	if (archive_open(file)) {
+		fprintf(stderr, "%s Can not open archive: %s\n",
+		        estr, file->filename);
+		close(file->fdesc);
+		file->fdesc = 0;
+		return RETVAL_FAILURE;
+	}
+	if (file->archive != NULL) {
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Read cache */
+	if (file_cache_create(file)) {
+		fprintf(stderr, "%s Can not create read cache.\n", estr);
+		close(file->fdesc);
+		file->fdesc = 0;
+		return RETVAL_FAILURE;
+	}
 	
 	return RETVAL_SUCCESS;
 }
@@ -71,6 +107,11 @@ int file_close(File *file)
 	}
 	
 	/* Close */
+	if (file->stream != NULL) {
+		return stream_close(file);
+	}
+	archive_close(file);
+	file_cache_destroy(file);
 	if (close(file->fdesc) == -1) {
 		fprintf(stderr, "%s Can not close file: [%d] %s: %s\n", estr,
 		       errno, strerror(errno), file->filename);
@@ -78,6 +119,7 @@ int file_close(File *file)
 		file->size = 0;
 		return RETVAL_FAILURE;
 	}
+	file->fdesc = 0;
 	
 	return RETVAL_SUCCESS;
 }
@@ -85,13 +127,23 @@ int file_close(File *file)
 
 /* ============================================================
        file_read() - Read data from file
+         Small reads go through block cache, large ones bypass.
    ============================================================ */
 int file_read(File *file, void *buffer, off_t offset, size_t size)
 {
 	/* --- Variables --- */
-	errno = 0;
 	char estr[] = "[ERROR] file_read:";
-	ssize_t readbytes = 0;
+	FileCache *cache = NULL;
+	CacheBlock *block = NULL;
+	CacheBlock *missing[CACHE_MAX_COALESCE];
+	memset(missing, 0x00, sizeof(missing));
+	int missing_count = 0;
+	off_t first = 0;
+	off_t last = 0;
+	off_t index = 0;
+	size_t skip = 0;
+	size_t length = 0;
+	char *cursor = NULL;
 	
 	/* --- Assert check --- */
 	assert(file != NULL);
@@ -108,28 +160,356 @@ int file_read(File *file, void *buffer, off_t offset, size_t size)
 		fprintf(stderr, "Read area overflowed.\n");
 		return RETVAL_FAILURE;
 	}
+	if (file->stream != NULL) {
+		return stream_read(file, buffer, offset, size);
+	}
+	if (file->archive != NULL) {
+		return archive_read(file, buffer, offset, size);
+	}
 	
-	/* Seek to offset */
-	if (lseek(file->fdesc, offset, SEEK_SET) == (off_t) -1) {
-		fprintf(stderr, "%s Seek failed: %s(0x%x) : [%d] %s\n", estr,
-		        file->filename, (unsigned) offset, errno, strerror(errno));
-		return RETVAL_FAILURE;
+	/* Bypass cache if disabled or larger than quarter of cache */
+	cache = file->cache;
+	if ((cache == NULL) || (size > cache->count * CACHE_BLOCK_SIZE / 4)) {
+		return file_read_direct(file, buffer, offset, size);
+	}
+	
+	/* Collect blocks, adjacent misses are read at once */
+	first = offset / CACHE_BLOCK_SIZE;
+	last = (offset + size - 1) / CACHE_BLOCK_SIZE;
+	for (index = first; index <= last; index++) {
+		block = file_cache_lookup(cache, index);
+		if (block != NULL) {
+			/* Touch now, not to be evicted by following misses */
+			file_cache_touch(cache, block);
+			file->stat.hits++;
+			if (missing_count > 0) {
+				if (file_cache_fill(file, missing, missing_count)) {
+					return RETVAL_FAILURE;
+				}
+				missing_count = 0;
+			}
+			continue;
+		}
+		if (missing_count == CACHE_MAX_COALESCE) {
+			if (file_cache_fill(file, missing, missing_count)) {
+				return RETVAL_FAILURE;
+			}
+			missing_count = 0;
+		}
+		block = file_cache_evict(cache);
+		block->index = index;
+		missing[missing_count++] = block;
+	}
+	if (missing_count > 0) {
+		if (file_cache_fill(file, missing, missing_count)) {
+			return RETVAL_FAILURE;
+		}
+	}
+	
+	/* Copy from cache */
+	cursor = (char*) buffer;
+	skip = offset % CACHE_BLOCK_SIZE;
+	for (index = first; index <= last; index++) {
+		block = file_cache_lookup(cache, index);
+		assert(block != NULL);
+		length = CACHE_BLOCK_SIZE - skip;
+		if (length > size - (cursor - (char*) buffer)) {
+			length = size - (cursor - (char*) buffer);
+		}
+		if (skip + length > block->length) {
+			fprintf(stderr, "%s Can not read: %s(0x%lx:0x%lx)\n", estr,
+			        file->filename, (unsigned long) offset,
+			        (unsigned long) size);
+			return RETVAL_FAILURE;
+		}
+		memcpy(cursor, block->data + skip, length);
+		file_cache_touch(cache, block);
+		cursor += length;
+		skip = 0;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       file_read_direct() - Read data without cache
+   ============================================================ */
+static int file_read_direct(File *file, void *buffer,
+                            off_t offset, size_t size)
+{
+	/* --- Variables --- */
+	errno = 0;
+	char estr[] = "[ERROR] file_read:";
+	ssize_t readbytes = 0;
+	size_t done = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(buffer != NULL);
+	
+	/* Read, retry on short read */
+	while (done < size) {
+		readbytes = pread(file->fdesc, (char*) buffer + done,
+		                  size - done, offset + done);
+		file->stat.syscalls++;
+		if (readbytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "%s Read failed: %s(0x%lx:0x%lx) : [%d] %s\n",
+			        estr, file->filename, (unsigned long) offset,
+			        (unsigned long) size, errno, strerror(errno));
+			return RETVAL_FAILURE;
+		}
+		else if (readbytes == 0) {
+			fprintf(stderr, "%s Can not read: %s(0x%lx:0x%lx,0x%lx)\n",
+			        estr, file->filename, (unsigned long) offset,
+			        (unsigned long) size, (unsigned long) done);
+			return RETVAL_FAILURE;
+		}
+		done += readbytes;
+	}
+	file->stat.bytes += done;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       file_cache_create() - Allocate read cache within limit
+   ============================================================ */
+static int file_cache_create(File *file)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] file_cache_create:";
+	FileCache *cache = NULL;
+	size_t count = 0;
+	size_t hash_size = 1;
+	size_t loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(file->cache == NULL);
+	
+	/* Number of blocks, metadata is counted in the limit too.
+	   Cache takes no more than quarter of memory left. */
+	count = file->cache_limit;
+	if (count > mem_available() / 4) {
+		count = mem_available() / 4;
+	}
+	count /= CACHE_BLOCK_SIZE + sizeof(CacheBlock) + 2 * sizeof(CacheBlock*);
+	if (count < 4) {
+		/* Cache disabled */
+		return RETVAL_SUCCESS;
+	}
+	while (hash_size < count) {
+		hash_size <<= 1;
 	}
 	
-	/* Read */
-	readbytes = read(file->fdesc, buffer, size);
-	if (readbytes ==  -1) {
-		fprintf(stderr, "%s Read failed: %s(0x%x:0x%x) : [%d] %s\n", estr,
-		        file->filename, (unsigned) offset, (unsigned) size,
-		        errno, strerror(errno));
+	cache = mem_calloc(1, sizeof(FileCache));
+	if (cache == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	cache->count = count;
+	cache->hash_mask = hash_size - 1;
+	cache->blocks = mem_calloc(count, sizeof(CacheBlock));
+	cache->hash = mem_calloc(hash_size, sizeof(CacheBlock*));
+	cache->buffer = mem_alloc_aligned(CACHE_BLOCK_SIZE,
+	                                  count * CACHE_BLOCK_SIZE);
+	if ((cache->blocks == NULL) || (cache->hash == NULL) ||
+	    (cache->buffer == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		mem_free(cache->buffer);
+		mem_free(cache->blocks);
+		mem_free(cache->hash);
+		mem_free(cache);
 		return RETVAL_FAILURE;
 	}
-	else if (readbytes != (ssize_t) size) {
-		fprintf(stderr, "%s Can not read: %s(0x%x:0x%x,0x%x) : [%d] %s\n",
-		        estr, file->filename, (unsigned) offset, (unsigned) size,
-		        (unsigned) readbytes, errno, strerror(errno));
+	
+	/* All blocks are unused, linked in LRU order */
+	for (loop = 0; loop < count; loop++) {
+		cache->blocks[loop].index = -1;
+		cache->blocks[loop].data = cache->buffer + loop * CACHE_BLOCK_SIZE;
+		cache->blocks[loop].lru_prev = (loop > 0) ?
+		                               &cache->blocks[loop - 1] : NULL;
+		cache->blocks[loop].lru_next = (loop < count - 1) ?
+		                               &cache->blocks[loop + 1] : NULL;
+	}
+	cache->lru_head = &cache->blocks[0];
+	cache->lru_tail = &cache->blocks[count - 1];
+	file->cache = cache;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       file_cache_destroy() - Free read cache
+   ============================================================ */
+static void file_cache_destroy(File *file)
+{
+	/* --- Assert check --- */
+	assert(file != NULL);
+	
+	if (file->cache == NULL) {
+		return;
+	}
+	mem_free(file->cache->buffer);
+	mem_free(file->cache->blocks);
+	mem_free(file->cache->hash);
+	mem_free(file->cache);
+	file->cache = NULL;
+	return;
+}
+
+
+/* ============================================================
+       file_cache_lookup() - Search block, NULL if not cached
+   ============================================================ */
+static CacheBlock *file_cache_lookup(FileCache *cache, off_t index)
+{
+	/* --- Variables --- */
+	CacheBlock *block = NULL;
+	
+	/* --- Assert check --- */
+	assert(cache != NULL);
+	
+	for (block = cache->hash[index & cache->hash_mask]; block != NULL;
+	     block = block->hash_next) {
+		if (block->index == index) {
+			return block;
+		}
+	}
+	
+	return NULL;
+}
+
+
+/* ============================================================
+       file_cache_evict() - Take least recently used block
+         Block is unhashed and moved to head of LRU.
+   ============================================================ */
+static CacheBlock *file_cache_evict(FileCache *cache)
+{
+	/* --- Variables --- */
+	CacheBlock *block = NULL;
+	CacheBlock **link = NULL;
+	
+	/* --- Assert check --- */
+	assert(cache != NULL);
+	
+	block = cache->lru_tail;
+	if (block->index != -1) {
+		link = &cache->hash[block->index & cache->hash_mask];
+		while (*link != block) {
+			link = &(*link)->hash_next;
+		}
+		*link = block->hash_next;
+		block->hash_next = NULL;
+		block->index = -1;
+	}
+	block->length = 0;
+	file_cache_touch(cache, block);
+	
+	return block;
+}
+
+
+/* ============================================================
+       file_cache_touch() - Move block to head of LRU
+   ============================================================ */
+static void file_cache_touch(FileCache *cache, CacheBlock *block)
+{
+	/* --- Assert check --- */
+	assert(cache != NULL);
+	assert(block != NULL);
+	
+	if (cache->lru_head == block) {
+		return;
+	}
+	
+	/* Unlink */
+	block->lru_prev->lru_next = block->lru_next;
+	if (block->lru_next != NULL) {
+		block->lru_next->lru_prev = block->lru_prev;
+	}
+	else {
+		cache->lru_tail = block->lru_prev;
+	}
+	
+	/* Link at head */
+	block->lru_prev = NULL;
+	block->lru_next = cache->lru_head;
+	cache->lru_head->lru_prev = block;
+	cache->lru_head = block;
+	return;
+}
+
+
+/* ============================================================
+       file_cache_fill() - Read consecutive blocks at once
+   ============================================================ */
+static int file_cache_fill(File *file, CacheBlock **blocks, int count)
+{
+	/* --- Variables --- */
+	errno = 0;
+	char estr[] = "[ERROR] file_cache_fill:";
+	struct iovec iov[CACHE_MAX_COALESCE];
+	memset(iov, 0x00, sizeof(iov));
+	FileCache *cache = NULL;
+	off_t offset = 0;
+	size_t want = 0;
+	ssize_t readbytes = 0;
+	size_t remain = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(blocks != NULL);
+	assert((count > 0) && (count <= CACHE_MAX_COALESCE));
+	
+	cache = file->cache;
+	offset = blocks[0]->index * CACHE_BLOCK_SIZE;
+	for (loop = 0; loop < count; loop++) {
+		assert(blocks[loop]->index == blocks[0]->index + loop);
+		iov[loop].iov_base = blocks[loop]->data;
+		iov[loop].iov_len = CACHE_BLOCK_SIZE;
+	}
+	
+	/* Last block may be short at end of file */
+	want = count * CACHE_BLOCK_SIZE;
+	if (offset + want > file->size) {
+		want = file->size - offset;
+	}
+	do {
+		readbytes = preadv(file->fdesc, iov, count, offset);
+		file->stat.syscalls++;
+	} while ((readbytes == -1) && (errno == EINTR));
+	if ((readbytes == -1) || (readbytes < want)) {
+		fprintf(stderr, "%s Read failed: %s(0x%lx:0x%lx) : [%d] %s\n",
+		        estr, file->filename, (unsigned long) offset,
+		        (unsigned long) want, errno, strerror(errno));
+		for (loop = 0; loop < count; loop++) {
+			/* Leave blocks unused */
+			blocks[loop]->index = -1;
+		}
 		return RETVAL_FAILURE;
 	}
+	file->stat.bytes += readbytes;
+	file->stat.misses += count;
+	
+	/* Register blocks */
+	remain = readbytes;
+	for (loop = 0; loop < count; loop++) {
+		blocks[loop]->length = (remain > CACHE_BLOCK_SIZE) ?
+		                       CACHE_BLOCK_SIZE : remain;
+		remain -= blocks[loop]->length;
+		blocks[loop]->hash_next =
+		    cache->hash[blocks[loop]->index & cache->hash_mask];
+		cache->hash[blocks[loop]->index & cache->hash_mask] = blocks[loop];
+	}
 	
 	return RETVAL_SUCCESS;
 }
@@ -0,0 +1,1120 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_kallsyms.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+#define KALLSYMS_TOKEN_COUNT 256 /* kallsyms_token_index[] */
+#define KALLSYMS_TOKEN_MAX 256 /* Max length of one token */
+#define KALLSYMS_MIN_READ 4096 /* Smallest read of kallsyms_names */
+#define KALLSYMS_PAGE_SIZE 4096 /* Stack is read page by page */
+#define KALLSYMS_ALIGN 8 /* ALGN of scripts/kallsyms.c */
+#define KALLSYMS_DIGIT_TOKEN 0x30 /* Token of '0', digits are never merged */
+#define KALLSYMS_MARKER_STEP 256 /* Symbols per kallsyms_markers[] entry */
+#define KALLSYMS_MARKERS_MAX (KALLSYMS_MAX_SYMS / KALLSYMS_MARKER_STEP * 8)
+#define KALLSYMS_TAIL_MAX (KALLSYMS_MARKER_STEP * (2 + KSYM_NAME_LEN))
+
+
+/* --- Data structures --- */
+
+/* Location of kallsyms tables, See:scripts/kallsyms.c */
+typedef struct {
+	uint64_t num_syms;
+	uint64_t names;
+	uint64_t token_table;
+	uint64_t token_index;
+	uint64_t offsets; /* kallsyms_offsets[], or kallsyms_addresses[] */
+	uint64_t relative_base; /* 0 if absolute addresses */
+	int scanned; /* Found by scan, addresses are not known yet */
+} KallsymsTables;
+
+
+/* --- Prototypes --- */
+static int kallsyms_find_tables(VMCore *vmcore, KallsymsTables *tables);
+static int kallsyms_scan_tables(VMCore *vmcore, KallsymsTables *tables);
+static int kallsyms_scan_tokens(VMCore *vmcore, LoadSegment *load,
+                                uint64_t digits, KallsymsTables *tables);
+static int kallsyms_scan_markers(VMCore *vmcore, LoadSegment *load,
+                                 KallsymsTables *tables);
+static int kallsyms_scan_names(VMCore *vmcore, LoadSegment *load,
+                               KallsymsTables *tables, uint64_t markers,
+                               uint64_t count, uint64_t first,
+                               uint64_t last);
+static int kallsyms_skip_names(unsigned char *data, size_t size,
+                               size_t limit, int count, size_t *ret);
+static int kallsyms_scan_addresses(VMCore *vmcore, Kallsyms *kallsyms,
+                                   KallsymsTables *tables);
+static int kallsyms_read_tokens(VMCore *vmcore, KallsymsTables *tables,
+                                char* *table, size_t *table_size,
+                                uint16_t *index);
+static int kallsyms_read_names(VMCore *vmcore, Kallsyms *kallsyms,
+                               uint64_t names, char *table,
+                               size_t table_size, uint16_t *index);
+static int kallsyms_add_name(Kallsyms *kallsyms, char *name, size_t length);
+static int kallsyms_read_addresses(VMCore *vmcore, Kallsyms *kallsyms,
+                                   KallsymsTables *tables);
+static int kallsyms_compare(const void *a, const void *b);
+static int kallsyms_find_name(Kallsyms *kallsyms, char *name, uint64_t *ret);
+static int kallsyms_is_text(Kallsyms *kallsyms, uint64_t address);
+
+
+/* ============================================================
+       kallsyms_load() - Decompress kallsyms tables of vmcore
+         Tables are located by VMCOREINFO (6.x), or by scan of
+         kernel image. See:kernel/kallsyms.c
+         Result is sorted by address.
+   ============================================================ */
+int kallsyms_load(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_load:";
+	Kallsyms *kallsyms = NULL;
+	KallsymsTables tables;
+	memset(&tables, 0x00, sizeof(KallsymsTables));
+	uint32_t count = 0;
+	char *table = NULL;
+	size_t table_size = 0;
+	uint16_t index[KALLSYMS_TOKEN_COUNT];
+	memset(index, 0x00, sizeof(index));
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	kallsyms = &vmcore->kallsyms;
+	if (kallsyms->loaded) {
+		return (kallsyms->loaded > 0) ? RETVAL_SUCCESS : RETVAL_FAILURE;
+	}
+	kallsyms->loaded = -1;
+	if (kallsyms_find_tables(vmcore, &tables) &&
+	    kallsyms_scan_tables(vmcore, &tables)) {
+		fprintf(stderr, "%s kallsyms tables not found.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Older kernels have unsigned long, low half is the same */
+	if (elf_read_load_uint32(vmcore, tables.num_syms, &count) ||
+	    (count == 0) || (count > KALLSYMS_MAX_SYMS)) {
+		fprintf(stderr, "%s Invalid kallsyms_num_syms: %u\n", estr, count);
+		return RETVAL_FAILURE;
+	}
+	kallsyms->symbols = mem_calloc(count, sizeof(KallsymsEntry));
+	if (kallsyms->symbols == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	kallsyms->count = count;
+	
+	if (kallsyms_read_tokens(vmcore, &tables, &table, &table_size, index)) {
+		fprintf(stderr, "%s Can not read token table.\n", estr);
+		goto ERROR_FREE;
+	}
+	if (kallsyms_read_names(vmcore, kallsyms, tables.names, table,
+	                        table_size, index)) {
+		fprintf(stderr, "%s Can not read kallsyms_names.\n", estr);
+		goto ERROR_FREE;
+	}
+	mem_free(table);
+	table = NULL;
+	if (tables.scanned ?
+	    kallsyms_scan_addresses(vmcore, kallsyms, &tables) :
+	    kallsyms_read_addresses(vmcore, kallsyms, &tables)) {
+		fprintf(stderr, "%s Can not read symbol addresses.\n", estr);
+		goto ERROR_FREE;
+	}
+	qsort(kallsyms->symbols, kallsyms->count, sizeof(KallsymsEntry),
+	      kallsyms_compare);
+	
+	/* Text range for stack scan, symbol type is used if missing */
+	if (kallsyms_find_name(kallsyms, "_stext", &kallsyms->text_start) ||
+	    kallsyms_find_name(kallsyms, "_etext", &kallsyms->text_end)) {
+		kallsyms->text_start = 0;
+		kallsyms->text_end = 0;
+	}
+	kallsyms->loaded = 1;
+	fprintf(stdout, "%s:    * Kallsyms:   %d symbols, %lu bytes of names\n",
+	        APP_NAME, kallsyms->count, (unsigned long) kallsyms->names_size);
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(table);
+	kallsyms_free(vmcore);
+	kallsyms->loaded = -1;
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_free() - Free symbol index
+   ============================================================ */
+void kallsyms_free(VMCore *vmcore)
+{
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	mem_free(vmcore->kallsyms.symbols);
+	mem_free(vmcore->kallsyms.names);
+	memset(&vmcore->kallsyms, 0x00, sizeof(Kallsyms));
+	return;
+}
+
+
+/* ============================================================
+       kallsyms_search_symbol() - Return address of symbol
+         VMCOREINFO first, kallsyms of vmcore if not there.
+   ============================================================ */
+int kallsyms_search_symbol(VMCore *vmcore, char *name, uint64_t *ret)
+{
+	/* --- Variables --- */
+	char key[MAX_SYMBOL_NAME];
+	memset(key, 0x00, sizeof(key));
+	int length = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(name != NULL);
+	assert(ret != NULL);
+	
+	length = snprintf(key, sizeof(key), "SYMBOL(%s)", name);
+	if ((length < sizeof(key)) &&
+	    (! elf_search_vmcoreinfo_number(vmcore, key, ret))) {
+		return RETVAL_SUCCESS;
+	}
+	if (kallsyms_load(vmcore)) {
+		return RETVAL_FAILURE;
+	}
+	return kallsyms_find_name(&vmcore->kallsyms, name, ret);
+}
+
+
+/* ============================================================
+       kallsyms_lookup() - Return symbol name containing address
+         NULL if not found, offset and size of symbol are set.
+   ============================================================ */
+char *kallsyms_lookup(VMCore *vmcore, uint64_t address,
+                      uint64_t *offset, uint64_t *size)
+{
+	/* --- Variables --- */
+	Kallsyms *kallsyms = NULL;
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	int next = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(offset != NULL);
+	assert(size != NULL);
+	
+	kallsyms = &vmcore->kallsyms;
+	if (kallsyms->loaded <= 0) {
+		return NULL;
+	}
+	
+	/* Last symbol <= address */
+	low = 0;
+	high = kallsyms->count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (kallsyms->symbols[middle].address <= address) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	if (low == 0) {
+		return NULL;
+	}
+	middle = low - 1;
+	
+	/* Size up to next different address, as kernel does */
+	*offset = address - kallsyms->symbols[middle].address;
+	*size = 0;
+	for (next = low; next < kallsyms->count; next++) {
+		if (kallsyms->symbols[next].address >
+		    kallsyms->symbols[middle].address) {
+			*size = kallsyms->symbols[next].address -
+			        kallsyms->symbols[middle].address;
+			break;
+		}
+	}
+	if ((*size == 0) || (*offset >= *size)) {
+		/* Beyond the last symbol */
+		return NULL;
+	}
+	return kallsyms->names + kallsyms->symbols[middle].name;
+}
+
+
+/* ============================================================
+       kallsyms_print_backtrace() - Print stack of each CPU
+         Words on stack from NT_PRSTATUS RSP which point into
+         kernel text are printed, like "?" lines of oops.
+   ============================================================ */
+int kallsyms_print_backtrace(VMCore *vmcore, FILE *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_print_backtrace:";
+	Note *note = NULL;
+	uint64_t reg[PRSTATUS_REG_COUNT];
+	memset(reg, 0x00, sizeof(reg));
+	uint64_t stack[KALLSYMS_STACK_SIZE / sizeof(uint64_t)];
+	memset(stack, 0x00, sizeof(stack));
+	uint64_t rsp = 0;
+	uint64_t end = 0;
+	uint64_t address = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	size_t length = 0;
+	size_t words = 0;
+	size_t word = 0;
+	char *name = NULL;
+	int32_t pid = 0;
+	int frames = 0;
+	int cpu = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(stream != NULL);
+	
+	if (kallsyms_load(vmcore)) {
+		fprintf(stderr, "%s Can not load kallsyms.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < vmcore->note_count; loop++) {
+		note = &vmcore->notes[loop];
+		if (note->type != NT_PRSTATUS) {
+			continue;
+		}
+		if (note->descsz < PRSTATUS_REG_OFFSET + sizeof(reg)) {
+			fprintf(stderr, "%s NT_PRSTATUS is too small: %u\n",
+			        estr, note->descsz);
+			return RETVAL_FAILURE;
+		}
+		memcpy(&pid, note->desc + PRSTATUS_PID_OFFSET, sizeof(pid));
+		memcpy(reg, note->desc + PRSTATUS_REG_OFFSET, sizeof(reg));
+		fprintf(stream, "CPU: %d PID: %d\n", cpu++, pid);
+		name = NULL;
+		if (kallsyms_is_text(&vmcore->kallsyms, reg[PRSTATUS_REG_RIP])) {
+			name = kallsyms_lookup(vmcore, reg[PRSTATUS_REG_RIP],
+			                       &offset, &size);
+		}
+		if (name != NULL) {
+			fprintf(stream, "RIP: %s+0x%lx/0x%lx\n", name, offset, size);
+		}
+		else {
+			fprintf(stream, "RIP: %016lx\n", reg[PRSTATUS_REG_RIP]);
+		}
+		
+		/* Up to end of stack, which is aligned to its size.
+		   Mapped pages are read until the first hole. */
+		rsp = reg[PRSTATUS_REG_RSP] & ~((uint64_t) sizeof(uint64_t) - 1);
+		end = (rsp | (KALLSYMS_STACK_SIZE - 1)) + 1;
+		for (address = rsp; address < end; address += length) {
+			length = KALLSYMS_PAGE_SIZE - (address & (KALLSYMS_PAGE_SIZE - 1));
+			if (length > end - address) {
+				length = end - address;
+			}
+			if (elf_read_load_data(vmcore, address,
+			                       stack + (address - rsp) / sizeof(uint64_t),
+			                       length)) {
+				break;
+			}
+		}
+		words = (address - rsp) / sizeof(uint64_t);
+		
+		frames = 0;
+		for (word = 0; (word < words) && (frames < KALLSYMS_MAX_FRAMES);
+		     word++) {
+			if (! kallsyms_is_text(&vmcore->kallsyms, stack[word])) {
+				continue;
+			}
+			name = kallsyms_lookup(vmcore, stack[word], &offset, &size);
+			if (name == NULL) {
+				continue;
+			}
+			fprintf(stream, " #%-2d [%016lx] ? %s+0x%lx/0x%lx\n", frames++,
+			        rsp + word * sizeof(uint64_t), name, offset, size);
+		}
+		if (words == 0) {
+			fprintf(stream, " (stack not in vmcore)\n");
+		}
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       kallsyms_find_tables() - Locate tables by VMCOREINFO
+         Exported by 6.x kernels only.
+   ============================================================ */
+static int kallsyms_find_tables(VMCore *vmcore, KallsymsTables *tables)
+{
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(tables != NULL);
+	
+	memset(tables, 0x00, sizeof(KallsymsTables));
+	if (elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_names)",
+	                                 &tables->names) ||
+	    elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_num_syms)",
+	                                 &tables->num_syms) ||
+	    elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_token_table)",
+	                                 &tables->token_table) ||
+	    elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_token_index)",
+	                                 &tables->token_index)) {
+		return RETVAL_FAILURE;
+	}
+	if (! elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_offsets)",
+	                                   &tables->offsets)) {
+		return elf_search_vmcoreinfo_number(vmcore,
+		                                    "SYMBOL(kallsyms_relative_base)",
+		                                    &tables->relative_base);
+	}
+	
+	/* Absolute addresses */
+	return elf_search_vmcoreinfo_number(vmcore, "SYMBOL(kallsyms_addresses)",
+	                                    &tables->offsets);
+}
+
+
+/* ============================================================
+       kallsyms_scan_tables() - Locate tables in kernel image
+         Digits are never merged into tokens, so token table
+         holds "0" to "9" in a row. Each hit is checked by the
+         token index, markers and num_syms around it.
+   ============================================================ */
+static int kallsyms_scan_tables(VMCore *vmcore, KallsymsTables *tables)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_scan_tables:";
+	static const char digits[] = "0\0" "1\0" "2\0" "3\0" "4\0"
+	                             "5\0" "6\0" "7\0" "8\0" "9";
+	LoadSegment *load = NULL;
+	char *buffer = NULL;
+	char *hit = NULL;
+	uint64_t position = 0;
+	size_t size = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(tables != NULL);
+	
+	buffer = mem_alloc(KALLSYMS_SCAN_CHUNK);
+	if (buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < vmcore->load_count; loop++) {
+		load = &vmcore->loads[loop];
+		if (load->vaddr < KALLSYMS_KERNEL_MAP) {
+			/* Direct mapping would scan whole memory again */
+			continue;
+		}
+		
+		/* Chunks overlap by signature, not to miss it at boundary */
+		for (position = 0; position + sizeof(digits) <= load->size;
+		     position += KALLSYMS_SCAN_CHUNK - sizeof(digits)) {
+			size = load->size - position;
+			if (size > KALLSYMS_SCAN_CHUNK) {
+				size = KALLSYMS_SCAN_CHUNK;
+			}
+			if (elf_read_load_data(vmcore, load->vaddr + position,
+			                       buffer, size)) {
+				continue;
+			}
+			for (hit = buffer;
+			     (hit = memmem(hit, size - (hit - buffer),
+			                   digits, sizeof(digits))) != NULL;
+			     hit++) {
+				memset(tables, 0x00, sizeof(KallsymsTables));
+				if ((! kallsyms_scan_tokens(vmcore, load, load->vaddr +
+				                            position + (hit - buffer),
+				                            tables)) &&
+				    (! kallsyms_scan_markers(vmcore, load, tables))) {
+					fprintf(stdout, "%s:    * Kallsyms:   Found by scan "
+					        "at 0x%016lx\n", APP_NAME, tables->token_table);
+					mem_free(buffer);
+					return RETVAL_SUCCESS;
+				}
+			}
+			if (size < KALLSYMS_SCAN_CHUNK) {
+				break;
+			}
+		}
+	}
+	mem_free(buffer);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_scan_tokens() - Check token table around digits
+         Walk back to token 0 and forward to the last token,
+         kallsyms_token_index must follow with same offsets.
+   ============================================================ */
+static int kallsyms_scan_tokens(VMCore *vmcore, LoadSegment *load,
+                                uint64_t digits, KallsymsTables *tables)
+{
+	/* --- Variables --- */
+	unsigned char *window = NULL;
+	uint64_t start = 0;
+	uint64_t end = 0;
+	uint64_t token_index = 0;
+	size_t cursor = 0;
+	size_t table = 0;
+	size_t length = 0;
+	uint16_t index[KALLSYMS_TOKEN_COUNT];
+	memset(index, 0x00, sizeof(index));
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(load != NULL);
+	assert(tables != NULL);
+	
+	start = digits - KALLSYMS_DIGIT_TOKEN * KALLSYMS_TOKEN_MAX;
+	if (start < load->vaddr) {
+		start = load->vaddr;
+	}
+	end = digits + KALLSYMS_TOKEN_COUNT * KALLSYMS_TOKEN_MAX +
+	      sizeof(index) + KALLSYMS_ALIGN;
+	if (end > load->vaddr + load->size) {
+		end = load->vaddr + load->size;
+	}
+	window = mem_alloc(end - start);
+	if (window == NULL) {
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, start, window, end - start)) {
+		goto ERROR_FREE;
+	}
+	
+	/* Back to token 0, each token ends with NUL */
+	cursor = digits - start;
+	for (loop = 0; loop < KALLSYMS_DIGIT_TOKEN; loop++) {
+		if ((cursor == 0) || (window[cursor - 1] != 0x00)) {
+			goto ERROR_FREE;
+		}
+		for (cursor--, length = 0;
+		     (cursor > 0) && (window[cursor - 1] != 0x00); cursor--) {
+			if (++length > KALLSYMS_TOKEN_MAX) {
+				goto ERROR_FREE;
+			}
+		}
+	}
+	table = cursor;
+	if ((cursor == 0) || ((start + table) % KALLSYMS_ALIGN)) {
+		goto ERROR_FREE;
+	}
+	
+	/* Offset of every token */
+	for (loop = 0; loop < KALLSYMS_TOKEN_COUNT; loop++) {
+		if (cursor - table > UINT16_MAX) {
+			goto ERROR_FREE;
+		}
+		index[loop] = cursor - table;
+		for (length = 0; (cursor < end - start) && (window[cursor] != 0x00);
+		     cursor++) {
+			if (++length > KALLSYMS_TOKEN_MAX) {
+				goto ERROR_FREE;
+			}
+		}
+		if (cursor++ >= end - start) {
+			goto ERROR_FREE;
+		}
+	}
+	token_index = (start + cursor + KALLSYMS_ALIGN - 1) &
+	              ~((uint64_t) KALLSYMS_ALIGN - 1);
+	if ((token_index + sizeof(index) > end) ||
+	    memcmp(window + (token_index - start), index, sizeof(index))) {
+		goto ERROR_FREE;
+	}
+	tables->token_table = start + table;
+	tables->token_index = token_index;
+	
+	mem_free(window);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(window);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_scan_markers() - Check kallsyms_markers[] before
+                                 token table
+         Name offset of every 256th symbol, from 0 upward.
+         Entry is unsigned int or unsigned long by version,
+         table is padded to 8 bytes.
+   ============================================================ */
+static int kallsyms_scan_markers(VMCore *vmcore, LoadSegment *load,
+                                 KallsymsTables *tables)
+{
+	/* --- Variables --- */
+	static const struct {
+		size_t width;
+		size_t pad;
+	} shapes[] = { { 4, 4 }, { 4, 0 }, { 8, 0 } };
+	unsigned char *window = NULL;
+	uint64_t start = 0;
+	uint64_t value = 0;
+	uint64_t previous = 0;
+	uint64_t last = 0;
+	uint64_t count = 0;
+	size_t size = 0;
+	size_t cursor = 0;
+	uint32_t pad = 0;
+	int found = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(load != NULL);
+	assert(tables != NULL);
+	
+	start = tables->token_table - KALLSYMS_MARKERS_MAX;
+	if (start < load->vaddr) {
+		start = load->vaddr;
+	}
+	size = tables->token_table - start;
+	if (size < KALLSYMS_ALIGN) {
+		return RETVAL_FAILURE;
+	}
+	window = mem_alloc(size);
+	if (window == NULL) {
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, start, window, size)) {
+		mem_free(window);
+		return RETVAL_FAILURE;
+	}
+	
+	for (loop = 0; loop < sizeof(shapes) / sizeof(shapes[0]); loop++) {
+		memcpy(&pad, window + size - sizeof(pad), sizeof(pad));
+		if (shapes[loop].pad && pad) {
+			continue;
+		}
+		
+		/* Backward, strictly decreasing down to 0 */
+		cursor = size - shapes[loop].pad;
+		previous = UINT64_MAX;
+		count = 0;
+		found = 0;
+		while (cursor >= shapes[loop].width) {
+			cursor -= shapes[loop].width;
+			value = 0;
+			memcpy(&value, window + cursor, shapes[loop].width);
+			if ((previous != UINT64_MAX) &&
+			    ((value >= previous) ||
+			     (previous - value < 2 * KALLSYMS_MARKER_STEP) ||
+			     (previous - value > KALLSYMS_TAIL_MAX))) {
+				break;
+			}
+			if (count++ == 0) {
+				last = value;
+			}
+			if (value == 0) {
+				found = 1;
+				break;
+			}
+			previous = value;
+		}
+		if ((! found) || ((start + cursor) % KALLSYMS_ALIGN)) {
+			continue;
+		}
+		if (! kallsyms_scan_names(vmcore, load, tables, start + cursor,
+		                          count, (count > 1) ? previous : 0, last)) {
+			mem_free(window);
+			return RETVAL_SUCCESS;
+		}
+	}
+	mem_free(window);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_scan_names() - Find start of kallsyms_names
+         Names end just before markers. Each candidate start
+         of the last group must reach there, and num_syms just
+         before names must match the number of entries.
+   ============================================================ */
+static int kallsyms_scan_names(VMCore *vmcore, LoadSegment *load,
+                               KallsymsTables *tables, uint64_t markers,
+                               uint64_t count, uint64_t first,
+                               uint64_t last)
+{
+	/* --- Variables --- */
+	unsigned char *window = NULL;
+	unsigned char *head = NULL;
+	uint64_t start = 0;
+	uint64_t tail = 0;
+	uint64_t names = 0;
+	uint32_t num_syms = 0;
+	size_t entries = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(load != NULL);
+	assert(tables != NULL);
+	
+	/* Last group with every possible length */
+	start = load->vaddr + last + KALLSYMS_ALIGN;
+	if (markers < start + 2) {
+		return RETVAL_FAILURE;
+	}
+	if (markers - start > KALLSYMS_TAIL_MAX) {
+		start = markers - KALLSYMS_TAIL_MAX;
+	}
+	window = mem_alloc(markers - start);
+	if (window == NULL) {
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, start, window, markers - start)) {
+		mem_free(window);
+		return RETVAL_FAILURE;
+	}
+	
+	/* names is aligned, so is tail - last */
+	for (tail = markers - KALLSYMS_ALIGN + (last % KALLSYMS_ALIGN);
+	     tail >= start; tail -= KALLSYMS_ALIGN) {
+		if (kallsyms_skip_names(window + (tail - start), markers - tail,
+		                        markers - tail - KALLSYMS_ALIGN,
+		                        KALLSYMS_MARKER_STEP, &entries)) {
+			continue;
+		}
+		names = tail - last;
+		if (elf_read_load_uint32(vmcore, names - KALLSYMS_ALIGN, &num_syms) ||
+		    (num_syms != (count - 1) * KALLSYMS_MARKER_STEP + entries)) {
+			continue;
+		}
+		
+		/* First group must end at second marker */
+		if (count > 1) {
+			head = mem_alloc(first);
+			if ((head == NULL) ||
+			    elf_read_load_data(vmcore, names, head, first) ||
+			    kallsyms_skip_names(head, first, first - 1,
+			                        KALLSYMS_MARKER_STEP, &entries) ||
+			    (entries != KALLSYMS_MARKER_STEP)) {
+				mem_free(head);
+				head = NULL;
+				continue;
+			}
+			mem_free(head);
+			head = NULL;
+		}
+		tables->names = names;
+		tables->num_syms = names - KALLSYMS_ALIGN;
+		tables->scanned = 1;
+		mem_free(window);
+		return RETVAL_SUCCESS;
+	}
+	mem_free(window);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_skip_names() - Skip up to count names entries
+         Success if skipping ends beyond limit and within size,
+         number of entries skipped is returned.
+   ============================================================ */
+static int kallsyms_skip_names(unsigned char *data, size_t size,
+                               size_t limit, int count, size_t *ret)
+{
+	/* --- Variables --- */
+	size_t cursor = 0;
+	size_t entry = 0;
+	
+	*ret = 0;
+	while ((cursor <= limit) && (*ret < count)) {
+		if (cursor + 2 > size) {
+			return RETVAL_FAILURE;
+		}
+		entry = data[cursor++];
+		if (entry & 0x80) {
+			entry = (entry & 0x7f) | (data[cursor++] << 7);
+		}
+		if ((entry == 0) || (entry > size - cursor)) {
+			return RETVAL_FAILURE;
+		}
+		cursor += entry;
+		(*ret)++;
+	}
+	return ((cursor > limit) && (cursor <= size)) ?
+	       RETVAL_SUCCESS : RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_scan_addresses() - Read addresses of scanned tables
+         kallsyms_offsets[] and kallsyms_relative_base come
+         before kallsyms_num_syms (4.6 - 6.3) or after token
+         index (6.4 -), kallsyms_addresses[] before it if not
+         relative. Symbols are sorted by address, wrong guess
+         is not.
+   ============================================================ */
+static int kallsyms_scan_addresses(VMCore *vmcore, Kallsyms *kallsyms,
+                                   KallsymsTables *tables)
+{
+	/* --- Variables --- */
+	uint64_t offsets_size = 0;
+	uint64_t candidates[3][2];
+	memset(candidates, 0x00, sizeof(candidates));
+	int index = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(kallsyms != NULL);
+	assert(tables != NULL);
+	
+	offsets_size = (sizeof(int32_t) * kallsyms->count + KALLSYMS_ALIGN - 1) &
+	               ~((uint64_t) KALLSYMS_ALIGN - 1);
+	candidates[0][1] = tables->num_syms - KALLSYMS_ALIGN;
+	candidates[0][0] = candidates[0][1] - offsets_size;
+	candidates[1][0] = tables->num_syms -
+	                   sizeof(uint64_t) * kallsyms->count;
+	candidates[1][1] = 0;
+	candidates[2][0] = tables->token_index +
+	                   sizeof(uint16_t) * KALLSYMS_TOKEN_COUNT;
+	candidates[2][1] = candidates[2][0] + offsets_size;
+	
+	for (loop = 0; loop < sizeof(candidates) / sizeof(candidates[0]);
+	     loop++) {
+		tables->offsets = candidates[loop][0];
+		tables->relative_base = candidates[loop][1];
+		if (kallsyms_read_addresses(vmcore, kallsyms, tables)) {
+			continue;
+		}
+		for (index = 1; index < kallsyms->count; index++) {
+			if (kallsyms->symbols[index].address <
+			    kallsyms->symbols[index - 1].address) {
+				break;
+			}
+		}
+		if ((index == kallsyms->count) &&
+		    (kallsyms->symbols[index - 1].address >= KALLSYMS_KERNEL_MAP)) {
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_read_tokens() - Read token table and index
+   ============================================================ */
+static int kallsyms_read_tokens(VMCore *vmcore, KallsymsTables *tables,
+                                char* *table, size_t *table_size,
+                                uint16_t *index)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_read_tokens:";
+	size_t size = 0;
+	int loop = 0;
+	
+	if (elf_read_load_data(vmcore, tables->token_index, index,
+	                       sizeof(uint16_t) * KALLSYMS_TOKEN_COUNT)) {
+		fprintf(stderr, "%s Can not read kallsyms_token_index.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Table ends with last token, terminated here if too long */
+	for (loop = 0; loop < KALLSYMS_TOKEN_COUNT; loop++) {
+		if (index[loop] + KALLSYMS_TOKEN_MAX > size) {
+			size = index[loop] + KALLSYMS_TOKEN_MAX;
+		}
+	}
+	*table = mem_alloc(size + 1);
+	if (*table == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, tables->token_table, *table, size)) {
+		fprintf(stderr, "%s Can not read kallsyms_token_table.\n", estr);
+		mem_free(*table);
+		*table = NULL;
+		return RETVAL_FAILURE;
+	}
+	(*table)[size] = 0x00;
+	*table_size = size;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       kallsyms_read_names() - Expand kallsyms_names
+         Entry is length and token numbers, length is 2 bytes
+         if bit 7 is set (6.1 -). First letter is symbol type.
+   ============================================================ */
+static int kallsyms_read_names(VMCore *vmcore, Kallsyms *kallsyms,
+                               uint64_t names, char *table,
+                               size_t table_size, uint16_t *index)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_read_names:";
+	unsigned char *window = NULL;
+	size_t fill = 0;
+	size_t cursor = 0;
+	size_t size = 0;
+	size_t entry = 0;
+	size_t length = 0;
+	char name[KSYM_NAME_LEN + 1];
+	memset(name, 0x00, sizeof(name));
+	char *token = NULL;
+	int loop = 0;
+	
+	window = mem_alloc(KALLSYMS_WINDOW);
+	if (window == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < kallsyms->count; loop++) {
+		/* Refill window, names end is unknown so shrink on failure */
+		if (fill - cursor < 2 + KALLSYMS_ENTRY_MAX) {
+			memmove(window, window + cursor, fill - cursor);
+			fill -= cursor;
+			cursor = 0;
+			for (size = KALLSYMS_WINDOW - fill;
+			     (size >= KALLSYMS_MIN_READ) &&
+			     elf_read_load_data(vmcore, names, window + fill, size);
+			     size /= 2) {
+				/* shrink */
+			}
+			if (size >= KALLSYMS_MIN_READ) {
+				names += size;
+				fill += size;
+			}
+		}
+		if (fill - cursor < 2) {
+			break;
+		}
+		
+		entry = window[cursor++];
+		if (entry & 0x80) {
+			entry = (entry & 0x7f) | (window[cursor++] << 7);
+		}
+		if ((entry == 0) || (entry > KALLSYMS_ENTRY_MAX) ||
+		    (entry > fill - cursor)) {
+			break;
+		}
+		
+		/* Expand tokens */
+		length = 0;
+		for (; entry > 0; entry--, cursor++) {
+			for (token = table + index[window[cursor]];
+			     (*token != 0x00) && (token < table + table_size) &&
+			     (length < KSYM_NAME_LEN); token++) {
+				name[length++] = *token;
+			}
+		}
+		if (length < 2) {
+			break;
+		}
+		kallsyms->symbols[loop].type = name[0];
+		kallsyms->symbols[loop].name = kallsyms->names_size;
+		if (kallsyms_add_name(kallsyms, name + 1, length - 1)) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			mem_free(window);
+			return RETVAL_FAILURE;
+		}
+	}
+	mem_free(window);
+	
+	if (loop < kallsyms->count) {
+		fprintf(stderr, "%s Broken entry %d of %d.\n",
+		        estr, loop, kallsyms->count);
+		return RETVAL_FAILURE;
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       kallsyms_add_name() - Append name to string pool
+   ============================================================ */
+static int kallsyms_add_name(Kallsyms *kallsyms, char *name, size_t length)
+{
+	/* --- Variables --- */
+	char *names = NULL;
+	size_t capacity = 0;
+	
+	if (kallsyms->names_size + length + 1 > kallsyms->names_capacity) {
+		capacity = kallsyms->names_capacity ?
+		           kallsyms->names_capacity * 2 : KALLSYMS_WINDOW;
+		while (capacity < kallsyms->names_size + length + 1) {
+			capacity *= 2;
+		}
+		names = mem_realloc(kallsyms->names, capacity);
+		if (names == NULL) {
+			return RETVAL_FAILURE;
+		}
+		kallsyms->names = names;
+		kallsyms->names_capacity = capacity;
+	}
+	memcpy(kallsyms->names + kallsyms->names_size, name, length);
+	kallsyms->names[kallsyms->names_size + length] = 0x00;
+	kallsyms->names_size += length + 1;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       kallsyms_read_addresses() - Read address of each symbol
+         kallsyms_offsets[] relative to kallsyms_relative_base
+         (4.6 -) or kallsyms_addresses[].
+   ============================================================ */
+static int kallsyms_read_addresses(VMCore *vmcore, Kallsyms *kallsyms,
+                                   KallsymsTables *tables)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] kallsyms_read_addresses:";
+	uint64_t base = 0;
+	uint64_t *addresses = NULL;
+	int32_t *values = NULL;
+	int absolute_percpu = 0;
+	int loop = 0;
+	
+	if (tables->relative_base == 0) {
+		/* Absolute addresses */
+		addresses = mem_alloc(sizeof(uint64_t) * kallsyms->count);
+		if (addresses == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		if (elf_read_load_data(vmcore, tables->offsets, addresses,
+		                       sizeof(uint64_t) * kallsyms->count)) {
+			fprintf(stderr, "%s Can not read kallsyms_addresses.\n", estr);
+			mem_free(addresses);
+			return RETVAL_FAILURE;
+		}
+		for (loop = 0; loop < kallsyms->count; loop++) {
+			kallsyms->symbols[loop].address = addresses[loop];
+		}
+		mem_free(addresses);
+		return RETVAL_SUCCESS;
+	}
+	
+	if (elf_read_load_uint64(vmcore, tables->relative_base, &base)) {
+		fprintf(stderr, "%s Can not read kallsyms_relative_base.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	values = mem_alloc(sizeof(int32_t) * kallsyms->count);
+	if (values == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, tables->offsets, values,
+	                       sizeof(int32_t) * kallsyms->count)) {
+		fprintf(stderr, "%s Can not read kallsyms_offsets.\n", estr);
+		mem_free(values);
+		return RETVAL_FAILURE;
+	}
+	
+	/* With KALLSYMS_ABSOLUTE_PERCPU, negative means base - 1 - value
+	   and positive is absolute. Otherwise all are unsigned. */
+	for (loop = 0; loop < kallsyms->count; loop++) {
+		if (values[loop] < 0) {
+			absolute_percpu = 1;
+			break;
+		}
+	}
+	for (loop = 0; loop < kallsyms->count; loop++) {
+		if (! absolute_percpu) {
+			kallsyms->symbols[loop].address = base + (uint32_t) values[loop];
+		}
+		else if (values[loop] >= 0) {
+			kallsyms->symbols[loop].address = values[loop];
+		}
+		else {
+			kallsyms->symbols[loop].address = base - 1 - values[loop];
+		}
+	}
+	mem_free(values);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       kallsyms_compare() - qsort() compare by address
+   ============================================================ */
+static int kallsyms_compare(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const KallsymsEntry *x = a;
+	const KallsymsEntry *y = b;
+	
+	if (x->address != y->address) {
+		return (x->address < y->address) ? -1 : 1;
+	}
+	return (x->name < y->name) ? -1 : (x->name > y->name);
+}
+
+
+/* ============================================================
+       kallsyms_find_name() - Search address by name
+   ============================================================ */
+static int kallsyms_find_name(Kallsyms *kallsyms, char *name, uint64_t *ret)
+{
+	/* --- Variables --- */
+	int loop = 0;
+	
+	for (loop = 0; loop < kallsyms->count; loop++) {
+		if (! strcmp(kallsyms->names + kallsyms->symbols[loop].name, name)) {
+			*ret = kallsyms->symbols[loop].address;
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       kallsyms_is_text() - Check address is in kernel text
+   ============================================================ */
+static int kallsyms_is_text(Kallsyms *kallsyms, uint64_t address)
+{
+	/* --- Variables --- */
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	
+	if (kallsyms->text_end > kallsyms->text_start) {
+		return (address >= kallsyms->text_start) &&
+		       (address < kallsyms->text_end);
+	}
+	
+	/* No _stext/_etext, type of containing symbol */
+	low = 0;
+	high = kallsyms->count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (kallsyms->symbols[middle].address <= address) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return (low > 0) && (kallsyms->symbols[low - 1].type != 0x00) &&
+	       (strchr("tTwW", kallsyms->symbols[low - 1].type) != NULL);
+}
+
+
+/* ====================================================================== */
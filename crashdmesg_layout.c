@@ -0,0 +1,319 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_layout.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Layout of "struct printk_log" (also "struct log" in 3.5 - 3.10) ---
+   See:kernel/printk/printk.c */
+#define LAYOUT_PRINTK_LOG           \
+	    .printk_log_size     = 16,  \
+	    .printk_log_ts_nsec  = 0,   \
+	    .printk_log_len      = 8,   \
+	    .printk_log_text_len = 10,  \
+	    .printk_log_dict_len = 12,  \
+	    .printk_log_facility = 14,  \
+	    .printk_log_flags    = 15
+
+/* --- Plain text log_buf, no record structure --- */
+#define LAYOUT_LEGACY                        \
+	    .printk_log_size     = LAYOUT_NONE,  \
+	    .printk_log_ts_nsec  = LAYOUT_NONE,  \
+	    .printk_log_len      = LAYOUT_NONE,  \
+	    .printk_log_text_len = LAYOUT_NONE,  \
+	    .printk_log_dict_len = LAYOUT_NONE,  \
+	    .printk_log_facility = LAYOUT_NONE,  \
+	    .printk_log_flags    = LAYOUT_NONE
+
+/* --- Layout of "struct module", See:include/linux/module.h ---
+   state, list and name lead the structure in every kernel.
+   The rest depends on config, only VMCOREINFO knows it. */
+#define LAYOUT_MODULE                        \
+	    .module_size         = LAYOUT_NONE,  \
+	    .module_list         = 8,            \
+	    .module_name         = 24,           \
+	    .module_core         = LAYOUT_NONE,  \
+	    .module_core_size    = LAYOUT_NONE,  \
+	    .module_taints       = LAYOUT_NONE
+
+/* --- Layout of "struct task_struct" and "struct rq" ---
+   Depends on config, no default. Profile of a known build
+   may give them, VMCOREINFO overrides. */
+#define LAYOUT_TASK                          \
+	    .task_tasks          = LAYOUT_NONE,  \
+	    .task_pid            = LAYOUT_NONE,  \
+	    .task_comm           = LAYOUT_NONE,  \
+	    .task_state          = LAYOUT_NONE,  \
+	    .task_exit_state     = LAYOUT_NONE,  \
+	    .task_thread_group   = LAYOUT_NONE,  \
+	    .rq_curr             = LAYOUT_NONE
+
+/* --- Layout of "struct printk_safe_seq_buf" (4.11 - 5.14) ---
+   See:kernel/printk/printk_safe.c, buffer follows struct irq_work.
+   Size is for the default CONFIG_PRINTK_SAFE_LOG_BUF_SHIFT=13. */
+#define LAYOUT_SAFE                          \
+	    .printk_safe_size    = 8192,         \
+	    .printk_safe_len     = 0,            \
+	    .printk_safe_lost    = 4,            \
+	    .printk_safe_buffer  = 32
+
+/* --- No per-CPU printk buffers --- */
+#define LAYOUT_SAFE_NONE                     \
+	    .printk_safe_size    = LAYOUT_NONE,  \
+	    .printk_safe_len     = LAYOUT_NONE,  \
+	    .printk_safe_lost    = LAYOUT_NONE,  \
+	    .printk_safe_buffer  = LAYOUT_NONE
+
+/* --- Layout profiles ---
+   Searched from the top, first match of OSRELEASE wins.
+   Values are defaults, VMCOREINFO overrides them when present. */
+static const LayoutProfile layout_profiles[] = {
+	{ "2.6.*",     "legacy-2.6",      { LAYOUT_LEGACY, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE_NONE } },
+	{ "3.[0-4].*", "legacy-3.0",      { LAYOUT_LEGACY, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE_NONE } },
+	{ "3.[5-9].*", "log-3.5",         { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE_NONE } },
+	{ "3.10.*",    "log-3.10",        { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE_NONE } },
+	{ "4.1[1-9].*", "safe-4.11",      { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE } },
+	{ "4.20.*",    "safe-4.20",       { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE } },
+	{ "5.[0-9].*", "safe-5.0",        { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE } },
+	{ "5.1[0-4].*", "safe-5.10",      { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE } },
+	{ "*",         "printk_log",      { LAYOUT_PRINTK_LOG, LAYOUT_MODULE,
+	                                    LAYOUT_TASK, LAYOUT_SAFE_NONE } },
+};
+
+/* --- VMCOREINFO keys which override profile values ---
+   Kernel 3.5 - 3.10 exports "log" instead of "printk_log",
+   kernel 5.14 - renamed task_struct.state to __state.
+   old_key is NULL if the member has no other name. */
+static const struct {
+	char *key;
+	char *old_key;
+	size_t member; /* offsetof(Layout, ...) */
+} layout_keys[] = {
+	{ "SIZE(printk_log)", "SIZE(log)",
+	  offsetof(Layout, printk_log_size) },
+	{ "OFFSET(printk_log.ts_nsec)", "OFFSET(log.ts_nsec)",
+	  offsetof(Layout, printk_log_ts_nsec) },
+	{ "OFFSET(printk_log.len)", "OFFSET(log.len)",
+	  offsetof(Layout, printk_log_len) },
+	{ "OFFSET(printk_log.text_len)", "OFFSET(log.text_len)",
+	  offsetof(Layout, printk_log_text_len) },
+	{ "OFFSET(printk_log.dict_len)", "OFFSET(log.dict_len)",
+	  offsetof(Layout, printk_log_dict_len) },
+	{ "SIZE(module)", NULL,
+	  offsetof(Layout, module_size) },
+	{ "OFFSET(module.list)", NULL,
+	  offsetof(Layout, module_list) },
+	{ "OFFSET(module.name)", NULL,
+	  offsetof(Layout, module_name) },
+	{ "OFFSET(module.module_core)", NULL,
+	  offsetof(Layout, module_core) },
+	{ "OFFSET(module.core_size)", NULL,
+	  offsetof(Layout, module_core_size) },
+	{ "OFFSET(module.taints)", NULL,
+	  offsetof(Layout, module_taints) },
+	{ "OFFSET(task_struct.tasks)", NULL,
+	  offsetof(Layout, task_tasks) },
+	{ "OFFSET(task_struct.pid)", NULL,
+	  offsetof(Layout, task_pid) },
+	{ "OFFSET(task_struct.comm)", NULL,
+	  offsetof(Layout, task_comm) },
+	{ "OFFSET(task_struct.__state)", "OFFSET(task_struct.state)",
+	  offsetof(Layout, task_state) },
+	{ "OFFSET(task_struct.exit_state)", NULL,
+	  offsetof(Layout, task_exit_state) },
+	{ "OFFSET(task_struct.thread_group)", NULL,
+	  offsetof(Layout, task_thread_group) },
+	{ "OFFSET(rq.curr)", NULL,
+	  offsetof(Layout, rq_curr) },
+	{ "SIZE(printk_safe_seq_buf)", NULL,
+	  offsetof(Layout, printk_safe_size) },
+	{ "OFFSET(printk_safe_seq_buf.len)", NULL,
+	  offsetof(Layout, printk_safe_len) },
+	{ "OFFSET(printk_safe_seq_buf.message_lost)", NULL,
+	  offsetof(Layout, printk_safe_lost) },
+	{ "OFFSET(printk_safe_seq_buf.buffer)", NULL,
+	  offsetof(Layout, printk_safe_buffer) },
+};
+
+/* --- Members which must lie within their structure ---
+   Checked after override, skipped if either value is unknown. */
+static const struct {
+	char *name;
+	size_t member; /* offsetof(Layout, ...) */
+	size_t width; /* Bytes read at member */
+	size_t size; /* offsetof(Layout, ...) of structure size */
+} layout_fields[] = {
+	{ "printk_log.ts_nsec", offsetof(Layout, printk_log_ts_nsec),
+	  sizeof(uint64_t), offsetof(Layout, printk_log_size) },
+	{ "printk_log.len", offsetof(Layout, printk_log_len),
+	  sizeof(uint16_t), offsetof(Layout, printk_log_size) },
+	{ "printk_log.text_len", offsetof(Layout, printk_log_text_len),
+	  sizeof(uint16_t), offsetof(Layout, printk_log_size) },
+	{ "printk_log.dict_len", offsetof(Layout, printk_log_dict_len),
+	  sizeof(uint16_t), offsetof(Layout, printk_log_size) },
+	{ "printk_log.facility", offsetof(Layout, printk_log_facility),
+	  sizeof(uint8_t), offsetof(Layout, printk_log_size) },
+	{ "printk_log.flags", offsetof(Layout, printk_log_flags),
+	  sizeof(uint8_t), offsetof(Layout, printk_log_size) },
+	{ "module.list", offsetof(Layout, module_list),
+	  2 * sizeof(uint64_t), offsetof(Layout, module_size) },
+	{ "module.name", offsetof(Layout, module_name),
+	  MODULE_NAME_LEN, offsetof(Layout, module_size) },
+	{ "module.module_core", offsetof(Layout, module_core),
+	  sizeof(uint64_t), offsetof(Layout, module_size) },
+	{ "module.core_size", offsetof(Layout, module_core_size),
+	  sizeof(uint32_t), offsetof(Layout, module_size) },
+	{ "module.taints", offsetof(Layout, module_taints),
+	  sizeof(uint64_t), offsetof(Layout, module_size) },
+	{ "printk_safe_seq_buf.len", offsetof(Layout, printk_safe_len),
+	  sizeof(int32_t), offsetof(Layout, printk_safe_size) },
+	{ "printk_safe_seq_buf.message_lost", offsetof(Layout, printk_safe_lost),
+	  sizeof(int32_t), offsetof(Layout, printk_safe_size) },
+	{ "printk_safe_seq_buf.buffer", offsetof(Layout, printk_safe_buffer),
+	  sizeof(char), offsetof(Layout, printk_safe_size) },
+};
+
+/* --- VMCOREINFO keys of module core area { void *base; uint size; } ---
+   "core_layout" in 4.5 - 6.3, "mem" (mem[MOD_TEXT] first) in 6.4 -. */
+static char *layout_module_core_keys[] = {
+	"OFFSET(module.core_layout)",
+	"OFFSET(module.mem)",
+};
+
+
+/* ============================================================
+       layout_setup() - Select profile and Build access plan
+   ============================================================ */
+int layout_setup(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] layout_setup:";
+	LayoutPlan *plan = NULL;
+	uint64_t value = 0;
+	uint32_t *member = NULL;
+	uint32_t offset = 0;
+	uint32_t size = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(vmcore->osrelease[0] != 0x00);
+	
+	plan = &vmcore->plan;
+	memset(plan, 0x00, sizeof(LayoutPlan));
+	
+	/* Select profile by OSRELEASE */
+	for (loop = 0; loop < sizeof(layout_profiles) / sizeof(LayoutProfile);
+	     loop++) {
+		if (! fnmatch(layout_profiles[loop].pattern, vmcore->osrelease, 0)) {
+			plan->profile = &layout_profiles[loop];
+			break;
+		}
+	}
+	if (plan->profile == NULL) {
+		fprintf(stderr, "%s No layout profile for \"%s\".\n",
+		        estr, vmcore->osrelease);
+		return RETVAL_FAILURE;
+	}
+	memcpy(&plan->layout, &plan->profile->layout, sizeof(Layout));
+	
+	/* Override by VMCOREINFO */
+	for (loop = 0; loop < sizeof(layout_keys) / sizeof(layout_keys[0]);
+	     loop++) {
+		if (elf_search_vmcoreinfo_number(vmcore,
+		                                 layout_keys[loop].key, &value) &&
+		    ((layout_keys[loop].old_key == NULL) ||
+		     elf_search_vmcoreinfo_number(vmcore,
+		                                  layout_keys[loop].old_key,
+		                                  &value))) {
+			/* Not in VMCOREINFO, keep profile value */
+			continue;
+		}
+		if (value >= LAYOUT_NONE) {
+			fprintf(stderr, "%s Invalid value: %s=%lu\n",
+			        estr, layout_keys[loop].key, value);
+			return RETVAL_FAILURE;
+		}
+		member = (uint32_t*) ((char*) &plan->layout +
+		                      layout_keys[loop].member);
+		*member = (uint32_t) value;
+		plan->overrides++;
+	}
+	
+	/* Module core area of newer kernels, size follows base pointer */
+	for (loop = 0; loop < sizeof(layout_module_core_keys) / sizeof(char*);
+	     loop++) {
+		if (elf_search_vmcoreinfo_number(vmcore,
+		                                 layout_module_core_keys[loop],
+		                                 &value)) {
+			continue;
+		}
+		if (value >= LAYOUT_NONE - sizeof(uint64_t)) {
+			fprintf(stderr, "%s Invalid value: %s=%lu\n",
+			        estr, layout_module_core_keys[loop], value);
+			return RETVAL_FAILURE;
+		}
+		plan->layout.module_core = (uint32_t) value;
+		plan->layout.module_core_size = (uint32_t) value + sizeof(uint64_t);
+		plan->overrides++;
+		break;
+	}
+	
+	/* Override must not move a member out of its structure */
+	for (loop = 0; loop < sizeof(layout_fields) / sizeof(layout_fields[0]);
+	     loop++) {
+		memcpy(&offset, (char*) &plan->layout + layout_fields[loop].member,
+		       sizeof(offset));
+		memcpy(&size, (char*) &plan->layout + layout_fields[loop].size,
+		       sizeof(size));
+		if ((offset == LAYOUT_NONE) || (size == LAYOUT_NONE)) {
+			continue;
+		}
+		if ((uint64_t) offset + layout_fields[loop].width > size) {
+			fprintf(stderr, "%s %s=%u is out of %u bytes structure.\n",
+			        estr, layout_fields[loop].name, offset, size);
+			return RETVAL_FAILURE;
+		}
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+
+/* ============================================================
+       layout_setup_default() - Use catch-all profile
+         For vmcore without VMCOREINFO, nothing to override.
+   ============================================================ */
+int layout_setup_default(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	LayoutPlan *plan = NULL;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	plan = &vmcore->plan;
+	memset(plan, 0x00, sizeof(LayoutPlan));
+	plan->profile = &layout_profiles[sizeof(layout_profiles) /
+	                                 sizeof(LayoutProfile) - 1];
+	memcpy(&plan->layout, &plan->profile->layout, sizeof(Layout));
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ====================================================================== */
@@ -7,12 +7,40 @@
 
 /* --- Include header files --- */
 #include "crashdmesg_common.h"
+#include <signal.h>
+
+
+/* --- Constant values --- */
+#define NEWEST_WINDOW (PRINTK_MIN_WINDOW / 2) /* Ring bytes per window */
+#define DEADLINE_MARKER \
+	"<<<<<<<<<<[ TRUNCATED at deadline ]<<<<<<<<<<<<<<<<<<<<\n"
+
+
+/* --- Data structures --- */
+
+/* Position of one record, for newest first order */
+typedef struct {
+	size_t cursor; /* Ring.cursor before the record */
+} RecordIndex;
 
 
 /* --- Prototypes --- */
 static void print_usage(void);
-static int parse_option(int argc, char *argv[], File *file);
-static int crashdmesg(VMCore *vmcore);
+static int parse_option(int argc, char *argv[], Option *option);
+static int parse_size(char *arg, size_t unit, size_t *ret);
+static int crashdmesg_file(Option *option, char *filename);
+static int crashdmesg(VMCore *vmcore, Option *option);
+static int crashdmesg_newest_first(VMCore *vmcore, Ring *ring,
+                                   SafeLog *safe, Option *option,
+                                   FILE *stream);
+static void crashdmesg_print_newest(VMCore *vmcore, Option *option,
+                                    FILE *stream, Record *record);
+static void deadline_signal(int signum);
+static int deadline_check(void);
+
+
+/* --- Variables --- */
+static volatile sig_atomic_t deadline_reached = 0;
 
 
 /* ============================================================
@@ -22,26 +50,95 @@ int main(int argc, char *argv[])
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] main:";
-	VMCore vmcore;
-	memset(&vmcore, 0x00, sizeof(VMCore));
+	int retval = RETVAL_SUCCESS;
+	int loop = 0;
+	Search search;
+	memset(&search, 0x00, sizeof(Search));
+	Option option;
+	memset(&option, 0x00, sizeof(Option));
+	struct sigaction action;
+	memset(&action, 0x00, sizeof(struct sigaction));
+	option.cache_limit = CACHE_DEFAULT_LIMIT;
+	option.watch_workers = WATCH_DEFAULT_WORKERS;
+	option.sync_interval = SINK_SYNC_DEFAULT * 1024;
 	
 	fprintf(stdout, "%s:  %s start.\n", APP_NAME, APP_NAME);
 	
 	/* Check args */
-	if (parse_option(argc, argv, &vmcore.file)) {
+	if (parse_option(argc, argv, &option)) {
 		fprintf(stderr, "%s Invalid option.\n", estr);
 		print_usage();
 		return RETVAL_FAILURE;
 	}
-	fprintf(stdout, "%s:   Target file: %s\n", APP_NAME, vmcore.file.filename);
 	
-	/* Do crashdmesg */
-	if (crashdmesg(&vmcore)) {
-		fprintf(stderr, "%s Dump Failed.\n", estr);
+	/* Time budget from now, no SA_RESTART to stop waiting reads */
+	if (option.time_budget) {
+		action.sa_handler = deadline_signal;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGALRM, &action, NULL);
+		alarm(option.time_budget);
+		fprintf(stdout, "%s:   Deadline: %u sec\n",
+		        APP_NAME, option.time_budget);
+	}
+	
+	/* Preallocate arena, every allocation is made from it */
+	if (mem_setup(option.memory_limit)) {
+		fprintf(stderr, "%s Can not setup memory.\n", estr);
 		return RETVAL_FAILURE;
 	}
 	
-	return RETVAL_SUCCESS;
+	/* Compile patterns once for all vmcores */
+	if (option.pattern_file) {
+		if (search_compile(&search, option.pattern_file)) {
+			fprintf(stderr, "%s Invalid pattern file.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		option.search = &search;
+		fprintf(stdout, "%s:   Patterns: %d (%d states)\n",
+		        APP_NAME, search.pattern_count, search.state_count);
+	}
+	
+	/* Query store, no vmcore is read */
+	if (option.query_dir) {
+		if (store_query(option.query_dir, option.query_terms,
+		                option.query_count, stdout)) {
+			fprintf(stderr, "%s Query Failed.\n", estr);
+			retval = RETVAL_FAILURE;
+		}
+	}
+	/* Watch directories, dump each new vmcore */
+	else if (option.watch_count) {
+		if (watch_run(&option, crashdmesg_file)) {
+			fprintf(stderr, "%s Watch Failed.\n", estr);
+			retval = RETVAL_FAILURE;
+		}
+	}
+	else if (option.split_count) {
+		if (crashdmesg_file(&option, option.filename)) {
+			fprintf(stderr, "%s Dump Failed.\n", estr);
+			retval = RETVAL_FAILURE;
+		}
+	}
+	else {
+		/* Do crashdmesg, continue with next vmcore on failure */
+		for (loop = 0; (loop < option.file_count) && (! deadline_reached);
+		     loop++) {
+			if (crashdmesg_file(&option, option.files[loop])) {
+				fprintf(stderr, "%s Dump Failed: %s\n",
+				        estr, option.files[loop]);
+				retval = RETVAL_FAILURE;
+			}
+		}
+	}
+	
+	if (option.search) {
+		fprintf(stdout, "%s:   Matched: %lu/%lu records\n", APP_NAME,
+		        search.matches, search.records);
+		search_free(&search);
+	}
+	mem_print_usage(stdout);
+	
+	return retval;
 }
 
 
@@ -51,8 +148,73 @@ int main(int argc, char *argv[])
 static void print_usage(void)
 {
 	fprintf(stdout, "%s (%s) - %s\n\n", APP_NAME, APP_FULLNAME, APP_VERSION);
-	fprintf(stdout, "Usage:  %s [vmcore]\n", APP_NAME);
-	fprintf(stdout, " vmcore        VMCore file to dump. [/proc/vmcore]\n");
+	fprintf(stdout, "Usage:  %s [-r] [-b] [-m] [-T] [-N] [-R] [-t sec] "
+	        "[-c KB] [-M MB]\n", APP_NAME);
+	fprintf(stdout, "                   [-p file] [-A dir] [vmcore ...]\n");
+	fprintf(stdout, "        %s [-r] [-b] [-m] [-T] [-N] [-R] [-t sec] "
+	        "[-c KB] [-M MB]\n", APP_NAME);
+	fprintf(stdout, "                   [-p file] [-A dir] -o file [-y KB] "
+	        "[vmcore]\n");
+	fprintf(stdout, "        %s [-r] [-b] [-m] [-T] [-N] [-R] [-c KB] "
+	        "[-M MB]\n", APP_NAME);
+	fprintf(stdout, "                   [-p file] [-A dir] -O output ... "
+	        "[-y KB] [vmcore]\n");
+	fprintf(stdout, "        %s [-r] [-c KB] -s vmcore1 vmcore2 ...\n",
+	        APP_NAME);
+	fprintf(stdout, "        %s [-r] [-c KB] [-j num] [-S file] -w dir ...\n",
+	        APP_NAME);
+	fprintf(stdout, "        %s [-r] [-t sec] [-p file] [-A dir] [-C file] "
+	        "-\n", APP_NAME);
+	fprintf(stdout, "        %s [-t sec] [-p file] [-o file] -P [-Z addr:size] "
+	        "[vmcore ...]\n", APP_NAME);
+	fprintf(stdout, "        %s -Q dir [key=value ...]\n", APP_NAME);
+	fprintf(stdout, " -r            Print registers of each CPU.\n");
+	fprintf(stdout, " -b            Print backtrace of each CPU by kallsyms\n");
+	fprintf(stdout, "               in vmcore.\n");
+	fprintf(stdout, " -m            Print loaded kernel modules.\n");
+	fprintf(stdout, " -T            Print tasks, running CPU and state.\n");
+	fprintf(stdout, " -N            Add lines of per-CPU printk_safe/NMI\n");
+	fprintf(stdout, "               buffers after ring, count records\n");
+	fprintf(stdout, "               not printed to console.\n");
+	fprintf(stdout, " -R            Recover log by scanning memory, without\n");
+	fprintf(stdout, "               VMCOREINFO. Non-ELF file is raw memory.\n");
+	fprintf(stdout, " -P            Read pstore/ramoops zones of previous\n");
+	fprintf(stdout, "               boot from directory (/sys/fs/pstore),\n");
+	fprintf(stdout, "               vmcore memory or raw ramoops memory.\n");
+	fprintf(stdout, " -Z addr:size  Physical range of ramoops zones. [All]\n");
+	fprintf(stdout, " -t sec        Time budget, newest records first, stop\n");
+	fprintf(stdout, "               with a truncation marker at deadline.\n");
+	fprintf(stdout, " -c KB         Read cache size, 0 to disable. [%d]\n",
+	        CACHE_DEFAULT_LIMIT / 1024);
+	fprintf(stdout, " -M MB         Hard limit of memory usage, 0 for none. [0]\n");
+	fprintf(stdout, " -o file       Write records to file with O_DIRECT.\n");
+	fprintf(stdout, " -O output     Write records to output by own thread,\n");
+	fprintf(stdout, "               file:path, console:device or\n");
+	fprintf(stdout, "               syslog[:socket], then options\n");
+	fprintf(stdout, "               ,format=dmesg|plain|syslog ,level=N\n");
+	fprintf(stdout, "               ,pattern=file ,block ,drop (Repeatable)\n");
+	fprintf(stdout, " -y KB         fdatasync interval of -o, 0 at end. [%d]\n",
+	        SINK_SYNC_DEFAULT);
+	fprintf(stdout, " -s            Files are parts of one split dump.\n");
+	fprintf(stdout, " -w dir        Watch directory for new vmcore. (Repeatable)\n");
+	fprintf(stdout, " -j num        Max vmcores processed at once. [%d]\n",
+	        WATCH_DEFAULT_WORKERS);
+	fprintf(stdout, " -S file       State file of processed vmcores.\n");
+	fprintf(stdout, "               [First watch dir/%s]\n",
+	        WATCH_STATE_FILENAME);
+	fprintf(stdout, " -p file       Print only records matching any line\n");
+	fprintf(stdout, "               of file. (Fixed strings)\n");
+	fprintf(stdout, " -A dir        Append records to indexed store in dir.\n");
+	fprintf(stdout, " -Q dir        Query store, all keys must match:\n");
+	fprintf(stdout, "               level=N release=pat host=pat word=word\n");
+	fprintf(stdout, "               since=time until=time, time is epoch,\n");
+	fprintf(stdout, "               YYYY-MM-DD or Nd. (word is repeatable)\n");
+	fprintf(stdout, " -C file       Copy whole stdin vmcore to file while\n");
+	fprintf(stdout, "               reading. (with vmcore \"-\")\n");
+	fprintf(stdout, " vmcore        VMCore files to dump, \"-\" reads stdin\n");
+	fprintf(stdout, "               in one pass. [/proc/vmcore]\n");
+	fprintf(stdout, "               Only xz is supported as compressed\n");
+	fprintf(stdout, "               vmcore, read by blocks.\n");
 	return;
 }
 
@@ -60,57 +222,290 @@ static void print_usage(void)
 /* ============================================================
        parse_option() - Parse and validate commandline option
    ============================================================ */
-static int parse_option(int argc, char *argv[], File *file)
+static int parse_option(int argc, char *argv[], Option *option)
 {
+	/* --- Variables --- */
+	static char *default_files[] = { DEFAULT_VMCORE };
+	int opt = 0;
+	int loop = 0;
+	char *endptr = NULL;
+	
 	/* --- Assert check --- */
 	assert(argv != NULL);
-	assert(file != NULL);
+	assert(option != NULL);
+	
+	while ((opt = getopt(argc, argv,
+	                     "rmTbNRPZ:t:c:M:o:y:O:sw:j:S:p:A:Q:C:")) != -1) {
+		switch (opt) {
+		case 'r':
+			option->registers = 1;
+			break;
+		case 'm':
+			option->modules = 1;
+			break;
+		case 'T':
+			option->tasks = 1;
+			break;
+		case 'b':
+			option->backtrace = 1;
+			break;
+		case 'N':
+			option->percpu = 1;
+			break;
+		case 'R':
+			option->recover = 1;
+			break;
+		case 'P':
+			option->pstore = 1;
+			break;
+		case 'Z':
+			option->pstore_start = strtoull(optarg, &endptr, 0);
+			if ((*optarg == 0x00) || (*endptr != ':')) {
+				return RETVAL_FAILURE;
+			}
+			option->pstore_size = strtoull(endptr + 1, &endptr, 0);
+			if ((*endptr != 0x00) || (option->pstore_size == 0)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 't':
+			option->time_budget = strtoul(optarg, &endptr, 10);
+			if ((*optarg == 0x00) || (*endptr != 0x00) ||
+			    (option->time_budget == 0)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 'c':
+			if (parse_size(optarg, 1024, &option->cache_limit)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 'M':
+			if (parse_size(optarg, 1024 * 1024, &option->memory_limit)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 'o':
+			option->output_file = optarg;
+			break;
+		case 'O':
+			if (option->output_count == MAX_OUTPUTS) {
+				return RETVAL_FAILURE;
+			}
+			option->outputs[option->output_count++] = optarg;
+			break;
+		case 'y':
+			if (parse_size(optarg, 1024, &option->sync_interval)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 's':
+			option->split_count = 1;
+			break;
+		case 'w':
+			if (option->watch_count == MAX_WATCH_DIRS) {
+				return RETVAL_FAILURE;
+			}
+			option->watch_dirs[option->watch_count++] = optarg;
+			break;
+		case 'j':
+			option->watch_workers = strtol(optarg, &endptr, 10);
+			if ((*optarg == 0x00) || (*endptr != 0x00) ||
+			    (option->watch_workers < 1)) {
+				return RETVAL_FAILURE;
+			}
+			break;
+		case 'S':
+			option->watch_state = optarg;
+			break;
+		case 'p':
+			option->pattern_file = optarg;
+			break;
+		case 'A':
+			option->store_dir = optarg;
+			break;
+		case 'Q':
+			option->query_dir = optarg;
+			break;
+		case 'C':
+			option->stream_copy = optarg;
+			break;
+		default:
+			return RETVAL_FAILURE;
+		}
+	}
 	
-	if (argc == 2) {
-		file->filename = argv[1];
+	if ((option->output_file || option->output_count) &&
+	    ((option->watch_count) ||
+	     ((! option->split_count) && (argc - optind > 1)))) {
+		/* One output file for one vmcore */
+		return RETVAL_FAILURE;
 	}
-	else if (argc == 1) {
-		file->filename = DEFAULT_VMCORE;
+	if (option->output_count &&
+	    (option->output_file || option->time_budget)) {
+		/* Outputs are queued, not flushed record by record */
+		return RETVAL_FAILURE;
+	}
+	if ((option->pstore_size && (! option->pstore)) ||
+	    (option->pstore &&
+	     (option->recover || option->registers || option->modules ||
+	      option->tasks || option->backtrace || option->percpu ||
+	      option->store_dir || option->stream_copy))) {
+		/* Zones are of previous boot, nothing else of this dump */
+		return RETVAL_FAILURE;
+	}
+	if (option->query_dir) {
+		/* Rest of args are terms, nothing is dumped */
+		if (option->watch_count || option->split_count ||
+		    option->store_dir || option->output_file) {
+			return RETVAL_FAILURE;
+		}
+		option->query_terms = &argv[optind];
+		option->query_count = argc - optind;
+	}
+	else if (option->watch_count) {
+		/* vmcore comes from watched directories, no end to budget */
+		if ((argc - optind != 0) || (option->split_count) ||
+		    (option->time_budget)) {
+			return RETVAL_FAILURE;
+		}
+	}
+	else if (option->split_count) {
+		/* All files are parts of split dump */
+		if ((argc - optind < 1) || (argc - optind > MAX_SPLIT_FILES)) {
+			return RETVAL_FAILURE;
+		}
+		option->filename = argv[optind];
+		for (option->split_count = 0; optind < argc; optind++) {
+			option->split_files[option->split_count++] = argv[optind];
+		}
+	}
+	else if (argc - optind >= 1) {
+		/* Each file is one vmcore */
+		option->files = &argv[optind];
+		option->file_count = argc - optind;
 	}
 	else {
-		/* Invalid option num */
+		option->files = default_files;
+		option->file_count = 1;
+	}
+	if (option->stream_copy &&
+	    ((option->file_count != 1) ||
+	     strcmp(option->files[0], STREAM_FILENAME))) {
+		/* Copy is only for stdin */
 		return RETVAL_FAILURE;
 	}
+	for (loop = 0; loop < option->file_count; loop++) {
+		if (strcmp(option->files[loop], STREAM_FILENAME)) {
+			continue;
+		}
+		/* Read once, no pointer chasing behind stream */
+		if ((option->file_count != 1) || option->recover ||
+		    option->modules || option->tasks || option->backtrace ||
+		    option->percpu || option->pstore) {
+			return RETVAL_FAILURE;
+		}
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       parse_size() - Parse decimal size in unit to bytes
+         Sign, overflow and trailing characters are rejected.
+   ============================================================ */
+static int parse_size(char *arg, size_t unit, size_t *ret)
+{
+	/* --- Variables --- */
+	unsigned long long value = 0;
+	char *endptr = NULL;
 	
+	/* --- Assert check --- */
+	assert(arg != NULL);
+	assert(unit > 0);
+	assert(ret != NULL);
+	
+	if ((*arg < '0') || (*arg > '9')) {
+		return RETVAL_FAILURE;
+	}
+	errno = 0;
+	value = strtoull(arg, &endptr, 10);
+	if ((errno != 0) || (*endptr != 0x00) || (value > SIZE_MAX / unit)) {
+		return RETVAL_FAILURE;
+	}
+	*ret = value * unit;
 	return RETVAL_SUCCESS;
 }
 
 
+/* ============================================================
+       crashdmesg_file() - Setup VMCore and Dump one vmcore
+   ============================================================ */
+static int crashdmesg_file(Option *option, char *filename)
+{
+	/* --- Variables --- */
+	VMCore vmcore;
+	memset(&vmcore, 0x00, sizeof(VMCore));
+	File split_files[MAX_SPLIT_FILES];
+	memset(split_files, 0x00, sizeof(split_files));
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(option != NULL);
+	assert(filename != NULL);
+	
+	vmcore.file.filename = filename;
+	vmcore.file.cache_limit = option->cache_limit;
+	vmcore.file.stream_copy = option->stream_copy;
+	fprintf(stdout, "%s:   Target file: %s\n", APP_NAME, vmcore.file.filename);
+	
+	/* Split dump, first file has NOTE */
+	for (loop = 0; loop < option->split_count; loop++) {
+		split_files[loop].filename = option->split_files[loop];
+		split_files[loop].cache_limit = option->cache_limit;
+		vmcore.parts[loop] = (loop == 0) ? &vmcore.file : &split_files[loop];
+		if (loop > 0) {
+			fprintf(stdout, "%s:   Split file:  %s\n",
+			        APP_NAME, split_files[loop].filename);
+		}
+	}
+	vmcore.part_count = option->split_count;
+	
+	return crashdmesg(&vmcore, option);
+}
+
+
 /* ============================================================
        crashdmesg() - Ring buffer dumper Core routine
    ============================================================ */
-static int crashdmesg(VMCore *vmcore)
+static int crashdmesg(VMCore *vmcore, Option *option)
 {
 	/* --- Variables --- */
 	char estr[] = "[ERROR] crashdmesg:";
-	int loop = 0;
-	Elf64_Phdr phdr_cache;
-	memset(&phdr_cache, 0x00, sizeof(Elf64_Phdr));
-	char osrelease[OSRELEASE_LENGTH];
-	memset(osrelease, 0x00, sizeof(osrelease));
 	time_t crashtime = 0;
 	struct tm *ct = NULL;
-
-	/* ringbuffer info from vmcoreinfo */
-	uint64_t log_buf_vaddr = 0;
-	uint64_t log_end_vaddr = 0;
-	uint64_t log_buf_len_vaddr = 0;
-	uint64_t logged_chars_vaddr = 0;
-	
-	/* Pointer of ring buffer */
-	off_t ringbuffer1 = 0; /* file offset */
-	uint32_t ringbuffer1_size = 0;
-	off_t ringbuffer2 = 0; /* file offset */
-	uint32_t ringbuffer2_size = 0;
-	char *ringbuffer = NULL;
+	int recover = 0;
+	int raw = 0;
+	int no_ring = 0;
+	FILE *stream = stdout;
+	Sink sink;
+	memset(&sink, 0x00, sizeof(Sink));
+	Fanout fanout;
+	memset(&fanout, 0x00, sizeof(Fanout));
+	Ring ring;
+	memset(&ring, 0x00, sizeof(Ring));
+	SafeLog safe;
+	memset(&safe, 0x00, sizeof(SafeLog));
+	uint64_t console_seq = 0;
+	uint64_t next_seq = 0;
+	size_t head = 0;
+	Record record;
+	memset(&record, 0x00, sizeof(Record));
 	
 	/* --- Assert check --- */
 	assert(vmcore != NULL);
+	assert(option != NULL);
 	
 	/* Open vmcore file and validate */
 	fprintf(stdout, "%s:  Validate vmcore ELF binary header.\n", APP_NAME);
@@ -118,191 +513,504 @@ static int crashdmesg(VMCore *vmcore)
 		fprintf(stderr, "%s Can not open vmcore file.\n", estr);
 		return RETVAL_FAILURE;
 	}
-	if (elf_validate_elfheader(vmcore)) {
-		fprintf(stderr, "%s Failed to validate vmcore file.\n", estr);
+	if (option->pstore) {
+		/* ramoops zones of previous boot, no VMCOREINFO needed */
+		fprintf(stdout, "%s:  Read pstore/ramoops zones.\n", APP_NAME);
+		if (pstore_read_ring(vmcore, option->pstore_start,
+		                     option->pstore_size, &ring)) {
+			fprintf(stderr, "%s Can not read ramoops zones.\n", estr);
+			goto ERROR_CLOSE;
+		}
+		goto DUMP;
+	}
+	recover = option->recover;
+	raw = recover && scan_is_raw(vmcore);
+	if (raw) {
+		/* Raw memory image, whole file is memory */
+		if (scan_load_raw(vmcore)) {
+			fprintf(stderr, "%s Failed to load raw image.\n", estr);
+			goto ERROR_CLOSE;
+		}
+		fprintf(stdout, "%s:    * Raw image:  0x%016lx bytes\n",
+		        APP_NAME, (unsigned long) vmcore->file.size);
+	}
+	else {
+		if (elf_validate_elfheader(vmcore)) {
+			fprintf(stderr, "%s Failed to validate vmcore file.\n", estr);
+			goto ERROR_CLOSE;
+		}
+		if (elf_load_segments(vmcore)) {
+			fprintf(stderr, "%s Failed to load program headers.\n", estr);
+			goto ERROR_CLOSE;
+		}
+		fprintf(stdout, "%s:    * LOAD:       %d segments in %d files\n",
+		        APP_NAME, vmcore->load_count, vmcore->part_count);
+	}
+	if (deadline_check()) {
 		goto ERROR_CLOSE;
 	}
 	
-	/* Search and Read VMCOREINFO */
-	fprintf(stdout, "%s:  Read VMCOREINFO from NOTE segment.\n", APP_NAME);
-	if (elf_read_vmcoreinfo(vmcore)) {
-		fprintf(stderr, "%s Can not read VMCOREINFO.\n", estr);
+	/* Search and Read VMCOREINFO, scan memory if not available */
+	if (! recover) {
+		fprintf(stdout, "%s:  Read VMCOREINFO from NOTE segment.\n",
+		        APP_NAME);
+		if (elf_read_vmcoreinfo(vmcore)) {
+			fprintf(stderr, "%s Can not read VMCOREINFO.\n", estr);
+			fprintf(stdout, "%s:  No VMCOREINFO, recover by scan.\n",
+			        APP_NAME);
+			recover = 1;
+		}
+	}
+	if (recover && vmcore->file.stream) {
+		/* Scan would keep whole memory */
+		fprintf(stderr, "%s Stream needs VMCOREINFO.\n", estr);
 		goto ERROR_CLOSE;
 	}
-
+	if (recover) {
+		layout_setup_default(vmcore);
+		if (scan_read_ring(vmcore, &ring)) {
+			fprintf(stderr, "%s Can not recover ring buffer.\n", estr);
+			goto ERROR_CLOSE;
+		}
+		goto DUMP;
+	}
+	
 	/* Read additional informations */
-	if (elf_read_osrelease(vmcore, osrelease, sizeof(osrelease))) {
+	if (elf_read_osrelease(vmcore, vmcore->osrelease,
+	                       sizeof(vmcore->osrelease))) {
 		fprintf(stderr, "%s Can not read OSRELEASE.\n", estr);
 		goto ERROR_CLOSE;
 	}
-	fprintf(stdout, "%s:    * OS Release: %s\n", APP_NAME, osrelease);
+	vmcore->osrelease_size = strlen(vmcore->osrelease);
+	fprintf(stdout, "%s:    * OS Release: %s\n", APP_NAME, vmcore->osrelease);
 	if (elf_read_crashtime(vmcore, &crashtime)) {
 		fprintf(stderr, "%s Can not read CRASHTIME.\n", estr);
 		goto ERROR_CLOSE;
 	}
+	vmcore->crashtime = crashtime;
 	fprintf(stdout, "%s:    * Crash Time: %ld,\n", APP_NAME, crashtime);
 	ct = localtime(&crashtime);
 	if (ct == NULL) {
 		fprintf(stderr, "%s localtime failed.\n", estr);
-		return RETVAL_FAILURE;
+		goto ERROR_CLOSE;
 	}
 	fprintf(stdout, "%s:                  %04d/%02d/%02d %02d:%02d:%02d\n",
 	        APP_NAME, ct->tm_year+1900, ct->tm_mon+1, ct->tm_mday,
 	        ct->tm_hour, ct->tm_min, ct->tm_sec);
 	
-	/* Read vaddr of ringbuffer */
-	fprintf(stdout, "%s:  Read Symbol from VMCOREINFO.\n", APP_NAME);
-	elf_search_vmcoreinfo_symbol(vmcore, "log_buf", &log_buf_vaddr);
-	elf_search_vmcoreinfo_symbol(vmcore, "log_end", &log_end_vaddr);
-	elf_search_vmcoreinfo_symbol(vmcore, "log_buf_len", &log_buf_len_vaddr);
-	elf_search_vmcoreinfo_symbol(vmcore, "logged_chars", &logged_chars_vaddr);
-	if ((! log_buf_vaddr) || (! log_end_vaddr) ||
-	    (! log_buf_len_vaddr) || (! logged_chars_vaddr)) {
-		fprintf(stderr, "%s Can not read Symbol from VMCOREINFO.\n", estr);
+	/* Select structure layout, once */
+	if (layout_setup(vmcore)) {
+		fprintf(stderr, "%s Can not select structure layout.\n", estr);
 		goto ERROR_CLOSE;
 	}
-	fprintf(stdout, "%s:    * log_buf:      0x%016lx\n",
-	        APP_NAME, log_buf_vaddr);
-	fprintf(stdout, "%s:    * log_end:      0x%016lx\n",
-	        APP_NAME, log_end_vaddr);
-	fprintf(stdout, "%s:    * log_buf_len:  0x%016lx\n",
-	        APP_NAME, log_buf_len_vaddr);
-	fprintf(stdout, "%s:    * logged_chars: 0x%016lx\n",
-	        APP_NAME, logged_chars_vaddr);
-
-	/* Read LOAD segment */
-	fprintf(stdout, "%s:  Read LOAD section about Ring buffer..\n",
-	        APP_NAME);
-	elf_read_load_uint64(vmcore, &phdr_cache,
-	                     log_buf_vaddr, &vmcore->log_buf);
-	elf_read_load_uint32(vmcore, &phdr_cache,
-	                     log_end_vaddr, &vmcore->log_end);
-	elf_read_load_int32(vmcore, &phdr_cache,
-	                    log_buf_len_vaddr, &vmcore->log_buf_len);
-	elf_read_load_uint32(vmcore, &phdr_cache,
-	                     logged_chars_vaddr, &vmcore->logged_chars);
-	if ((! vmcore->log_buf) || (! vmcore->log_end) ||
-	    (! vmcore->log_buf_len) || (! vmcore->logged_chars)) {
-		fprintf(stderr, "%s Can not read value from LOAD segment.\n", estr);
+	fprintf(stdout, "%s:    * Layout:     %s (%d from VMCOREINFO)\n",
+	        APP_NAME, vmcore->plan.profile->name, vmcore->plan.overrides);
+	
+	/* Stream is read once, keep what ring buffer needs */
+	if (vmcore->file.stream && stream_plan(vmcore)) {
+		fprintf(stderr, "%s Can not plan stream.\n", estr);
 		goto ERROR_CLOSE;
 	}
-	fprintf(stdout, "%s:    * log_buf:      0x%016lx\n",
-	        APP_NAME, vmcore->log_buf);
-	fprintf(stdout, "%s:    * log_end:              0x%08x\n",
-	        APP_NAME, vmcore->log_end);
-	fprintf(stdout, "%s:    * log_buf_len:          0x%08x\n",
-	        APP_NAME, vmcore->log_buf_len);
-	fprintf(stdout, "%s:    * logged_chars:         0x%08x\n",
-	        APP_NAME, vmcore->logged_chars);
-
-	/* Check log_buf size for safety */
-	if (vmcore->log_buf_len > MAX_LOGBUF_LIMIT) {
-		fprintf(stderr, "%s log_buf_len is too big.\n", estr);
-		goto ERROR_CLOSE;
+	
+	/* Read ring buffer, extras are dumped even without it */
+	if (printk_read_ring(vmcore, &ring)) {
+		fprintf(stderr, "%s Can not read ring buffer.\n", estr);
+		printk_free_ring(&ring);
+		no_ring = 1;
 	}
-
-	/* Allocate memory for ring buffer */
-	ringbuffer = malloc(vmcore->log_buf_len);
-	if (ringbuffer == NULL) {
-		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+	
+	/* Lines never flushed to ring, and records console missed */
+	if (option->percpu && (! deadline_reached)) {
+		fprintf(stdout, "%s:  Read per-CPU printk buffers.\n", APP_NAME);
+		/* Sequence numbers of ring, by kallsyms if not exported */
+		if ((! no_ring) && printk_read_seq(vmcore, &ring)) {
+			fprintf(stderr, "%s Sequence number is unknown.\n", estr);
+		}
+		if (deadline_reached) {
+			/* Ring read is still dumped */
+			goto DUMP;
+		}
+		printk_head(vmcore, &ring, &head, &next_seq);
+		if (percpu_read_safe(vmcore, &safe, next_seq)) {
+			fprintf(stderr, "%s Can not read per-CPU buffers.\n", estr);
+		}
+		if ((vmcore->log_format == LOGFORMAT_RECORD) &&
+		    (vmcore->log_next_seq != 0) &&
+		    (! percpu_read_console_seq(vmcore, &console_seq)) &&
+		    (console_seq <= next_seq)) {
+			fprintf(stdout, "%s:    * Console:    %lu records not printed "
+			        "(seq %lu -)\n", APP_NAME,
+			        (unsigned long) (next_seq - console_seq),
+			        (unsigned long) console_seq);
+		}
+	}
+	
+	/* DUMP */
+DUMP:
+	if (no_ring && deadline_check()) {
+		printk_free_ring(&ring);
 		goto ERROR_CLOSE;
 	}
-	memset(ringbuffer, 0x00, vmcore->log_buf_len);
-	
-	/* Calculate Dump address */
-	fprintf(stdout, "%s:  Calculating dump area address.\n", APP_NAME);
-	if ( vmcore->logged_chars < vmcore->log_buf_len ) {
-		/* ring buffer not filled */
-		ringbuffer1_size = vmcore->logged_chars;
-		if (elf_search_load_data(vmcore, &phdr_cache,
-		                         vmcore->log_buf, ringbuffer1_size,
-		                         &ringbuffer1)) {
-			fprintf(stderr, "%s Ring buffer not found in vmcore.\n", estr);
-			goto ERROR_FREE;
-		}   
-		fprintf(stdout, "%s:   Ring buffer Part: 1/1\n", APP_NAME);
-		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
-		        APP_NAME, ringbuffer1);
-		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
-		        APP_NAME, ringbuffer1_size);
-		/* DUMP */
-		if (file_read(&vmcore->file, (void*) ringbuffer,
-			          ringbuffer1, ringbuffer1_size)) {
-			fprintf(stderr, "%s Can not read ring buffer.\n", estr);
-			goto ERROR_FREE;
+	if (option->store_dir && (! no_ring) && (! deadline_reached)) {
+		/* Archived before dump, ring position is kept */
+		fprintf(stdout, "%s:  Append ring buffer to store.\n", APP_NAME);
+		if (store_append(vmcore, &ring, option->store_dir)) {
+			fprintf(stderr, "%s Can not append to store.\n", estr);
 		}
-		fprintf(stdout, "%s:  Dump ring buffer.\n", APP_NAME);
+	}
+	if (option->output_file) {
+		/* Records go to durable file, not stdout */
+		if (sink_open(&sink, option->output_file, option->sync_interval)) {
+			fprintf(stderr, "%s Can not open output.\n", estr);
+			printk_free_ring(&ring);
+			goto ERROR_CLOSE;
+		}
+		stream = sink.stream;
+	}
+	if (option->output_count) {
+		/* Records are shared by outputs, each with own thread */
+		if (fanout_open(&fanout, option->outputs, option->output_count,
+		                option->sync_interval)) {
+			fprintf(stderr, "%s Can not open outputs.\n", estr);
+			printk_free_ring(&ring);
+			goto ERROR_CLOSE;
+		}
+	}
+	if (option->time_budget) {
+		/* Most valuable first, whatever happens at deadline */
+		fprintf(stdout, "%s:  Dump ring buffer, newest first.\n", APP_NAME);
 		fprintf(stdout,
 		        ">>>>>>>>>>[ START kernel ring buffer ]>>>>>>>>>>>>>>>>>\n");
-		for (loop = 0; loop < ringbuffer1_size; loop++) {
-		     fputc(ringbuffer[loop], stdout);
-		}
+		crashdmesg_newest_first(vmcore, &ring, &safe, option, stream);
 		fprintf(stdout,
 		        "<<<<<<<<<<[ END kernel ring buffer   ]<<<<<<<<<<<<<<<<<\n");
 	}
-	else {
-		/* ring buffer filled  */
-		ringbuffer1_size = vmcore->log_buf_len -
-		                   (vmcore->log_end & (vmcore->log_buf_len-1));
-		ringbuffer2_size = vmcore->log_end & (vmcore->log_buf_len-1);
-		if ( ((ringbuffer1_size + ringbuffer2_size) != vmcore->log_buf_len) ||
-		     ((ringbuffer1_size + ringbuffer2_size) > MAX_LOGBUF_LIMIT) ) {
-			fprintf(stderr, "%s Dump area size calculation failed.\n", estr);
-			goto ERROR_FREE;
-		}
-		if (elf_search_load_data(vmcore, &phdr_cache,
-		                         vmcore->log_buf +
-			                     (vmcore->log_end & (vmcore->log_buf_len-1)),
-		                         ringbuffer1_size, &ringbuffer1) ||
-		    elf_search_load_data(vmcore, &phdr_cache, vmcore->log_buf,
-		                         ringbuffer2_size, &ringbuffer2)) {
-			fprintf(stderr, "%s Ring buffer not found in vmcore.\n", estr);
-			goto ERROR_FREE;
-		}
-		fprintf(stdout, "%s:   Ring buffer Part: 1/2\n", APP_NAME);
-		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
-		        APP_NAME, ringbuffer1);
-		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
-		        APP_NAME, ringbuffer1_size);
-		fprintf(stdout, "%s:   Ring buffer Part: 2/2\n", APP_NAME);
-		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
-		        APP_NAME, ringbuffer2);
-		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
-		        APP_NAME, ringbuffer2_size);
-		/* DUMP */
-		if (file_read(&vmcore->file, (void*) ringbuffer,
-			          ringbuffer1, ringbuffer1_size) ||
-		    file_read(&vmcore->file, (void*) ringbuffer + ringbuffer1_size,
-		              ringbuffer2, ringbuffer2_size)) {
-			fprintf(stderr, "%s Can not read ring buffer.\n", estr);
-			goto ERROR_FREE;
+	else if (option->search) {
+		/* Only matched records, with file and sequence number */
+		fprintf(stdout, "%s:  Search ring buffer.\n", APP_NAME);
+		fprintf(stdout,
+		        ">>>>>>>>>>[ START matched records ]>>>>>>>>>>>>>>>>>>>>\n");
+		while (printk_next_record(vmcore, &ring, &record) ||
+		       percpu_next_record(&safe, &record)) {
+			if (search_record(option->search, &record) < 0) {
+				continue;
+			}
+			if (option->output_count) {
+				fanout_write(&fanout, &record);
+				continue;
+			}
+			fprintf(stream, "%s:%lu:", vmcore->file.filename, record.seq);
+			printk_print_record(stream, &record);
 		}
+		fprintf(stdout,
+		        "<<<<<<<<<<[ END matched records   ]<<<<<<<<<<<<<<<<<<<<\n");
+	}
+	else {
 		fprintf(stdout, "%s:  Dump ring buffer.\n", APP_NAME);
 		fprintf(stdout,
 		        ">>>>>>>>>>[ START kernel ring buffer ]>>>>>>>>>>>>>>>>>\n");
-		for (loop = 0; loop < ringbuffer1_size + ringbuffer2_size ; loop++) {
-			fputc(ringbuffer[loop], stdout);
+		while (printk_next_record(vmcore, &ring, &record) ||
+		       percpu_next_record(&safe, &record)) {
+			if (option->output_count) {
+				fanout_write(&fanout, &record);
+				continue;
+			}
+			printk_print_record(stream, &record);
 		}
 		fprintf(stdout,
 		        "<<<<<<<<<<[ END kernel ring buffer   ]<<<<<<<<<<<<<<<<<\n");
 	}
+	if (option->output_file && sink_close(&sink)) {
+		fprintf(stderr, "%s Can not write output.\n", estr);
+		printk_free_ring(&ring);
+		goto ERROR_CLOSE;
+	}
+	if (option->output_count && fanout_close(&fanout)) {
+		fprintf(stderr, "%s Can not write outputs.\n", estr);
+		printk_free_ring(&ring);
+		goto ERROR_CLOSE;
+	}
 	
-	fprintf(stdout, "%s: Dump complete.\n", APP_NAME);
+	/* Extras come after records, skipped at deadline */
+	if (deadline_check()) {
+		printk_free_ring(&ring);
+		goto ERROR_CLOSE;
+	}
+	
+	/* Registers from NT_PRSTATUS */
+	if (option->registers && (! raw)) {
+		fprintf(stdout, "%s:  Dump CPU registers.\n", APP_NAME);
+		fprintf(stdout,
+		        ">>>>>>>>>>[ START CPU registers ]>>>>>>>>>>>>>>>>>>>>>>\n");
+		if (elf_print_prstatus(vmcore, stdout)) {
+			fprintf(stderr, "%s Can not read CPU registers.\n", estr);
+		}
+		fprintf(stdout,
+		        "<<<<<<<<<<[ END CPU registers   ]<<<<<<<<<<<<<<<<<<<<<<\n");
+	}
+	
+	/* Backtrace needs kernel image to find kallsyms */
+	if (option->backtrace && (! recover)) {
+		fprintf(stdout, "%s:  Dump CPU backtraces.\n", APP_NAME);
+		fprintf(stdout,
+		        ">>>>>>>>>>[ START CPU backtraces ]>>>>>>>>>>>>>>>>>>>>>\n");
+		if (kallsyms_print_backtrace(vmcore, stdout)) {
+			fprintf(stderr, "%s Can not print backtraces.\n", estr);
+		}
+		fprintf(stdout,
+		        "<<<<<<<<<<[ END CPU backtraces   ]<<<<<<<<<<<<<<<<<<<<<\n");
+	}
+	
+	/* Module list needs VMCOREINFO */
+	if (option->modules && (! recover)) {
+		fprintf(stdout, "%s:  Dump kernel modules.\n", APP_NAME);
+		fprintf(stdout,
+		        ">>>>>>>>>>[ START kernel modules ]>>>>>>>>>>>>>>>>>>>>>\n");
+		if (module_print_list(vmcore, stdout)) {
+			fprintf(stderr, "%s Can not read module list.\n", estr);
+		}
+		fprintf(stdout,
+		        "<<<<<<<<<<[ END kernel modules   ]<<<<<<<<<<<<<<<<<<<<<\n");
+	}
+	
+	/* Task list needs VMCOREINFO */
+	if (option->tasks && (! recover)) {
+		fprintf(stdout, "%s:  Dump task list.\n", APP_NAME);
+		fprintf(stdout,
+		        ">>>>>>>>>>[ START task list ]>>>>>>>>>>>>>>>>>>>>>>>>>>\n");
+		if (task_print_list(vmcore, stdout)) {
+			fprintf(stderr, "%s Can not read task list.\n", estr);
+		}
+		fprintf(stdout,
+		        "<<<<<<<<<<[ END task list   ]<<<<<<<<<<<<<<<<<<<<<<<<<<\n");
+	}
+	
+	fprintf(stdout, "%s:    * Read: %lu calls, %lu bytes, cache %lu/%lu hit\n",
+	        APP_NAME, vmcore->file.stat.syscalls, vmcore->file.stat.bytes,
+	        vmcore->file.stat.hits,
+	        vmcore->file.stat.hits + vmcore->file.stat.misses);
+	fprintf(stdout, "%s: Dump complete%s.\n", APP_NAME,
+	        no_ring ? " without ring buffer" : "");
 	
 	/* free ringbuffer andclose file */
-	free(ringbuffer);
+	printk_free_ring(&ring);
+	percpu_free_safe(&safe);
+	kallsyms_free(vmcore);
+	elf_free_notes(vmcore);
+	elf_close_segments(vmcore);
 	file_close(&vmcore->file);
 	
-	return RETVAL_SUCCESS;
+	return no_ring ? RETVAL_FAILURE : RETVAL_SUCCESS;
 	
 	/* Error */
-ERROR_FREE:
-	free(ringbuffer);
 ERROR_CLOSE:
+	percpu_free_safe(&safe);
+	kallsyms_free(vmcore);
+	elf_free_notes(vmcore);
+	elf_close_segments(vmcore);
 	file_close(&vmcore->file);
+	
+	return RETVAL_FAILURE;
+}
+
 
+/* ============================================================
+       crashdmesg_newest_first() - Print records newest first
+         Ring is indexed backward from head in windows, each
+         window is decoded backward and flushed record by
+         record before the older one is indexed. Newest
+         window is printed even if deadline already passed.
+   ============================================================ */
+static int crashdmesg_newest_first(VMCore *vmcore, Ring *ring,
+                                   SafeLog *safe, Option *option,
+                                   FILE *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] crashdmesg_newest_first:";
+	RecordIndex *index = NULL;
+	RecordIndex *grown = NULL;
+	size_t capacity = 0;
+	size_t count = 0;
+	size_t printed = 0;
+	size_t loop = 0;
+	size_t first = 0; /* Ring.cursor of oldest record */
+	size_t lower = 0; /* Start of ring part holding end */
+	size_t from = 0;
+	size_t start = 0;
+	size_t end = 0;
+	uint64_t first_seq = 0;
+	uint64_t end_seq = 0;
+	uint64_t head_seq = 0;
+	int wrapped = 0;
+	int found = 0;
+	Record record;
+	memset(&record, 0x00, sizeof(Record));
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(safe != NULL);
+	assert(option != NULL);
+	assert(stream != NULL);
+	
+	/* Per-CPU lines are newer than any record of ring */
+	for (loop = safe->count; (loop > 0) && (! deadline_reached); loop--) {
+		memcpy(&record, &safe->records[loop - 1], sizeof(Record));
+		record.seq = safe->seq + loop - 1;
+		crashdmesg_print_newest(vmcore, option, stream, &record);
+		printed++;
+	}
+	
+	first = ring->cursor;
+	first_seq = ring->seq;
+	printk_head(vmcore, ring, &end, &end_seq);
+	head_seq = end_seq;
+	wrapped = (vmcore->log_format == LOGFORMAT_RECORD) &&
+	          (end <= first) && (end_seq > first_seq);
+	
+	while ((end_seq > first_seq) &&
+	       ((end_seq == head_seq) || (! deadline_reached))) {
+		/* Part after wrap is done, continue from wrap point */
+		if (wrapped && (end == 0)) {
+			end = PRINTK_WRAP;
+			wrapped = 0;
+		}
+		lower = wrapped ? 0 : first;
+		from = (end == PRINTK_WRAP) ? ring->size : end;
+		for (found = 0; (! found) && (from > lower); ) {
+			from = (from - lower > NEWEST_WINDOW) ?
+			       from - NEWEST_WINDOW : lower;
+			found = printk_sync_record(vmcore, ring, from, end, &start);
+		}
+		if (! found) {
+			fprintf(stderr, "%s No record boundary before 0x%x.\n",
+			        estr, (unsigned) end);
+			break;
+		}
+		
+		/* Index window, it ends at end or where ring wraps */
+		ring->cursor = start;
+		ring->seq = first_seq;
+		for (count = 0; ring->cursor < end; count++) {
+			if (count == capacity) {
+				capacity = capacity ? capacity * 2 : 1024;
+				grown = mem_realloc(index, sizeof(RecordIndex) * capacity);
+				if (grown == NULL) {
+					fprintf(stderr, "%s Can not allocate memory.\n", estr);
+					goto ERROR_FREE;
+				}
+				index = grown;
+			}
+			index[count].cursor = ring->cursor;
+			if ((! printk_next_record(vmcore, ring, &record)) ||
+			    (ring->cursor <= index[count].cursor)) {
+				break;
+			}
+		}
+		if ((count == 0) || (count > end_seq - first_seq)) {
+			fprintf(stderr, "%s Broken window at 0x%x.\n",
+			        estr, (unsigned) start);
+			break;
+		}
+		
+		/* Whole window is printed, even if deadline passed */
+		for (loop = count; loop > 0; loop--) {
+			if (! printk_seek_record(vmcore, ring, index[loop - 1].cursor,
+			                         end_seq - count + loop - 1, &record)) {
+				break;
+			}
+			crashdmesg_print_newest(vmcore, option, stream, &record);
+			printed++;
+		}
+		end = start;
+		end_seq -= count;
+	}
+	
+	if (deadline_reached) {
+		/* Marker goes before END line of stdout */
+		if (stream != stdout) {
+			fprintf(stream, DEADLINE_MARKER);
+			fflush(stream);
+		}
+		deadline_check();
+		fprintf(stdout, "%s:    * Truncated:  %lu records printed, "
+		        "%lu older not read\n", APP_NAME, (unsigned long) printed,
+		        (unsigned long) (end_seq - first_seq));
+	}
+	mem_free(index);
+	return deadline_reached ? RETVAL_FAILURE : RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(index);
 	return RETVAL_FAILURE;
 }
 
 
+/* ============================================================
+       crashdmesg_print_newest() - Print one record at once
+   ============================================================ */
+static void crashdmesg_print_newest(VMCore *vmcore, Option *option,
+                                    FILE *stream, Record *record)
+{
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(option != NULL);
+	assert(stream != NULL);
+	assert(record != NULL);
+	
+	if (option->search) {
+		if (search_record(option->search, record) < 0) {
+			return;
+		}
+		fprintf(stream, "%s:%lu:", vmcore->file.filename, record->seq);
+	}
+	printk_print_record(stream, record);
+	fflush(stream);
+	return;
+}
+
+
+/* ============================================================
+       deadline_signal() - SIGALRM handler
+         Second alarm means still blocked after grace time,
+         leave a marker and exit at once.
+   ============================================================ */
+static void deadline_signal(int signum)
+{
+	/* --- Variables --- */
+	static const char marker[] = "\n" DEADLINE_MARKER;
+	
+	if (deadline_reached) {
+		if (write(STDOUT_FILENO, marker, sizeof(marker) - 1) < 0) {
+			/* Nothing to do */
+		}
+		_exit(RETVAL_FAILURE);
+	}
+	deadline_reached = 1;
+	alarm(DEADLINE_GRACE);
+	return;
+}
+
+
+/* ============================================================
+       deadline_check() - Print marker once if deadline passed
+   ============================================================ */
+static int deadline_check(void)
+{
+	/* --- Variables --- */
+	static int reported = 0;
+	
+	if (! deadline_reached) {
+		return 0;
+	}
+	if (! reported) {
+		fprintf(stdout, DEADLINE_MARKER);
+		fflush(stdout);
+		reported = 1;
+	}
+	return 1;
+}
+
+
 /* ====================================================================== */
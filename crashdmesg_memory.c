@@ -0,0 +1,346 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_memory.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+#define MEM_ALIGN 16 /* Alignment of every allocation */
+#define MEM_ROUND(size) (((size) + MEM_ALIGN - 1) & ~((size_t) MEM_ALIGN - 1))
+
+
+/* --- Data structures --- */
+
+/* Block of arena, blocks are contiguous from arena base */
+typedef struct {
+	size_t size; /* Bytes of block, including this header */
+	size_t prev_size; /* Size of previous block, 0 if first */
+	size_t free;
+	size_t reserved; /* Keep header MEM_ALIGN aligned */
+} MemBlock;
+
+/* Placed just before every returned pointer */
+typedef struct {
+	size_t size; /* Bytes accounted for this allocation */
+	size_t offset; /* From start of underlying block to this tag */
+} MemTag;
+
+/* Allocator state */
+typedef struct {
+	char *base; /* Arena, NULL if not limited */
+	size_t limit; /* Arena size */
+	size_t used;
+	size_t peak;
+	pthread_mutex_t lock;
+} Memory;
+
+
+/* --- Prototypes --- */
+static void *mem_arena_alloc(size_t size);
+static void mem_arena_free(void *ptr);
+
+
+/* --- Variables --- */
+static Memory memory = { NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+
+/* ============================================================
+       mem_setup() - Preallocate arena of hard ceiling
+         0 means no limit, libc malloc() is used.
+   ============================================================ */
+int mem_setup(size_t limit)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] mem_setup:";
+	MemBlock *block = NULL;
+	
+	assert(memory.base == NULL);
+	
+	if (limit == 0) {
+		return RETVAL_SUCCESS;
+	}
+	limit &= ~((size_t) MEM_ALIGN - 1);
+	if (limit < 2 * sizeof(MemBlock)) {
+		fprintf(stderr, "%s Memory limit too small.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Populate now, not to fail on page fault in the middle of dump */
+	memory.base = mmap(NULL, limit, PROT_READ | PROT_WRITE,
+	                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (memory.base == MAP_FAILED) {
+		fprintf(stderr, "%s Can not map arena: [%d] %s\n",
+		        estr, errno, strerror(errno));
+		memory.base = NULL;
+		return RETVAL_FAILURE;
+	}
+	memory.limit = limit;
+	
+	/* One free block covers whole arena */
+	block = (MemBlock*) memory.base;
+	block->size = limit;
+	block->prev_size = 0;
+	block->free = 1;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       mem_alloc() - Allocate memory, NULL if over the limit
+   ============================================================ */
+void *mem_alloc(size_t size)
+{
+	return mem_alloc_aligned(MEM_ALIGN, size);
+}
+
+
+/* ============================================================
+       mem_calloc() - Allocate zero filled array
+   ============================================================ */
+void *mem_calloc(size_t count, size_t size)
+{
+	/* --- Variables --- */
+	void *ptr = NULL;
+	
+	if ((size != 0) && (count > SIZE_MAX / size)) {
+		return NULL;
+	}
+	ptr = mem_alloc(count * size);
+	if (ptr != NULL) {
+		memset(ptr, 0x00, count * size);
+	}
+	return ptr;
+}
+
+
+/* ============================================================
+       mem_realloc() - Resize allocation, copy contents
+   ============================================================ */
+void *mem_realloc(void *ptr, size_t size)
+{
+	/* --- Variables --- */
+	MemTag *tag = NULL;
+	void *new_ptr = NULL;
+	size_t old_size = 0;
+	
+	new_ptr = mem_alloc(size);
+	if ((new_ptr == NULL) || (ptr == NULL)) {
+		return new_ptr;
+	}
+	tag = (MemTag*) ptr - 1;
+	old_size = tag->size - tag->offset - sizeof(MemTag);
+	memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+	mem_free(ptr);
+	return new_ptr;
+}
+
+
+/* ============================================================
+       mem_strdup() - Copy string
+   ============================================================ */
+char *mem_strdup(const char *string)
+{
+	/* --- Variables --- */
+	char *copy = NULL;
+	
+	/* --- Assert check --- */
+	assert(string != NULL);
+	
+	copy = mem_alloc(strlen(string) + 1);
+	if (copy != NULL) {
+		strcpy(copy, string);
+	}
+	return copy;
+}
+
+
+/* ============================================================
+       mem_alloc_aligned() - Allocate with power of 2 alignment
+   ============================================================ */
+void *mem_alloc_aligned(size_t align, size_t size)
+{
+	/* --- Variables --- */
+	char *raw = NULL;
+	char *ptr = NULL;
+	size_t total = 0;
+	MemTag *tag = NULL;
+	
+	/* --- Assert check --- */
+	assert((align & (align - 1)) == 0);
+	
+	if (align < MEM_ALIGN) {
+		align = MEM_ALIGN;
+	}
+	if (size > SIZE_MAX / 2) {
+		return NULL;
+	}
+	total = MEM_ROUND(size) + sizeof(MemTag) + align - MEM_ALIGN;
+	
+	pthread_mutex_lock(&memory.lock);
+	raw = (memory.base != NULL) ? mem_arena_alloc(total) : malloc(total);
+	if (raw != NULL) {
+		ptr = (char*) (((uintptr_t) raw + sizeof(MemTag) + align - 1) &
+		               ~((uintptr_t) align - 1));
+		tag = (MemTag*) ptr - 1;
+		tag->size = (ptr - raw) + MEM_ROUND(size);
+		tag->offset = (char*) tag - raw;
+		memory.used += tag->size;
+		if (memory.used > memory.peak) {
+			memory.peak = memory.used;
+		}
+	}
+	pthread_mutex_unlock(&memory.lock);
+	
+	return ptr;
+}
+
+
+/* ============================================================
+       mem_free() - Free allocation, NULL is ignored
+   ============================================================ */
+void mem_free(void *ptr)
+{
+	/* --- Variables --- */
+	MemTag *tag = NULL;
+	char *raw = NULL;
+	
+	if (ptr == NULL) {
+		return;
+	}
+	tag = (MemTag*) ptr - 1;
+	raw = (char*) tag - tag->offset;
+	
+	pthread_mutex_lock(&memory.lock);
+	memory.used -= tag->size;
+	if (memory.base != NULL) {
+		mem_arena_free(raw);
+	}
+	else {
+		free(raw);
+	}
+	pthread_mutex_unlock(&memory.lock);
+	return;
+}
+
+
+/* ============================================================
+       mem_available() - Bytes still allocatable
+         Upper bound, fragmentation may make it smaller.
+   ============================================================ */
+size_t mem_available(void)
+{
+	/* --- Variables --- */
+	size_t available = SIZE_MAX;
+	
+	pthread_mutex_lock(&memory.lock);
+	if (memory.base != NULL) {
+		available = memory.limit - memory.used;
+	}
+	pthread_mutex_unlock(&memory.lock);
+	return available;
+}
+
+
+/* ============================================================
+       mem_print_usage() - Print peak usage and limit
+   ============================================================ */
+void mem_print_usage(FILE *stream)
+{
+	/* --- Assert check --- */
+	assert(stream != NULL);
+	
+	pthread_mutex_lock(&memory.lock);
+	if (memory.base != NULL) {
+		fprintf(stream, "%s:   Memory: peak %lu KB, limit %lu KB\n", APP_NAME,
+		        (unsigned long) (memory.peak + 1023) / 1024,
+		        (unsigned long) memory.limit / 1024);
+	}
+	else {
+		fprintf(stream, "%s:   Memory: peak %lu KB, no limit\n", APP_NAME,
+		        (unsigned long) (memory.peak + 1023) / 1024);
+	}
+	pthread_mutex_unlock(&memory.lock);
+	return;
+}
+
+
+/* ============================================================
+       mem_arena_alloc() - First fit from arena, under lock
+   ============================================================ */
+static void *mem_arena_alloc(size_t size)
+{
+	/* --- Variables --- */
+	MemBlock *block = NULL;
+	MemBlock *rest = NULL;
+	MemBlock *next = NULL;
+	char *limit = NULL;
+	size_t need = 0;
+	
+	need = MEM_ROUND(size) + sizeof(MemBlock);
+	limit = memory.base + memory.limit;
+	for (block = (MemBlock*) memory.base; (char*) block < limit;
+	     block = (MemBlock*) ((char*) block + block->size)) {
+		if ((! block->free) || (block->size < need)) {
+			continue;
+		}
+	
+		/* Split, if rest can hold a block */
+		if (block->size - need >= sizeof(MemBlock) + MEM_ALIGN) {
+			rest = (MemBlock*) ((char*) block + need);
+			rest->size = block->size - need;
+			rest->prev_size = need;
+			rest->free = 1;
+			next = (MemBlock*) ((char*) rest + rest->size);
+			if ((char*) next < limit) {
+				next->prev_size = rest->size;
+			}
+			block->size = need;
+		}
+		block->free = 0;
+		return block + 1;
+	}
+	return NULL;
+}
+
+
+/* ============================================================
+       mem_arena_free() - Return block, merge free neighbours
+   ============================================================ */
+static void mem_arena_free(void *ptr)
+{
+	/* --- Variables --- */
+	MemBlock *block = NULL;
+	MemBlock *next = NULL;
+	MemBlock *prev = NULL;
+	char *limit = NULL;
+	
+	limit = memory.base + memory.limit;
+	block = (MemBlock*) ptr - 1;
+	block->free = 1;
+	
+	next = (MemBlock*) ((char*) block + block->size);
+	if (((char*) next < limit) && next->free) {
+		block->size += next->size;
+	}
+	if (block->prev_size) {
+		prev = (MemBlock*) ((char*) block - block->prev_size);
+		if (prev->free) {
+			prev->size += block->size;
+			block = prev;
+		}
+	}
+	next = (MemBlock*) ((char*) block + block->size);
+	if ((char*) next < limit) {
+		next->prev_size = block->size;
+	}
+	return;
+}
+
+
+/* ====================================================================== */
@@ -0,0 +1,189 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_module.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+
+/* Letters of taint bits, See:kernel/panic.c taint_flags[] */
+#define MODULE_TAINT_LETTERS "PFSRMBUDAWCIOELKXTN"
+
+
+/* --- Prototypes --- */
+static size_t module_read_size(Layout *layout);
+static void module_print_taints(FILE *stream, uint64_t taints);
+
+
+/* ============================================================
+       module_print_list() - Walk "modules" list and Print
+         Each struct module is read at once, fields are taken
+         from the copy.
+   ============================================================ */
+int module_print_list(VMCore *vmcore, FILE *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] module_print_list:";
+	Layout *layout = NULL;
+	uint64_t head = 0;
+	uint64_t node = 0;
+	uint64_t module = 0;
+	uint64_t core = 0;
+	uint64_t taints = 0;
+	uint32_t core_size = 0;
+	char *buffer = NULL;
+	size_t size = 0;
+	int count = 0;
+	int retval = RETVAL_SUCCESS;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(stream != NULL);
+	
+	layout = &vmcore->plan.layout;
+	if ((layout->module_list == LAYOUT_NONE) ||
+	    (layout->module_name == LAYOUT_NONE)) {
+		fprintf(stderr, "%s Layout of struct module is unknown.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (kallsyms_search_symbol(vmcore, "modules", &head)) {
+		fprintf(stderr, "%s Symbol \"modules\" not found.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	size = module_read_size(layout);
+	buffer = mem_alloc(size);
+	if (buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* modules.next is first module */
+	if (elf_read_load_uint64(vmcore, head, &node)) {
+		fprintf(stderr, "%s Can not read list head.\n", estr);
+		mem_free(buffer);
+		return RETVAL_FAILURE;
+	}
+	fprintf(stream, "%-24s %-18s %10s  %s\n",
+	        "Module", "Address", "Size", "Taints");
+	while (node != head) {
+		if (count == MODULE_MAX_COUNT) {
+			fprintf(stderr, "%s Too many modules, list is broken?\n",
+			        estr);
+			retval = RETVAL_FAILURE;
+			break;
+		}
+		module = node - layout->module_list;
+		if (elf_read_load_data(vmcore, module, buffer, size)) {
+			fprintf(stderr, "%s Can not read module: 0x%016lx\n",
+			        estr, module);
+			retval = RETVAL_FAILURE;
+			break;
+		}
+		
+		core = 0;
+		core_size = 0;
+		taints = 0;
+		if (layout->module_core != LAYOUT_NONE) {
+			memcpy(&core, buffer + layout->module_core, sizeof(core));
+		}
+		if (layout->module_core_size != LAYOUT_NONE) {
+			memcpy(&core_size, buffer + layout->module_core_size,
+			       sizeof(core_size));
+		}
+		if (layout->module_taints != LAYOUT_NONE) {
+			memcpy(&taints, buffer + layout->module_taints,
+			       sizeof(taints));
+		}
+		fprintf(stream, "%-24.*s ", MODULE_NAME_LEN,
+		        buffer + layout->module_name);
+		if (core) {
+			fprintf(stream, "0x%016lx", (unsigned long) core);
+		}
+		else {
+			/* Load address unknown, struct module is elsewhere */
+			fprintf(stream, "%-18s", "-");
+		}
+		if (layout->module_core_size != LAYOUT_NONE) {
+			fprintf(stream, " %10u  ", core_size);
+		}
+		else {
+			fprintf(stream, " %10s  ", "-");
+		}
+		module_print_taints(stream, taints);
+		memcpy(&node, buffer + layout->module_list, sizeof(node));
+		count++;
+	}
+	fprintf(stdout, "%s:    * Modules:    %d\n", APP_NAME, count);
+	
+	mem_free(buffer);
+	return retval;
+}
+
+
+/* ============================================================
+       module_read_size() - Bytes to read for one struct module
+         Up to the last known member if size is not known.
+   ============================================================ */
+static size_t module_read_size(Layout *layout)
+{
+	/* --- Variables --- */
+	size_t size = 0;
+	
+	/* --- Assert check --- */
+	assert(layout != NULL);
+	
+	if ((layout->module_size != LAYOUT_NONE) &&
+	    (layout->module_size <= MODULE_READ_MAX)) {
+		size = layout->module_size;
+	}
+	if (size < layout->module_list + 2 * sizeof(uint64_t)) {
+		size = layout->module_list + 2 * sizeof(uint64_t);
+	}
+	if (size < layout->module_name + MODULE_NAME_LEN) {
+		size = layout->module_name + MODULE_NAME_LEN;
+	}
+	if ((layout->module_core != LAYOUT_NONE) &&
+	    (size < layout->module_core + sizeof(uint64_t))) {
+		size = layout->module_core + sizeof(uint64_t);
+	}
+	if ((layout->module_core_size != LAYOUT_NONE) &&
+	    (size < layout->module_core_size + sizeof(uint32_t))) {
+		size = layout->module_core_size + sizeof(uint32_t);
+	}
+	if ((layout->module_taints != LAYOUT_NONE) &&
+	    (size < layout->module_taints + sizeof(uint64_t))) {
+		size = layout->module_taints + sizeof(uint64_t);
+	}
+	return size;
+}
+
+
+/* ============================================================
+       module_print_taints() - Print taint letters and newline
+   ============================================================ */
+static void module_print_taints(FILE *stream, uint64_t taints)
+{
+	/* --- Variables --- */
+	char letters[] = MODULE_TAINT_LETTERS;
+	int loop = 0;
+	
+	if (taints == 0) {
+		fprintf(stream, "-\n");
+		return;
+	}
+	for (loop = 0; loop < sizeof(letters) - 1; loop++) {
+		if (taints & (1UL << loop)) {
+			fputc(letters[loop], stream);
+		}
+	}
+	fputc('\n', stream);
+	return;
+}
+
+
+/* ====================================================================== */
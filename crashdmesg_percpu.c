@@ -0,0 +1,369 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_percpu.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+#define KERN_SOH '\001' /* Level prefix, See:include/linux/kern_levels.h */
+#define PERCPU_RECORD_STEP 64 /* Grow step of SafeLog.records */
+
+
+/* --- Data structures --- */
+
+/* One per-CPU buffer, See:kernel/printk/printk_safe.c */
+typedef struct {
+	char *symbol;
+	char *label;
+	uint64_t address; /* Per-CPU offset, 0 if not found */
+} SafeBuffer;
+
+
+/* --- Prototypes --- */
+static int percpu_add_lines(SafeLog *log, Layout *layout, char *data,
+                            int cpu, char *label, size_t *capacity);
+static int percpu_add_line(SafeLog *log, char *line, size_t length,
+                           int cpu, char *label, size_t *capacity);
+
+
+/* ============================================================
+       percpu_read_safe() - Read printk_safe/NMI buffers of CPUs
+         CPUs are those set in cpu_possible_mask, by id.
+         __per_cpu_offset[] is read once, then both buffers of
+         a CPU are read at once when they lie close together.
+         Lines have no timestamp, they were never flushed to
+         ring, so they follow its last record, next_seq.
+   ============================================================ */
+int percpu_read_safe(VMCore *vmcore, SafeLog *log, uint64_t next_seq)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] percpu_read_safe:";
+	SafeBuffer buffers[] = {
+		{ "safe_print_seq", "safe", 0 },
+		{ "nmi_print_seq", "nmi", 0 },
+	};
+	Layout *layout = NULL;
+	uint64_t per_cpu_offset = 0;
+	uint64_t *offsets = NULL;
+	int *cpus = NULL;
+	uint64_t low = 0;
+	uint64_t high = 0;
+	char *span = NULL;
+	size_t span_size = 0;
+	size_t capacity = 0;
+	size_t position = 0;
+	int cpu_count = 0;
+	int cpu = 0;
+	int index = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(log != NULL);
+	
+	memset(log, 0x00, sizeof(SafeLog));
+	layout = &vmcore->plan.layout;
+	if ((layout->printk_safe_size == LAYOUT_NONE) ||
+	    (layout->printk_safe_buffer >= layout->printk_safe_size) ||
+	    (layout->printk_safe_len + sizeof(int32_t) >
+	     layout->printk_safe_buffer) ||
+	    (layout->printk_safe_size > PERCPU_READ_SPAN)) {
+		fprintf(stderr, "%s Layout of printk_safe_seq_buf is unknown.\n",
+		        estr);
+		return RETVAL_FAILURE;
+	}
+	if (kallsyms_search_symbol(vmcore, "__per_cpu_offset",
+	                           &per_cpu_offset) ||
+	    kallsyms_search_symbol(vmcore, buffers[0].symbol,
+	                           &buffers[0].address)) {
+		fprintf(stderr, "%s No printk_safe buffers in this kernel.\n",
+		        estr);
+		return RETVAL_FAILURE;
+	}
+	/* CONFIG_PRINTK_NMI may be off */
+	kallsyms_search_symbol(vmcore, buffers[1].symbol, &buffers[1].address);
+	
+	cpus = mem_alloc(sizeof(int) * TASK_MAX_CPUS);
+	if (cpus == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	cpu_count = task_read_cpus(vmcore, "possible", cpus, TASK_MAX_CPUS);
+	if (cpu_count <= 0) {
+		fprintf(stderr, "%s Invalid number of CPUs: %d\n",
+		        estr, cpu_count);
+		mem_free(cpus);
+		return RETVAL_FAILURE;
+	}
+	
+	/* One read covers both buffers of a CPU if they are close */
+	low = buffers[0].address;
+	high = buffers[0].address;
+	if (buffers[1].address && (buffers[1].address < low)) {
+		low = buffers[1].address;
+	}
+	if (buffers[1].address > high) {
+		high = buffers[1].address;
+	}
+	span_size = high - low + layout->printk_safe_size;
+	if (span_size > PERCPU_READ_SPAN) {
+		span_size = layout->printk_safe_size;
+	}
+	
+	/* __per_cpu_offset[] at once, up to highest CPU id */
+	offsets = mem_alloc(sizeof(uint64_t) * (cpus[cpu_count - 1] + 1));
+	span = mem_alloc(span_size);
+	if ((offsets == NULL) || (span == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_FREE;
+	}
+	if (elf_read_load_data(vmcore, per_cpu_offset, offsets,
+	                       sizeof(uint64_t) * (cpus[cpu_count - 1] + 1))) {
+		fprintf(stderr, "%s Can not read __per_cpu_offset.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	for (index = 0; index < cpu_count; index++) {
+		cpu = cpus[index];
+		if ((span_size > layout->printk_safe_size) &&
+		    elf_read_load_data(vmcore, low + offsets[cpu],
+		                       span, span_size)) {
+			fprintf(stderr, "%s Can not read buffers of CPU %d.\n",
+			        estr, cpu);
+			goto ERROR_FREE;
+		}
+		for (loop = 0; loop < sizeof(buffers) / sizeof(SafeBuffer);
+		     loop++) {
+			if (buffers[loop].address == 0) {
+				continue;
+			}
+			if (span_size > layout->printk_safe_size) {
+				position = buffers[loop].address - low;
+			}
+			else if (elf_read_load_data(vmcore, buffers[loop].address +
+			                            offsets[cpu], span, span_size)) {
+				fprintf(stderr, "%s Can not read %s of CPU %d.\n",
+				        estr, buffers[loop].symbol, cpu);
+				goto ERROR_FREE;
+			}
+			else {
+				position = 0;
+			}
+			if (percpu_add_lines(log, layout, span + position, cpu,
+			                     buffers[loop].label, &capacity)) {
+				goto ERROR_FREE;
+			}
+		}
+	}
+	
+	/* Texts are packed in record order */
+	for (loop = 0, position = 0; loop < log->count; loop++) {
+		log->records[loop].text = log->text + position;
+		position += log->records[loop].text_len;
+	}
+	log->seq = next_seq;
+	fprintf(stdout, "%s:    * Per-CPU:    %d lines of %d CPUs, %u lost\n",
+	        APP_NAME, log->count, cpu_count, log->lost);
+	
+	mem_free(cpus);
+	mem_free(offsets);
+	mem_free(span);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(cpus);
+	mem_free(offsets);
+	mem_free(span);
+	percpu_free_safe(log);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       percpu_free_safe() - Free per-CPU lines
+   ============================================================ */
+void percpu_free_safe(SafeLog *log)
+{
+	/* --- Assert check --- */
+	assert(log != NULL);
+	
+	mem_free(log->records);
+	mem_free(log->text);
+	memset(log, 0x00, sizeof(SafeLog));
+	return;
+}
+
+
+/* ============================================================
+       percpu_next_record() - Get next per-CPU line
+         Return 1 if record is set, 0 at end of lines.
+         Sequence numbers continue those of ring.
+   ============================================================ */
+int percpu_next_record(SafeLog *log, Record *record)
+{
+	/* --- Assert check --- */
+	assert(log != NULL);
+	assert(record != NULL);
+	
+	if (log->next >= log->count) {
+		return 0;
+	}
+	memcpy(record, &log->records[log->next], sizeof(Record));
+	record->seq = log->seq + log->next;
+	log->next++;
+	return 1;
+}
+
+
+/* ============================================================
+       percpu_read_console_seq() - Read first record not printed
+         Records from console_seq on never reached console.
+   ============================================================ */
+int percpu_read_console_seq(VMCore *vmcore, uint64_t *seq)
+{
+	/* --- Variables --- */
+	uint64_t address = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(seq != NULL);
+	
+	if (kallsyms_search_symbol(vmcore, "console_seq", &address) ||
+	    elf_read_load_uint64(vmcore, address, seq)) {
+		return RETVAL_FAILURE;
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       percpu_add_lines() - Cut lines from one printk_safe_seq_buf
+         len and message_lost are atomic_t, buffer is text of
+         vprintk with KERN_SOH level prefixes.
+   ============================================================ */
+static int percpu_add_lines(SafeLog *log, Layout *layout, char *data,
+                            int cpu, char *label, size_t *capacity)
+{
+	/* --- Variables --- */
+	int32_t length = 0;
+	int32_t lost = 0;
+	char *line = NULL;
+	char *limit = NULL;
+	char *end = NULL;
+	
+	/* --- Assert check --- */
+	assert(log != NULL);
+	assert(layout != NULL);
+	assert(data != NULL);
+	assert(label != NULL);
+	assert(capacity != NULL);
+	
+	memcpy(&length, data + layout->printk_safe_len, sizeof(length));
+	if (layout->printk_safe_lost != LAYOUT_NONE) {
+		memcpy(&lost, data + layout->printk_safe_lost, sizeof(lost));
+		if (lost > 0) {
+			log->lost += lost;
+		}
+	}
+	if (length <= 0) {
+		return RETVAL_SUCCESS;
+	}
+	if (length > layout->printk_safe_size - layout->printk_safe_buffer) {
+		/* Being written at crash, keep what fits */
+		length = layout->printk_safe_size - layout->printk_safe_buffer;
+	}
+	
+	line = data + layout->printk_safe_buffer;
+	limit = line + length;
+	while (line < limit) {
+		end = memchr(line, '\n', limit - line);
+		if (end == NULL) {
+			end = limit;
+		}
+		if (percpu_add_line(log, line, end - line, cpu, label, capacity)) {
+			return RETVAL_FAILURE;
+		}
+		line = end + 1;
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       percpu_add_line() - Add one labelled line to SafeLog
+         Level is taken from KERN_SOH prefixes, text pointers
+         are set by caller when the pool stops moving.
+   ============================================================ */
+static int percpu_add_line(SafeLog *log, char *line, size_t length,
+                           int cpu, char *label, size_t *capacity)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] percpu_add_line:";
+	Record *record = NULL;
+	Record *records = NULL;
+	char *text = NULL;
+	size_t needed = 0;
+	int level = -1;
+	int written = 0;
+	
+	/* --- Assert check --- */
+	assert(log != NULL);
+	assert(line != NULL);
+	assert(label != NULL);
+	assert(capacity != NULL);
+	
+	while ((length >= 2) && (line[0] == KERN_SOH)) {
+		if ((line[1] >= '0') && (line[1] <= '7') && (level < 0)) {
+			level = line[1] - '0';
+		}
+		line += 2;
+		length -= 2;
+	}
+	if (length == 0) {
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Grow record index and text pool */
+	if ((log->count % PERCPU_RECORD_STEP) == 0) {
+		records = mem_realloc(log->records,
+		                      sizeof(Record) *
+		                      (log->count + PERCPU_RECORD_STEP));
+		if (records == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		log->records = records;
+	}
+	needed = log->text_size + PERCPU_LABEL_SIZE + length;
+	if (needed > *capacity) {
+		text = mem_realloc(log->text, needed * 2);
+		if (text == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		log->text = text;
+		*capacity = needed * 2;
+	}
+	
+	written = snprintf(log->text + log->text_size, PERCPU_LABEL_SIZE,
+	                   "[CPU%d %s] ", cpu, label);
+	memcpy(log->text + log->text_size + written, line, length);
+	record = &log->records[log->count];
+	memset(record, 0x00, sizeof(Record));
+	record->level = level;
+	record->facility = -1;
+	record->prefixed = 1;
+	record->text_len = written + length;
+	log->text_size += record->text_len;
+	log->count++;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ====================================================================== */
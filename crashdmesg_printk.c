@@ -0,0 +1,949 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_printk.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Prototypes --- */
+static int printk_read_legacy(VMCore *vmcore, Ring *ring);
+static int printk_read_record(VMCore *vmcore, Ring *ring);
+static char *printk_ring_window(Ring *ring, size_t pos, size_t length,
+                                size_t *avail);
+static size_t printk_check_record(VMCore *vmcore, Ring *ring, size_t pos,
+                                  size_t end, uint64_t *ts_nsec);
+static int printk_next_legacy(Ring *ring, Record *record);
+static int printk_next_record_struct(VMCore *vmcore, Ring *ring,
+                                     Record *record);
+
+
+/* ============================================================
+       printk_read_ring() - Read ring buffer from vmcore
+   ============================================================ */
+int printk_read_ring(VMCore *vmcore, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_read_ring:";
+	uint64_t value = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	
+	memset(ring, 0x00, sizeof(Ring));
+	
+	/* Detect ring buffer format */
+	if (! elf_search_vmcoreinfo_number(vmcore, "SYMBOL(log_end)", &value)) {
+		vmcore->log_format = LOGFORMAT_LEGACY;
+		return printk_read_legacy(vmcore, ring);
+	}
+	if (! elf_search_vmcoreinfo_number(vmcore,
+	                                   "SYMBOL(log_first_idx)", &value)) {
+		vmcore->log_format = LOGFORMAT_RECORD;
+		if (vmcore->plan.layout.printk_log_size == LAYOUT_NONE) {
+			fprintf(stderr, "%s Layout profile \"%s\" has no printk_log.\n",
+			        estr, vmcore->plan.profile->name);
+			return RETVAL_FAILURE;
+		}
+		return printk_read_record(vmcore, ring);
+	}
+	
+	fprintf(stderr, "%s Unknown ring buffer format.\n", estr);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       printk_free_ring() - Free ring buffer
+   ============================================================ */
+void printk_free_ring(Ring *ring)
+{
+	/* --- Assert check --- */
+	assert(ring != NULL);
+	
+	mem_free(ring->buffer);
+	mem_free(ring->extents);
+	memset(ring, 0x00, sizeof(Ring));
+	return;
+}
+
+
+/* ============================================================
+       printk_setup_ring() - Allocate window and Read first part
+         Whole ring is read at once if memory allows, else it
+         is read in windows of what the memory limit leaves.
+   ============================================================ */
+int printk_setup_ring(Ring *ring, RingExtent *extents, int extent_count)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_setup_ring:";
+	size_t available = 0;
+	size_t avail = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(ring != NULL);
+	assert(extents != NULL);
+	assert(extent_count > 0);
+	
+	ring->extents = mem_alloc(sizeof(RingExtent) * extent_count);
+	if (ring->extents == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	memcpy(ring->extents, extents, sizeof(RingExtent) * extent_count);
+	ring->extent_count = extent_count;
+	ring->size = 0;
+	for (loop = 0; loop < extent_count; loop++) {
+		ring->size += extents[loop].size;
+	}
+	if (ring->size == 0) {
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Leave half of available memory to others */
+	available = mem_available() / 2;
+	ring->capacity = ring->size;
+	if (ring->size > available) {
+		ring->capacity = available & ~((size_t) CACHE_BLOCK_SIZE - 1);
+		if (ring->capacity < PRINTK_MIN_WINDOW) {
+			ring->capacity = PRINTK_MIN_WINDOW;
+		}
+		if (ring->capacity > ring->size) {
+			ring->capacity = ring->size;
+		}
+	}
+	ring->buffer = mem_alloc(ring->capacity);
+	if (ring->buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (ring->capacity < ring->size) {
+		fprintf(stdout, "%s:    * Window:               0x%08x\n",
+		        APP_NAME, (unsigned) ring->capacity);
+	}
+	
+	if (printk_ring_window(ring, 0, 1, &avail) == NULL) {
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       printk_ring_window() - Get ring contents at pos
+         At least length bytes from pos are in the window,
+         avail is set to bytes until end of window.
+         Window is read again from pos if needed.
+   ============================================================ */
+static char *printk_ring_window(Ring *ring, size_t pos, size_t length,
+                                size_t *avail)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_ring_window:";
+	RingExtent *extent = NULL;
+	size_t start = 0; /* Ring offset of extent */
+	size_t done = 0;
+	size_t skip = 0;
+	size_t size = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(ring != NULL);
+	assert(avail != NULL);
+	
+	if ((length > ring->capacity) || (pos + length > ring->size)) {
+		return NULL;
+	}
+	if ((pos >= ring->window) &&
+	    (pos + length <= ring->window + ring->window_size)) {
+		*avail = ring->window + ring->window_size - pos;
+		return ring->buffer + (pos - ring->window);
+	}
+	
+	/* Read window from extents */
+	ring->window = pos;
+	ring->window_size = ring->size - pos;
+	if (ring->window_size > ring->capacity) {
+		ring->window_size = ring->capacity;
+	}
+	for (loop = 0; loop < ring->extent_count; loop++) {
+		extent = &ring->extents[loop];
+		if (pos + done >= start + extent->size) {
+			start += extent->size;
+			continue;
+		}
+		skip = pos + done - start;
+		size = extent->size - skip;
+		if (size > ring->window_size - done) {
+			size = ring->window_size - done;
+		}
+		if (file_read(extent->file, (void*) ring->buffer + done,
+		              extent->offset + skip, size)) {
+			fprintf(stderr, "%s Can not read ring buffer.\n", estr);
+			ring->window_size = 0;
+			return NULL;
+		}
+		done += size;
+		start += extent->size;
+		if (done == ring->window_size) {
+			break;
+		}
+	}
+	
+	*avail = ring->window_size;
+	return ring->buffer;
+}
+
+
+/* ============================================================
+       printk_read_legacy() - Read plain text log_buf
+   ============================================================ */
+static int printk_read_legacy(VMCore *vmcore, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_read_legacy:";
+	
+	/* ringbuffer info from vmcoreinfo */
+	uint64_t log_buf_vaddr = 0;
+	uint64_t log_end_vaddr = 0;
+	uint64_t log_buf_len_vaddr = 0;
+	uint64_t logged_chars_vaddr = 0;
+	
+	/* Pointer of ring buffer */
+	RingExtent extents[2];
+	memset(extents, 0x00, sizeof(extents));
+	File *file1 = NULL;
+	off_t ringbuffer1 = 0; /* file offset */
+	uint32_t ringbuffer1_size = 0;
+	File *file2 = NULL;
+	off_t ringbuffer2 = 0; /* file offset */
+	uint32_t ringbuffer2_size = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	
+	/* Read vaddr of ringbuffer */
+	fprintf(stdout, "%s:  Read Symbol from VMCOREINFO.\n", APP_NAME);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_buf", &log_buf_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_end", &log_end_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_buf_len", &log_buf_len_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "logged_chars", &logged_chars_vaddr);
+	if ((! log_buf_vaddr) || (! log_end_vaddr) ||
+	    (! log_buf_len_vaddr) || (! logged_chars_vaddr)) {
+		fprintf(stderr, "%s Can not read Symbol from VMCOREINFO.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	fprintf(stdout, "%s:    * log_buf:      0x%016lx\n",
+	        APP_NAME, log_buf_vaddr);
+	fprintf(stdout, "%s:    * log_end:      0x%016lx\n",
+	        APP_NAME, log_end_vaddr);
+	fprintf(stdout, "%s:    * log_buf_len:  0x%016lx\n",
+	        APP_NAME, log_buf_len_vaddr);
+	fprintf(stdout, "%s:    * logged_chars: 0x%016lx\n",
+	        APP_NAME, logged_chars_vaddr);
+	
+	/* Read LOAD segment */
+	fprintf(stdout, "%s:  Read LOAD section about Ring buffer..\n",
+	        APP_NAME);
+	elf_read_load_uint64(vmcore, log_buf_vaddr, &vmcore->log_buf);
+	elf_read_load_uint32(vmcore, log_end_vaddr, &vmcore->log_end);
+	elf_read_load_int32(vmcore, log_buf_len_vaddr, &vmcore->log_buf_len);
+	elf_read_load_uint32(vmcore, logged_chars_vaddr, &vmcore->logged_chars);
+	if ((! vmcore->log_buf) || (! vmcore->log_end) ||
+	    (! vmcore->log_buf_len) || (! vmcore->logged_chars)) {
+		fprintf(stderr, "%s Can not read value from LOAD segment.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	fprintf(stdout, "%s:    * log_buf:      0x%016lx\n",
+	        APP_NAME, vmcore->log_buf);
+	fprintf(stdout, "%s:    * log_end:              0x%08x\n",
+	        APP_NAME, vmcore->log_end);
+	fprintf(stdout, "%s:    * log_buf_len:          0x%08x\n",
+	        APP_NAME, vmcore->log_buf_len);
+	fprintf(stdout, "%s:    * logged_chars:         0x%08x\n",
+	        APP_NAME, vmcore->logged_chars);
+	
+	/* Check log_buf size for safety */
+	if ((vmcore->log_buf_len < 0) ||
+	    (vmcore->log_buf_len > MAX_LOGBUF_LIMIT)) {
+		fprintf(stderr, "%s log_buf_len is too big.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Calculate Dump address */
+	fprintf(stdout, "%s:  Calculating dump area address.\n", APP_NAME);
+	if ( vmcore->logged_chars < vmcore->log_buf_len ) {
+		/* ring buffer not filled */
+		ringbuffer1_size = vmcore->logged_chars;
+		if (elf_search_load_data(vmcore, vmcore->log_buf, ringbuffer1_size,
+		                         &file1, &ringbuffer1)) {
+			fprintf(stderr, "%s Ring buffer not found in vmcore.\n", estr);
+			goto ERROR_FREE;
+		}
+		fprintf(stdout, "%s:   Ring buffer Part: 1/1\n", APP_NAME);
+		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
+		        APP_NAME, ringbuffer1);
+		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
+		        APP_NAME, ringbuffer1_size);
+	}
+	else {
+		/* ring buffer filled  */
+		ringbuffer1_size = vmcore->log_buf_len -
+		                   (vmcore->log_end & (vmcore->log_buf_len-1));
+		ringbuffer2_size = vmcore->log_end & (vmcore->log_buf_len-1);
+		if ( ((ringbuffer1_size + ringbuffer2_size) != vmcore->log_buf_len) ||
+		     ((ringbuffer1_size + ringbuffer2_size) > MAX_LOGBUF_LIMIT) ) {
+			fprintf(stderr, "%s Dump area size calculation failed.\n", estr);
+			goto ERROR_FREE;
+		}
+		if (elf_search_load_data(vmcore, vmcore->log_buf +
+			                     (vmcore->log_end & (vmcore->log_buf_len-1)),
+		                         ringbuffer1_size, &file1, &ringbuffer1) ||
+		    ((ringbuffer2_size > 0) &&
+		     elf_search_load_data(vmcore, vmcore->log_buf, ringbuffer2_size,
+		                          &file2, &ringbuffer2))) {
+			fprintf(stderr, "%s Ring buffer not found in vmcore.\n", estr);
+			goto ERROR_FREE;
+		}
+		fprintf(stdout, "%s:   Ring buffer Part: 1/2\n", APP_NAME);
+		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
+		        APP_NAME, ringbuffer1);
+		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
+		        APP_NAME, ringbuffer1_size);
+		fprintf(stdout, "%s:   Ring buffer Part: 2/2\n", APP_NAME);
+		fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
+		        APP_NAME, ringbuffer2);
+		fprintf(stdout, "%s:    * Size:                 0x%08x\n",
+		        APP_NAME, ringbuffer2_size);
+	}
+	
+	/* DUMP */
+	extents[0].file = file1;
+	extents[0].offset = ringbuffer1;
+	extents[0].size = ringbuffer1_size;
+	extents[1].file = file2;
+	extents[1].offset = ringbuffer2;
+	extents[1].size = ringbuffer2_size;
+	if (printk_setup_ring(ring, extents, (ringbuffer2_size > 0) ? 2 : 1)) {
+		fprintf(stderr, "%s Can not read ring buffer.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	printk_free_ring(ring);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       printk_read_record() - Read struct printk_log buffer
+   ============================================================ */
+static int printk_read_record(VMCore *vmcore, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_read_record:";
+	RingExtent extent;
+	memset(&extent, 0x00, sizeof(RingExtent));
+	
+	/* ringbuffer info from vmcoreinfo */
+	uint64_t log_buf_vaddr = 0;
+	uint64_t log_buf_len_vaddr = 0;
+	uint64_t log_first_idx_vaddr = 0;
+	uint64_t log_next_idx_vaddr = 0;
+	uint64_t log_first_seq_vaddr = 0;
+	uint64_t log_next_seq_vaddr = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	
+	/* Read vaddr of ringbuffer */
+	fprintf(stdout, "%s:  Read Symbol from VMCOREINFO.\n", APP_NAME);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_buf", &log_buf_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_buf_len", &log_buf_len_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_first_idx",
+	                             &log_first_idx_vaddr);
+	elf_search_vmcoreinfo_symbol(vmcore, "log_next_idx",
+	                             &log_next_idx_vaddr);
+	/* log_{first,next}_seq are not exported by all kernels */
+	elf_search_vmcoreinfo_number(vmcore, "SYMBOL(log_first_seq)",
+	                             &log_first_seq_vaddr);
+	elf_search_vmcoreinfo_number(vmcore, "SYMBOL(log_next_seq)",
+	                             &log_next_seq_vaddr);
+	if ((! log_buf_vaddr) || (! log_buf_len_vaddr) ||
+	    (! log_first_idx_vaddr) || (! log_next_idx_vaddr)) {
+		fprintf(stderr, "%s Can not read Symbol from VMCOREINFO.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	fprintf(stdout, "%s:    * log_buf:       0x%016lx\n",
+	        APP_NAME, log_buf_vaddr);
+	fprintf(stdout, "%s:    * log_buf_len:   0x%016lx\n",
+	        APP_NAME, log_buf_len_vaddr);
+	fprintf(stdout, "%s:    * log_first_idx: 0x%016lx\n",
+	        APP_NAME, log_first_idx_vaddr);
+	fprintf(stdout, "%s:    * log_next_idx:  0x%016lx\n",
+	        APP_NAME, log_next_idx_vaddr);
+	
+	/* Read LOAD segment */
+	fprintf(stdout, "%s:  Read LOAD section about Ring buffer..\n",
+	        APP_NAME);
+	if (elf_read_load_uint64(vmcore, log_buf_vaddr, &vmcore->log_buf) ||
+	    elf_read_load_int32(vmcore, log_buf_len_vaddr, &vmcore->log_buf_len) ||
+	    elf_read_load_uint32(vmcore, log_first_idx_vaddr,
+	                         &vmcore->log_first_idx) ||
+	    elf_read_load_uint32(vmcore, log_next_idx_vaddr,
+	                         &vmcore->log_next_idx)) {
+		fprintf(stderr, "%s Can not read value from LOAD segment.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (log_first_seq_vaddr && log_next_seq_vaddr) {
+		if (elf_read_load_uint64(vmcore, log_first_seq_vaddr,
+		                         &vmcore->log_first_seq) ||
+		    elf_read_load_uint64(vmcore, log_next_seq_vaddr,
+		                         &vmcore->log_next_seq)) {
+			fprintf(stderr, "%s Can not read sequence number.\n", estr);
+			return RETVAL_FAILURE;
+		}
+	}
+	fprintf(stdout, "%s:    * log_buf:       0x%016lx\n",
+	        APP_NAME, vmcore->log_buf);
+	fprintf(stdout, "%s:    * log_buf_len:           0x%08x\n",
+	        APP_NAME, vmcore->log_buf_len);
+	fprintf(stdout, "%s:    * log_first_idx:         0x%08x\n",
+	        APP_NAME, vmcore->log_first_idx);
+	fprintf(stdout, "%s:    * log_next_idx:          0x%08x\n",
+	        APP_NAME, vmcore->log_next_idx);
+	
+	/* Check log_buf size for safety */
+	if ((vmcore->log_buf_len <= 0) ||
+	    (vmcore->log_buf_len > MAX_LOGBUF_LIMIT) ||
+	    (vmcore->log_first_idx >= vmcore->log_buf_len) ||
+	    (vmcore->log_next_idx >= vmcore->log_buf_len)) {
+		fprintf(stderr, "%s Invalid log_buf_len or index.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Records are read in place, whole buffer at once if possible */
+	extent.size = vmcore->log_buf_len;
+	if (elf_search_load_data(vmcore, vmcore->log_buf, extent.size,
+	                         &extent.file, &extent.offset)) {
+		fprintf(stderr, "%s Ring buffer not found in vmcore.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	fprintf(stdout, "%s:   Ring buffer Part: 1/1\n", APP_NAME);
+	fprintf(stdout, "%s:    * File Offset:  0x%016lx\n",
+	        APP_NAME, extent.offset);
+	fprintf(stdout, "%s:    * Size:                 0x%08x\n",
+	        APP_NAME, (unsigned) extent.size);
+	if (printk_setup_ring(ring, &extent, 1)) {
+		fprintf(stderr, "%s Can not read ring buffer.\n", estr);
+		goto ERROR_FREE;
+	}
+	ring->cursor = vmcore->log_first_idx;
+	ring->seq = vmcore->log_first_seq;
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	printk_free_ring(ring);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       printk_next_record() - Get next record from ring buffer
+         Return 1 if record is set, 0 at end of ring buffer.
+   ============================================================ */
+int printk_next_record(VMCore *vmcore, Ring *ring, Record *record)
+{
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(record != NULL);
+	
+	memset(record, 0x00, sizeof(Record));
+	record->level = -1;
+	record->facility = -1;
+	if (ring->buffer == NULL) {
+		return 0;
+	}
+	
+	if (vmcore->log_format == LOGFORMAT_LEGACY) {
+		return printk_next_legacy(ring, record);
+	}
+	return printk_next_record_struct(vmcore, ring, record);
+}
+
+
+/* ============================================================
+       printk_seek_record() - Get record at saved position
+         cursor and seq are Ring values before the record was
+         taken. Window is placed to end after it, so seeking
+         backward does not read the window for each record.
+   ============================================================ */
+int printk_seek_record(VMCore *vmcore, Ring *ring, size_t cursor,
+                       uint64_t seq, Record *record)
+{
+	/* --- Variables --- */
+	size_t start = 0;
+	size_t avail = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(record != NULL);
+	
+	if ((ring->buffer != NULL) && (cursor < ring->size) &&
+	    ((cursor < ring->window) ||
+	     (cursor >= ring->window + ring->window_size))) {
+		/* Window holds a whole record, see PRINTK_MIN_WINDOW */
+		if (cursor + PRINTK_MIN_WINDOW / 2 > ring->capacity) {
+			start = cursor + PRINTK_MIN_WINDOW / 2 - ring->capacity;
+		}
+		if (start > cursor) {
+			start = cursor;
+		}
+		printk_ring_window(ring, start, 1, &avail);
+	}
+	ring->cursor = cursor;
+	ring->seq = seq;
+	return printk_next_record(vmcore, ring, record);
+}
+
+
+/* ============================================================
+       printk_read_seq() - Read log_{first,next}_seq by kallsyms
+         Not all VMCOREINFO export them, records are numbered
+         from 0 then. Ring must not be iterated yet.
+   ============================================================ */
+int printk_read_seq(VMCore *vmcore, Ring *ring)
+{
+	/* --- Variables --- */
+	uint64_t first_vaddr = 0;
+	uint64_t next_vaddr = 0;
+	uint64_t first_seq = 0;
+	uint64_t next_seq = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	
+	if ((vmcore->log_format != LOGFORMAT_RECORD) ||
+	    (vmcore->log_next_seq != 0)) {
+		return RETVAL_SUCCESS;
+	}
+	if (kallsyms_search_symbol(vmcore, "log_first_seq", &first_vaddr) ||
+	    kallsyms_search_symbol(vmcore, "log_next_seq", &next_vaddr) ||
+	    elf_read_load_uint64(vmcore, first_vaddr, &first_seq) ||
+	    elf_read_load_uint64(vmcore, next_vaddr, &next_seq) ||
+	    (first_seq > next_seq)) {
+		return RETVAL_FAILURE;
+	}
+	vmcore->log_first_seq = first_seq;
+	vmcore->log_next_seq = next_seq;
+	ring->seq = first_seq;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       printk_head() - Position after newest record
+         Sequence number is counted by walk if kernel does not
+         keep it. Iteration of ring is kept.
+   ============================================================ */
+int printk_head(VMCore *vmcore, Ring *ring, size_t *cursor, uint64_t *seq)
+{
+	/* --- Variables --- */
+	Record record;
+	memset(&record, 0x00, sizeof(Record));
+	size_t saved_cursor = 0;
+	uint64_t saved_seq = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(cursor != NULL);
+	assert(seq != NULL);
+	
+	if (vmcore->log_format == LOGFORMAT_RECORD) {
+		*cursor = vmcore->log_next_idx;
+		if (vmcore->log_next_seq != 0) {
+			*seq = vmcore->log_next_seq;
+			return RETVAL_SUCCESS;
+		}
+	}
+	else {
+		*cursor = ring->size;
+	}
+	
+	saved_cursor = ring->cursor;
+	saved_seq = ring->seq;
+	while (printk_next_record(vmcore, ring, &record));
+	*seq = ring->seq;
+	ring->cursor = saved_cursor;
+	ring->seq = saved_seq;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       printk_sync_record() - Find record boundary in [from, end)
+         Records have no link backward. First offset whose
+         chain of len reaches end exactly is taken, end is
+         PRINTK_WRAP for the zero header where ring wraps.
+         Text log_buf lines start after newline.
+         Return 1 if ret is set, 0 if not found.
+   ============================================================ */
+int printk_sync_record(VMCore *vmcore, Ring *ring, size_t from, size_t end,
+                       size_t *ret)
+{
+	/* --- Variables --- */
+	Layout *layout = NULL;
+	char *data = NULL;
+	char *limit = NULL;
+	char *hit = NULL;
+	size_t candidate = 0;
+	size_t length = 0;
+	size_t pos = 0;
+	size_t avail = 0;
+	uint64_t ts_nsec = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(ret != NULL);
+	
+	if (vmcore->log_format == LOGFORMAT_LEGACY) {
+		if (from == 0) {
+			*ret = 0;
+			return 1;
+		}
+		if ((end > ring->size) || (from >= end)) {
+			return 0;
+		}
+		length = end - from;
+		if (length >= ring->capacity) {
+			length = ring->capacity - 1;
+		}
+		data = printk_ring_window(ring, from - 1, length, &avail);
+		if (data == NULL) {
+			return 0;
+		}
+		hit = memchr(data, '\n', length);
+		if (hit == NULL) {
+			return 0;
+		}
+		*ret = from + (hit - data);
+		return 1;
+	}
+	
+	layout = &vmcore->plan.layout;
+	candidate = (from + PRINTK_RECORD_ALIGN - 1) &
+	            ~((size_t) PRINTK_RECORD_ALIGN - 1);
+	for (; (candidate < end) && (candidate < ring->size);
+	     candidate += PRINTK_RECORD_ALIGN) {
+		ts_nsec = 0;
+		for (pos = candidate; pos != end; pos += length) {
+			length = printk_check_record(vmcore, ring, pos, end, &ts_nsec);
+			if (length == 0) {
+				break;
+			}
+		}
+		if (pos == end) {
+			*ret = candidate;
+			return 1;
+		}
+		if ((end != PRINTK_WRAP) || (pos == candidate)) {
+			continue;
+		}
+		
+		/* Wrap is where header does not fit, or zero header */
+		if (pos + layout->printk_log_size > ring->size) {
+			*ret = candidate;
+			return 1;
+		}
+		data = printk_ring_window(ring, pos, layout->printk_log_size, &avail);
+		if (data == NULL) {
+			return 0;
+		}
+		for (limit = data + layout->printk_log_size;
+		     (data < limit) && (*data == 0x00); data++);
+		if (data == limit) {
+			*ret = candidate;
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+
+/* ============================================================
+       printk_check_record() - Check struct printk_log at pos
+         Record must end by end, have time not before ts_nsec,
+         and zero padding as log_store() writes.
+         Return len of record, 0 if it is not a record.
+   ============================================================ */
+static size_t printk_check_record(VMCore *vmcore, Ring *ring, size_t pos,
+                                  size_t end, uint64_t *ts_nsec)
+{
+	/* --- Variables --- */
+	Layout *layout = NULL;
+	char *data = NULL;
+	size_t avail = 0;
+	size_t used = 0;
+	uint64_t ts = 0;
+	uint16_t len = 0;
+	uint16_t text_len = 0;
+	uint16_t dict_len = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(ts_nsec != NULL);
+	
+	layout = &vmcore->plan.layout;
+	if (pos + layout->printk_log_size > ring->size) {
+		return 0;
+	}
+	data = printk_ring_window(ring, pos, layout->printk_log_size, &avail);
+	if (data == NULL) {
+		return 0;
+	}
+	memcpy(&len, data + layout->printk_log_len, sizeof(len));
+	memcpy(&text_len, data + layout->printk_log_text_len, sizeof(text_len));
+	if (layout->printk_log_dict_len != LAYOUT_NONE) {
+		memcpy(&dict_len, data + layout->printk_log_dict_len,
+		       sizeof(dict_len));
+	}
+	memcpy(&ts, data + layout->printk_log_ts_nsec, sizeof(ts));
+	used = layout->printk_log_size + text_len + dict_len;
+	if ((len < layout->printk_log_size) || (len % PRINTK_RECORD_ALIGN) ||
+	    (pos + len > ring->size) || (pos + len > end) ||
+	    (used > len) || (ts < *ts_nsec)) {
+		return 0;
+	}
+	data = printk_ring_window(ring, pos, len, &avail);
+	if (data == NULL) {
+		return 0;
+	}
+	for (; (used < len) && (data[used] == 0x00); used++);
+	if (used < len) {
+		return 0;
+	}
+	
+	*ts_nsec = ts;
+	return len;
+}
+
+
+/* ============================================================
+       printk_next_legacy() - Cut one line from text log_buf
+   ============================================================ */
+static int printk_next_legacy(Ring *ring, Record *record)
+{
+	/* --- Variables --- */
+	char *line = NULL;
+	char *limit = NULL;
+	char *newline = NULL;
+	char *cursor = NULL;
+	size_t avail = 0;
+	uint64_t sec = 0;
+	uint64_t usec = 0;
+	
+	/* --- Assert check --- */
+	assert(ring != NULL);
+	assert(record != NULL);
+	
+	/* Skip unused (zero filled) area */
+	for (;;) {
+		if (ring->cursor >= ring->size) {
+			return 0;
+		}
+		line = printk_ring_window(ring, ring->cursor, 1, &avail);
+		if (line == NULL) {
+			return 0;
+		}
+		limit = line + avail;
+		while ((line < limit) && (*line == 0x00)) {
+			line++;
+		}
+		ring->cursor += avail - (limit - line);
+		if (line < limit) {
+			break;
+		}
+	}
+	
+	/* Line continues after window, read again from line start */
+	newline = memchr(line, '\n', limit - line);
+	if ((newline == NULL) && (ring->cursor + (limit - line) < ring->size)) {
+		avail = ring->size - ring->cursor;
+		line = printk_ring_window(ring, ring->cursor,
+		                          (avail < ring->capacity) ?
+		                          avail : ring->capacity, &avail);
+		if (line == NULL) {
+			return 0;
+		}
+		limit = line + avail;
+		newline = memchr(line, '\n', limit - line);
+	}
+	if (newline == NULL) {
+		newline = limit;
+	}
+	record->seq = ring->seq++;
+	record->prefixed = 1;
+	record->text = line;
+	record->text_len = newline - line;
+	ring->cursor += (newline < limit) ? newline - line + 1 : limit - line;
+	
+	/* "<N>" level prefix, then "[ sec.usec]" if CONFIG_PRINTK_TIME */
+	cursor = line;
+	if ((newline - cursor >= 3) && (cursor[0] == '<') &&
+	    (cursor[1] >= '0') && (cursor[1] <= '7') && (cursor[2] == '>')) {
+		record->level = cursor[1] - '0';
+		cursor += 3;
+	}
+	if ((cursor < newline) && (*cursor == '[')) {
+		for (cursor++; (cursor < newline) && (*cursor == ' '); cursor++);
+		for (; (cursor < newline) && (*cursor >= '0') && (*cursor <= '9');
+		     cursor++) {
+			sec = sec * 10 + (*cursor - '0');
+		}
+		if ((cursor < newline) && (*cursor == '.')) {
+			for (cursor++;
+			     (cursor < newline) && (*cursor >= '0') && (*cursor <= '9');
+			     cursor++) {
+				usec = usec * 10 + (*cursor - '0');
+			}
+			if ((cursor < newline) && (*cursor == ']')) {
+				record->ts_nsec = sec * 1000000000ULL + usec * 1000;
+			}
+		}
+	}
+	
+	return 1;
+}
+
+
+/* ============================================================
+       printk_next_record_struct() - Decode one struct printk_log
+   ============================================================ */
+static int printk_next_record_struct(VMCore *vmcore, Ring *ring,
+                                     Record *record)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] printk_next_record_struct:";
+	Layout *layout = NULL;
+	char *header = NULL;
+	uint16_t len = 0;
+	uint16_t text_len = 0;
+	uint8_t flags = 0;
+	size_t avail = 0;
+	int wrapped = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(record != NULL);
+	
+	layout = &vmcore->plan.layout;
+	
+	for (;;) {
+		if ((vmcore->log_next_seq != 0) &&
+		    (ring->seq >= vmcore->log_next_seq)) {
+			return 0;
+		}
+		if (ring->cursor == vmcore->log_next_idx) {
+			if ((vmcore->log_next_seq == 0) || (wrapped)) {
+				return 0;
+			}
+		}
+	
+		/* Header must fit, len == 0 means wrap to start of buffer */
+		if (ring->cursor + layout->printk_log_size > ring->size) {
+			len = 0;
+		}
+		else {
+			header = printk_ring_window(ring, ring->cursor,
+			                            layout->printk_log_size, &avail);
+			if (header == NULL) {
+				return 0;
+			}
+			memcpy(&len, header + layout->printk_log_len, sizeof(len));
+		}
+		if (len == 0) {
+			if (wrapped) {
+				fprintf(stderr, "%s Broken record at 0x%x.\n",
+				        estr, (unsigned) ring->cursor);
+				return 0;
+			}
+			ring->cursor = 0;
+			wrapped = 1;
+			continue;
+		}
+		break;
+	}
+	
+	memcpy(&text_len, header + layout->printk_log_text_len, sizeof(text_len));
+	if ((len < layout->printk_log_size) ||
+	    (ring->cursor + len > ring->size) ||
+	    (text_len > len - layout->printk_log_size)) {
+		fprintf(stderr, "%s Broken record at 0x%x.\n",
+		        estr, (unsigned) ring->cursor);
+		return 0;
+	}
+	header = printk_ring_window(ring, ring->cursor, len, &avail);
+	if (header == NULL) {
+		return 0;
+	}
+	
+	record->seq = ring->seq++;
+	memcpy(&record->ts_nsec, header + layout->printk_log_ts_nsec,
+	       sizeof(record->ts_nsec));
+	if (layout->printk_log_facility != LAYOUT_NONE) {
+		record->facility = (uint8_t) header[layout->printk_log_facility];
+	}
+	if (layout->printk_log_flags != LAYOUT_NONE) {
+		flags = (uint8_t) header[layout->printk_log_flags];
+		record->level = flags >> 5;
+	}
+	record->text = header + layout->printk_log_size;
+	record->text_len = text_len;
+	ring->cursor += len;
+	
+	return 1;
+}
+
+
+/* ============================================================
+       printk_print_record() - Print record like dmesg
+   ============================================================ */
+void printk_print_record(FILE *stream, Record *record)
+{
+	/* --- Assert check --- */
+	assert(stream != NULL);
+	assert(record != NULL);
+	
+	if (! record->prefixed) {
+		fprintf(stream, "[%5lu.%06lu] ",
+		        (unsigned long) (record->ts_nsec / 1000000000ULL),
+		        (unsigned long) (record->ts_nsec % 1000000000ULL) / 1000);
+	}
+	fwrite(record->text, 1, record->text_len, stream);
+	fputc('\n', stream);
+	return;
+}
+
+
+/* ====================================================================== */
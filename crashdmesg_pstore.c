@@ -0,0 +1,682 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_pstore.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#include <dirent.h>
+#include <limits.h>
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
+
+/* --- Constant values --- */
+
+/* struct persistent_ram_buffer, See:fs/pstore/ram_core.c */
+#define PSTORE_SIG 0x43474244 /* PERSISTENT_RAM_SIG "DBGC" */
+#define PSTORE_HEADER_SIZE 12 /* sig, atomic_t start, atomic_t size */
+#define PSTORE_ALIGN 4 /* Zones start at least 4 bytes aligned */
+#define PSTORE_ZONE_MAX 16777216 /* 16MB, Sanity limit of one zone */
+#define PSTORE_TEXT_MAX 67108864 /* 64MB, Max decompressed dmesg */
+#define PSTORE_SCAN_CHUNK 1048576 /* 1MB, Read unit of memory scan */
+#define PSTORE_ZONE_STEP 16 /* Grow step of zone list */
+#define PSTORE_NAME_SIZE 64
+
+/* Zone type, also sort order of output */
+#define PSTORE_DMESG 0
+#define PSTORE_CONSOLE 1
+#define PSTORE_PMSG 2
+
+
+/* --- Data structures --- */
+
+/* One ramoops zone or pstore file */
+typedef struct {
+	char name[PSTORE_NAME_SIZE];
+	int type; /* PSTORE_* */
+	int64_t sec; /* Time of dump, "====sec.nsec" or file mtime */
+	long nsec;
+	unsigned int part; /* "Reason#N PartM", Part1 is the newest */
+	int compressed; /* "-C" header or ".enc.z" file */
+	char *data; /* Text, oldest first */
+	size_t size;
+} PstoreZone;
+
+/* Zones of one input */
+typedef struct {
+	PstoreZone *zones;
+	int count;
+} Pstore;
+
+
+/* --- Prototypes --- */
+static int pstore_read_dir(Pstore *pstore, char *path);
+static int pstore_scan_memory(Pstore *pstore, VMCore *vmcore,
+                              uint64_t start, uint64_t size);
+static int pstore_scan_load(Pstore *pstore, LoadSegment *load,
+                            uint64_t start, uint64_t end, char *buffer);
+static int pstore_read_zone(Pstore *pstore, LoadSegment *load,
+                            uint64_t offset, uint64_t end, size_t *used);
+static int pstore_add_zone(Pstore *pstore, char *name, char *data,
+                           size_t size, int type, int64_t sec, long nsec);
+static int pstore_decompress(PstoreZone *zone);
+static int pstore_compare_zone(const void *a, const void *b);
+static int pstore_build_ring(Pstore *pstore, Ring *ring);
+static void pstore_free(Pstore *pstore);
+#ifdef HAVE_ZLIB
+static voidpf pstore_zalloc(voidpf opaque, uInt items, uInt size);
+static void pstore_zfree(voidpf opaque, voidpf address);
+#endif
+
+
+/* ============================================================
+       pstore_read_ring() - Read ramoops zones as text ring
+         vmcore is a /sys/fs/pstore like directory, an ELF
+         dump whose memory holds the zones of previous boot,
+         or raw ramoops memory. start and size limit the scan
+         to physical addresses, size 0 scans all memory.
+         Zones are joined into one text ring, each after a
+         "pstore:" line, and cut like legacy log_buf.
+   ============================================================ */
+int pstore_read_ring(VMCore *vmcore, uint64_t start, uint64_t size,
+                     Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_read_ring:";
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	Pstore pstore;
+	memset(&pstore, 0x00, sizeof(Pstore));
+	int loop = 0;
+	int dmesg = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	
+	memset(ring, 0x00, sizeof(Ring));
+	if (stat(vmcore->file.filename, &filestat) == -1) {
+		fprintf(stderr, "%s Get file stat failed: [%d] %s: %s\n", estr,
+		        errno, strerror(errno), vmcore->file.filename);
+		return RETVAL_FAILURE;
+	}
+	if (S_ISDIR(filestat.st_mode)) {
+		if (pstore_read_dir(&pstore, vmcore->file.filename)) {
+			goto ERROR_FREE;
+		}
+	}
+	else {
+		if (scan_is_raw(vmcore)) {
+			if (scan_load_raw(vmcore)) {
+				goto ERROR_FREE;
+			}
+		}
+		else if (elf_validate_elfheader(vmcore) ||
+		         elf_load_segments(vmcore)) {
+			fprintf(stderr, "%s Failed to load vmcore.\n", estr);
+			goto ERROR_FREE;
+		}
+		if (pstore_scan_memory(&pstore, vmcore, start, size)) {
+			goto ERROR_FREE;
+		}
+	}
+	
+	/* Compressed dmesg, older kernels wrote zlib, newer raw deflate */
+	for (loop = 0; loop < pstore.count; loop++) {
+		if (pstore.zones[loop].compressed &&
+		    pstore_decompress(&pstore.zones[loop])) {
+			fprintf(stderr, "%s Can not decompress: %s\n",
+			        estr, pstore.zones[loop].name);
+		}
+		if (pstore.zones[loop].type == PSTORE_DMESG) {
+			sscanf(pstore.zones[loop].data, "%*[^#\n]#%*u Part%u",
+			       &pstore.zones[loop].part);
+			dmesg++;
+		}
+	}
+	qsort(pstore.zones, pstore.count, sizeof(PstoreZone),
+	      pstore_compare_zone);
+	fprintf(stdout, "%s:    * pstore:     %d zones, %d dmesg\n",
+	        APP_NAME, pstore.count, dmesg);
+	
+	if (pstore_build_ring(&pstore, ring)) {
+		goto ERROR_FREE;
+	}
+	vmcore->log_format = LOGFORMAT_LEGACY;
+	
+	pstore_free(&pstore);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	pstore_free(&pstore);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       pstore_read_dir() - Read files of mounted pstore
+         dmesg-*, console-* and pmsg-* are taken, ".enc.z"
+         is dmesg the kernel could not decompress.
+   ============================================================ */
+static int pstore_read_dir(Pstore *pstore, char *path)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_read_dir:";
+	char filename[PATH_MAX];
+	memset(filename, 0x00, sizeof(filename));
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	DIR *dirp = NULL;
+	struct dirent *entry = NULL;
+	FILE *stream = NULL;
+	char *data = NULL;
+	size_t size = 0;
+	int type = 0;
+	int retval = RETVAL_SUCCESS;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(path != NULL);
+	
+	dirp = opendir(path);
+	if (dirp == NULL) {
+		fprintf(stderr, "%s Can not open directory: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	while ((entry = readdir(dirp)) != NULL) {
+		if (! strncmp(entry->d_name, "dmesg-", 6)) {
+			type = PSTORE_DMESG;
+		}
+		else if (! strncmp(entry->d_name, "console-", 8)) {
+			type = PSTORE_CONSOLE;
+		}
+		else if (! strncmp(entry->d_name, "pmsg-", 5)) {
+			type = PSTORE_PMSG;
+		}
+		else {
+			continue;
+		}
+		if ((snprintf(filename, sizeof(filename), "%s/%s",
+		              path, entry->d_name) >= sizeof(filename)) ||
+		    (stat(filename, &filestat) == -1) ||
+		    (! S_ISREG(filestat.st_mode)) ||
+		    (filestat.st_size > PSTORE_ZONE_MAX)) {
+			continue;
+		}
+	
+		/* Whole file at once, pstore files are small */
+		size = filestat.st_size;
+		data = mem_alloc(size + 1);
+		stream = fopen(filename, "r");
+		if ((data == NULL) || (stream == NULL)) {
+			fprintf(stderr, "%s Can not read: %s\n", estr, filename);
+			mem_free(data);
+			if (stream != NULL) {
+				fclose(stream);
+			}
+			retval = RETVAL_FAILURE;
+			continue;
+		}
+		size = fread(data, 1, size, stream);
+		fclose(stream);
+		if (pstore_add_zone(pstore, entry->d_name, data, size, type,
+		                    filestat.st_mtim.tv_sec,
+		                    filestat.st_mtim.tv_nsec)) {
+			mem_free(data);
+			closedir(dirp);
+			return RETVAL_FAILURE;
+		}
+		if (strstr(entry->d_name, ".enc.z") != NULL) {
+			pstore->zones[pstore->count - 1].compressed = 1;
+		}
+	}
+	closedir(dirp);
+	
+	return retval;
+}
+
+
+/* ============================================================
+       pstore_scan_memory() - Find ramoops zones in LOAD segments
+         Only the part of each segment in physical range is
+         read, sequentially in chunks.
+   ============================================================ */
+static int pstore_scan_memory(Pstore *pstore, VMCore *vmcore,
+                              uint64_t start, uint64_t size)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_scan_memory:";
+	LoadSegment *load = NULL;
+	uint64_t end = 0;
+	uint64_t low = 0;
+	uint64_t high = 0;
+	char *buffer = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(vmcore != NULL);
+	
+	end = (size == 0) ? UINT64_MAX : start + size;
+	buffer = mem_alloc(PSTORE_SCAN_CHUNK);
+	if (buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < vmcore->load_count; loop++) {
+		load = &vmcore->loads[loop];
+		low = (load->paddr > start) ? load->paddr : start;
+		high = (load->paddr + load->size < end) ?
+		       load->paddr + load->size : end;
+		if (low >= high) {
+			continue;
+		}
+		if (pstore_scan_load(pstore, load, low - load->paddr,
+		                     high - load->paddr, buffer)) {
+			mem_free(buffer);
+			return RETVAL_FAILURE;
+		}
+	}
+	mem_free(buffer);
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       pstore_scan_load() - Find zones in part of one segment
+         start and end are offsets in segment. Zone data is
+         skipped once the zone is taken.
+   ============================================================ */
+static int pstore_scan_load(Pstore *pstore, LoadSegment *load,
+                            uint64_t start, uint64_t end, char *buffer)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_scan_load:";
+	uint64_t offset = 0;
+	size_t chunk = 0;
+	size_t pos = 0;
+	size_t used = 0;
+	uint32_t sig = 0;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(load != NULL);
+	assert(buffer != NULL);
+	
+	offset = (start + PSTORE_ALIGN - 1) & ~((uint64_t) PSTORE_ALIGN - 1);
+	while (offset + PSTORE_HEADER_SIZE <= end) {
+		chunk = (end - offset < PSTORE_SCAN_CHUNK) ?
+		        end - offset : PSTORE_SCAN_CHUNK;
+		if (file_read(load->file, buffer, load->offset + offset, chunk)) {
+			fprintf(stderr, "%s Can not read memory: 0x%016lx\n",
+			        estr, load->paddr + offset);
+			return RETVAL_FAILURE;
+		}
+		used = 0;
+		for (pos = 0; pos + sizeof(sig) <= chunk; pos += PSTORE_ALIGN) {
+			memcpy(&sig, buffer + pos, sizeof(sig));
+			if ((sig != PSTORE_SIG) ||
+			    (offset + pos + PSTORE_HEADER_SIZE > end)) {
+				continue;
+			}
+			if (pstore_read_zone(pstore, load, offset + pos, end, &used)) {
+				return RETVAL_FAILURE;
+			}
+			if (used > 0) {
+				break;
+			}
+		}
+		
+		/* After zone, or after chunk */
+		offset += pos + used;
+		offset = (offset + PSTORE_ALIGN - 1) & ~((uint64_t) PSTORE_ALIGN - 1);
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       pstore_read_zone() - Take persistent_ram_buffer at offset
+         size stops growing at buffer size, so data is
+         data[start, size) then data[0, start) once wrapped,
+         and data[0, size) before. used is 0 if not a zone.
+   ============================================================ */
+static int pstore_read_zone(Pstore *pstore, LoadSegment *load,
+                            uint64_t offset, uint64_t end, size_t *used)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_read_zone:";
+	char name[PSTORE_NAME_SIZE];
+	memset(name, 0x00, sizeof(name));
+	uint32_t header[3];
+	memset(header, 0x00, sizeof(header));
+	uint32_t zone_start = 0;
+	uint32_t zone_size = 0;
+	char *data = NULL;
+	char *text = NULL;
+	char *newline = NULL;
+	long long sec = 0;
+	unsigned long nsec = 0;
+	char flag = 0;
+	int skip = 0;
+	int type = PSTORE_CONSOLE;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(load != NULL);
+	assert(used != NULL);
+	
+	*used = 0;
+	if (file_read(load->file, header, load->offset + offset,
+	              sizeof(header))) {
+		fprintf(stderr, "%s Can not read zone header.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	zone_start = header[1];
+	zone_size = header[2];
+	if ((zone_size == 0) || (zone_size > PSTORE_ZONE_MAX) ||
+	    (zone_start > zone_size) ||
+	    (offset + PSTORE_HEADER_SIZE + zone_size > end)) {
+		/* Empty zone or signature by chance */
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Oldest first */
+	data = mem_alloc(zone_size + 1);
+	if (data == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (((zone_size > zone_start) &&
+	     file_read(load->file, data, load->offset + offset +
+	               PSTORE_HEADER_SIZE + zone_start, zone_size - zone_start)) ||
+	    ((zone_start > 0) &&
+	     file_read(load->file, data + zone_size - zone_start,
+	               load->offset + offset + PSTORE_HEADER_SIZE, zone_start))) {
+		fprintf(stderr, "%s Can not read zone.\n", estr);
+		mem_free(data);
+		return RETVAL_FAILURE;
+	}
+	data[zone_size] = 0x00;
+	
+	/* dmesg zone starts with "====sec.nsec-C\n", "-C" since 3.19 */
+	text = data;
+	newline = memchr(data, '\n', (zone_size < PSTORE_NAME_SIZE) ?
+	                              zone_size : PSTORE_NAME_SIZE);
+	if ((newline != NULL) && (! strncmp(data, "====", 4))) {
+		*newline = 0x00;
+		skip = newline - data + 1;
+		if (sscanf(data, "====%lld.%lu-%c", &sec, &nsec, &flag) == 3) {
+			type = PSTORE_DMESG;
+		}
+		else if (sscanf(data, "====%lld.%lu", &sec, &nsec) == 2) {
+			type = PSTORE_DMESG;
+			flag = 'D';
+		}
+		*newline = '\n';
+	}
+	if (type == PSTORE_DMESG) {
+		memmove(data, data + skip, zone_size - skip + 1);
+		zone_size -= skip;
+	}
+	snprintf(name, sizeof(name), "%s@0x%lx",
+	         (type == PSTORE_DMESG) ? "dmesg" : "console",
+	         (unsigned long) (load->paddr + offset));
+	if (pstore_add_zone(pstore, name, text, zone_size, type, sec, nsec)) {
+		mem_free(data);
+		return RETVAL_FAILURE;
+	}
+	pstore->zones[pstore->count - 1].compressed = (flag == 'C');
+	*used = PSTORE_HEADER_SIZE + header[2];
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       pstore_add_zone() - Add zone, data is owned by Pstore
+   ============================================================ */
+static int pstore_add_zone(Pstore *pstore, char *name, char *data,
+                           size_t size, int type, int64_t sec, long nsec)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_add_zone:";
+	PstoreZone *zones = NULL;
+	PstoreZone *zone = NULL;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(name != NULL);
+	assert(data != NULL);
+	
+	if ((pstore->count % PSTORE_ZONE_STEP) == 0) {
+		zones = mem_realloc(pstore->zones, sizeof(PstoreZone) *
+		                    (pstore->count + PSTORE_ZONE_STEP));
+		if (zones == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			return RETVAL_FAILURE;
+		}
+		pstore->zones = zones;
+	}
+	zone = &pstore->zones[pstore->count++];
+	memset(zone, 0x00, sizeof(PstoreZone));
+	snprintf(zone->name, sizeof(zone->name), "%s", name);
+	zone->type = type;
+	zone->sec = sec;
+	zone->nsec = nsec;
+	zone->data = data;
+	zone->size = size;
+	data[size] = 0x00;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       pstore_decompress() - Inflate compressed dmesg zone
+         zlib header is tried first, then raw deflate.
+   ============================================================ */
+static int pstore_decompress(PstoreZone *zone)
+{
+#ifdef HAVE_ZLIB
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_decompress:";
+	z_stream inflater;
+	memset(&inflater, 0x00, sizeof(z_stream));
+	unsigned char *input = NULL;
+	char *text = NULL;
+	char *grown = NULL;
+	size_t capacity = 0;
+	int result = Z_OK;
+	
+	/* --- Assert check --- */
+	assert(zone != NULL);
+	
+	input = (unsigned char*) zone->data;
+	inflater.zalloc = pstore_zalloc;
+	inflater.zfree = pstore_zfree;
+	inflater.opaque = Z_NULL;
+	if (inflateInit2(&inflater, ((zone->size >= 2) && (input[0] == 0x78) &&
+	                             (((input[0] << 8) | input[1]) % 31 == 0)) ?
+	                            MAX_WBITS : -MAX_WBITS) != Z_OK) {
+		fprintf(stderr, "%s inflateInit2 failed.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	inflater.next_in = input;
+	inflater.avail_in = zone->size;
+	while (result == Z_OK) {
+		if (inflater.total_out + 1 >= capacity) {
+			capacity = capacity ? capacity * 2 : zone->size * 4 + 4096;
+			if (capacity > PSTORE_TEXT_MAX) {
+				break;
+			}
+			grown = mem_realloc(text, capacity);
+			if (grown == NULL) {
+				fprintf(stderr, "%s Can not allocate memory.\n", estr);
+				break;
+			}
+			text = grown;
+		}
+		inflater.next_out = (unsigned char*) text + inflater.total_out;
+		inflater.avail_out = capacity - inflater.total_out - 1;
+		result = inflate(&inflater, Z_NO_FLUSH);
+	}
+	inflateEnd(&inflater);
+	if (result != Z_STREAM_END) {
+		/* Keep compressed data, it is not text */
+		mem_free(text);
+		zone->size = 0;
+		return RETVAL_FAILURE;
+	}
+	mem_free(zone->data);
+	zone->data = text;
+	zone->size = inflater.total_out;
+	zone->data[zone->size] = 0x00;
+	zone->compressed = 0;
+	
+	return RETVAL_SUCCESS;
+#else
+	/* --- Assert check --- */
+	assert(zone != NULL);
+	
+	fprintf(stderr, "[ERROR] pstore_decompress: Built without zlib.\n");
+	zone->size = 0;
+	return RETVAL_FAILURE;
+#endif
+}
+
+
+/* ============================================================
+       pstore_compare_zone() - qsort() compare for output order
+         dmesg by dump time, parts of a dump oldest first,
+         then console and pmsg.
+   ============================================================ */
+static int pstore_compare_zone(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const PstoreZone *left = a;
+	const PstoreZone *right = b;
+	
+	if (left->type != right->type) {
+		return (left->type < right->type) ? -1 : 1;
+	}
+	if (left->sec != right->sec) {
+		return (left->sec < right->sec) ? -1 : 1;
+	}
+	if (left->nsec != right->nsec) {
+		return (left->nsec < right->nsec) ? -1 : 1;
+	}
+	if (left->part != right->part) {
+		return (left->part > right->part) ? -1 : 1;
+	}
+	return strcmp(left->name, right->name);
+}
+
+
+/* ============================================================
+       pstore_build_ring() - Join zones into one text ring
+         Ring has no extents, whole text is the window.
+   ============================================================ */
+static int pstore_build_ring(Pstore *pstore, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] pstore_build_ring:";
+	PstoreZone *zone = NULL;
+	size_t size = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	assert(ring != NULL);
+	
+	for (loop = 0; loop < pstore->count; loop++) {
+		size += PSTORE_NAME_SIZE * 2 + pstore->zones[loop].size + 1;
+	}
+	if (size == 0) {
+		return RETVAL_SUCCESS;
+	}
+	ring->buffer = mem_alloc(size);
+	if (ring->buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	for (loop = 0; loop < pstore->count; loop++) {
+		zone = &pstore->zones[loop];
+		if (zone->type == PSTORE_DMESG) {
+			ring->size += sprintf(ring->buffer + ring->size,
+			                      "pstore: %s at %lld.%09lu%s\n", zone->name,
+			                      (long long) zone->sec,
+			                      (unsigned long) zone->nsec,
+			                      zone->compressed ? ", not decompressed" : "");
+		}
+		else {
+			ring->size += sprintf(ring->buffer + ring->size,
+			                      "pstore: %s\n", zone->name);
+		}
+		memcpy(ring->buffer + ring->size, zone->data, zone->size);
+		ring->size += zone->size;
+		if ((zone->size > 0) && (zone->data[zone->size - 1] != '\n')) {
+			ring->buffer[ring->size++] = '\n';
+		}
+	}
+	ring->capacity = ring->size;
+	ring->window_size = ring->size;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       pstore_free() - Free zones
+   ============================================================ */
+static void pstore_free(Pstore *pstore)
+{
+	/* --- Variables --- */
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(pstore != NULL);
+	
+	for (loop = 0; loop < pstore->count; loop++) {
+		mem_free(pstore->zones[loop].data);
+	}
+	mem_free(pstore->zones);
+	memset(pstore, 0x00, sizeof(Pstore));
+	return;
+}
+
+
+#ifdef HAVE_ZLIB
+/* ============================================================
+       pstore_zalloc() - zlib alloc_func by mem_alloc()
+   ============================================================ */
+static voidpf pstore_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	if ((size != 0) && (items > SIZE_MAX / size)) {
+		return Z_NULL;
+	}
+	return mem_alloc((size_t) items * size);
+}
+
+
+/* ============================================================
+       pstore_zfree() - zlib free_func by mem_free()
+   ============================================================ */
+static void pstore_zfree(voidpf opaque, voidpf address)
+{
+	mem_free(address);
+	return;
+}
+#endif
+
+
+/* ====================================================================== */
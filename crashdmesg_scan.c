@@ -0,0 +1,710 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_scan.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+#define SCAN_RECORD_ALIGN 8 /* __alignof__(struct printk_log) */
+#define SCAN_LINE_MAX 1024 /* LOG_LINE_MAX of legacy printk */
+#define SCAN_MAX_FACILITY 23 /* LOG_LOCAL7 */
+#define SCAN_RUN_STEP 256 /* Grow step of run list */
+
+
+/* --- Data structures --- */
+
+/* Part of one LOAD segment, scanned by one thread at a time */
+typedef struct {
+	int load; /* Index of VMCore.loads */
+	off_t offset; /* File offset */
+	size_t size; /* Runs must start in this size */
+	size_t readable; /* size + overlap, within segment */
+} ScanChunk;
+
+/* Consecutive valid records or lines */
+typedef struct {
+	int format; /* LOGFORMAT_* */
+	int load;
+	off_t start; /* File offset */
+	off_t end;
+	uint64_t first_ts;
+	uint64_t last_ts;
+} ScanRun;
+
+/* Scan context shared by threads */
+typedef struct {
+	VMCore *vmcore;
+	Layout *layout;
+	size_t chunk_size; /* Fits in memory limit */
+	ScanChunk *chunks;
+	int chunk_count;
+	int next_chunk; /* Next chunk to take, under lock */
+	ScanRun *runs;
+	int run_count;
+	int run_size;
+	FileStat stat; /* Reads of all threads */
+	int result;
+	pthread_mutex_t lock;
+} Scan;
+
+
+/* --- Prototypes --- */
+static int scan_build_chunks(Scan *scan);
+static void *scan_worker(void *arg);
+static int scan_chunk(Scan *scan, ScanChunk *chunk, char *buffer);
+static size_t scan_check_record(Layout *layout, char *buffer, size_t avail,
+                                size_t pos, uint64_t *ts_nsec);
+static size_t scan_check_line(char *buffer, size_t avail, size_t pos,
+                              uint64_t *ts_nsec);
+static int scan_add_run(Scan *scan, ScanRun *run);
+static int scan_compare_run(const void *a, const void *b);
+static int scan_compare_ts(const void *a, const void *b);
+static int scan_rebuild(Scan *scan, Ring *ring);
+
+
+/* ============================================================
+       scan_is_raw() - Check vmcore has no ELF header
+   ============================================================ */
+int scan_is_raw(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	unsigned char ident[SELFMAG];
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	
+	if ((vmcore->file.size < sizeof(Elf64_Ehdr)) ||
+	    file_read(&vmcore->file, (void*) ident, 0, SELFMAG)) {
+		return 1;
+	}
+	return (memcmp(ident, ELFMAG, SELFMAG) != 0);
+}
+
+
+/* ============================================================
+       scan_load_raw() - Whole file as one LOAD segment
+   ============================================================ */
+int scan_load_raw(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_load_raw:";
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(vmcore->loads == NULL);
+	
+	if ((vmcore->part_count > 1) || (vmcore->file.size == 0)) {
+		fprintf(stderr, "%s Raw image must be one non-empty file.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	vmcore->loads = mem_alloc(sizeof(LoadSegment));
+	if (vmcore->loads == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	memset(vmcore->loads, 0x00, sizeof(LoadSegment));
+	vmcore->loads->size = vmcore->file.size;
+	vmcore->loads->file = &vmcore->file;
+	vmcore->load_count = 1;
+	vmcore->parts[0] = &vmcore->file;
+	vmcore->part_count = 1;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       scan_read_ring() - Rebuild ring buffer by scanning memory
+         Used when VMCOREINFO is not available. Every LOAD
+         segment is scanned in chunks by worker threads, then
+         the best region is taken as the ring buffer.
+   ============================================================ */
+int scan_read_ring(VMCore *vmcore, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_read_ring:";
+	Scan scan;
+	memset(&scan, 0x00, sizeof(Scan));
+	pthread_t threads[SCAN_MAX_THREADS];
+	int thread_count = 0;
+	long cpus = 0;
+	size_t available = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(vmcore->plan.profile != NULL);
+	
+	memset(ring, 0x00, sizeof(Ring));
+	scan.vmcore = vmcore;
+	scan.layout = &vmcore->plan.layout;
+	
+	/* One thread per CPU, each buffer takes one chunk.
+	   Fewer threads and smaller chunks under memory limit. */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	thread_count = (cpus < 1) ? 1 : (cpus > SCAN_MAX_THREADS) ?
+	               SCAN_MAX_THREADS : (int) cpus;
+	scan.chunk_size = SCAN_CHUNK_SIZE;
+	available = mem_available() / 2;
+	if (available / (SCAN_CHUNK_SIZE + SCAN_CHUNK_OVERLAP) < thread_count) {
+		thread_count = available / (SCAN_CHUNK_SIZE + SCAN_CHUNK_OVERLAP);
+		if (thread_count == 0) {
+			thread_count = 1;
+			scan.chunk_size = SCAN_MIN_CHUNK;
+			if (available > SCAN_MIN_CHUNK + SCAN_CHUNK_OVERLAP) {
+				scan.chunk_size = (available - SCAN_CHUNK_OVERLAP) &
+				                  ~((size_t) SCAN_RECORD_ALIGN - 1);
+			}
+		}
+	}
+	if (scan_build_chunks(&scan)) {
+		return RETVAL_FAILURE;
+	}
+	if (thread_count > scan.chunk_count) {
+		thread_count = scan.chunk_count;
+	}
+	fprintf(stdout, "%s:  Scan memory for ring buffer.\n", APP_NAME);
+	fprintf(stdout, "%s:    * Chunks:     %d in %d segments, %d threads\n",
+	        APP_NAME, scan.chunk_count, vmcore->load_count, thread_count);
+	
+	pthread_mutex_init(&scan.lock, NULL);
+	for (loop = 0; loop < thread_count; loop++) {
+		if (pthread_create(&threads[loop], NULL, scan_worker, &scan)) {
+			break;
+		}
+	}
+	thread_count = loop;
+	if (thread_count == 0) {
+		/* Scan in this thread */
+		scan_worker(&scan);
+	}
+	for (loop = 0; loop < thread_count; loop++) {
+		pthread_join(threads[loop], NULL);
+	}
+	pthread_mutex_destroy(&scan.lock);
+	vmcore->file.stat.syscalls += scan.stat.syscalls;
+	vmcore->file.stat.bytes += scan.stat.bytes;
+	if (scan.result) {
+		fprintf(stderr, "%s Scan failed.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	if (scan_rebuild(&scan, ring)) {
+		fprintf(stderr, "%s No ring buffer found.\n", estr);
+		goto ERROR_FREE;
+	}
+	
+	mem_free(scan.chunks);
+	mem_free(scan.runs);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(scan.chunks);
+	mem_free(scan.runs);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       scan_build_chunks() - Split LOAD segments into chunks
+   ============================================================ */
+static int scan_build_chunks(Scan *scan)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_build_chunks:";
+	VMCore *vmcore = NULL;
+	LoadSegment *load = NULL;
+	ScanChunk *chunk = NULL;
+	uint64_t done = 0;
+	int count = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(scan != NULL);
+	
+	vmcore = scan->vmcore;
+	for (loop = 0; loop < vmcore->load_count; loop++) {
+		count += (vmcore->loads[loop].size + scan->chunk_size - 1) /
+		         scan->chunk_size;
+	}
+	if (count == 0) {
+		fprintf(stderr, "%s No LOAD segment to scan.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	scan->chunks = mem_alloc(sizeof(ScanChunk) * count);
+	if (scan->chunks == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Chunks overlap, so runs starting near the end are complete */
+	for (loop = 0; loop < vmcore->load_count; loop++) {
+		load = &vmcore->loads[loop];
+		for (done = 0; done < load->size; done += scan->chunk_size) {
+			chunk = &scan->chunks[scan->chunk_count++];
+			chunk->load = loop;
+			chunk->offset = load->offset + done;
+			chunk->size = (load->size - done < scan->chunk_size) ?
+			              load->size - done : scan->chunk_size;
+			chunk->readable = (load->size - done <
+			                   scan->chunk_size + SCAN_CHUNK_OVERLAP) ?
+			                  load->size - done :
+			                  scan->chunk_size + SCAN_CHUNK_OVERLAP;
+		}
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       scan_worker() - Take chunks and Scan, Thread routine
+   ============================================================ */
+static void *scan_worker(void *arg)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_worker:";
+	Scan *scan = NULL;
+	ScanChunk *chunk = NULL;
+	char *buffer = NULL;
+	
+	/* --- Assert check --- */
+	assert(arg != NULL);
+	
+	scan = (Scan*) arg;
+	buffer = mem_alloc(scan->chunk_size + SCAN_CHUNK_OVERLAP);
+	if (buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		pthread_mutex_lock(&scan->lock);
+		scan->result = RETVAL_FAILURE;
+		pthread_mutex_unlock(&scan->lock);
+		return NULL;
+	}
+	
+	for (;;) {
+		pthread_mutex_lock(&scan->lock);
+		chunk = (scan->result || (scan->next_chunk == scan->chunk_count)) ?
+		        NULL : &scan->chunks[scan->next_chunk++];
+		pthread_mutex_unlock(&scan->lock);
+		if (chunk == NULL) {
+			break;
+		}
+		if (scan_chunk(scan, chunk, buffer)) {
+			pthread_mutex_lock(&scan->lock);
+			scan->result = RETVAL_FAILURE;
+			pthread_mutex_unlock(&scan->lock);
+			break;
+		}
+	}
+	
+	mem_free(buffer);
+	return NULL;
+}
+
+
+/* ============================================================
+       scan_chunk() - Find record and line runs in one chunk
+   ============================================================ */
+static int scan_chunk(Scan *scan, ScanChunk *chunk, char *buffer)
+{
+	/* --- Variables --- */
+	LoadSegment *load = NULL;
+	File view; /* Uncached, private statistics */
+	ScanRun run;
+	char *found = NULL;
+	size_t pos = 0;
+	size_t next = 0;
+	size_t end = 0;
+	uint64_t ts_nsec = 0;
+	int count = 0;
+	
+	/* --- Assert check --- */
+	assert(scan != NULL);
+	assert(chunk != NULL);
+	assert(buffer != NULL);
+	
+	load = &scan->vmcore->loads[chunk->load];
+	memcpy(&view, load->file, sizeof(File));
+	view.cache = NULL;
+	memset(&view.stat, 0x00, sizeof(FileStat));
+	if (file_read(&view, (void*) buffer, chunk->offset, chunk->readable)) {
+		return RETVAL_FAILURE;
+	}
+	pthread_mutex_lock(&scan->lock);
+	scan->stat.syscalls += view.stat.syscalls;
+	scan->stat.bytes += view.stat.bytes;
+	pthread_mutex_unlock(&scan->lock);
+	
+	/* struct printk_log records, split where timestamp goes back */
+	if (scan->layout->printk_log_size != LAYOUT_NONE) {
+		for (pos = 0; pos < chunk->size; ) {
+			memset(&run, 0x00, sizeof(ScanRun));
+			for (end = pos, count = 0;
+			     (next = scan_check_record(scan->layout, buffer,
+			                               chunk->readable, end, &ts_nsec));
+			     end = next, count++) {
+				if (count == 0) {
+					run.first_ts = ts_nsec;
+				}
+				else if (ts_nsec < run.last_ts) {
+					break;
+				}
+				run.last_ts = ts_nsec;
+			}
+			if (count < SCAN_MIN_RUN) {
+				pos += SCAN_RECORD_ALIGN;
+				continue;
+			}
+			run.format = LOGFORMAT_RECORD;
+			run.load = chunk->load;
+			run.start = chunk->offset + pos;
+			run.end = chunk->offset + end;
+			if (scan_add_run(scan, &run)) {
+				return RETVAL_FAILURE;
+			}
+			pos = end;
+		}
+	}
+	
+	/* "<N>" lines of plain text log_buf */
+	for (pos = 0; pos < chunk->size; ) {
+		found = memchr(buffer + pos, '<', chunk->size - pos);
+		if (found == NULL) {
+			break;
+		}
+		pos = found - buffer;
+		/* Line start, or start of buffer after non-text */
+		if ((pos > 0) && (buffer[pos - 1] != '\n') &&
+		    ((unsigned char) buffer[pos - 1] >= 0x20)) {
+			pos++;
+			continue;
+		}
+		memset(&run, 0x00, sizeof(ScanRun));
+		for (end = pos, count = 0;
+		     (next = scan_check_line(buffer, chunk->readable, end, &ts_nsec));
+		     end = next, count++) {
+			if (count == 0) {
+				run.first_ts = ts_nsec;
+			}
+			else if (ts_nsec < run.last_ts) {
+				break;
+			}
+			run.last_ts = ts_nsec;
+		}
+		if (count < SCAN_MIN_RUN) {
+			pos++;
+			continue;
+		}
+		run.format = LOGFORMAT_LEGACY;
+		run.load = chunk->load;
+		run.start = chunk->offset + pos;
+		run.end = chunk->offset + end;
+		if (scan_add_run(scan, &run)) {
+			return RETVAL_FAILURE;
+		}
+		pos = end;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       scan_check_record() - Validate struct printk_log at pos
+         Return offset of next record, 0 if not valid.
+   ============================================================ */
+static size_t scan_check_record(Layout *layout, char *buffer, size_t avail,
+                                size_t pos, uint64_t *ts_nsec)
+{
+	/* --- Variables --- */
+	char *header = NULL;
+	unsigned char *text = NULL;
+	uint16_t len = 0;
+	uint16_t text_len = 0;
+	uint16_t dict_len = 0;
+	size_t used = 0;
+	size_t loop = 0;
+	
+	if (pos + layout->printk_log_size > avail) {
+		return 0;
+	}
+	header = buffer + pos;
+	memcpy(&len, header + layout->printk_log_len, sizeof(len));
+	memcpy(&text_len, header + layout->printk_log_text_len, sizeof(text_len));
+	if (layout->printk_log_dict_len != LAYOUT_NONE) {
+		memcpy(&dict_len, header + layout->printk_log_dict_len,
+		       sizeof(dict_len));
+	}
+	
+	/* Size, padded to alignment */
+	used = layout->printk_log_size + text_len + dict_len;
+	if ((len % SCAN_RECORD_ALIGN) || (text_len == 0) ||
+	    (len < used) || (len - used >= SCAN_RECORD_ALIGN) ||
+	    (pos + len > avail)) {
+		return 0;
+	}
+	if ((layout->printk_log_facility != LAYOUT_NONE) &&
+	    ((uint8_t) header[layout->printk_log_facility] > SCAN_MAX_FACILITY)) {
+		return 0;
+	}
+	if ((layout->printk_log_flags != LAYOUT_NONE) &&
+	    ((uint8_t) header[layout->printk_log_flags] & 0x10)) {
+		/* Only LOG_NOCONS, LOG_NEWLINE, LOG_PREFIX, LOG_CONT */
+		return 0;
+	}
+	
+	/* Text must be printable */
+	text = (unsigned char*) header + layout->printk_log_size;
+	for (loop = 0; loop < text_len; loop++) {
+		if ((text[loop] < 0x20) && (text[loop] != '\t')) {
+			return 0;
+		}
+	}
+	memcpy(ts_nsec, header + layout->printk_log_ts_nsec, sizeof(*ts_nsec));
+	
+	return pos + len;
+}
+
+
+/* ============================================================
+       scan_check_line() - Validate "<N>" text line at pos
+         Return offset after newline, 0 if not valid.
+   ============================================================ */
+static size_t scan_check_line(char *buffer, size_t avail, size_t pos,
+                              uint64_t *ts_nsec)
+{
+	/* --- Variables --- */
+	unsigned char *line = NULL;
+	size_t length = 0;
+	size_t cursor = 0;
+	size_t newline = 0;
+	uint64_t sec = 0;
+	uint64_t usec = 0;
+	
+	line = (unsigned char*) buffer + pos;
+	length = avail - pos;
+	if ((length < 4) || (line[0] != '<') ||
+	    (line[1] < '0') || (line[1] > '7') || (line[2] != '>')) {
+		return 0;
+	}
+	for (cursor = 3; (cursor < length) && (cursor < SCAN_LINE_MAX) &&
+	     (line[cursor] != '\n'); cursor++) {
+		if ((line[cursor] < 0x20) && (line[cursor] != '\t')) {
+			return 0;
+		}
+	}
+	if ((cursor == length) || (line[cursor] != '\n')) {
+		return 0;
+	}
+	newline = cursor;
+	
+	/* "[ sec.usec]" if CONFIG_PRINTK_TIME, else 0 */
+	*ts_nsec = 0;
+	if (line[3] == '[') {
+		for (cursor = 4; line[cursor] == ' '; cursor++);
+		for (; (line[cursor] >= '0') && (line[cursor] <= '9'); cursor++) {
+			sec = sec * 10 + (line[cursor] - '0');
+		}
+		if (line[cursor] == '.') {
+			for (cursor++; (line[cursor] >= '0') && (line[cursor] <= '9');
+			     cursor++) {
+				usec = usec * 10 + (line[cursor] - '0');
+			}
+			if (line[cursor] == ']') {
+				*ts_nsec = sec * 1000000000ULL + usec * 1000;
+			}
+		}
+	}
+	
+	return pos + newline + 1;
+}
+
+
+/* ============================================================
+       scan_add_run() - Append run to list, under lock
+   ============================================================ */
+static int scan_add_run(Scan *scan, ScanRun *run)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_add_run:";
+	ScanRun *runs = NULL;
+	int result = RETVAL_SUCCESS;
+	
+	/* --- Assert check --- */
+	assert(scan != NULL);
+	assert(run != NULL);
+	
+	pthread_mutex_lock(&scan->lock);
+	if (scan->run_count == scan->run_size) {
+		runs = mem_realloc(scan->runs,
+		               sizeof(ScanRun) * (scan->run_size + SCAN_RUN_STEP));
+		if (runs == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			result = RETVAL_FAILURE;
+			goto UNLOCK;
+		}
+		scan->runs = runs;
+		scan->run_size += SCAN_RUN_STEP;
+	}
+	memcpy(&scan->runs[scan->run_count++], run, sizeof(ScanRun));
+	
+UNLOCK:
+	pthread_mutex_unlock(&scan->lock);
+	return result;
+}
+
+
+/* ============================================================
+       scan_compare_run() - qsort() comparator, by file position
+   ============================================================ */
+static int scan_compare_run(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const ScanRun *run_a = (const ScanRun*) a;
+	const ScanRun *run_b = (const ScanRun*) b;
+	
+	if (run_a->load != run_b->load) {
+		return (run_a->load < run_b->load) ? -1 : 1;
+	}
+	if (run_a->start != run_b->start) {
+		return (run_a->start < run_b->start) ? -1 : 1;
+	}
+	return run_a->format - run_b->format;
+}
+
+
+/* ============================================================
+       scan_compare_ts() - qsort() comparator, by first timestamp
+   ============================================================ */
+static int scan_compare_ts(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const ScanRun *run_a = (const ScanRun*) a;
+	const ScanRun *run_b = (const ScanRun*) b;
+	
+	if (run_a->first_ts != run_b->first_ts) {
+		return (run_a->first_ts < run_b->first_ts) ? -1 : 1;
+	}
+	return scan_compare_run(a, b);
+}
+
+
+/* ============================================================
+       scan_rebuild() - Score runs and Read best region as ring
+         Runs split by chunk borders are merged first. The
+         longest run and its neighbours within MAX_LOGBUF_LIMIT
+         make the ring buffer, oldest run first.
+   ============================================================ */
+static int scan_rebuild(Scan *scan, Ring *ring)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] scan_rebuild:";
+	VMCore *vmcore = NULL;
+	ScanRun *runs = NULL;
+	ScanRun *best = NULL;
+	ScanRun *last = NULL;
+	RingExtent *extents = NULL;
+	int count = 0;
+	int group = 0;
+	int loop = 0;
+	size_t size = 0;
+	
+	/* --- Assert check --- */
+	assert(scan != NULL);
+	assert(ring != NULL);
+	
+	vmcore = scan->vmcore;
+	runs = scan->runs;
+	if (scan->run_count == 0) {
+		return RETVAL_FAILURE;
+	}
+	
+	/* Merge overlapping runs which continue in time */
+	qsort(runs, scan->run_count, sizeof(ScanRun), scan_compare_run);
+	for (loop = 1, count = 1; loop < scan->run_count; loop++) {
+		last = &runs[count - 1];
+		if ((runs[loop].load == last->load) &&
+		    (runs[loop].format == last->format) &&
+		    (runs[loop].start <= last->end) &&
+		    (runs[loop].first_ts >= last->first_ts)) {
+			if (runs[loop].end > last->end) {
+				last->end = runs[loop].end;
+			}
+			if (runs[loop].last_ts > last->last_ts) {
+				last->last_ts = runs[loop].last_ts;
+			}
+			continue;
+		}
+		memcpy(&runs[count++], &runs[loop], sizeof(ScanRun));
+	}
+	
+	/* Score by size, largest run is the anchor */
+	best = &runs[0];
+	for (loop = 1; loop < count; loop++) {
+		if (runs[loop].end - runs[loop].start > best->end - best->start) {
+			best = &runs[loop];
+		}
+	}
+	fprintf(stdout, "%s:    * Candidates: %d regions\n", APP_NAME, count);
+	
+	/* Neighbours of same format form the ring buffer */
+	for (loop = 0, group = 0; loop < count; loop++) {
+		if ((runs[loop].load != best->load) ||
+		    (runs[loop].format != best->format) ||
+		    (runs[loop].start + MAX_LOGBUF_LIMIT < best->start) ||
+		    (runs[loop].end > best->end + MAX_LOGBUF_LIMIT)) {
+			continue;
+		}
+		if (&runs[loop] == best) {
+			best = &runs[group];
+		}
+		memcpy(&runs[group++], &runs[loop], sizeof(ScanRun));
+		size += runs[group - 1].end - runs[group - 1].start;
+	}
+	vmcore->log_format = best->format;
+	fprintf(stdout, "%s:    * Found:      %s, %d regions, 0x%08x bytes\n",
+	        APP_NAME, (best->format == LOGFORMAT_LEGACY) ? "text" : "records",
+	        group, (unsigned) size);
+	fprintf(stdout, "%s:    * Near vaddr: 0x%016lx\n", APP_NAME,
+	        vmcore->loads[best->load].vaddr +
+	        (best->start - vmcore->loads[best->load].offset));
+	qsort(runs, group, sizeof(ScanRun), scan_compare_ts);
+	
+	/* Regions make ring, oldest first */
+	extents = mem_alloc(sizeof(RingExtent) * group);
+	if (extents == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < group; loop++) {
+		extents[loop].file = vmcore->loads[runs[loop].load].file;
+		extents[loop].offset = runs[loop].start;
+		extents[loop].size = runs[loop].end - runs[loop].start;
+	}
+	if (printk_setup_ring(ring, extents, group)) {
+		fprintf(stderr, "%s Can not read region.\n", estr);
+		mem_free(extents);
+		printk_free_ring(ring);
+		return RETVAL_FAILURE;
+	}
+	mem_free(extents);
+	
+	/* Records are packed, iterate from start to end */
+	vmcore->log_buf_len = ring->size;
+	vmcore->log_first_idx = 0;
+	vmcore->log_next_idx = ring->size;
+	vmcore->log_first_seq = 0;
+	vmcore->log_next_seq = 0;
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ====================================================================== */
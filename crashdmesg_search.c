@@ -0,0 +1,315 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_search.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+
+/* --- Constant values --- */
+#define SEARCH_LINE_MAX 4096 /* Max length of one pattern */
+
+
+/* --- Prototypes --- */
+static int search_add_pattern(Search *search, char *line, size_t length);
+static int search_build(Search *search);
+static size_t search_skip(Search *search, unsigned char *text,
+                          size_t cursor, size_t length);
+
+
+/* ============================================================
+       search_compile() - Read pattern file and Build automaton
+         One fixed string per line, empty lines are ignored.
+   ============================================================ */
+int search_compile(Search *search, char *filename)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] search_compile:";
+	FILE *stream = NULL;
+	char line[SEARCH_LINE_MAX];
+	size_t length = 0;
+	
+	/* --- Assert check --- */
+	assert(search != NULL);
+	assert(filename != NULL);
+	
+	memset(search, 0x00, sizeof(Search));
+	
+	stream = fopen(filename, "r");
+	if (stream == NULL) {
+		fprintf(stderr, "%s Can not open pattern file: %s\n", estr, filename);
+		return RETVAL_FAILURE;
+	}
+	while (fgets(line, sizeof(line), stream) != NULL) {
+		length = strlen(line);
+		if ((length > 0) && (line[length - 1] == '\n')) {
+			line[--length] = 0x00;
+		}
+		else if (! feof(stream)) {
+			fprintf(stderr, "%s Pattern too long: %.32s...\n", estr, line);
+			goto ERROR_CLOSE;
+		}
+		if ((length > 0) && (line[length - 1] == '\r')) {
+			line[--length] = 0x00;
+		}
+		if (length == 0) {
+			continue;
+		}
+		if (search_add_pattern(search, line, length)) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			goto ERROR_CLOSE;
+		}
+	}
+	fclose(stream);
+	
+	if (search->pattern_count == 0) {
+		fprintf(stderr, "%s No pattern in %s\n", estr, filename);
+		search_free(search);
+		return RETVAL_FAILURE;
+	}
+	if (search_build(search)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		search_free(search);
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_CLOSE:
+	fclose(stream);
+	search_free(search);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       search_free() - Free patterns and automaton
+   ============================================================ */
+void search_free(Search *search)
+{
+	/* --- Variables --- */
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(search != NULL);
+	
+	for (loop = 0; loop < search->pattern_count; loop++) {
+		mem_free(search->patterns[loop]);
+	}
+	mem_free(search->patterns);
+	mem_free(search->next);
+	mem_free(search->output);
+	memset(search, 0x00, sizeof(Search));
+	return;
+}
+
+
+/* ============================================================
+       search_add_pattern() - Append copy of one pattern
+   ============================================================ */
+static int search_add_pattern(Search *search, char *line, size_t length)
+{
+	/* --- Variables --- */
+	char **patterns = NULL;
+	
+	/* --- Assert check --- */
+	assert(search != NULL);
+	assert(line != NULL);
+	
+	patterns = mem_realloc(search->patterns,
+	                   sizeof(char*) * (search->pattern_count + 1));
+	if (patterns == NULL) {
+		return RETVAL_FAILURE;
+	}
+	search->patterns = patterns;
+	search->patterns[search->pattern_count] = mem_strdup(line);
+	if (search->patterns[search->pattern_count] == NULL) {
+		return RETVAL_FAILURE;
+	}
+	search->pattern_count++;
+	search->state_count += length;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       search_build() - Build Aho-Corasick automaton
+         Trie with failure links resolved into a full 256-way
+         transition table, so matching is one lookup per byte.
+   ============================================================ */
+static int search_build(Search *search)
+{
+	/* --- Variables --- */
+	int32_t *next = NULL;
+	int32_t *fail = NULL;
+	int32_t *queue = NULL;
+	int head = 0;
+	int tail = 0;
+	int states = 0; /* Max number of states */
+	int state = 0;
+	int child = 0;
+	int loop = 0;
+	int byte = 0;
+	unsigned char *cursor = NULL;
+	
+	/* --- Assert check --- */
+	assert(search != NULL);
+	
+	/* Allocate for worst case, no common prefix */
+	states = search->state_count + 1;
+	search->next = mem_alloc(sizeof(int32_t) * 256 * states);
+	search->output = mem_alloc(sizeof(int32_t) * states);
+	fail = mem_alloc(sizeof(int32_t) * states);
+	queue = mem_alloc(sizeof(int32_t) * states);
+	if ((search->next == NULL) || (search->output == NULL) ||
+	    (fail == NULL) || (queue == NULL)) {
+		mem_free(fail);
+		mem_free(queue);
+		return RETVAL_FAILURE;
+	}
+	next = search->next;
+	memset(next, 0xff, sizeof(int32_t) * 256 * states);
+	memset(search->output, 0xff, sizeof(int32_t) * states);
+	search->state_count = 1;
+	
+	/* Trie, state 0 is root */
+	for (loop = 0; loop < search->pattern_count; loop++) {
+		state = 0;
+		for (cursor = (unsigned char*) search->patterns[loop];
+		     *cursor != 0x00; cursor++) {
+			if (next[state * 256 + *cursor] < 0) {
+				next[state * 256 + *cursor] = search->state_count++;
+			}
+			state = next[state * 256 + *cursor];
+		}
+		if (search->output[state] < 0) {
+			search->output[state] = loop;
+		}
+	}
+	
+	/* Bytes which leave root, used by prefilter */
+	for (byte = 0; byte < 256; byte++) {
+		search->start[byte] = (next[byte] >= 0);
+		if (next[byte] >= 0) {
+			if (search->start_count < sizeof(search->start_bytes)) {
+				search->start_bytes[search->start_count] = byte;
+			}
+			search->start_count++;
+		}
+		else {
+			next[byte] = 0;
+		}
+	}
+	
+	/* Breadth first, resolve failure links into transitions */
+	for (byte = 0; byte < 256; byte++) {
+		if (next[byte] > 0) {
+			fail[next[byte]] = 0;
+			queue[tail++] = next[byte];
+		}
+	}
+	while (head < tail) {
+		state = queue[head++];
+		if (search->output[state] < 0) {
+			search->output[state] = search->output[fail[state]];
+		}
+		for (byte = 0; byte < 256; byte++) {
+			child = next[state * 256 + byte];
+			if (child < 0) {
+				next[state * 256 + byte] = next[fail[state] * 256 + byte];
+				continue;
+			}
+			fail[child] = next[fail[state] * 256 + byte];
+			queue[tail++] = child;
+		}
+	}
+	
+	mem_free(fail);
+	mem_free(queue);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       search_skip() - Skip bytes which can not start a match
+         Return offset of next candidate, length if none.
+   ============================================================ */
+static size_t search_skip(Search *search, unsigned char *text,
+                          size_t cursor, size_t length)
+{
+	/* --- Variables --- */
+#ifdef __SSE2__
+	__m128i block;
+	__m128i starts[SEARCH_SIMD_BYTES];
+	int mask = 0;
+	int loop = 0;
+	
+	/* Compare 16 bytes at once against each start byte */
+	if (search->start_count <= SEARCH_SIMD_BYTES) {
+		for (loop = 0; loop < search->start_count; loop++) {
+			starts[loop] = _mm_set1_epi8((char) search->start_bytes[loop]);
+		}
+		for (; cursor + 16 <= length; cursor += 16) {
+			block = _mm_loadu_si128((__m128i*) (text + cursor));
+			mask = 0;
+			for (loop = 0; loop < search->start_count; loop++) {
+				mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(block, starts[loop]));
+			}
+			if (mask) {
+				return cursor + __builtin_ctz(mask);
+			}
+		}
+	}
+#endif
+	
+	for (; cursor < length; cursor++) {
+		if (search->start[text[cursor]]) {
+			break;
+		}
+	}
+	return cursor;
+}
+
+
+/* ============================================================
+       search_record() - Match record text against patterns
+         Return pattern index of first match, -1 if none.
+   ============================================================ */
+int search_record(Search *search, Record *record)
+{
+	/* --- Variables --- */
+	unsigned char *text = NULL;
+	size_t cursor = 0;
+	int32_t state = 0;
+	
+	/* --- Assert check --- */
+	assert(search != NULL);
+	assert(record != NULL);
+	
+	text = (unsigned char*) record->text;
+	search->records++;
+	while (cursor < record->text_len) {
+		if (state == 0) {
+			cursor = search_skip(search, text, cursor, record->text_len);
+			if (cursor >= record->text_len) {
+				break;
+			}
+		}
+		state = search->next[state * 256 + text[cursor++]];
+		if (search->output[state] >= 0) {
+			search->matches++;
+			return search->output[state];
+		}
+	}
+	return -1;
+}
+
+
+/* ====================================================================== */
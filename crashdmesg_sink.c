@@ -0,0 +1,285 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_sink.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#include <libgen.h>
+#include <limits.h>
+
+
+/* --- Prototypes --- */
+static ssize_t sink_cookie_write(void *cookie, const char *data, size_t size);
+static int sink_flush(Sink *sink, int final);
+static int sink_sync(Sink *sink);
+static void sink_time(Sink *sink, struct timespec *start);
+
+
+/* ============================================================
+       sink_open() - Open durable output file
+         Data is written in aligned blocks with O_DIRECT and
+         fdatasync()ed every sync_interval bytes.
+   ============================================================ */
+int sink_open(Sink *sink, char *path, size_t sync_interval)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] sink_open:";
+	cookie_io_functions_t functions;
+	memset(&functions, 0x00, sizeof(functions));
+	struct timespec start;
+	
+	/* --- Assert check --- */
+	assert(sink != NULL);
+	assert(path != NULL);
+	
+	memset(sink, 0x00, sizeof(Sink));
+	sink->path = path;
+	sink->sync_interval = sync_interval;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	/* Page cache is bypassed, fall back if filesystem refuses */
+	sink->direct = 1;
+	sink->fdesc = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if ((sink->fdesc == -1) && (errno == EINVAL)) {
+		sink->direct = 0;
+		sink->fdesc = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (sink->fdesc == -1) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	
+	/* Blocks are written when threshold is reached */
+	sink->buffer = mem_alloc_aligned(SINK_BLOCK_SIZE, SINK_BUFFER_SIZE);
+	if (sink->buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_CLOSE;
+	}
+	sink->threshold = SINK_BUFFER_SIZE;
+	if ((sync_interval > 0) && (sync_interval < SINK_BUFFER_SIZE)) {
+		sink->threshold = (sync_interval + SINK_BLOCK_SIZE - 1) &
+		                  ~((size_t) SINK_BLOCK_SIZE - 1);
+	}
+	
+	/* stdio stream on top, unbuffered not to copy twice */
+	functions.write = sink_cookie_write;
+	sink->stream = fopencookie(sink, "w", functions);
+	if (sink->stream == NULL) {
+		fprintf(stderr, "%s Can not create stream.\n", estr);
+		goto ERROR_CLOSE;
+	}
+	setvbuf(sink->stream, NULL, _IONBF, 0);
+	sink_time(sink, &start);
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_CLOSE:
+	mem_free(sink->buffer);
+	close(sink->fdesc);
+	memset(sink, 0x00, sizeof(Sink));
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       sink_close() - Write rest, Sync file and directory
+   ============================================================ */
+int sink_close(Sink *sink)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] sink_close:";
+	char directory[PATH_MAX];
+	memset(directory, 0x00, sizeof(directory));
+	struct timespec start;
+	int fdesc = 0;
+	
+	/* --- Assert check --- */
+	assert(sink != NULL);
+	assert(sink->stream != NULL);
+	
+	fclose(sink->stream);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((! sink->error) && (sink_flush(sink, 1) || sink_sync(sink))) {
+		sink->error = 1;
+	}
+	if (close(sink->fdesc) == -1) {
+		fprintf(stderr, "%s Can not close: %s: [%d] %s\n",
+		        estr, sink->path, errno, strerror(errno));
+		sink->error = 1;
+	}
+	mem_free(sink->buffer);
+	
+	/* Directory entry must be durable too */
+	snprintf(directory, sizeof(directory), "%s", sink->path);
+	fdesc = open(dirname(directory), O_RDONLY | O_DIRECTORY);
+	if ((fdesc == -1) || (fsync(fdesc) == -1)) {
+		fprintf(stderr, "%s Can not sync directory of %s: [%d] %s\n",
+		        estr, sink->path, errno, strerror(errno));
+		sink->error = 1;
+	}
+	if (fdesc != -1) {
+		close(fdesc);
+	}
+	sink_time(sink, &start);
+	
+	fprintf(stdout, "%s:    * Output:     %s%s\n", APP_NAME, sink->path,
+	        sink->direct ? " (O_DIRECT)" : "");
+	fprintf(stdout, "%s:    * Written:    %lu bytes, %lu syncs, "
+	        "%lu.%03lu sec\n", APP_NAME, (unsigned long) sink->written,
+	        (unsigned long) sink->syncs, (unsigned long) sink->elapsed.tv_sec,
+	        (unsigned long) sink->elapsed.tv_nsec / 1000000);
+	
+	return sink->error ? RETVAL_FAILURE : RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       sink_cookie_write() - fopencookie() write function
+   ============================================================ */
+static ssize_t sink_cookie_write(void *cookie, const char *data, size_t size)
+{
+	/* --- Variables --- */
+	Sink *sink = NULL;
+	struct timespec start;
+	size_t done = 0;
+	size_t length = 0;
+	
+	/* --- Assert check --- */
+	assert(cookie != NULL);
+	
+	sink = (Sink*) cookie;
+	if (sink->error) {
+		return -1;
+	}
+	while (done < size) {
+		length = SINK_BUFFER_SIZE - sink->fill;
+		if (length > size - done) {
+			length = size - done;
+		}
+		memcpy(sink->buffer + sink->fill, data + done, length);
+		sink->fill += length;
+		done += length;
+		if (sink->fill >= sink->threshold) {
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (sink_flush(sink, 0)) {
+				sink->error = 1;
+				return -1;
+			}
+			sink_time(sink, &start);
+		}
+	}
+	return size;
+}
+
+
+/* ============================================================
+       sink_flush() - Write whole blocks of buffer
+         Final flush pads last block and truncates file.
+   ============================================================ */
+static int sink_flush(Sink *sink, int final)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] sink_flush:";
+	size_t length = 0;
+	size_t done = 0;
+	ssize_t written = 0;
+	
+	/* --- Assert check --- */
+	assert(sink != NULL);
+	
+	length = sink->fill & ~((size_t) SINK_BLOCK_SIZE - 1);
+	if (final && (length < sink->fill)) {
+		length += SINK_BLOCK_SIZE;
+		memset(sink->buffer + sink->fill, 0x00, length - sink->fill);
+	}
+	while (done < length) {
+		written = pwrite(sink->fdesc, sink->buffer + done, length - done,
+		                 sink->offset + done);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "%s Write failed: %s: [%d] %s\n",
+			        estr, sink->path, errno, strerror(errno));
+			return RETVAL_FAILURE;
+		}
+		done += written;
+	}
+	
+	if (final) {
+		sink->written += sink->fill;
+		sink->offset += sink->fill;
+		sink->fill = 0;
+		if ((length > 0) && (ftruncate(sink->fdesc, sink->offset) == -1)) {
+			fprintf(stderr, "%s Can not truncate: %s: [%d] %s\n",
+			        estr, sink->path, errno, strerror(errno));
+			return RETVAL_FAILURE;
+		}
+		return RETVAL_SUCCESS;
+	}
+	
+	/* Keep partial block for next write */
+	memmove(sink->buffer, sink->buffer + length, sink->fill - length);
+	sink->fill -= length;
+	sink->offset += length;
+	sink->written += length;
+	sink->unsynced += length;
+	if ((sink->sync_interval > 0) &&
+	    (sink->unsynced >= sink->sync_interval)) {
+		return sink_sync(sink);
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       sink_sync() - fdatasync() written data
+   ============================================================ */
+static int sink_sync(Sink *sink)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] sink_sync:";
+	
+	/* --- Assert check --- */
+	assert(sink != NULL);
+	
+	if (fdatasync(sink->fdesc) == -1) {
+		fprintf(stderr, "%s Can not sync: %s: [%d] %s\n",
+		        estr, sink->path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	sink->syncs++;
+	sink->unsynced = 0;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       sink_time() - Add time since start to elapsed
+   ============================================================ */
+static void sink_time(Sink *sink, struct timespec *start)
+{
+	/* --- Variables --- */
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sink->elapsed.tv_sec += now.tv_sec - start->tv_sec;
+	sink->elapsed.tv_nsec += now.tv_nsec - start->tv_nsec;
+	if (sink->elapsed.tv_nsec < 0) {
+		sink->elapsed.tv_sec--;
+		sink->elapsed.tv_nsec += 1000000000L;
+	}
+	else if (sink->elapsed.tv_nsec >= 1000000000L) {
+		sink->elapsed.tv_sec++;
+		sink->elapsed.tv_nsec -= 1000000000L;
+	}
+	return;
+}
+
+
+/* ====================================================================== */
@@ -0,0 +1,1309 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_store.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#include <sys/file.h>
+#include <limits.h>
+#include <ctype.h>
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
+
+/* --- Constant values --- */
+#define STORE_CATALOG_NAME "catalog"
+#define STORE_CATALOG_MAGIC "CDC1"
+#define STORE_SEGMENT_MAGIC "CDSEG001"
+#define STORE_LEVEL_UNKNOWN 8 /* Bit of level_mask, record level -1 */
+#define STORE_DAY 86400 /* [sec] Unit of relative time "Nd" */
+#define STORE_BLOCK_RECORDS 256 /* Max records of one text block */
+#define STORE_BLOCK_SIZE 65536 /* Max text bytes of one text block */
+#define STORE_TEXT_OFFSET (sizeof(uint32_t) * (STORE_BLOCK_RECORDS + 1))
+#define STORE_PACKED_SIZE (STORE_TEXT_OFFSET + STORE_BLOCK_SIZE + 1024)
+#define STORE_MAX_WORDS 16 /* Max word= terms of query */
+
+
+/* --- Data structures ---
+   Files are native endian, written and read by the same host type.
+   "catalog" is an array of StoreCatalog, one per segment.
+   Segment "NNNNNNNN.seg" is StoreSegment, compressed text blocks,
+   then the columns, block table, token table and postings. */
+
+/* Catalog entry, fixed 256 bytes */
+typedef struct {
+	char magic[4];
+	uint32_t segment; /* Segment file number */
+	uint32_t record_count;
+	uint32_t format; /* LOGFORMAT_*, legacy text has own prefix */
+	int64_t crashtime;
+	uint64_t ts_first; /* Oldest record timestamp [nsec] */
+	uint64_t ts_last;
+	uint32_t level_mask; /* Bit N if level N is in segment */
+	uint32_t reserved;
+	char osrelease[OSRELEASE_LENGTH];
+	char host[OSRELEASE_LENGTH]; /* utsname.nodename */
+	char source[256 - 48 - 2 * OSRELEASE_LENGTH]; /* vmcore path */
+} StoreCatalog;
+
+/* Segment header, offsets are from start of file */
+typedef struct {
+	char magic[8];
+	uint32_t record_count;
+	uint32_t block_count;
+	uint32_t token_count;
+	uint32_t posting_count;
+	uint64_t seq_offset; /* uint64_t seq[record_count] */
+	uint64_t ts_offset; /* uint64_t ts_nsec[record_count] */
+	uint64_t level_offset; /* int8_t level[record_count] */
+	uint64_t block_offset; /* StoreBlock[block_count] */
+	uint64_t token_offset; /* StoreToken[token_count], sorted by hash */
+	uint64_t posting_offset; /* uint32_t record[posting_count] */
+} StoreSegment;
+
+/* Text block: uint32_t count, uint32_t length[count], texts */
+typedef struct {
+	uint64_t offset;
+	uint32_t size; /* Stored size, == raw_size if not compressed */
+	uint32_t raw_size;
+	uint32_t first; /* First record number */
+	uint32_t count;
+} StoreBlock;
+
+/* Token of index, postings are sorted record numbers */
+typedef struct {
+	uint64_t hash; /* FNV-1a of lower case word */
+	uint32_t first; /* Index of postings */
+	uint32_t count;
+} StoreToken;
+
+/* Token occurrence while building index */
+typedef struct {
+	uint64_t hash;
+	uint32_t record;
+	uint32_t reserved;
+} StorePair;
+
+/* Segment being written */
+typedef struct {
+	int fdesc;
+	off_t offset; /* End of written data */
+	uint64_t *seqs;
+	uint64_t *stamps;
+	int8_t *levels;
+	uint32_t count;
+	uint32_t capacity;
+	StoreBlock *blocks;
+	uint32_t block_count;
+	uint32_t block_capacity;
+	StorePair *pairs;
+	size_t pair_count;
+	size_t pair_capacity;
+	char *image; /* Current block, texts from STORE_TEXT_OFFSET */
+	size_t text_fill;
+	char *packed; /* Compressed block */
+	StoreCatalog catalog;
+} StoreWriter;
+
+/* Mapped segment for query */
+typedef struct {
+	char *base;
+	size_t size;
+	StoreSegment *header;
+	uint64_t *seqs;
+	uint64_t *stamps;
+	int8_t *levels;
+	StoreBlock *blocks;
+	StoreToken *tokens;
+	uint32_t *postings;
+	char *block; /* Expanded block, cached */
+	uint32_t block_index; /* Cached block, block_count if none */
+} StoreReader;
+
+/* Parsed query terms */
+typedef struct {
+	int level; /* Records with level <= this, -1 for all */
+	char *release; /* fnmatch(3) pattern */
+	char *host;
+	time_t since; /* Crash time range, 0 if open */
+	time_t until;
+	char *words[STORE_MAX_WORDS]; /* All must be in text */
+	uint64_t hashes[STORE_MAX_WORDS];
+	int word_count;
+} StoreQuery;
+
+
+/* --- Prototypes --- */
+static int store_read_host(VMCore *vmcore, char *host, size_t size);
+static int store_add_record(StoreWriter *writer, Record *record);
+static int store_add_tokens(StoreWriter *writer, char *text, size_t length);
+static int store_flush_block(StoreWriter *writer);
+static int store_finish(StoreWriter *writer);
+static int store_write(StoreWriter *writer, void *data, size_t size);
+static void store_free_writer(StoreWriter *writer);
+static int store_compare_pair(const void *a, const void *b);
+static uint64_t store_hash(char *word, size_t length);
+static int store_next_word(char *text, size_t length, size_t *cursor,
+                           size_t *start);
+static int store_parse_query(StoreQuery *query, char **terms, int count);
+static int store_parse_time(char *text, time_t *ret);
+static int store_open_segment(char *dir, uint32_t segment,
+                              StoreReader *reader);
+static void store_close_segment(StoreReader *reader);
+static uint32_t *store_lookup(StoreReader *reader, uint64_t hash,
+                              uint32_t *count);
+static size_t store_candidates(StoreReader *reader, StoreQuery *query,
+                               uint32_t *records);
+static int store_get_text(StoreReader *reader, uint32_t record,
+                          char* *text, uint32_t *length);
+static int store_match_words(StoreQuery *query, char *text, size_t length);
+#ifdef HAVE_ZLIB
+static voidpf store_zalloc(voidpf opaque, uInt items, uInt size);
+static void store_zfree(voidpf opaque, voidpf address);
+#endif
+
+
+/* ============================================================
+       store_append() - Append all records of ring to store
+         One segment per vmcore, then one catalog entry.
+         Ring iteration position is restored.
+   ============================================================ */
+int store_append(VMCore *vmcore, Ring *ring, char *dir)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] store_append:";
+	StoreWriter writer;
+	memset(&writer, 0x00, sizeof(StoreWriter));
+	Record record;
+	memset(&record, 0x00, sizeof(Record));
+	char path[PATH_MAX];
+	memset(path, 0x00, sizeof(path));
+	char segment[PATH_MAX];
+	memset(segment, 0x00, sizeof(segment));
+	char temporary[PATH_MAX];
+	memset(temporary, 0x00, sizeof(temporary));
+	struct stat status;
+	memset(&status, 0x00, sizeof(struct stat));
+	size_t cursor = 0;
+	uint64_t seq = 0;
+	int catalog = -1;
+	writer.fdesc = -1;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ring != NULL);
+	assert(dir != NULL);
+	
+	/* Catalog is locked while appending, segment number is its size */
+	if ((mkdir(dir, 0755) == -1) && (errno != EEXIST)) {
+		fprintf(stderr, "%s Can not create: %s: [%d] %s\n",
+		        estr, dir, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	if (snprintf(path, sizeof(path), "%s/%s", dir, STORE_CATALOG_NAME) >=
+	    sizeof(path)) {
+		fprintf(stderr, "%s Path is too long: %s\n", estr, dir);
+		return RETVAL_FAILURE;
+	}
+	catalog = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if ((catalog == -1) || (flock(catalog, LOCK_EX) == -1) ||
+	    (fstat(catalog, &status) == -1)) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		goto ERROR_CLOSE;
+	}
+	if (status.st_size % sizeof(StoreCatalog)) {
+		fprintf(stderr, "%s Broken catalog: %s\n", estr, path);
+		goto ERROR_CLOSE;
+	}
+	
+	/* Segment metadata from VMCore */
+	memcpy(writer.catalog.magic, STORE_CATALOG_MAGIC,
+	       sizeof(writer.catalog.magic));
+	writer.catalog.segment = status.st_size / sizeof(StoreCatalog);
+	writer.catalog.format = vmcore->log_format;
+	writer.catalog.crashtime = vmcore->crashtime;
+	snprintf(writer.catalog.osrelease, sizeof(writer.catalog.osrelease),
+	         "%s", vmcore->osrelease);
+	if (store_read_host(vmcore, writer.catalog.host,
+	                    sizeof(writer.catalog.host))) {
+		snprintf(writer.catalog.host, sizeof(writer.catalog.host), "-");
+	}
+	snprintf(writer.catalog.source, sizeof(writer.catalog.source),
+	         "%s", vmcore->file.filename);
+	
+	if ((snprintf(segment, sizeof(segment), "%s/%08u.seg",
+	              dir, writer.catalog.segment) >= sizeof(segment)) ||
+	    (snprintf(temporary, sizeof(temporary), "%s.tmp", segment) >=
+	     sizeof(temporary))) {
+		fprintf(stderr, "%s Path is too long: %s\n", estr, dir);
+		goto ERROR_CLOSE;
+	}
+	writer.fdesc = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (writer.fdesc == -1) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, temporary, errno, strerror(errno));
+		goto ERROR_CLOSE;
+	}
+	writer.image = mem_alloc(STORE_PACKED_SIZE);
+	writer.packed = mem_alloc(STORE_PACKED_SIZE);
+	if ((writer.image == NULL) || (writer.packed == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_UNLINK;
+	}
+	writer.offset = sizeof(StoreSegment);
+	
+	/* All records, then back to where dump starts */
+	cursor = ring->cursor;
+	seq = ring->seq;
+	while (printk_next_record(vmcore, ring, &record)) {
+		if (store_add_record(&writer, &record)) {
+			fprintf(stderr, "%s Can not add record.\n", estr);
+			ring->cursor = cursor;
+			ring->seq = seq;
+			goto ERROR_UNLINK;
+		}
+	}
+	ring->cursor = cursor;
+	ring->seq = seq;
+	
+	/* Segment is complete before it is in catalog */
+	if (store_finish(&writer) || (fsync(writer.fdesc) == -1) ||
+	    (rename(temporary, segment) == -1)) {
+		fprintf(stderr, "%s Can not write: %s: [%d] %s\n",
+		        estr, segment, errno, strerror(errno));
+		goto ERROR_UNLINK;
+	}
+	if ((write(catalog, &writer.catalog, sizeof(StoreCatalog)) !=
+	     sizeof(StoreCatalog)) || (fsync(catalog) == -1)) {
+		fprintf(stderr, "%s Can not write: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		goto ERROR_CLOSE;
+	}
+	fprintf(stdout, "%s:    * Store:      %s, %u records, %u blocks, "
+	        "%lu bytes\n", APP_NAME, segment, writer.count,
+	        writer.block_count, (unsigned long) writer.offset);
+	
+	store_free_writer(&writer);
+	close(catalog);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_UNLINK:
+	unlink(temporary);
+ERROR_CLOSE:
+	store_free_writer(&writer);
+	if (catalog != -1) {
+		close(catalog);
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       store_read_host() - Read utsname.nodename of vmcore
+   ============================================================ */
+static int store_read_host(VMCore *vmcore, char *host, size_t size)
+{
+	/* --- Variables --- */
+	uint64_t uts = 0;
+	uint64_t name = 0;
+	
+	if (elf_search_vmcoreinfo_number(vmcore, "SYMBOL(init_uts_ns)", &uts) ||
+	    elf_search_vmcoreinfo_number(vmcore, "OFFSET(uts_namespace.name)",
+	                                 &name)) {
+		return RETVAL_FAILURE;
+	}
+	
+	/* struct new_utsname { sysname[65]; nodename[65]; ... } */
+	if (elf_read_load_data(vmcore, uts + name + OSRELEASE_LENGTH,
+	                       host, size)) {
+		return RETVAL_FAILURE;
+	}
+	host[size - 1] = 0x00;
+	return (host[0] != 0x00) ? RETVAL_SUCCESS : RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       store_add_record() - Add record to columns and block
+   ============================================================ */
+static int store_add_record(StoreWriter *writer, Record *record)
+{
+	/* --- Variables --- */
+	StoreBlock *block = NULL;
+	uint32_t capacity = 0;
+	uint32_t length32 = 0;
+	size_t length = 0;
+	void *grown = NULL;
+	
+	/* Columns grow by doubling */
+	if (writer->count == writer->capacity) {
+		capacity = writer->capacity ? writer->capacity * 2 : 1024;
+		grown = mem_realloc(writer->seqs, sizeof(uint64_t) * capacity);
+		if (grown == NULL) {
+			return RETVAL_FAILURE;
+		}
+		writer->seqs = grown;
+		grown = mem_realloc(writer->stamps, sizeof(uint64_t) * capacity);
+		if (grown == NULL) {
+			return RETVAL_FAILURE;
+		}
+		writer->stamps = grown;
+		grown = mem_realloc(writer->levels, sizeof(int8_t) * capacity);
+		if (grown == NULL) {
+			return RETVAL_FAILURE;
+		}
+		writer->levels = grown;
+		writer->capacity = capacity;
+	}
+	
+	/* Block is written when full */
+	length = record->text_len;
+	if (length > STORE_BLOCK_SIZE) {
+		length = STORE_BLOCK_SIZE;
+	}
+	length32 = length;
+	if ((writer->block_count > 0) &&
+	    ((writer->text_fill + length > STORE_BLOCK_SIZE) ||
+	     (writer->blocks[writer->block_count - 1].count ==
+	      STORE_BLOCK_RECORDS))) {
+		if (store_flush_block(writer)) {
+			return RETVAL_FAILURE;
+		}
+	}
+	if ((writer->block_count == 0) ||
+	    (writer->blocks[writer->block_count - 1].size != 0)) {
+		/* Start new block */
+		if (writer->block_count == writer->block_capacity) {
+			capacity = writer->block_capacity ?
+			           writer->block_capacity * 2 : 64;
+			grown = mem_realloc(writer->blocks,
+			                    sizeof(StoreBlock) * capacity);
+			if (grown == NULL) {
+				return RETVAL_FAILURE;
+			}
+			writer->blocks = grown;
+			writer->block_capacity = capacity;
+		}
+		memset(&writer->blocks[writer->block_count], 0x00,
+		       sizeof(StoreBlock));
+		writer->blocks[writer->block_count].first = writer->count;
+		writer->block_count++;
+	}
+	
+	writer->seqs[writer->count] = record->seq;
+	writer->stamps[writer->count] = record->ts_nsec;
+	writer->levels[writer->count] = record->level;
+	writer->catalog.level_mask |= 1 << ((record->level < 0) ?
+	                              STORE_LEVEL_UNKNOWN : record->level);
+	if (writer->count == 0) {
+		writer->catalog.ts_first = record->ts_nsec;
+	}
+	writer->catalog.ts_last = record->ts_nsec;
+	if (store_add_tokens(writer, record->text, length)) {
+		return RETVAL_FAILURE;
+	}
+	block = &writer->blocks[writer->block_count - 1];
+	memcpy(writer->image + sizeof(uint32_t) * (block->count + 1),
+	       &length32, sizeof(uint32_t));
+	block->count++;
+	memcpy(writer->image + STORE_TEXT_OFFSET + writer->text_fill,
+	       record->text, length);
+	writer->text_fill += length;
+	writer->count++;
+	writer->catalog.record_count = writer->count;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_add_tokens() - Add words of text to index pairs
+   ============================================================ */
+static int store_add_tokens(StoreWriter *writer, char *text, size_t length)
+{
+	/* --- Variables --- */
+	StorePair *grown = NULL;
+	size_t capacity = 0;
+	size_t cursor = 0;
+	size_t start = 0;
+	
+	while (store_next_word(text, length, &cursor, &start)) {
+		if (writer->pair_count == writer->pair_capacity) {
+			capacity = writer->pair_capacity ?
+			           writer->pair_capacity * 2 : 4096;
+			grown = mem_realloc(writer->pairs, sizeof(StorePair) * capacity);
+			if (grown == NULL) {
+				return RETVAL_FAILURE;
+			}
+			writer->pairs = grown;
+			writer->pair_capacity = capacity;
+		}
+		writer->pairs[writer->pair_count].hash =
+			store_hash(text + start, cursor - start);
+		writer->pairs[writer->pair_count].record = writer->count;
+		writer->pair_count++;
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_flush_block() - Compress and Write current block
+   ============================================================ */
+static int store_flush_block(StoreWriter *writer)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] store_flush_block:";
+	StoreBlock *block = NULL;
+	size_t header = 0;
+	char *image = NULL;
+#ifdef HAVE_ZLIB
+	z_stream zstream;
+	memset(&zstream, 0x00, sizeof(z_stream));
+#endif
+	
+	if ((writer->block_count == 0) ||
+	    (writer->blocks[writer->block_count - 1].size != 0)) {
+		return RETVAL_SUCCESS;
+	}
+	block = &writer->blocks[writer->block_count - 1];
+	
+	/* Image: count, lengths, texts, moved next to lengths */
+	header = sizeof(uint32_t) * (block->count + 1);
+	image = writer->image;
+	memcpy(image, &block->count, sizeof(uint32_t));
+	memmove(image + header, image + STORE_TEXT_OFFSET, writer->text_fill);
+	block->raw_size = header + writer->text_fill;
+	block->size = block->raw_size;
+	block->offset = writer->offset;
+	
+#ifdef HAVE_ZLIB
+	/* Kept raw if compression does not pay, zlib state from arena */
+	zstream.zalloc = store_zalloc;
+	zstream.zfree = store_zfree;
+	zstream.opaque = Z_NULL;
+	if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS,
+	                 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+		zstream.next_in = (Bytef*) image;
+		zstream.avail_in = block->raw_size;
+		zstream.next_out = (Bytef*) writer->packed;
+		zstream.avail_out = STORE_PACKED_SIZE;
+		if ((deflate(&zstream, Z_FINISH) == Z_STREAM_END) &&
+		    (zstream.total_out < block->raw_size)) {
+			block->size = zstream.total_out;
+			image = writer->packed;
+		}
+		deflateEnd(&zstream);
+	}
+#endif
+	
+	if (store_write(writer, image, block->size)) {
+		fprintf(stderr, "%s Can not write block.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	writer->text_fill = 0;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_finish() - Write columns, index and header
+   ============================================================ */
+static int store_finish(StoreWriter *writer)
+{
+	/* --- Variables --- */
+	StoreSegment header;
+	memset(&header, 0x00, sizeof(StoreSegment));
+	StoreToken token;
+	memset(&token, 0x00, sizeof(StoreToken));
+	uint32_t *postings = NULL;
+	size_t count = 0;
+	size_t loop = 0;
+	ssize_t written = 0;
+	
+	if (store_flush_block(writer)) {
+		return RETVAL_FAILURE;
+	}
+	
+	/* Pairs to unique sorted (hash, record) postings */
+	qsort(writer->pairs, writer->pair_count, sizeof(StorePair),
+	      store_compare_pair);
+	postings = mem_alloc(sizeof(uint32_t) * (writer->pair_count + 1));
+	if (postings == NULL) {
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < writer->pair_count; loop++) {
+		if ((loop > 0) &&
+		    (writer->pairs[loop].hash == writer->pairs[loop - 1].hash) &&
+		    (writer->pairs[loop].record == writer->pairs[loop - 1].record)) {
+			continue;
+		}
+		postings[count++] = writer->pairs[loop].record;
+		writer->pairs[count - 1].hash = writer->pairs[loop].hash;
+	}
+	
+	/* Columns, 8 bytes aligned */
+	memcpy(header.magic, STORE_SEGMENT_MAGIC, sizeof(header.magic));
+	header.record_count = writer->count;
+	header.block_count = writer->block_count;
+	header.posting_count = count;
+	writer->offset = (writer->offset + 7) & ~((off_t) 7);
+	header.seq_offset = writer->offset;
+	if (store_write(writer, writer->seqs, sizeof(uint64_t) * writer->count)) {
+		goto ERROR_FREE;
+	}
+	header.ts_offset = writer->offset;
+	if (store_write(writer, writer->stamps,
+	                sizeof(uint64_t) * writer->count)) {
+		goto ERROR_FREE;
+	}
+	header.level_offset = writer->offset;
+	if (store_write(writer, writer->levels, sizeof(int8_t) * writer->count)) {
+		goto ERROR_FREE;
+	}
+	writer->offset = (writer->offset + 7) & ~((off_t) 7);
+	header.block_offset = writer->offset;
+	if (store_write(writer, writer->blocks,
+	                sizeof(StoreBlock) * writer->block_count)) {
+		goto ERROR_FREE;
+	}
+	
+	/* Token table from runs of equal hash */
+	header.token_offset = writer->offset;
+	for (loop = 0; loop < count; loop++) {
+		if ((loop > 0) &&
+		    (writer->pairs[loop].hash == writer->pairs[loop - 1].hash)) {
+			token.count++;
+			continue;
+		}
+		if ((loop > 0) && store_write(writer, &token, sizeof(StoreToken))) {
+			goto ERROR_FREE;
+		}
+		token.hash = writer->pairs[loop].hash;
+		token.first = loop;
+		token.count = 1;
+		header.token_count++;
+	}
+	if ((count > 0) && store_write(writer, &token, sizeof(StoreToken))) {
+		goto ERROR_FREE;
+	}
+	header.posting_offset = writer->offset;
+	if (store_write(writer, postings, sizeof(uint32_t) * count)) {
+		goto ERROR_FREE;
+	}
+	mem_free(postings);
+	
+	written = pwrite(writer->fdesc, &header, sizeof(StoreSegment), 0);
+	return (written == sizeof(StoreSegment)) ?
+	       RETVAL_SUCCESS : RETVAL_FAILURE;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(postings);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       store_write() - Write at end of segment
+   ============================================================ */
+static int store_write(StoreWriter *writer, void *data, size_t size)
+{
+	/* --- Variables --- */
+	ssize_t written = 0;
+	size_t done = 0;
+	
+	while (done < size) {
+		written = pwrite(writer->fdesc, (char*) data + done, size - done,
+		                 writer->offset + done);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return RETVAL_FAILURE;
+		}
+		done += written;
+	}
+	writer->offset += size;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_free_writer() - Close segment and Free buffers
+   ============================================================ */
+static void store_free_writer(StoreWriter *writer)
+{
+	if (writer->fdesc != -1) {
+		close(writer->fdesc);
+	}
+	mem_free(writer->seqs);
+	mem_free(writer->stamps);
+	mem_free(writer->levels);
+	mem_free(writer->blocks);
+	mem_free(writer->pairs);
+	mem_free(writer->image);
+	mem_free(writer->packed);
+	return;
+}
+
+
+/* ============================================================
+       store_compare_pair() - qsort() compare by hash, record
+   ============================================================ */
+static int store_compare_pair(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const StorePair *x = a;
+	const StorePair *y = b;
+	
+	if (x->hash != y->hash) {
+		return (x->hash < y->hash) ? -1 : 1;
+	}
+	return (x->record < y->record) ? -1 : (x->record > y->record);
+}
+
+
+/* ============================================================
+       store_hash() - FNV-1a of lower case word
+   ============================================================ */
+static uint64_t store_hash(char *word, size_t length)
+{
+	/* --- Variables --- */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t loop = 0;
+	
+	for (loop = 0; loop < length; loop++) {
+		hash ^= (unsigned char) tolower((unsigned char) word[loop]);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+/* ============================================================
+       store_next_word() - Find next word of text
+         Word is [A-Za-z0-9_] run of 2 bytes or more, from start
+         to cursor. Return 0 at end of text.
+   ============================================================ */
+static int store_next_word(char *text, size_t length, size_t *cursor,
+                           size_t *start)
+{
+	while (*cursor < length) {
+		while ((*cursor < length) &&
+		       (! isalnum((unsigned char) text[*cursor])) &&
+		       (text[*cursor] != '_')) {
+			(*cursor)++;
+		}
+		*start = *cursor;
+		while ((*cursor < length) &&
+		       (isalnum((unsigned char) text[*cursor]) ||
+		        (text[*cursor] == '_'))) {
+			(*cursor)++;
+		}
+		if (*cursor - *start >= 2) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/* ============================================================
+       store_query() - Print records of store matching terms
+         Terms: level=N release=GLOB host=GLOB since=T until=T
+         word=WORD (repeatable). T is epoch, YYYY-MM-DD or Nd.
+   ============================================================ */
+int store_query(char *dir, char **terms, int count, FILE *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] store_query:";
+	StoreQuery query;
+	memset(&query, 0x00, sizeof(StoreQuery));
+	StoreReader reader;
+	memset(&reader, 0x00, sizeof(StoreReader));
+	StoreCatalog *catalog = NULL;
+	StoreCatalog *entry = NULL;
+	char path[PATH_MAX];
+	memset(path, 0x00, sizeof(path));
+	struct stat status;
+	memset(&status, 0x00, sizeof(struct stat));
+	Record record;
+	memset(&record, 0x00, sizeof(Record));
+	struct tm *ct = NULL;
+	time_t crashtime = 0;
+	uint32_t *records = NULL;
+	size_t candidates = 0;
+	size_t entries = 0;
+	size_t loop = 0;
+	size_t index = 0;
+	uint64_t matched = 0;
+	int segments = 0;
+	int fdesc = -1;
+	char *text = NULL;
+	uint32_t length = 0;
+	int retval = RETVAL_SUCCESS;
+	
+	/* --- Assert check --- */
+	assert(dir != NULL);
+	assert(stream != NULL);
+	
+	if (store_parse_query(&query, terms, count)) {
+		fprintf(stderr, "%s Invalid query.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (snprintf(path, sizeof(path), "%s/%s", dir, STORE_CATALOG_NAME) >=
+	    sizeof(path)) {
+		fprintf(stderr, "%s Path is too long: %s\n", estr, dir);
+		return RETVAL_FAILURE;
+	}
+	fdesc = open(path, O_RDONLY);
+	if ((fdesc == -1) || (fstat(fdesc, &status) == -1)) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		goto ERROR_CLOSE;
+	}
+	entries = status.st_size / sizeof(StoreCatalog);
+	if (entries == 0) {
+		close(fdesc);
+		return RETVAL_SUCCESS;
+	}
+	catalog = mmap(NULL, entries * sizeof(StoreCatalog), PROT_READ,
+	               MAP_SHARED, fdesc, 0);
+	if (catalog == MAP_FAILED) {
+		fprintf(stderr, "%s Can not map: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		goto ERROR_CLOSE;
+	}
+	
+	for (loop = 0; loop < entries; loop++) {
+		/* Catalog prunes segments, they are not opened */
+		entry = &catalog[loop];
+		if (memcmp(entry->magic, STORE_CATALOG_MAGIC, sizeof(entry->magic)) ||
+		    (query.release && fnmatch(query.release, entry->osrelease, 0)) ||
+		    (query.host && fnmatch(query.host, entry->host, 0)) ||
+		    (query.since && (entry->crashtime < query.since)) ||
+		    (query.until && (entry->crashtime >= query.until)) ||
+		    ((query.level >= 0) &&
+		     (! (entry->level_mask & ((2U << query.level) - 1))))) {
+			continue;
+		}
+		if (store_open_segment(dir, entry->segment, &reader)) {
+			retval = RETVAL_FAILURE;
+			continue;
+		}
+		segments++;
+	
+		/* Token index, then level column */
+		records = mem_alloc(sizeof(uint32_t) *
+		                    (reader.header->record_count + 1));
+		if (records == NULL) {
+			fprintf(stderr, "%s Can not allocate memory.\n", estr);
+			store_close_segment(&reader);
+			retval = RETVAL_FAILURE;
+			break;
+		}
+		candidates = store_candidates(&reader, &query, records);
+		crashtime = entry->crashtime;
+		ct = localtime(&crashtime);
+		for (index = 0; index < candidates; index++) {
+			if (store_get_text(&reader, records[index], &text, &length)) {
+				fprintf(stderr, "%s Broken block in segment %u.\n",
+				        estr, entry->segment);
+				retval = RETVAL_FAILURE;
+				break;
+			}
+			if (! store_match_words(&query, text, length)) {
+				continue;
+			}
+			record.seq = reader.seqs[records[index]];
+			record.ts_nsec = reader.stamps[records[index]];
+			record.level = reader.levels[records[index]];
+			record.prefixed = (entry->format == LOGFORMAT_LEGACY);
+			record.text = text;
+			record.text_len = length;
+			fprintf(stream, "%s %s %04d-%02d-%02d %02d:%02d:%02d %lu: ",
+			        entry->host, entry->osrelease,
+			        ct ? ct->tm_year + 1900 : 0, ct ? ct->tm_mon + 1 : 0,
+			        ct ? ct->tm_mday : 0, ct ? ct->tm_hour : 0,
+			        ct ? ct->tm_min : 0, ct ? ct->tm_sec : 0,
+			        (unsigned long) record.seq);
+			printk_print_record(stream, &record);
+			matched++;
+		}
+		mem_free(records);
+		store_close_segment(&reader);
+	}
+	fprintf(stdout, "%s:    * Query:      %lu records from %d/%lu segments\n",
+	        APP_NAME, (unsigned long) matched, segments,
+	        (unsigned long) entries);
+	
+	munmap(catalog, entries * sizeof(StoreCatalog));
+	close(fdesc);
+	return retval;
+	
+	/* Error */
+ERROR_CLOSE:
+	if (fdesc != -1) {
+		close(fdesc);
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       store_parse_query() - Parse "key=value" terms
+   ============================================================ */
+static int store_parse_query(StoreQuery *query, char **terms, int count)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] store_parse_query:";
+	char *value = NULL;
+	char *endptr = NULL;
+	size_t cursor = 0;
+	size_t start = 0;
+	int loop = 0;
+	
+	query->level = -1;
+	for (loop = 0; loop < count; loop++) {
+		value = strchr(terms[loop], '=');
+		if (value == NULL) {
+			fprintf(stderr, "%s Not key=value: %s\n", estr, terms[loop]);
+			return RETVAL_FAILURE;
+		}
+		*value++ = 0x00;
+		if (! strcmp(terms[loop], "level")) {
+			query->level = strtol(value, &endptr, 10);
+			if ((*value == 0x00) || (*endptr != 0x00) ||
+			    (query->level < 0) || (query->level > 7)) {
+				fprintf(stderr, "%s Invalid level: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+		}
+		else if (! strcmp(terms[loop], "release")) {
+			query->release = value;
+		}
+		else if (! strcmp(terms[loop], "host")) {
+			query->host = value;
+		}
+		else if (! strcmp(terms[loop], "since")) {
+			if (store_parse_time(value, &query->since)) {
+				fprintf(stderr, "%s Invalid time: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+		}
+		else if (! strcmp(terms[loop], "until")) {
+			if (store_parse_time(value, &query->until)) {
+				fprintf(stderr, "%s Invalid time: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+		}
+		else if (! strcmp(terms[loop], "word")) {
+			/* Same word split as index */
+			cursor = 0;
+			if ((query->word_count == STORE_MAX_WORDS) ||
+			    (! store_next_word(value, strlen(value), &cursor, &start)) ||
+			    (start != 0) || (value[cursor] != 0x00)) {
+				fprintf(stderr, "%s Invalid word: %s\n", estr, value);
+				return RETVAL_FAILURE;
+			}
+			query->words[query->word_count] = value;
+			query->hashes[query->word_count] = store_hash(value, cursor);
+			query->word_count++;
+		}
+		else {
+			fprintf(stderr, "%s Unknown key: %s\n", estr, terms[loop]);
+			return RETVAL_FAILURE;
+		}
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_parse_time() - Epoch, YYYY-MM-DD or Nd (days ago)
+   ============================================================ */
+static int store_parse_time(char *text, time_t *ret)
+{
+	/* --- Variables --- */
+	struct tm date;
+	memset(&date, 0x00, sizeof(struct tm));
+	char *endptr = NULL;
+	long value = 0;
+	
+	value = strtol(text, &endptr, 10);
+	if ((endptr != text) && (*endptr == 0x00)) {
+		*ret = value;
+		return RETVAL_SUCCESS;
+	}
+	if ((endptr != text) && (! strcmp(endptr, "d"))) {
+		*ret = time(NULL) - value * STORE_DAY;
+		return RETVAL_SUCCESS;
+	}
+	endptr = strptime(text, "%Y-%m-%d", &date);
+	if ((endptr == NULL) || (*endptr != 0x00)) {
+		return RETVAL_FAILURE;
+	}
+	date.tm_isdst = -1;
+	*ret = mktime(&date);
+	return (*ret == -1) ? RETVAL_FAILURE : RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_open_segment() - mmap segment and Check bounds
+   ============================================================ */
+static int store_open_segment(char *dir, uint32_t segment,
+                              StoreReader *reader)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] store_open_segment:";
+	char path[PATH_MAX];
+	memset(path, 0x00, sizeof(path));
+	struct stat status;
+	memset(&status, 0x00, sizeof(struct stat));
+	StoreSegment *header = NULL;
+	int fdesc = -1;
+	int loop = 0;
+	
+	memset(reader, 0x00, sizeof(StoreReader));
+	if (snprintf(path, sizeof(path), "%s/%08u.seg", dir, segment) >=
+	    sizeof(path)) {
+		fprintf(stderr, "%s Path is too long: %s\n", estr, dir);
+		return RETVAL_FAILURE;
+	}
+	fdesc = open(path, O_RDONLY);
+	if ((fdesc == -1) || (fstat(fdesc, &status) == -1) ||
+	    (status.st_size < sizeof(StoreSegment))) {
+		fprintf(stderr, "%s Can not open: %s\n", estr, path);
+		if (fdesc != -1) {
+			close(fdesc);
+		}
+		return RETVAL_FAILURE;
+	}
+	reader->size = status.st_size;
+	reader->base = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fdesc, 0);
+	close(fdesc);
+	if (reader->base == MAP_FAILED) {
+		fprintf(stderr, "%s Can not map: %s\n", estr, path);
+		reader->base = NULL;
+		return RETVAL_FAILURE;
+	}
+	
+	/* Every table must be in file */
+	header = (StoreSegment*) reader->base;
+	reader->header = header;
+	if (memcmp(header->magic, STORE_SEGMENT_MAGIC, sizeof(header->magic)) ||
+	    (header->seq_offset + sizeof(uint64_t) * header->record_count >
+	     reader->size) ||
+	    (header->ts_offset + sizeof(uint64_t) * header->record_count >
+	     reader->size) ||
+	    (header->level_offset + header->record_count > reader->size) ||
+	    (header->block_offset + sizeof(StoreBlock) * header->block_count >
+	     reader->size) ||
+	    (header->token_offset + sizeof(StoreToken) * header->token_count >
+	     reader->size) ||
+	    (header->posting_offset + sizeof(uint32_t) * header->posting_count >
+	     reader->size)) {
+		fprintf(stderr, "%s Broken segment: %s\n", estr, path);
+		goto ERROR_UNMAP;
+	}
+	reader->seqs = (uint64_t*) (reader->base + header->seq_offset);
+	reader->stamps = (uint64_t*) (reader->base + header->ts_offset);
+	reader->levels = (int8_t*) (reader->base + header->level_offset);
+	reader->blocks = (StoreBlock*) (reader->base + header->block_offset);
+	reader->tokens = (StoreToken*) (reader->base + header->token_offset);
+	reader->postings = (uint32_t*) (reader->base + header->posting_offset);
+	for (loop = 0; loop < header->block_count; loop++) {
+		if ((reader->blocks[loop].offset + reader->blocks[loop].size >
+		     reader->size) ||
+		    (reader->blocks[loop].raw_size > STORE_PACKED_SIZE)) {
+			fprintf(stderr, "%s Broken block: %s\n", estr, path);
+			goto ERROR_UNMAP;
+		}
+#ifndef HAVE_ZLIB
+		if (reader->blocks[loop].size != reader->blocks[loop].raw_size) {
+			fprintf(stderr, "%s Compressed, built without zlib: %s\n",
+			        estr, path);
+			goto ERROR_UNMAP;
+		}
+#endif
+	}
+	reader->block_index = header->block_count;
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_UNMAP:
+	munmap(reader->base, reader->size);
+	memset(reader, 0x00, sizeof(StoreReader));
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       store_close_segment() - Unmap segment
+   ============================================================ */
+static void store_close_segment(StoreReader *reader)
+{
+	if (reader->base != NULL) {
+		munmap(reader->base, reader->size);
+	}
+	mem_free(reader->block);
+	memset(reader, 0x00, sizeof(StoreReader));
+	return;
+}
+
+
+/* ============================================================
+       store_lookup() - Postings of token, NULL if none
+   ============================================================ */
+static uint32_t *store_lookup(StoreReader *reader, uint64_t hash,
+                              uint32_t *count)
+{
+	/* --- Variables --- */
+	StoreToken *token = NULL;
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	
+	low = 0;
+	high = reader->header->token_count - 1;
+	while (low <= high) {
+		middle = (low + high) / 2;
+		token = &reader->tokens[middle];
+		if (token->hash == hash) {
+			if (token->first + (uint64_t) token->count >
+			    reader->header->posting_count) {
+				return NULL;
+			}
+			*count = token->count;
+			return reader->postings + token->first;
+		}
+		if (token->hash < hash) {
+			low = middle + 1;
+		}
+		else {
+			high = middle - 1;
+		}
+	}
+	return NULL;
+}
+
+
+/* ============================================================
+       store_candidates() - Records passing index and level
+         Postings of all words are intersected.
+   ============================================================ */
+static size_t store_candidates(StoreReader *reader, StoreQuery *query,
+                               uint32_t *records)
+{
+	/* --- Variables --- */
+	uint32_t *postings = NULL;
+	uint32_t posting_count = 0;
+	size_t count = 0;
+	size_t kept = 0;
+	size_t other = 0;
+	size_t loop = 0;
+	int word = 0;
+	
+	if (query->word_count == 0) {
+		for (loop = 0; loop < reader->header->record_count; loop++) {
+			records[count++] = loop;
+		}
+	}
+	for (word = 0; word < query->word_count; word++) {
+		postings = store_lookup(reader, query->hashes[word], &posting_count);
+		if (postings == NULL) {
+			return 0;
+		}
+		if (word == 0) {
+			for (loop = 0; loop < posting_count; loop++) {
+				if (postings[loop] < reader->header->record_count) {
+					records[count++] = postings[loop];
+				}
+			}
+			continue;
+		}
+	
+		/* Both sorted, merge */
+		kept = 0;
+		other = 0;
+		for (loop = 0; loop < count; loop++) {
+			while ((other < posting_count) &&
+			       (postings[other] < records[loop])) {
+				other++;
+			}
+			if ((other < posting_count) &&
+			    (postings[other] == records[loop])) {
+				records[kept++] = records[loop];
+			}
+		}
+		count = kept;
+	}
+	
+	if (query->level >= 0) {
+		kept = 0;
+		for (loop = 0; loop < count; loop++) {
+			if ((reader->levels[records[loop]] >= 0) &&
+			    (reader->levels[records[loop]] <= query->level)) {
+				records[kept++] = records[loop];
+			}
+		}
+		count = kept;
+	}
+	return count;
+}
+
+
+/* ============================================================
+       store_get_text() - Expand block and Return record text
+   ============================================================ */
+static int store_get_text(StoreReader *reader, uint32_t record,
+                          char* *text, uint32_t *length)
+{
+	/* --- Variables --- */
+	StoreBlock *block = NULL;
+	uint32_t count = 0;
+	uint32_t offset = 0;
+	uint32_t loop = 0;
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+#ifdef HAVE_ZLIB
+	z_stream zstream;
+	memset(&zstream, 0x00, sizeof(z_stream));
+	int status = Z_OK;
+#endif
+	
+	/* Last block whose first <= record */
+	low = 0;
+	high = reader->header->block_count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (reader->blocks[middle].first <= record) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	if (low == 0) {
+		return RETVAL_FAILURE;
+	}
+	block = &reader->blocks[low - 1];
+	
+	if (reader->block_index != low - 1) {
+		if (reader->block == NULL) {
+			reader->block = mem_alloc(STORE_PACKED_SIZE);
+			if (reader->block == NULL) {
+				return RETVAL_FAILURE;
+			}
+		}
+		if (block->size == block->raw_size) {
+			memcpy(reader->block, reader->base + block->offset, block->size);
+		}
+		else {
+#ifdef HAVE_ZLIB
+			zstream.zalloc = store_zalloc;
+			zstream.zfree = store_zfree;
+			zstream.opaque = Z_NULL;
+			zstream.next_in = (Bytef*) reader->base + block->offset;
+			zstream.avail_in = block->size;
+			if (inflateInit(&zstream) != Z_OK) {
+				return RETVAL_FAILURE;
+			}
+			zstream.next_out = (Bytef*) reader->block;
+			zstream.avail_out = block->raw_size;
+			status = inflate(&zstream, Z_FINISH);
+			inflateEnd(&zstream);
+			if ((status != Z_STREAM_END) ||
+			    (zstream.total_out != block->raw_size)) {
+				return RETVAL_FAILURE;
+			}
+#else
+			return RETVAL_FAILURE;
+#endif
+		}
+		reader->block_index = low - 1;
+	}
+	
+	/* Lengths, then texts */
+	memcpy(&count, reader->block, sizeof(uint32_t));
+	if ((record - block->first >= count) ||
+	    (sizeof(uint32_t) * (count + 1) > block->raw_size)) {
+		return RETVAL_FAILURE;
+	}
+	offset = sizeof(uint32_t) * (count + 1);
+	for (loop = 0; loop <= record - block->first; loop++) {
+		memcpy(length, reader->block + sizeof(uint32_t) * (loop + 1),
+		       sizeof(uint32_t));
+		if (loop < record - block->first) {
+			offset += *length;
+		}
+	}
+	if (offset + *length > block->raw_size) {
+		return RETVAL_FAILURE;
+	}
+	*text = reader->block + offset;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       store_match_words() - Check words, index has only hashes
+   ============================================================ */
+static int store_match_words(StoreQuery *query, char *text, size_t length)
+{
+	/* --- Variables --- */
+	size_t cursor = 0;
+	size_t start = 0;
+	int found = 0;
+	int word = 0;
+	
+	for (word = 0; word < query->word_count; word++) {
+		found = 0;
+		cursor = 0;
+		while ((! found) && store_next_word(text, length, &cursor, &start)) {
+			found = (cursor - start == strlen(query->words[word])) &&
+			        (! strncasecmp(text + start, query->words[word],
+			                       cursor - start));
+		}
+		if (! found) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+#ifdef HAVE_ZLIB
+/* ============================================================
+       store_zalloc() - zlib alloc_func by mem_alloc()
+   ============================================================ */
+static voidpf store_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	if ((size != 0) && (items > SIZE_MAX / size)) {
+		return Z_NULL;
+	}
+	return mem_alloc((size_t) items * size);
+}
+
+
+/* ============================================================
+       store_zfree() - zlib free_func by mem_free()
+   ============================================================ */
+static void store_zfree(voidpf opaque, voidpf address)
+{
+	mem_free(address);
+	return;
+}
+#endif
+
+
+/* ====================================================================== */
@@ -0,0 +1,478 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_stream.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Prototypes --- */
+static int stream_advance(File *file, off_t end);
+static int stream_fill(File *file);
+static StreamRange *stream_find(Stream *stream, off_t offset, size_t size);
+static int stream_add_range(Stream *stream, off_t offset, size_t size);
+static void stream_capture(Stream *stream, StreamRange *range);
+static int stream_plan_vaddr(VMCore *vmcore, uint64_t vaddr, size_t size,
+                             off_t *first);
+static void stream_resolve(Stream *stream);
+
+
+/* ============================================================
+       stream_open() - Open stdin as vmcore
+         Size is unknown, data is kept only where it is read or
+         planned, everything else passes through to the copy.
+   ============================================================ */
+int stream_open(File *file)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_open:";
+	Stream *stream = NULL;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	
+	stream = mem_calloc(1, sizeof(Stream));
+	if (stream != NULL) {
+		stream->chunk = mem_alloc(STREAM_CHUNK_SIZE);
+	}
+	if ((stream == NULL) || (stream->chunk == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_FREE;
+	}
+	stream->pointer_offset = -1;
+	stream->length_offset = -1;
+	
+	/* Own descriptor, 0 means closed for File */
+	file->fdesc = dup(STDIN_FILENO);
+	if (file->fdesc == -1) {
+		fprintf(stderr, "%s Can not open stdin: [%d] %s\n",
+		        estr, errno, strerror(errno));
+		file->fdesc = 0;
+		goto ERROR_FREE;
+	}
+	if (file->stream_copy &&
+	    sink_open(&stream->copy, file->stream_copy, 0)) {
+		fprintf(stderr, "%s Can not open copy.\n", estr);
+		close(file->fdesc);
+		file->fdesc = 0;
+		goto ERROR_FREE;
+	}
+	file->size = SIZE_MAX / 2;
+	file->stream = stream;
+	memset(&file->stat, 0x00, sizeof(FileStat));
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	if (stream != NULL) {
+		mem_free(stream->chunk);
+	}
+	mem_free(stream);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       stream_close() - Pass rest to copy, Free kept ranges
+         Without copy rest is not read, writer gets EPIPE.
+   ============================================================ */
+int stream_close(File *file)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_close:";
+	Stream *stream = NULL;
+	int retval = RETVAL_SUCCESS;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(file->stream != NULL);
+	
+	stream = file->stream;
+	if (file->stream_copy) {
+		do {
+			if (stream_fill(file)) {
+				retval = RETVAL_FAILURE;
+				break;
+			}
+		} while (stream->chunk_size > 0);
+		if (sink_close(&stream->copy)) {
+			fprintf(stderr, "%s Can not write copy.\n", estr);
+			retval = RETVAL_FAILURE;
+		}
+	}
+	fprintf(stdout, "%s:    * Stream:     %lu bytes, kept %lu bytes "
+	        "in %d ranges\n", APP_NAME, (unsigned long) stream->position,
+	        (unsigned long) stream->retained, stream->range_count);
+	
+	for (loop = 0; loop < stream->range_count; loop++) {
+		mem_free(stream->ranges[loop].data);
+	}
+	mem_free(stream->ranges);
+	mem_free(stream->chunk);
+	mem_free(stream);
+	file->stream = NULL;
+	close(file->fdesc);
+	file->fdesc = 0;
+	return retval;
+}
+
+
+/* ============================================================
+       stream_read() - Read data from kept range or ahead
+         Planned range not reached yet is read to its end,
+         others ahead are kept as new range. Data which has
+         passed without plan can not be read.
+   ============================================================ */
+int stream_read(File *file, void *buffer, off_t offset, size_t size)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_read:";
+	Stream *stream = NULL;
+	StreamRange *range = NULL;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(file != NULL);
+	assert(file->stream != NULL);
+	
+	stream = file->stream;
+	range = stream_find(stream, offset, size);
+	for (loop = 0; (range == NULL) && (loop < stream->range_count);
+	     loop++) {
+		range = &stream->ranges[loop];
+		if ((offset < range->valid) ||
+		    (offset + size > range->offset + range->size)) {
+			range = NULL;
+			continue;
+		}
+		/* Ranges may grow while stream is read */
+		if (stream_advance(file, range->offset + range->size)) {
+			return RETVAL_FAILURE;
+		}
+		range = &stream->ranges[loop];
+	}
+	if (range == NULL) {
+		/* Ahead, or still in last chunk */
+		if (offset < stream->position - (off_t) stream->chunk_size) {
+			fprintf(stderr, "%s Data has passed: 0x%lx:0x%lx, "
+			        "stream at 0x%lx\n", estr, (unsigned long) offset,
+			        (unsigned long) size, (unsigned long) stream->position);
+			return RETVAL_FAILURE;
+		}
+		if (stream_add_range(stream, offset, size) ||
+		    stream_advance(file, offset + size)) {
+			return RETVAL_FAILURE;
+		}
+		range = stream_find(stream, offset, size);
+		assert(range != NULL);
+	}
+	memcpy(buffer, range->data + (offset - range->offset), size);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_plan() - Plan ranges to keep from VMCOREINFO
+         Every SYMBOL, then ring buffer when log_buf and
+         log_buf_len have passed. Ring before them is lost.
+   ============================================================ */
+int stream_plan(VMCore *vmcore)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_plan:";
+	Stream *stream = NULL;
+	char *cursor = NULL;
+	char *limit = NULL;
+	char *endptr = NULL;
+	char name[MAX_SYMBOL_NAME];
+	memset(name, 0x00, sizeof(name));
+	uint64_t vaddr = 0;
+	off_t offset = 0;
+	int length = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(vmcore->file.stream != NULL);
+	
+	stream = vmcore->file.stream;
+	stream->vmcore = vmcore;
+	
+	/* Lines "SYMBOL(name)=hex" */
+	cursor = vmcore->vmcoreinfo;
+	limit = vmcore->vmcoreinfo + vmcore->vmcoreinfo_size;
+	while ((cursor < limit) &&
+	       ((cursor = memmem(cursor, limit - cursor, "SYMBOL(", 7)) != NULL)) {
+		cursor += 7;
+		endptr = memchr(cursor, ')', limit - cursor);
+		if ((endptr == NULL) || (endptr + 1 >= limit) ||
+		    (endptr[1] != '=') || (endptr - cursor >= sizeof(name))) {
+			continue;
+		}
+		length = endptr - cursor;
+		memcpy(name, cursor, length);
+		name[length] = 0x00;
+		vaddr = strtoull(endptr + 2, &cursor, 16);
+		if (stream_plan_vaddr(vmcore, vaddr, STREAM_SYMBOL_SIZE, &offset)) {
+			continue;
+		}
+		if (! strcmp(name, "log_buf")) {
+			stream->pointer_offset = offset;
+		}
+		else if (! strcmp(name, "log_buf_len")) {
+			stream->length_offset = offset;
+		}
+	}
+	if ((stream->pointer_offset == -1) || (stream->length_offset == -1)) {
+		fprintf(stderr, "%s log_buf is not in stream.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	stream_resolve(stream);
+	fprintf(stdout, "%s:    * Stream:     %d ranges planned, at 0x%lx\n",
+	        APP_NAME, stream->range_count, (unsigned long) stream->position);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_advance() - Read stream until end
+   ============================================================ */
+static int stream_advance(File *file, off_t end)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_advance:";
+	Stream *stream = NULL;
+	
+	stream = file->stream;
+	while (stream->position < end) {
+		if (stream_fill(file)) {
+			return RETVAL_FAILURE;
+		}
+		if (stream->chunk_size == 0) {
+			fprintf(stderr, "%s Stream ended at 0x%lx, need 0x%lx\n",
+			        estr, (unsigned long) stream->position,
+			        (unsigned long) end);
+			return RETVAL_FAILURE;
+		}
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_fill() - Read next chunk, Copy and Capture it
+         chunk_size is 0 at end of stream.
+   ============================================================ */
+static int stream_fill(File *file)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_fill:";
+	Stream *stream = NULL;
+	ssize_t readbytes = 0;
+	int loop = 0;
+	
+	stream = file->stream;
+	do {
+		readbytes = read(file->fdesc, stream->chunk, STREAM_CHUNK_SIZE);
+		file->stat.syscalls++;
+	} while ((readbytes == -1) && (errno == EINTR));
+	if (readbytes == -1) {
+		fprintf(stderr, "%s Read failed at 0x%lx: [%d] %s\n", estr,
+		        (unsigned long) stream->position, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	stream->chunk_size = readbytes;
+	stream->position += readbytes;
+	file->stat.bytes += readbytes;
+	if (readbytes == 0) {
+		return RETVAL_SUCCESS;
+	}
+	
+	if (file->stream_copy &&
+	    (fwrite(stream->chunk, readbytes, 1, stream->copy.stream) != 1)) {
+		fprintf(stderr, "%s Can not write copy.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < stream->range_count; loop++) {
+		stream_capture(stream, &stream->ranges[loop]);
+	}
+	
+	/* Ring may start in this chunk, errors show up on read */
+	stream_resolve(stream);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_find() - Range which has all of data, NULL if none
+   ============================================================ */
+static StreamRange *stream_find(Stream *stream, off_t offset, size_t size)
+{
+	/* --- Variables --- */
+	StreamRange *range = NULL;
+	int loop = 0;
+	
+	for (loop = 0; loop < stream->range_count; loop++) {
+		range = &stream->ranges[loop];
+		if ((offset >= range->valid) &&
+		    (offset + size <= range->offset + range->size) &&
+		    (offset + size <= stream->position)) {
+			return range;
+		}
+	}
+	return NULL;
+}
+
+
+/* ============================================================
+       stream_add_range() - Keep range, from last chunk if there
+   ============================================================ */
+static int stream_add_range(Stream *stream, off_t offset, size_t size)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_add_range:";
+	StreamRange *ranges = NULL;
+	StreamRange *range = NULL;
+	off_t passed = 0;
+	
+	ranges = mem_realloc(stream->ranges,
+	                     sizeof(StreamRange) * (stream->range_count + 1));
+	if (ranges == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	stream->ranges = ranges;
+	range = &stream->ranges[stream->range_count];
+	memset(range, 0x00, sizeof(StreamRange));
+	range->data = mem_alloc(size);
+	if (range->data == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	stream->range_count++;
+	stream->retained += size;
+	
+	range->offset = offset;
+	range->size = size;
+	passed = stream->position - stream->chunk_size;
+	range->valid = (offset > passed) ? offset : passed;
+	stream_capture(stream, range);
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_capture() - Copy part of range in last chunk
+   ============================================================ */
+static void stream_capture(Stream *stream, StreamRange *range)
+{
+	/* --- Variables --- */
+	off_t start = 0;
+	off_t end = 0;
+	
+	start = stream->position - stream->chunk_size;
+	if (start < range->valid) {
+		start = range->valid;
+	}
+	end = range->offset + range->size;
+	if (end > stream->position) {
+		end = stream->position;
+	}
+	if (start < end) {
+		memcpy(range->data + (start - range->offset),
+		       stream->chunk + (start - (stream->position -
+		                                 stream->chunk_size)),
+		       end - start);
+	}
+	return;
+}
+
+
+/* ============================================================
+       stream_plan_vaddr() - Keep LOAD data of virtual address
+         first is file offset of vaddr.
+   ============================================================ */
+static int stream_plan_vaddr(VMCore *vmcore, uint64_t vaddr, size_t size,
+                             off_t *first)
+{
+	/* --- Variables --- */
+	LoadSegment *load = NULL;
+	size_t length = 0;
+	size_t done = 0;
+	
+	/* Split at end of each LOAD */
+	while (done < size) {
+		load = elf_find_load(vmcore, vaddr + done);
+		if ((load == NULL) || (vaddr + done - load->vaddr >= load->size)) {
+			/* Not in LOAD, would need page table walk */
+			return RETVAL_FAILURE;
+		}
+		length = load->size - (vaddr + done - load->vaddr);
+		if (length > size - done) {
+			length = size - done;
+		}
+		if ((done == 0) && (first != NULL)) {
+			*first = load->offset + vaddr - load->vaddr;
+		}
+		if (stream_add_range(vmcore->file.stream,
+		                     load->offset + vaddr + done - load->vaddr,
+		                     length)) {
+			return RETVAL_FAILURE;
+		}
+		done += length;
+	}
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       stream_resolve() - Plan ring when log_buf is known
+         Ring which has passed can not be read, stream is not
+         seekable.
+   ============================================================ */
+static void stream_resolve(Stream *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] stream_resolve:";
+	StreamRange *pointer = NULL;
+	StreamRange *length = NULL;
+	uint64_t log_buf = 0;
+	int32_t log_buf_len = 0;
+	off_t first = 0;
+	
+	if ((stream->vmcore == NULL) || (stream->pointer_offset == -1)) {
+		return;
+	}
+	pointer = stream_find(stream, stream->pointer_offset, sizeof(uint64_t));
+	length = stream_find(stream, stream->length_offset, sizeof(int32_t));
+	if ((pointer == NULL) || (length == NULL)) {
+		return;
+	}
+	memcpy(&log_buf, pointer->data + (stream->pointer_offset -
+	                                  pointer->offset), sizeof(uint64_t));
+	memcpy(&log_buf_len, length->data + (stream->length_offset -
+	                                     length->offset), sizeof(int32_t));
+	stream->pointer_offset = -1;
+	
+	if ((log_buf == 0) || (log_buf_len <= 0)) {
+		fprintf(stderr, "%s Invalid log_buf.\n", estr);
+		return;
+	}
+	if (stream_plan_vaddr(stream->vmcore, log_buf, log_buf_len, &first)) {
+		fprintf(stderr, "%s Ring buffer is not in LOAD.\n", estr);
+		return;
+	}
+	if (first < stream->position - (off_t) stream->chunk_size) {
+		fprintf(stderr, "%s Ring buffer at 0x%lx had passed when "
+		        "log_buf was read at 0x%lx.\n", estr, (unsigned long) first,
+		        (unsigned long) stream->position);
+	}
+	return;
+}
+
+
+/* ====================================================================== */
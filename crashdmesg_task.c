@@ -0,0 +1,867 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_task.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+
+
+/* --- Constant values --- */
+
+/* Task state, See:fs/proc/array.c task_state_array[] */
+#define TASK_STATE_LETTERS "RSDTtXZPI"
+#define TASK_REPORT 0x7f /* Bits shown by ps */
+#define TASK_IDLE 0x402 /* TASK_UNINTERRUPTIBLE | TASK_NOLOAD */
+#define TASK_DEAD 0x80 /* Set by do_task_dead(), zombie or dead */
+#define TASK_EXIT_ZOMBIE 0x20 /* EXIT_ZOMBIE of exit_state */
+#define TASK_STATE_MAX 0xfff /* Above any TASK_* bits */
+
+/* Layout probe, See:task_probe_layout() */
+#define TASK_PROBE_SIZE 16384 /* Bytes of init_task searched */
+#define TASK_PROBE_RQ 4096 /* Bytes of struct rq searched */
+#define TASK_PROBE_TASKS 3 /* init_task, init and kthreadd */
+#define TASK_PROBE_GROUP 256 /* Bytes from group_leader to thread_group */
+#define TASK_STACK_ALIGN 4096 /* task->stack is THREAD_SIZE aligned */
+#define TASK_KERNEL_SPACE 0xffff800000000000UL /* Lowest kernel pointer */
+
+
+/* --- Data structures --- */
+
+/* Current task of one CPU, sorted by task address */
+typedef struct {
+	uint64_t task; /* rq->curr */
+	int cpu;
+	int seen; /* Printed while walking task list */
+} TaskCurrent;
+
+/* State of one task list walk */
+typedef struct {
+	VMCore *vmcore;
+	FILE *stream;
+	Layout *layout;
+	uint64_t init_task;
+	uint32_t start; /* First byte of task_struct to read */
+	size_t size; /* Bytes to read from start */
+	char *buffer;
+	TaskCurrent *currents;
+	int cpu_count;
+	uint64_t count; /* Tasks printed */
+} TaskWalk;
+
+
+/* --- Prototypes --- */
+static int task_probe_layout(VMCore *vmcore, uint64_t init_task,
+                             Layout *layout);
+static int task_probe_pid(char **buffers, Layout *layout);
+static int task_probe_state(char **buffers, Layout *layout);
+static int task_probe_thread(VMCore *vmcore, uint64_t *tasks,
+                             char **buffers, Layout *layout);
+static int task_is_thread_group(VMCore *vmcore, uint64_t *tasks,
+                                char **buffers, Layout *layout,
+                                uint32_t offset, int empty);
+static int task_probe_rq(VMCore *vmcore, uint64_t rq, uint64_t init_task,
+                         uint32_t *ret);
+static int task_is_mapped(VMCore *vmcore, uint64_t vaddr, size_t size);
+static void task_read_span(TaskWalk *walk);
+static int task_read_currents(TaskWalk *walk);
+static int task_compare_current(const void *a, const void *b);
+static int task_print(TaskWalk *walk, uint64_t task,
+                      uint64_t *tasks_next, uint64_t *thread_next);
+static char task_state_letter(uint32_t state);
+
+
+/* ============================================================
+       task_print_list() - Walk init_task.tasks and Print
+         Threads follow their leader when thread_group is known.
+         Each task_struct is read at once, only the used span.
+         Members not in VMCOREINFO are probed from init_task.
+   ============================================================ */
+int task_print_list(VMCore *vmcore, FILE *stream)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] task_print_list:";
+	TaskWalk walk;
+	memset(&walk, 0x00, sizeof(TaskWalk));
+	Layout probed;
+	memset(&probed, 0x00, sizeof(Layout));
+	Layout *layout = NULL;
+	uint64_t init_task = 0;
+	uint64_t leader = 0;
+	uint64_t task = 0;
+	uint64_t tasks_next = 0;
+	uint64_t thread_next = 0;
+	int retval = RETVAL_SUCCESS;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(stream != NULL);
+	
+	if (kallsyms_search_symbol(vmcore, "init_task", &init_task)) {
+		fprintf(stderr, "%s Symbol \"init_task\" not found.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	memcpy(&probed, &vmcore->plan.layout, sizeof(Layout));
+	layout = &probed;
+	if (((layout->task_tasks == LAYOUT_NONE) ||
+	     (layout->task_pid == LAYOUT_NONE) ||
+	     (layout->task_comm == LAYOUT_NONE) ||
+	     (layout->task_state == LAYOUT_NONE) ||
+	     (layout->task_thread_group == LAYOUT_NONE)) &&
+	    task_probe_layout(vmcore, init_task, layout)) {
+		fprintf(stderr, "%s Layout of task_struct is unknown.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	walk.vmcore = vmcore;
+	walk.init_task = init_task;
+	walk.stream = stream;
+	walk.layout = layout;
+	task_read_span(&walk);
+	walk.buffer = mem_alloc(walk.size);
+	if (walk.buffer == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (task_read_currents(&walk)) {
+		/* CPU column is not available, continue */
+		fprintf(stderr, "%s Can not read runqueues.\n", estr);
+	}
+	
+	fprintf(stream, "%7s %4s %2s  %-18s  %s\n",
+	        "PID", "CPU", "ST", "TASK", "COMM");
+	leader = init_task;
+	do {
+		if (task_print(&walk, leader, &tasks_next, &thread_next)) {
+			retval = RETVAL_FAILURE;
+			break;
+		}
+		
+		/* Other threads of the group, circular through leader */
+		if (layout->task_thread_group != LAYOUT_NONE) {
+			task = thread_next - layout->task_thread_group;
+			while ((task != leader) && (walk.count < TASK_MAX_COUNT)) {
+				if (task_print(&walk, task, NULL, &thread_next)) {
+					retval = RETVAL_FAILURE;
+					break;
+				}
+				task = thread_next - layout->task_thread_group;
+			}
+		}
+		leader = tasks_next - layout->task_tasks;
+	} while ((retval == RETVAL_SUCCESS) && (leader != init_task) &&
+	         (walk.count < TASK_MAX_COUNT));
+	if (walk.count >= TASK_MAX_COUNT) {
+		fprintf(stderr, "%s Too many tasks, list is broken?\n", estr);
+		retval = RETVAL_FAILURE;
+	}
+	
+	/* Idle tasks of other CPUs are not in the list */
+	for (loop = 0; (retval == RETVAL_SUCCESS) && (loop < walk.cpu_count);
+	     loop++) {
+		if ((! walk.currents[loop].seen) && (walk.currents[loop].task)) {
+			task_print(&walk, walk.currents[loop].task, NULL, NULL);
+		}
+	}
+	fprintf(stdout, "%s:    * Tasks:      %lu\n", APP_NAME, walk.count);
+	
+	mem_free(walk.currents);
+	mem_free(walk.buffer);
+	return retval;
+}
+
+
+/* ============================================================
+       task_probe_layout() - Find task_struct members in init_task
+         Offsets depend on config, not on release. comm of
+         init_task is "swapper/0", tasks is the first list whose
+         next task links back to it. Others are told by values
+         of init_task and the two tasks after it, init and
+         kthreadd. exit_state is left unknown.
+   ============================================================ */
+static int task_probe_layout(VMCore *vmcore, uint64_t init_task,
+                             Layout *layout)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] task_probe_layout:";
+	char *buffers[TASK_PROBE_TASKS];
+	memset(buffers, 0x00, sizeof(buffers));
+	uint64_t tasks[TASK_PROBE_TASKS];
+	memset(tasks, 0x00, sizeof(tasks));
+	char *hit = NULL;
+	char comm[TASK_COMM_LEN + 1];
+	memset(comm, 0x00, sizeof(comm));
+	uint64_t next = 0;
+	uint64_t prev = 0;
+	uint64_t link = 0;
+	uint32_t offset = 0;
+	size_t size = 0;
+	int retval = RETVAL_FAILURE;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(layout != NULL);
+	
+	buffers[0] = mem_alloc(TASK_PROBE_SIZE);
+	if (buffers[0] == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	if (elf_read_load_data(vmcore, init_task, buffers[0], TASK_PROBE_SIZE)) {
+		fprintf(stderr, "%s Can not read init_task.\n", estr);
+		goto END_FREE;
+	}
+	tasks[0] = init_task;
+	
+	/* comm, "swapper" before 3.7 */
+	for (hit = buffers[0]; (layout->task_comm == LAYOUT_NONE) &&
+	     ((hit = memmem(hit, TASK_PROBE_SIZE - TASK_COMM_LEN -
+	                    (hit - buffers[0]), "swapper", 7)) != NULL); hit++) {
+		if (((hit[7] == 0x00) || (hit[7] == '/')) &&
+		    (memchr(hit, 0x00, TASK_COMM_LEN) != NULL)) {
+			layout->task_comm = hit - buffers[0];
+		}
+	}
+	if ((layout->task_comm == LAYOUT_NONE) ||
+	    (layout->task_comm + TASK_COMM_LEN > TASK_PROBE_SIZE)) {
+		fprintf(stderr, "%s comm of init_task not found.\n", estr);
+		goto END_FREE;
+	}
+	
+	/* tasks, next and prev of first task link back */
+	for (offset = 0; (layout->task_tasks == LAYOUT_NONE) &&
+	     (offset + 2 * sizeof(uint64_t) <= layout->task_comm);
+	     offset += sizeof(uint64_t)) {
+		memcpy(&next, buffers[0] + offset, sizeof(next));
+		memcpy(&prev, buffers[0] + offset + sizeof(next), sizeof(prev));
+		if ((next == init_task + offset) || (next < TASK_KERNEL_SPACE) ||
+		    (prev < TASK_KERNEL_SPACE) || (next % sizeof(uint64_t)) ||
+		    (prev % sizeof(uint64_t)) ||
+		    (! task_is_mapped(vmcore, next, 2 * sizeof(uint64_t))) ||
+		    (! task_is_mapped(vmcore, prev, sizeof(uint64_t))) ||
+		    (! task_is_mapped(vmcore, next - offset + layout->task_comm,
+		                      TASK_COMM_LEN))) {
+			continue;
+		}
+		if (elf_read_load_uint64(vmcore, next + sizeof(uint64_t), &link) ||
+		    (link != init_task + offset) ||
+		    elf_read_load_uint64(vmcore, prev, &link) ||
+		    (link != init_task + offset) ||
+		    elf_read_load_data(vmcore, next - offset + layout->task_comm,
+		                       comm, TASK_COMM_LEN) ||
+		    (comm[0] == 0x00) || (strlen(comm) >= TASK_COMM_LEN)) {
+			continue;
+		}
+		layout->task_tasks = offset;
+	}
+	if (layout->task_tasks == LAYOUT_NONE) {
+		fprintf(stderr, "%s tasks of init_task not found.\n", estr);
+		goto END_FREE;
+	}
+	
+	/* init and kthreadd, up to comm */
+	size = layout->task_comm + TASK_COMM_LEN;
+	for (loop = 1; loop < TASK_PROBE_TASKS; loop++) {
+		memcpy(&next, buffers[loop - 1] + layout->task_tasks, sizeof(next));
+		tasks[loop] = next - layout->task_tasks;
+		buffers[loop] = mem_alloc(size);
+		if ((tasks[loop] == init_task) || (buffers[loop] == NULL) ||
+		    (! task_is_mapped(vmcore, tasks[loop], size)) ||
+		    elf_read_load_data(vmcore, tasks[loop], buffers[loop], size)) {
+			fprintf(stderr, "%s Can not read tasks after init_task.\n",
+			        estr);
+			goto END_FREE;
+		}
+	}
+	
+	if ((layout->task_pid == LAYOUT_NONE) &&
+	    task_probe_pid(buffers, layout)) {
+		fprintf(stderr, "%s pid of init_task not found.\n", estr);
+		goto END_FREE;
+	}
+	if ((layout->task_state == LAYOUT_NONE) &&
+	    task_probe_state(buffers, layout)) {
+		fprintf(stderr, "%s state of init_task not found.\n", estr);
+		goto END_FREE;
+	}
+	if ((layout->task_thread_group == LAYOUT_NONE) &&
+	    task_probe_thread(vmcore, tasks, buffers, layout)) {
+		/* Gone in 6.7, leaders are still listed */
+		fprintf(stderr, "%s thread_group of init_task not found, "
+		        "threads are not listed.\n", estr);
+	}
+	fprintf(stdout, "%s:    * Task:       Probed tasks=%u pid=%u comm=%u\n",
+	        APP_NAME, layout->task_tasks, layout->task_pid,
+	        layout->task_comm);
+	fprintf(stdout, "%s:                  state=%u thread_group=%d\n",
+	        APP_NAME, layout->task_state,
+	        (layout->task_thread_group == LAYOUT_NONE) ?
+	        -1 : (int) layout->task_thread_group);
+	retval = RETVAL_SUCCESS;
+	
+END_FREE:
+	for (loop = 0; loop < TASK_PROBE_TASKS; loop++) {
+		mem_free(buffers[loop]);
+	}
+	return retval;
+}
+
+
+/* ============================================================
+       task_probe_pid() - Find pid between tasks and comm
+         Tasks are listed in creation order, pid and tgid are
+         0 of init_task, 1 of init, and same N > 1 of kthreadd.
+   ============================================================ */
+static int task_probe_pid(char **buffers, Layout *layout)
+{
+	/* --- Variables --- */
+	uint32_t offset = 0;
+	int32_t ids[TASK_PROBE_TASKS][2];
+	memset(ids, 0x00, sizeof(ids));
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(buffers != NULL);
+	assert(layout != NULL);
+	
+	for (offset = layout->task_tasks + 2 * sizeof(uint64_t);
+	     offset + 2 * sizeof(int32_t) <= layout->task_comm;
+	     offset += sizeof(int32_t)) {
+		for (loop = 0; loop < TASK_PROBE_TASKS; loop++) {
+			memcpy(ids[loop], buffers[loop] + offset, sizeof(ids[loop]));
+		}
+		if ((ids[0][0] == 0) && (ids[0][1] == 0) &&
+		    (ids[1][0] == 1) && (ids[1][1] == 1) &&
+		    (ids[2][0] > 1) && (ids[2][1] == ids[2][0])) {
+			layout->task_pid = offset;
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       task_probe_state() - Find state at head of task_struct
+         state is followed by stack, a THREAD_SIZE aligned
+         pointer. init_task is running, others hold only
+         TASK_* bits.
+   ============================================================ */
+static int task_probe_state(char **buffers, Layout *layout)
+{
+	/* --- Variables --- */
+	uint32_t offset = 0;
+	uint32_t state = 0;
+	uint64_t stack = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(buffers != NULL);
+	assert(layout != NULL);
+	
+	for (offset = 0; offset + 2 * sizeof(uint64_t) <= layout->task_tasks;
+	     offset += sizeof(uint64_t)) {
+		for (loop = 0; loop < TASK_PROBE_TASKS; loop++) {
+			memcpy(&state, buffers[loop] + offset, sizeof(state));
+			memcpy(&stack, buffers[loop] + offset + sizeof(uint64_t),
+			       sizeof(stack));
+			if ((state > TASK_STATE_MAX) || ((loop == 0) && state) ||
+			    (stack < TASK_KERNEL_SPACE) ||
+			    (stack % TASK_STACK_ALIGN)) {
+				break;
+			}
+		}
+		if (loop == TASK_PROBE_TASKS) {
+			layout->task_state = offset;
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       task_probe_thread() - Find thread_group after group_leader
+         group_leader points to the task itself. ptraced and
+         ptrace_entry follow it, then pid links, then
+         thread_group, empty or holding tasks of same tgid.
+   ============================================================ */
+static int task_probe_thread(VMCore *vmcore, uint64_t *tasks,
+                             char **buffers, Layout *layout)
+{
+	/* --- Variables --- */
+	uint32_t leader = 0;
+	uint32_t offset = 0;
+	uint32_t limit = 0;
+	uint64_t value = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(tasks != NULL);
+	assert(buffers != NULL);
+	assert(layout != NULL);
+	
+	/* group_leader, pointer to self in each leader */
+	for (leader = layout->task_pid + 2 * sizeof(int32_t);
+	     leader + sizeof(uint64_t) <= layout->task_comm;
+	     leader += sizeof(uint32_t)) {
+		for (loop = 0; loop < TASK_PROBE_TASKS; loop++) {
+			memcpy(&value, buffers[loop] + leader, sizeof(value));
+			if (value != tasks[loop]) {
+				break;
+			}
+		}
+		if (loop == TASK_PROBE_TASKS) {
+			break;
+		}
+	}
+	if (leader + sizeof(uint64_t) > layout->task_comm) {
+		return RETVAL_FAILURE;
+	}
+	
+	/* Skip empty ptraced and ptrace_entry */
+	offset = leader + sizeof(uint64_t);
+	limit = leader + TASK_PROBE_GROUP;
+	if (limit > layout->task_comm) {
+		limit = layout->task_comm;
+	}
+	while ((offset + 2 * sizeof(uint64_t) <= limit) &&
+	       task_is_thread_group(vmcore, tasks, buffers, layout, offset, 1)) {
+		offset += 2 * sizeof(uint64_t);
+	}
+	for (; offset + 2 * sizeof(uint64_t) <= limit;
+	     offset += sizeof(uint64_t)) {
+		if (task_is_thread_group(vmcore, tasks, buffers, layout,
+		                         offset, 0)) {
+			layout->task_thread_group = offset;
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       task_is_thread_group() - Check list at offset of tasks
+         Empty in init_task, empty or linking same tgid in
+         others. Only empty lists pass if empty is set.
+   ============================================================ */
+static int task_is_thread_group(VMCore *vmcore, uint64_t *tasks,
+                                char **buffers, Layout *layout,
+                                uint32_t offset, int empty)
+{
+	/* --- Variables --- */
+	uint32_t tgid_offset = 0;
+	uint64_t next = 0;
+	uint64_t prev = 0;
+	int32_t tgid = 0;
+	int32_t other = 0;
+	int loop = 0;
+	
+	tgid_offset = layout->task_pid + sizeof(int32_t);
+	for (loop = 0; loop < TASK_PROBE_TASKS; loop++) {
+		memcpy(&next, buffers[loop] + offset, sizeof(next));
+		memcpy(&prev, buffers[loop] + offset + sizeof(next), sizeof(prev));
+		if ((next == tasks[loop] + offset) && (prev == next)) {
+			continue;
+		}
+		if (empty || (loop == 0)) {
+			return 0;
+		}
+		memcpy(&tgid, buffers[loop] + tgid_offset, sizeof(tgid));
+		if ((next < TASK_KERNEL_SPACE) ||
+		    (! task_is_mapped(vmcore, next - offset + tgid_offset,
+		                      sizeof(other))) ||
+		    elf_read_load_int32(vmcore, next - offset + tgid_offset,
+		                        &other) ||
+		    (other != tgid)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/* ============================================================
+       task_probe_rq() - Find rq->curr in runqueue of CPU 0
+         curr is followed by idle, which is init_task on CPU 0.
+   ============================================================ */
+static int task_probe_rq(VMCore *vmcore, uint64_t rq, uint64_t init_task,
+                         uint32_t *ret)
+{
+	/* --- Variables --- */
+	uint64_t values[TASK_PROBE_RQ / sizeof(uint64_t)];
+	memset(values, 0x00, sizeof(values));
+	int count = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(ret != NULL);
+	
+	count = sizeof(values) / sizeof(uint64_t);
+	if (elf_read_load_data(vmcore, rq, values, sizeof(values))) {
+		return RETVAL_FAILURE;
+	}
+	for (loop = 0; loop < count; loop++) {
+		if (values[loop] != init_task) {
+			continue;
+		}
+		if ((loop + 1 < count) && (values[loop + 1] == init_task)) {
+			/* CPU 0 was idle, curr is idle */
+			*ret = loop * sizeof(uint64_t);
+			return RETVAL_SUCCESS;
+		}
+		if (loop > 0) {
+			*ret = (loop - 1) * sizeof(uint64_t);
+			return RETVAL_SUCCESS;
+		}
+	}
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       task_is_mapped() - Check address is in vmcore, quietly
+   ============================================================ */
+static int task_is_mapped(VMCore *vmcore, uint64_t vaddr, size_t size)
+{
+	/* --- Variables --- */
+	LoadSegment *load = NULL;
+	
+	load = elf_find_load(vmcore, vaddr);
+	return (load != NULL) && (vaddr - load->vaddr < load->size) &&
+	       (size <= load->size - (vaddr - load->vaddr));
+}
+
+
+/* ============================================================
+       task_read_span() - Smallest range covering used members
+   ============================================================ */
+static void task_read_span(TaskWalk *walk)
+{
+	/* --- Variables --- */
+	Layout *layout = NULL;
+	uint32_t offsets[6];
+	uint32_t sizes[6];
+	uint32_t end = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(walk != NULL);
+	
+	layout = walk->layout;
+	offsets[0] = layout->task_tasks;
+	sizes[0] = 2 * sizeof(uint64_t);
+	offsets[1] = layout->task_pid;
+	sizes[1] = sizeof(int32_t);
+	offsets[2] = layout->task_comm;
+	sizes[2] = TASK_COMM_LEN;
+	offsets[3] = layout->task_state;
+	sizes[3] = sizeof(uint32_t);
+	offsets[4] = layout->task_exit_state;
+	sizes[4] = sizeof(uint32_t);
+	offsets[5] = layout->task_thread_group;
+	sizes[5] = 2 * sizeof(uint64_t);
+	
+	walk->start = LAYOUT_NONE;
+	for (loop = 0; loop < sizeof(offsets) / sizeof(uint32_t); loop++) {
+		if (offsets[loop] == LAYOUT_NONE) {
+			continue;
+		}
+		if (offsets[loop] < walk->start) {
+			walk->start = offsets[loop];
+		}
+		if (offsets[loop] + sizes[loop] > end) {
+			end = offsets[loop] + sizes[loop];
+		}
+	}
+	walk->size = end - walk->start;
+	return;
+}
+
+
+/* ============================================================
+       task_read_currents() - Read rq->curr of each online CPU
+         runqueues is per-CPU, indexed by CPU id.
+   ============================================================ */
+static int task_read_currents(TaskWalk *walk)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] task_read_currents:";
+	VMCore *vmcore = NULL;
+	uint64_t runqueues = 0;
+	uint64_t per_cpu_offset = 0;
+	uint64_t *offsets = NULL;
+	uint32_t curr = 0;
+	int *cpus = NULL;
+	int cpu_count = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(walk != NULL);
+	
+	vmcore = walk->vmcore;
+	if (kallsyms_search_symbol(vmcore, "runqueues", &runqueues) ||
+	    kallsyms_search_symbol(vmcore, "__per_cpu_offset", &per_cpu_offset)) {
+		return RETVAL_FAILURE;
+	}
+	cpus = mem_alloc(sizeof(int) * TASK_MAX_CPUS);
+	if (cpus == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	cpu_count = task_read_cpus(vmcore, "online", cpus, TASK_MAX_CPUS);
+	if ((cpu_count <= 0) || (cpus[0] != 0)) {
+		fprintf(stderr, "%s Can not read online CPUs.\n", estr);
+		mem_free(cpus);
+		return RETVAL_FAILURE;
+	}
+	
+	/* __per_cpu_offset[] at once, up to highest CPU id */
+	offsets = mem_alloc(sizeof(uint64_t) * (cpus[cpu_count - 1] + 1));
+	walk->currents = mem_calloc(cpu_count, sizeof(TaskCurrent));
+	if ((offsets == NULL) || (walk->currents == NULL)) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		goto ERROR_FREE;
+	}
+	if (elf_read_load_data(vmcore, per_cpu_offset, offsets,
+	                       sizeof(uint64_t) * (cpus[cpu_count - 1] + 1))) {
+		fprintf(stderr, "%s Can not read __per_cpu_offset.\n", estr);
+		goto ERROR_FREE;
+	}
+	curr = walk->layout->rq_curr;
+	if ((curr == LAYOUT_NONE) &&
+	    task_probe_rq(vmcore, runqueues + offsets[0], walk->init_task,
+	                  &curr)) {
+		fprintf(stderr, "%s rq->curr not found.\n", estr);
+		goto ERROR_FREE;
+	}
+	for (loop = 0; loop < cpu_count; loop++) {
+		walk->currents[loop].cpu = cpus[loop];
+		if (elf_read_load_uint64(vmcore,
+		                         runqueues + offsets[cpus[loop]] + curr,
+		                         &walk->currents[loop].task)) {
+			fprintf(stderr, "%s Can not read rq of CPU %d.\n",
+			        estr, cpus[loop]);
+			goto ERROR_FREE;
+		}
+	}
+	qsort(walk->currents, cpu_count, sizeof(TaskCurrent),
+	      task_compare_current);
+	walk->cpu_count = cpu_count;
+	
+	mem_free(cpus);
+	mem_free(offsets);
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_FREE:
+	mem_free(cpus);
+	mem_free(offsets);
+	mem_free(walk->currents);
+	walk->currents = NULL;
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       task_read_cpus() - CPU ids set in cpu_<name>_mask
+         Mask is bitmap __cpu_<name>_mask since 4.5, pointer
+         cpu_<name>_mask before, nr_cpu_ids bits long. Without
+         them CPUs are one per NT_PRSTATUS, numbered from 0.
+         Return number of ids set to cpus, -1 on error.
+   ============================================================ */
+int task_read_cpus(VMCore *vmcore, char *name, int *cpus, int max)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] task_read_cpus:";
+	char symbol[MAX_SYMBOL_NAME];
+	memset(symbol, 0x00, sizeof(symbol));
+	uint64_t bits[TASK_MAX_CPUS / 64];
+	memset(bits, 0x00, sizeof(bits));
+	uint64_t address = 0;
+	uint64_t value = 0;
+	uint32_t nr_cpu_ids = 0;
+	int count = 0;
+	int cpu = 0;
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(vmcore != NULL);
+	assert(name != NULL);
+	assert(cpus != NULL);
+	
+	snprintf(symbol, sizeof(symbol), "__cpu_%s_mask", name);
+	if (kallsyms_search_symbol(vmcore, symbol, &address)) {
+		snprintf(symbol, sizeof(symbol), "cpu_%s_mask", name);
+		if (kallsyms_search_symbol(vmcore, symbol, &value) ||
+		    elf_read_load_uint64(vmcore, value, &address)) {
+			address = 0;
+		}
+	}
+	if (address &&
+	    (kallsyms_search_symbol(vmcore, "nr_cpu_ids", &value) ||
+	     elf_read_load_uint32(vmcore, value, &nr_cpu_ids) ||
+	     (nr_cpu_ids == 0) || (nr_cpu_ids > TASK_MAX_CPUS))) {
+		address = 0;
+	}
+	
+	/* Notes are saved in CPU order */
+	if (address == 0) {
+		for (loop = 0; loop < vmcore->note_count; loop++) {
+			if (vmcore->notes[loop].type != NT_PRSTATUS) {
+				continue;
+			}
+			if (count >= max) {
+				fprintf(stderr, "%s Too many CPUs.\n", estr);
+				return -1;
+			}
+			cpus[count] = count;
+			count++;
+		}
+		return count;
+	}
+	
+	if (elf_read_load_data(vmcore, address, bits,
+	                       sizeof(uint64_t) * ((nr_cpu_ids + 63) / 64))) {
+		fprintf(stderr, "%s Can not read %s.\n", estr, symbol);
+		return -1;
+	}
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (! ((bits[cpu / 64] >> (cpu % 64)) & 1)) {
+			continue;
+		}
+		if (count >= max) {
+			fprintf(stderr, "%s Too many CPUs.\n", estr);
+			return -1;
+		}
+		cpus[count] = cpu;
+		count++;
+	}
+	return count;
+}
+
+
+/* ============================================================
+       task_compare_current() - qsort() compare by task address
+   ============================================================ */
+static int task_compare_current(const void *a, const void *b)
+{
+	/* --- Variables --- */
+	const TaskCurrent *x = a;
+	const TaskCurrent *y = b;
+	
+	if (x->task != y->task) {
+		return (x->task < y->task) ? -1 : 1;
+	}
+	return x->cpu - y->cpu;
+}
+
+
+/* ============================================================
+       task_print() - Read one task_struct and Print
+         Return tasks.next and thread_group.next if requested.
+   ============================================================ */
+static int task_print(TaskWalk *walk, uint64_t task,
+                      uint64_t *tasks_next, uint64_t *thread_next)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] task_print:";
+	Layout *layout = NULL;
+	char *base = NULL;
+	char cpu[12];
+	memset(cpu, 0x00, sizeof(cpu));
+	int32_t pid = 0;
+	uint32_t state = 0;
+	uint32_t exit_state = 0;
+	char letter = '?';
+	int low = 0;
+	int high = 0;
+	int middle = 0;
+	
+	/* --- Assert check --- */
+	assert(walk != NULL);
+	
+	layout = walk->layout;
+	if (elf_read_load_data(walk->vmcore, task + walk->start,
+	                       walk->buffer, walk->size)) {
+		fprintf(stderr, "%s Can not read task: 0x%016lx\n", estr, task);
+		return RETVAL_FAILURE;
+	}
+	base = walk->buffer - walk->start;
+	memcpy(&pid, base + layout->task_pid, sizeof(pid));
+	memcpy(&state, base + layout->task_state, sizeof(state));
+	if (layout->task_exit_state != LAYOUT_NONE) {
+		memcpy(&exit_state, base + layout->task_exit_state,
+		       sizeof(exit_state));
+	}
+	else if (state == TASK_DEAD) {
+		/* Probed layout, do_task_dead() runs after exit_notify() */
+		exit_state = TASK_EXIT_ZOMBIE;
+	}
+	letter = task_state_letter(state | exit_state);
+	if (tasks_next != NULL) {
+		memcpy(tasks_next, base + layout->task_tasks, sizeof(uint64_t));
+	}
+	if ((thread_next != NULL) && (layout->task_thread_group != LAYOUT_NONE)) {
+		memcpy(thread_next, base + layout->task_thread_group,
+		       sizeof(uint64_t));
+	}
+	
+	/* Running on a CPU, lower bound of sorted currents */
+	snprintf(cpu, sizeof(cpu), "-");
+	low = 0;
+	high = walk->cpu_count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (walk->currents[middle].task < task) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	for (; (low < walk->cpu_count) && (walk->currents[low].task == task);
+	     low++) {
+		if (! walk->currents[low].seen) {
+			snprintf(cpu, sizeof(cpu), "%d", walk->currents[low].cpu);
+			walk->currents[low].seen = 1;
+			break;
+		}
+	}
+	
+	fprintf(walk->stream, "%7d %4s %2c  0x%016lx  %.*s\n", pid, cpu, letter,
+	        task, TASK_COMM_LEN, base + layout->task_comm);
+	walk->count++;
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       task_state_letter() - Same letter as ps
+   ============================================================ */
+static char task_state_letter(uint32_t state)
+{
+	/* --- Variables --- */
+	char letters[] = TASK_STATE_LETTERS;
+	int index = 0;
+	
+	if ((state & TASK_IDLE) == TASK_IDLE) {
+		return letters[sizeof(letters) - 2];
+	}
+	state &= TASK_REPORT;
+	while (state) {
+		/* fls(), highest bit */
+		index++;
+		state >>= 1;
+	}
+	return letters[index];
+}
+
+
+/* ====================================================================== */
@@ -0,0 +1,765 @@
+/* ======================================================================
+       crashdmesg - VMCore Kernel Ring Buffer Dumper
+       [ crashdmesg_watch.c ]
+       Copyright(c) 2011 by Hiroshi KIHIRA.
+   ====================================================================== */
+
+
+/* --- Include header files --- */
+#include "crashdmesg_common.h"
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <limits.h>
+
+
+/* --- Constant values --- */
+#define WATCH_QUEUED 0 /* Waiting for size to settle */
+#define WATCH_RUNNING 1 /* Child process running */
+#define WATCH_DONE 2
+#define WATCH_FAILED 3
+#define WATCH_POLL_INTERVAL 1000 /* [msec] */
+#define WATCH_EVENT_BUFFER 4096
+
+
+/* --- Data structures --- */
+
+/* One vmcore known to watch mode */
+typedef struct WatchCore {
+	char path[PATH_MAX];
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	time_t settled; /* Time size was last changed */
+	int status; /* WATCH_* */
+	pid_t pid;
+	struct WatchCore *next;
+} WatchCore;
+
+/* Watched directory, top level or crash directory */
+typedef struct WatchDir {
+	char path[PATH_MAX];
+	int wd; /* inotify watch descriptor */
+	int top; /* Configured directory */
+	struct WatchDir *next;
+} WatchDir;
+
+/* Watch mode context */
+typedef struct {
+	Option *option;
+	DumpFunction dump;
+	int inotify;
+	FILE *state;
+	WatchDir *dirs;
+	WatchCore *cores;
+	int running; /* Number of child processes */
+} Watch;
+
+
+/* --- Prototypes --- */
+static void watch_signal(int signum);
+static int watch_load_state(Watch *watch, char *state_path);
+static int watch_add_dir(Watch *watch, char *path, int top);
+static int watch_scan_top(Watch *watch, char *path);
+static void watch_rescan(Watch *watch);
+static void watch_add_core(Watch *watch, char *dir, int complete);
+static void watch_drop_dir(Watch *watch, int wd);
+static void watch_read_events(Watch *watch);
+static void watch_start(Watch *watch, time_t now);
+static void watch_reap(Watch *watch, int block);
+static int watch_dump(Watch *watch, WatchCore *core);
+static void watch_cleanup(Watch *watch);
+
+
+/* --- Variables --- */
+static volatile sig_atomic_t watch_stop = 0;
+
+
+/* ============================================================
+       watch_run() - Watch directories and Dump new vmcores
+   ============================================================ */
+int watch_run(Option *option, DumpFunction dump)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] watch_run:";
+	Watch watch;
+	memset(&watch, 0x00, sizeof(Watch));
+	char state_path[PATH_MAX];
+	memset(state_path, 0x00, sizeof(state_path));
+	struct sigaction action;
+	memset(&action, 0x00, sizeof(struct sigaction));
+	struct pollfd pfd;
+	memset(&pfd, 0x00, sizeof(struct pollfd));
+	int loop = 0;
+	
+	/* --- Assert check --- */
+	assert(option != NULL);
+	assert(dump != NULL);
+	assert(option->watch_count > 0);
+	
+	watch.option = option;
+	watch.dump = dump;
+	
+	/* Stop by SIGINT/SIGTERM, no SA_RESTART to wake poll() */
+	action.sa_handler = watch_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	
+	/* Processed vmcores */
+	if (option->watch_state) {
+		snprintf(state_path, sizeof(state_path), "%s", option->watch_state);
+	}
+	else {
+		snprintf(state_path, sizeof(state_path), "%s/%s",
+		         option->watch_dirs[0], WATCH_STATE_FILENAME);
+	}
+	if (watch_load_state(&watch, state_path)) {
+		fprintf(stderr, "%s Can not load state file.\n", estr);
+		goto ERROR_CLEANUP;
+	}
+	fprintf(stdout, "%s:   State file: %s\n", APP_NAME, state_path);
+	
+	/* Watch directories, existing vmcores are queued */
+	watch.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch.inotify == -1) {
+		fprintf(stderr, "%s inotify_init1 failed: [%d] %s\n",
+		        estr, errno, strerror(errno));
+		goto ERROR_CLEANUP;
+	}
+	for (loop = 0; loop < option->watch_count; loop++) {
+		if (watch_add_dir(&watch, option->watch_dirs[loop], 1)) {
+			fprintf(stderr, "%s Can not watch: %s\n",
+			        estr, option->watch_dirs[loop]);
+			goto ERROR_CLEANUP;
+		}
+		fprintf(stdout, "%s:   Watch: %s\n", APP_NAME, option->watch_dirs[loop]);
+	}
+	fflush(stdout);
+	
+	/* Main loop */
+	pfd.fd = watch.inotify;
+	pfd.events = POLLIN;
+	while (! watch_stop) {
+		if (poll(&pfd, 1, WATCH_POLL_INTERVAL) > 0) {
+			watch_read_events(&watch);
+		}
+		watch_reap(&watch, 0);
+		watch_start(&watch, time(NULL));
+	}
+	
+	/* Wait running dumps */
+	fprintf(stdout, "%s:  Stop watching, wait %d dumps.\n",
+	        APP_NAME, watch.running);
+	while (watch.running > 0) {
+		watch_reap(&watch, 1);
+	}
+	watch_cleanup(&watch);
+	
+	return RETVAL_SUCCESS;
+	
+	/* Error */
+ERROR_CLEANUP:
+	watch_cleanup(&watch);
+	return RETVAL_FAILURE;
+}
+
+
+/* ============================================================
+       watch_signal() - SIGINT/SIGTERM handler
+   ============================================================ */
+static void watch_signal(int signum)
+{
+	watch_stop = 1;
+	return;
+}
+
+
+/* ============================================================
+       watch_load_state() - Read state file and Open to append
+         Line: "status dev ino size mtime path"
+         vmcores removed since are not kept.
+   ============================================================ */
+static int watch_load_state(Watch *watch, char *state_path)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] watch_load_state:";
+	FILE *state = NULL;
+	char line[PATH_MAX + 128];
+	memset(line, 0x00, sizeof(line));
+	char status[8];
+	memset(status, 0x00, sizeof(status));
+	unsigned long dev = 0;
+	unsigned long ino = 0;
+	long size = 0;
+	long mtime = 0;
+	int path_start = 0;
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	WatchCore *core = NULL;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	assert(state_path != NULL);
+	
+	state = fopen(state_path, "r");
+	if (state != NULL) {
+		while (fgets(line, sizeof(line), state) != NULL) {
+			line[strcspn(line, "\n")] = 0x00;
+			if (sscanf(line, "%7s %lu %lu %ld %ld %n", status, &dev, &ino,
+			           &size, &mtime, &path_start) != 5) {
+				/* Broken line, e.g. by crash while writing */
+				continue;
+			}
+			if ((stat(line + path_start, &filestat) == -1) ||
+			    (filestat.st_dev != (dev_t) dev) ||
+			    (filestat.st_ino != (ino_t) ino)) {
+				continue;
+			}
+			core = mem_calloc(1, sizeof(WatchCore));
+			if (core == NULL) {
+				fprintf(stderr, "%s Can not allocate memory.\n", estr);
+				fclose(state);
+				return RETVAL_FAILURE;
+			}
+			snprintf(core->path, sizeof(core->path), "%s", line + path_start);
+			core->dev = (dev_t) dev;
+			core->ino = (ino_t) ino;
+			core->size = (off_t) size;
+			core->mtime = (time_t) mtime;
+			core->status = strcmp(status, "done") ? WATCH_FAILED : WATCH_DONE;
+			core->next = watch->cores;
+			watch->cores = core;
+		}
+		fclose(state);
+	}
+	else if (errno != ENOENT) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, state_path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	
+	watch->state = fopen(state_path, "a");
+	if (watch->state == NULL) {
+		fprintf(stderr, "%s Can not open: %s: [%d] %s\n",
+		        estr, state_path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       watch_add_dir() - Add inotify watch, Scan existing entries
+         Top directory: watch new crash directories.
+         Crash directory: watch vmcore written or renamed.
+   ============================================================ */
+static int watch_add_dir(Watch *watch, char *path, int top)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] watch_add_dir:";
+	WatchDir *dir = NULL;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	assert(path != NULL);
+	
+	/* Already watched */
+	for (dir = watch->dirs; dir != NULL; dir = dir->next) {
+		if (! strcmp(dir->path, path)) {
+			return RETVAL_SUCCESS;
+		}
+	}
+	
+	dir = mem_calloc(1, sizeof(WatchDir));
+	if (dir == NULL) {
+		fprintf(stderr, "%s Can not allocate memory.\n", estr);
+		return RETVAL_FAILURE;
+	}
+	snprintf(dir->path, sizeof(dir->path), "%s", path);
+	dir->top = top;
+	dir->wd = inotify_add_watch(watch->inotify, path, IN_DELETE_SELF |
+	                            IN_ONLYDIR | (top ?
+	                            (IN_CREATE | IN_MOVED_TO) :
+	                            (IN_CLOSE_WRITE | IN_MOVED_TO)));
+	if (dir->wd == -1) {
+		fprintf(stderr, "%s inotify_add_watch failed: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		mem_free(dir);
+		return RETVAL_FAILURE;
+	}
+	dir->next = watch->dirs;
+	watch->dirs = dir;
+	
+	/* Entries created before watch was added */
+	if (! top) {
+		watch_add_core(watch, path, 0);
+		return RETVAL_SUCCESS;
+	}
+	return watch_scan_top(watch, path);
+}
+
+
+/* ============================================================
+       watch_scan_top() - Add crash directories in top directory
+         Directories already watched are left as they are,
+         entries of unknown type are checked by stat().
+   ============================================================ */
+static int watch_scan_top(Watch *watch, char *path)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] watch_scan_top:";
+	DIR *dirp = NULL;
+	struct dirent *entry = NULL;
+	char subdir[PATH_MAX];
+	memset(subdir, 0x00, sizeof(subdir));
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	assert(path != NULL);
+	
+	dirp = opendir(path);
+	if (dirp == NULL) {
+		fprintf(stderr, "%s Can not open directory: %s: [%d] %s\n",
+		        estr, path, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	while ((entry = readdir(dirp)) != NULL) {
+		if ((entry->d_name[0] == '.') ||
+		    ((entry->d_type != DT_DIR) && (entry->d_type != DT_UNKNOWN))) {
+			continue;
+		}
+		if (snprintf(subdir, sizeof(subdir), "%s/%s",
+		             path, entry->d_name) >= sizeof(subdir)) {
+			continue;
+		}
+		if ((entry->d_type == DT_UNKNOWN) &&
+		    ((stat(subdir, &filestat) == -1) ||
+		     (! S_ISDIR(filestat.st_mode)))) {
+			continue;
+		}
+		watch_add_dir(watch, subdir, 0);
+	}
+	closedir(dirp);
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       watch_rescan() - Look at every directory again
+         Events were lost by queue overflow, new crash
+         directories and vmcores are found by scan instead.
+   ============================================================ */
+static void watch_rescan(Watch *watch)
+{
+	/* --- Variables --- */
+	WatchDir *dir = NULL;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	fprintf(stdout, "%s:   Event queue overflow, rescan.\n", APP_NAME);
+	fflush(stdout);
+	
+	/* New directories are prepended, already scanned when added */
+	for (dir = watch->dirs; dir != NULL; dir = dir->next) {
+		if (dir->top) {
+			watch_scan_top(watch, dir->path);
+		}
+		else {
+			watch_add_core(watch, dir->path, 0);
+		}
+	}
+	return;
+}
+
+
+/* ============================================================
+       watch_add_core() - Queue vmcore in directory if new
+         complete: vmcore was renamed, no need to settle.
+   ============================================================ */
+static void watch_add_core(Watch *watch, char *dir, int complete)
+{
+	/* --- Variables --- */
+	char path[PATH_MAX];
+	memset(path, 0x00, sizeof(path));
+	char output[PATH_MAX];
+	memset(output, 0x00, sizeof(output));
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	WatchCore *core = NULL;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	assert(dir != NULL);
+	
+	snprintf(path, sizeof(path), "%s/%s", dir, WATCH_VMCORE_NAME);
+	if ((stat(path, &filestat) == -1) || (! S_ISREG(filestat.st_mode))) {
+		return;
+	}
+	
+	/* Known vmcore: processed, queued or running */
+	for (core = watch->cores; core != NULL; core = core->next) {
+		if ((core->dev == filestat.st_dev) && (core->ino == filestat.st_ino)) {
+			if ((core->status == WATCH_QUEUED) ||
+			    (core->status == WATCH_RUNNING) ||
+			    ((core->size == filestat.st_size) &&
+			     (core->mtime == filestat.st_mtime))) {
+				return;
+			}
+		}
+	}
+	
+	/* Output exists, processed by others (e.g. kdump itself) */
+	snprintf(output, sizeof(output), "%s/%s", dir, WATCH_OUTPUT_NAME);
+	if (access(output, F_OK) == 0) {
+		return;
+	}
+	
+	core = mem_calloc(1, sizeof(WatchCore));
+	if (core == NULL) {
+		fprintf(stderr, "[ERROR] watch_add_core: Can not allocate memory.\n");
+		return;
+	}
+	snprintf(core->path, sizeof(core->path), "%s", path);
+	core->dev = filestat.st_dev;
+	core->ino = filestat.st_ino;
+	core->size = filestat.st_size;
+	core->mtime = filestat.st_mtime;
+	core->settled = complete ? 0 : time(NULL);
+	core->status = WATCH_QUEUED;
+	core->next = watch->cores;
+	watch->cores = core;
+	fprintf(stdout, "%s:   Found: %s\n", APP_NAME, path);
+	fflush(stdout);
+	return;
+}
+
+
+/* ============================================================
+       watch_drop_dir() - Forget removed directory and its vmcores
+         Running vmcores are dropped when reaped.
+   ============================================================ */
+static void watch_drop_dir(Watch *watch, int wd)
+{
+	/* --- Variables --- */
+	WatchDir **dir_link = NULL;
+	WatchDir *dir = NULL;
+	WatchCore **core_link = NULL;
+	WatchCore *core = NULL;
+	size_t length = 0;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	for (dir_link = &watch->dirs; *dir_link != NULL;
+	     dir_link = &(*dir_link)->next) {
+		if ((*dir_link)->wd == wd) {
+			break;
+		}
+	}
+	if (*dir_link == NULL) {
+		/* IN_IGNORED after IN_DELETE_SELF */
+		return;
+	}
+	dir = *dir_link;
+	*dir_link = dir->next;
+	
+	length = strlen(dir->path);
+	core_link = &watch->cores;
+	while (*core_link != NULL) {
+		core = *core_link;
+		if ((core->status != WATCH_RUNNING) &&
+		    (! strncmp(core->path, dir->path, length)) &&
+		    (core->path[length] == '/')) {
+			*core_link = core->next;
+			mem_free(core);
+			continue;
+		}
+		core_link = &core->next;
+	}
+	fprintf(stdout, "%s:   Removed: %s\n", APP_NAME, dir->path);
+	fflush(stdout);
+	mem_free(dir);
+	return;
+}
+
+
+/* ============================================================
+       watch_read_events() - Handle inotify events
+   ============================================================ */
+static void watch_read_events(Watch *watch)
+{
+	/* --- Variables --- */
+	char buffer[WATCH_EVENT_BUFFER]
+	    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *event = NULL;
+	ssize_t length = 0;
+	char *cursor = NULL;
+	WatchDir *dir = NULL;
+	char path[PATH_MAX];
+	memset(path, 0x00, sizeof(path));
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	while ((length = read(watch->inotify, buffer, sizeof(buffer))) > 0) {
+		for (cursor = buffer; cursor < buffer + length;
+		     cursor += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event*) cursor;
+			if (event->mask & IN_Q_OVERFLOW) {
+				watch_rescan(watch);
+				continue;
+			}
+			if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+				watch_drop_dir(watch, event->wd);
+				continue;
+			}
+			if (event->len == 0) {
+				continue;
+			}
+			for (dir = watch->dirs; dir != NULL; dir = dir->next) {
+				if (dir->wd == event->wd) {
+					break;
+				}
+			}
+			if (dir == NULL) {
+				continue;
+			}
+			if (dir->top && (event->mask & IN_ISDIR)) {
+				/* New crash directory */
+				if (snprintf(path, sizeof(path), "%s/%s",
+				             dir->path, event->name) < sizeof(path)) {
+					watch_add_dir(watch, path, 0);
+				}
+			}
+			else if ((! dir->top) &&
+			         (! strcmp(event->name, WATCH_VMCORE_NAME))) {
+				/* "vmcore-incomplete" is renamed to "vmcore" when done */
+				watch_add_core(watch, dir->path,
+				               (event->mask & IN_MOVED_TO) ? 1 : 0);
+			}
+		}
+	}
+	return;
+}
+
+
+/* ============================================================
+       watch_start() - Start dump of settled vmcores
+   ============================================================ */
+static void watch_start(Watch *watch, time_t now)
+{
+	/* --- Variables --- */
+	WatchCore *core = NULL;
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	pid_t pid = 0;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	for (core = watch->cores; core != NULL; core = core->next) {
+		if (core->status != WATCH_QUEUED) {
+			continue;
+		}
+	
+		/* Size and mtime must be unchanged for WATCH_SETTLE_TIME */
+		if (stat(core->path, &filestat) == -1) {
+			/* Removed before dump */
+			core->status = WATCH_FAILED;
+			continue;
+		}
+		if ((filestat.st_size != core->size) ||
+		    (filestat.st_mtime != core->mtime)) {
+			core->size = filestat.st_size;
+			core->mtime = filestat.st_mtime;
+			core->settled = now;
+			continue;
+		}
+		if ((now - core->settled < WATCH_SETTLE_TIME) ||
+		    (watch->running >= watch->option->watch_workers)) {
+			continue;
+		}
+	
+		/* Dump by child process, keeps daemon safe from broken vmcore */
+		fflush(stdout);
+		fflush(stderr);
+		pid = fork();
+		if (pid == -1) {
+			fprintf(stderr, "[ERROR] watch_start: fork failed: [%d] %s\n",
+			        errno, strerror(errno));
+			return;
+		}
+		if (pid == 0) {
+			/* Handlers of daemon would leave child running */
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			_exit(watch_dump(watch, core));
+		}
+		core->pid = pid;
+		core->status = WATCH_RUNNING;
+		watch->running++;
+		fprintf(stdout, "%s:   Dump: %s (pid %d)\n",
+		        APP_NAME, core->path, (int) pid);
+		fflush(stdout);
+	}
+	return;
+}
+
+
+/* ============================================================
+       watch_dump() - Child process, Write output next to vmcore
+         Records go to temporary file through Sink, status lines
+         stay on stdout of daemon.
+   ============================================================ */
+static int watch_dump(Watch *watch, WatchCore *core)
+{
+	/* --- Variables --- */
+	char estr[] = "[ERROR] watch_dump:";
+	char output[PATH_MAX];
+	memset(output, 0x00, sizeof(output));
+	char temporary[PATH_MAX];
+	memset(temporary, 0x00, sizeof(temporary));
+	char *slash = NULL;
+	size_t room = 0;
+	int result = RETVAL_FAILURE;
+	Option option;
+	memset(&option, 0x00, sizeof(Option));
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	assert(core != NULL);
+	
+	close(watch->inotify);
+	
+	/* Output is renamed when complete */
+	snprintf(output, sizeof(output), "%s", core->path);
+	slash = strrchr(output, '/') + 1;
+	room = sizeof(output) - (slash - output);
+	if ((snprintf(slash, room, "%s", WATCH_OUTPUT_NAME) >= room) ||
+	    (snprintf(temporary, sizeof(temporary), "%s.tmp", output) >=
+	     sizeof(temporary))) {
+		fprintf(stderr, "%s Path is too long: %s\n", estr, core->path);
+		return RETVAL_FAILURE;
+	}
+	
+	/* Single vmcore, not split, synced when sink is closed */
+	memcpy(&option, watch->option, sizeof(Option));
+	option.split_count = 0;
+	option.watch_count = 0;
+	option.output_file = temporary;
+	result = watch->dump(&option, core->path);
+	fflush(stdout);
+	
+	if (result) {
+		unlink(temporary);
+		return RETVAL_FAILURE;
+	}
+	if (rename(temporary, output) == -1) {
+		fprintf(stderr, "%s Can not rename: %s: [%d] %s\n",
+		        estr, temporary, errno, strerror(errno));
+		return RETVAL_FAILURE;
+	}
+	
+	return RETVAL_SUCCESS;
+}
+
+
+/* ============================================================
+       watch_reap() - Wait child processes and Record result
+   ============================================================ */
+static void watch_reap(Watch *watch, int block)
+{
+	/* --- Variables --- */
+	WatchCore **core_link = NULL;
+	WatchCore *core = NULL;
+	struct stat filestat;
+	memset(&filestat, 0x00, sizeof(struct stat));
+	pid_t pid = 0;
+	int status = 0;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	while ((pid = waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+		for (core_link = &watch->cores; *core_link != NULL;
+		     core_link = &(*core_link)->next) {
+			if (((*core_link)->status == WATCH_RUNNING) &&
+			    ((*core_link)->pid == pid)) {
+				break;
+			}
+		}
+		if (*core_link == NULL) {
+			continue;
+		}
+		core = *core_link;
+		watch->running--;
+		core->status = (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ?
+		               WATCH_DONE : WATCH_FAILED;
+		fprintf(watch->state, "%s %lu %lu %ld %ld %s\n",
+		        (core->status == WATCH_DONE) ? "done" : "failed",
+		        (unsigned long) core->dev, (unsigned long) core->ino,
+		        (long) core->size, (long) core->mtime, core->path);
+		fflush(watch->state);
+		fsync(fileno(watch->state));
+		fprintf(stdout, "%s:   %s: %s\n", APP_NAME,
+		        (core->status == WATCH_DONE) ? "Done" : "Failed", core->path);
+		fflush(stdout);
+		if (stat(core->path, &filestat) == -1) {
+			/* Directory was removed while running */
+			*core_link = core->next;
+			mem_free(core);
+		}
+		if (block) {
+			/* One at a time, caller checks running */
+			break;
+		}
+	}
+	if ((pid == -1) && (errno == ECHILD)) {
+		watch->running = 0;
+	}
+	return;
+}
+
+
+/* ============================================================
+       watch_cleanup() - Free everything
+   ============================================================ */
+static void watch_cleanup(Watch *watch)
+{
+	/* --- Variables --- */
+	WatchDir *dir = NULL;
+	WatchCore *core = NULL;
+	
+	/* --- Assert check --- */
+	assert(watch != NULL);
+	
+	while (watch->dirs != NULL) {
+		dir = watch->dirs;
+		watch->dirs = dir->next;
+		mem_free(dir);
+	}
+	while (watch->cores != NULL) {
+		core = watch->cores;
+		watch->cores = core->next;
+		mem_free(core);
+	}
+	if (watch->inotify > 0) {
+		close(watch->inotify);
+	}
+	if (watch->state != NULL) {
+		fclose(watch->state);
+	}
+	return;
+}
+
+
+/* ====================================================================== */